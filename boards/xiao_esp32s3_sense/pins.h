@@ -25,8 +25,8 @@
 #define XIAO_D6                     43
 #define XIAO_D7                     44
 #define XIAO_D8                     7     // SPI SCK
-#define XIAO_D9                     8     // SPI MOSI
-#define XIAO_D10                    9     // SPI MISO
+#define XIAO_D9                     8     // SPI MISO
+#define XIAO_D10                    9     // SPI MOSI
 
 // ============================================================================
 // Analog Pins (A0-A2)
@@ -46,10 +46,18 @@
 // ============================================================================
 // SPI Default
 // ============================================================================
-#define XIAO_SPI_MISO               9
-#define XIAO_SPI_MOSI               8
+#define XIAO_SPI_MISO               8
+#define XIAO_SPI_MOSI               9
 #define XIAO_SPI_SCK                7
 
+// ============================================================================
+// microSD (Sense expansion board, on the SPI pins)
+// ============================================================================
+#define XIAO_SD_PIN_CS              21    // Shared with the LED
+#define XIAO_SD_PIN_SCK             XIAO_SPI_SCK
+#define XIAO_SD_PIN_MISO            XIAO_SPI_MISO
+#define XIAO_SD_PIN_MOSI            XIAO_SPI_MOSI
+
 // ============================================================================
 // Camera OV2640
 // ============================================================================
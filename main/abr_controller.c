@@ -0,0 +1,120 @@
+/*
+ * Adaptive bitrate controller
+ */
+
+#include <string.h>
+
+#include "abr_controller.h"
+
+// Headroom thresholds in percent of the bitrate needed at the target fps
+#define ABR_DOWN_PCT    90
+#define ABR_UP_PCT      150
+
+void abr_init(abr_t *abr, const abr_config_t *cfg, int quality, int rung)
+{
+    memset(abr, 0, sizeof(*abr));
+    abr->cfg = *cfg;
+    abr->quality = quality;
+    abr->rung = rung;
+}
+
+void abr_on_frame(abr_t *abr, size_t bytes)
+{
+    abr->frame_bytes += bytes;
+    abr->frames++;
+}
+
+void abr_on_send(abr_t *abr, uint64_t bytes, uint64_t send_us, uint32_t sends)
+{
+    abr->sent_bytes += bytes;
+    abr->send_us += send_us;
+    abr->sends += sends;
+}
+
+static void abr_reset_window(abr_t *abr)
+{
+    abr->frame_bytes = 0;
+    abr->frames = 0;
+    abr->sent_bytes = 0;
+    abr->send_us = 0;
+    abr->sends = 0;
+}
+
+static bool abr_step_down(abr_t *abr)
+{
+    const abr_config_t *c = &abr->cfg;
+
+    if (abr->quality < c->quality_worst) {
+        abr->quality += c->quality_step;
+        if (abr->quality > c->quality_worst) {
+            abr->quality = c->quality_worst;
+        }
+        return true;
+    }
+    if (abr->rung > 0) {
+        // A smaller frame roughly halves the bytes; start it at better quality
+        abr->rung--;
+        abr->quality = (c->quality_best + c->quality_worst) / 2;
+        return true;
+    }
+    return false;
+}
+
+static bool abr_step_up(abr_t *abr)
+{
+    const abr_config_t *c = &abr->cfg;
+
+    if (abr->quality > c->quality_best) {
+        abr->quality -= c->quality_step;
+        if (abr->quality < c->quality_best) {
+            abr->quality = c->quality_best;
+        }
+        return true;
+    }
+    if (abr->rung < c->rungs - 1) {
+        // A larger frame roughly doubles the bytes; start it conservatively
+        abr->rung++;
+        abr->quality = c->quality_worst;
+        return true;
+    }
+    return false;
+}
+
+bool abr_update(abr_t *abr)
+{
+    bool changed = false;
+
+    // Nothing to judge without both sides of the measurement
+    if (abr->frames == 0 || abr->sends == 0 || abr->send_us == 0) {
+        abr_reset_window(abr);
+        return false;
+    }
+    if (abr->cooldown > 0) {
+        abr->cooldown--;
+        abr_reset_window(abr);
+        return false;
+    }
+
+    uint64_t avg_frame = abr->frame_bytes / abr->frames;
+    uint64_t need_bps = avg_frame * abr->cfg.target_fps;
+    uint64_t have_bps = abr->sent_bytes * 1000000 / abr->send_us;
+    uint64_t latency_us = abr->send_us / abr->sends;
+
+    if (have_bps * 100 < need_bps * ABR_DOWN_PCT || latency_us > abr->cfg.target_latency_us) {
+        abr->good_windows = 0;
+        changed = abr_step_down(abr);
+    } else if (have_bps * 100 > need_bps * ABR_UP_PCT && latency_us * 2 < abr->cfg.target_latency_us) {
+        if (++abr->good_windows >= abr->cfg.up_windows) {
+            abr->good_windows = 0;
+            changed = abr_step_up(abr);
+        }
+    } else {
+        abr->good_windows = 0;
+    }
+
+    if (changed) {
+        abr->cooldown = abr->cfg.cooldown_windows;
+    }
+    abr_reset_window(abr);
+    return changed;
+}
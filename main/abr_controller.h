@@ -0,0 +1,59 @@
+/*
+ * Adaptive bitrate controller
+ *
+ * Closed-loop control of JPEG quality and frame size from measured frame
+ * sizes and send throughput. Each control window compares the bitrate the
+ * current settings need at the target fps with what the link delivered:
+ * too little headroom (or sends slower than the latency target) steps the
+ * quality number up and, once quality is exhausted, the frame size down one
+ * rung; sustained headroom walks back the other way. A cooldown after every
+ * change plus separate up/down thresholds keep it from oscillating.
+ *
+ * Frame sizes are rung indexes into a caller-defined ladder, lowest first.
+ * Pure C, no ESP-IDF dependencies, so it can be driven from recorded traces.
+ */
+
+#ifndef ABR_CONTROLLER_H
+#define ABR_CONTROLLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t target_fps;
+    uint32_t target_latency_us;     // Upper bound on average per-frame send time
+    int quality_best;               // Lowest jpeg_quality number allowed
+    int quality_worst;              // Highest jpeg_quality number allowed
+    int quality_step;
+    int rungs;                      // Frame size ladder length
+    int up_windows;                 // Good windows needed before stepping up
+    int cooldown_windows;           // Windows ignored after a change
+} abr_config_t;
+
+typedef struct {
+    abr_config_t cfg;
+    int quality;
+    int rung;
+    uint64_t frame_bytes;           // Frames captured this window
+    uint32_t frames;
+    uint64_t sent_bytes;            // Bytes delivered this window
+    uint64_t send_us;               // Time spent delivering them
+    uint32_t sends;
+    int good_windows;
+    int cooldown;
+} abr_t;
+
+void abr_init(abr_t *abr, const abr_config_t *cfg, int quality, int rung);
+
+// A frame of bytes was produced with the current settings.
+void abr_on_frame(abr_t *abr, size_t bytes);
+
+// A client finished sending bytes taking send_us. May be an aggregate of
+// several frames (sends counts them).
+void abr_on_send(abr_t *abr, uint64_t bytes, uint64_t send_us, uint32_t sends);
+
+// Close the current window. Returns true when quality or rung changed.
+bool abr_update(abr_t *abr);
+
+#endif // ABR_CONTROLLER_H
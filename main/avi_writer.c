@@ -0,0 +1,703 @@
+/*
+ * MJPEG AVI writer - double-buffered batch writes, incremental index
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "avi_writer.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+// Everything up to and including the 'movi' fourcc: exactly one sector,
+// so frame data starts sector-aligned and a header patch is a whole-sector
+// write.
+#define AVI_HEADER_SIZE     512
+#define MOVI_LIST_OFF       500
+#define MOVI_FOURCC_OFF     508     // idx1 offsets count from here
+#define CHUNK_HDR           8
+#define IDX_ENTRY           16
+#define AVIF_HASINDEX       0x10
+#define AVIIF_KEYFRAME      0x10
+
+// Header fields rewritten at checkpoints
+#define OFF_RIFF_SIZE       4
+#define OFF_US_PER_FRAME    32
+#define OFF_MAX_BPS         36
+#define OFF_FLAGS           44
+#define OFF_TOTAL_FRAMES    48
+#define OFF_SUGGESTED       60
+#define OFF_STRH_SCALE      128
+#define OFF_STRH_LENGTH     140
+#define OFF_STRH_SUGGESTED  144
+#define OFF_MOVI_SIZE       (MOVI_LIST_OFF + 4)
+
+#define AVI_PATH_MAX        128
+#define PENDING_MIN         256
+#define RECOVER_SCRATCH     4096
+
+// A queued frame that is not in the sidecar index yet
+typedef struct {
+    uint32_t offset;                // Chunk header, relative to 'movi'
+    uint32_t len;
+} pending_t;
+
+struct avi_writer {
+    avi_writer_config_t cfg;
+    int fd;
+    int idx_fd;
+    char idx_path[AVI_PATH_MAX];
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // The caller fills buf[cur]; buffers marked full belong to the writer
+    // thread until written. fill[cur] is only touched by the caller.
+    uint8_t *buf[2];
+    size_t fill[2];
+    bool full[2];
+    int cur;
+
+    // Under lock
+    bool closing;
+    bool failed;
+    uint64_t queued;                // File size once every buffer is out
+    uint64_t written;
+    pending_t *pending;
+    size_t npending;
+    size_t pending_cap;
+    uint32_t frames;
+    uint32_t max_frame;
+    int64_t first_ts;
+    int64_t last_ts;
+    avi_writer_stats_t stats;
+
+    // Writer thread only
+    int next_write;                 // Buffer next in file order
+    uint8_t header[AVI_HEADER_SIZE];
+    uint8_t *idx_out;
+    size_t idx_out_cap;
+    uint32_t indexed;               // Entries in the sidecar
+    uint64_t indexed_end;           // Just past the last indexed chunk
+    int64_t checkpoint_at;
+};
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint8_t *emit_u32(uint8_t *p, uint32_t v)
+{
+    put_u32(p, v);
+    return p + 4;
+}
+
+static inline uint8_t *emit_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static inline uint8_t *emit_cc(uint8_t *p, const char *cc)
+{
+    memcpy(p, cc, 4);
+    return p + 4;
+}
+
+// Chunks are word-aligned
+static inline uint32_t chunk_size(uint32_t len)
+{
+    return CHUNK_HDR + len + (len & 1);
+}
+
+static inline int64_t now_us(const avi_writer_t *w)
+{
+    return w->cfg.clock_us ? w->cfg.clock_us() : 0;
+}
+
+static void build_header(uint8_t *h, int width, int height, uint32_t us_per_frame)
+{
+    uint8_t *p = h;
+    memset(h, 0, AVI_HEADER_SIZE);
+
+    p = emit_cc(p, "RIFF");
+    p = emit_u32(p, AVI_HEADER_SIZE - 8);
+    p = emit_cc(p, "AVI ");
+    p = emit_cc(p, "LIST");
+    p = emit_u32(p, 192);
+    p = emit_cc(p, "hdrl");
+
+    p = emit_cc(p, "avih");
+    p = emit_u32(p, 56);
+    p = emit_u32(p, us_per_frame);
+    p = emit_u32(p, 0);             // dwMaxBytesPerSec
+    p = emit_u32(p, 0);             // dwPaddingGranularity
+    p = emit_u32(p, 0);             // dwFlags
+    p = emit_u32(p, 0);             // dwTotalFrames
+    p = emit_u32(p, 0);             // dwInitialFrames
+    p = emit_u32(p, 1);             // dwStreams
+    p = emit_u32(p, 0);             // dwSuggestedBufferSize
+    p = emit_u32(p, width);
+    p = emit_u32(p, height);
+    p += 16;                        // dwReserved
+
+    p = emit_cc(p, "LIST");
+    p = emit_u32(p, 116);
+    p = emit_cc(p, "strl");
+    p = emit_cc(p, "strh");
+    p = emit_u32(p, 56);
+    p = emit_cc(p, "vids");
+    p = emit_cc(p, "MJPG");
+    p = emit_u32(p, 0);             // dwFlags
+    p = emit_u32(p, 0);             // wPriority, wLanguage
+    p = emit_u32(p, 0);             // dwInitialFrames
+    p = emit_u32(p, us_per_frame);  // dwScale
+    p = emit_u32(p, 1000000);       // dwRate: frame rate is rate / scale
+    p = emit_u32(p, 0);             // dwStart
+    p = emit_u32(p, 0);             // dwLength
+    p = emit_u32(p, 0);             // dwSuggestedBufferSize
+    p = emit_u32(p, UINT32_MAX);    // dwQuality: driver default
+    p = emit_u32(p, 0);             // dwSampleSize
+    p = emit_u16(p, 0);             // rcFrame
+    p = emit_u16(p, 0);
+    p = emit_u16(p, width);
+    p = emit_u16(p, height);
+
+    p = emit_cc(p, "strf");         // BITMAPINFOHEADER
+    p = emit_u32(p, 40);
+    p = emit_u32(p, 40);
+    p = emit_u32(p, width);
+    p = emit_u32(p, height);
+    p = emit_u16(p, 1);             // biPlanes
+    p = emit_u16(p, 24);            // biBitCount
+    p = emit_cc(p, "MJPG");
+    p = emit_u32(p, width * height * 3);
+    p += 16;                        // Resolution and palette, unused
+
+    // Pad so that the movi list ends the header
+    p = emit_cc(p, "JUNK");
+    p = emit_u32(p, MOVI_LIST_OFF - (p - h) - 4);
+    p = h + MOVI_LIST_OFF;
+    p = emit_cc(p, "LIST");
+    p = emit_u32(p, 4);
+    emit_cc(p, "movi");
+}
+
+static bool header_valid(const uint8_t *h)
+{
+    return !memcmp(h, "RIFF", 4) && !memcmp(h + 8, "AVI ", 4) &&
+           !memcmp(h + MOVI_LIST_OFF, "LIST", 4) && !memcmp(h + MOVI_FOURCC_OFF, "movi", 4);
+}
+
+// Describe frames up to movi_end, with idx1 after them or not
+static void patch_header(uint8_t *h, uint32_t frames, uint64_t movi_end, bool has_index)
+{
+    uint64_t end = movi_end + (has_index ? CHUNK_HDR + (uint64_t)frames * IDX_ENTRY : 0);
+    put_u32(h + OFF_RIFF_SIZE, end - 8);
+    put_u32(h + OFF_MOVI_SIZE, movi_end - MOVI_FOURCC_OFF);
+    put_u32(h + OFF_FLAGS, has_index ? AVIF_HASINDEX : 0);
+    put_u32(h + OFF_TOTAL_FRAMES, frames);
+    put_u32(h + OFF_STRH_LENGTH, frames);
+}
+
+static void patch_rate(uint8_t *h, uint32_t us_per_frame, uint32_t max_frame)
+{
+    put_u32(h + OFF_US_PER_FRAME, us_per_frame);
+    put_u32(h + OFF_STRH_SCALE, us_per_frame);
+    put_u32(h + OFF_MAX_BPS, (uint64_t)max_frame * 1000000 / us_per_frame);
+    put_u32(h + OFF_SUGGESTED, chunk_size(max_frame));
+    put_u32(h + OFF_STRH_SUGGESTED, max_frame);
+}
+
+static void put_entry(uint8_t *e, uint32_t offset, uint32_t len)
+{
+    memcpy(e, "00dc", 4);
+    put_u32(e + 4, AVIIF_KEYFRAME);
+    put_u32(e + 8, offset);
+    put_u32(e + 12, len);
+}
+
+static bool write_all(int fd, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool pwrite_all(int fd, const void *data, size_t len, off_t off)
+{
+    const uint8_t *p = data;
+    while (len) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool pread_all(int fd, void *data, size_t len, off_t off)
+{
+    uint8_t *p = data;
+    while (len) {
+        ssize_t n = pread(fd, p, len, off);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Trim the file to movi_end, append idx1 copied from the sidecar and
+// write the final header. scratch_cap must be a multiple of IDX_ENTRY.
+static bool finalize(int fd, int idx_fd, uint8_t *h, uint64_t movi_end, uint32_t frames,
+                     uint8_t *scratch, size_t scratch_cap)
+{
+    uint64_t idx_bytes = (uint64_t)frames * IDX_ENTRY;
+    uint8_t chunk[CHUNK_HDR];
+    memcpy(chunk, "idx1", 4);
+    put_u32(chunk + 4, idx_bytes);
+
+    if (ftruncate(fd, movi_end) != 0 || lseek(fd, movi_end, SEEK_SET) < 0 ||
+        !write_all(fd, chunk, CHUNK_HDR)) {
+        return false;
+    }
+    for (uint64_t done = 0; done < idx_bytes; ) {
+        size_t n = idx_bytes - done < scratch_cap ? idx_bytes - done : scratch_cap;
+        if (!pread_all(idx_fd, scratch, n, done) || !write_all(fd, scratch, n)) {
+            return false;
+        }
+        done += n;
+    }
+
+    patch_header(h, frames, movi_end, true);
+    return pwrite_all(fd, h, AVI_HEADER_SIZE, 0) && fsync(fd) == 0;
+}
+
+// Move the entries of frames that are in the file into the sidecar, then
+// patch the header to cover them. Data is synced before the header claims
+// it, so after a power cut the header never describes missing frames.
+static bool checkpoint(avi_writer_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    size_t k = 0;
+    while (k < w->npending &&
+           MOVI_FOURCC_OFF + w->pending[k].offset + chunk_size(w->pending[k].len) <= w->written) {
+        k++;
+    }
+    if (k * IDX_ENTRY > w->idx_out_cap) {
+        uint8_t *p = realloc(w->idx_out, k * IDX_ENTRY);
+        if (!p) {
+            pthread_mutex_unlock(&w->lock);
+            return false;
+        }
+        w->idx_out = p;
+        w->idx_out_cap = k * IDX_ENTRY;
+    }
+    for (size_t i = 0; i < k; i++) {
+        put_entry(w->idx_out + i * IDX_ENTRY, w->pending[i].offset, w->pending[i].len);
+    }
+    if (k) {
+        const pending_t *last = &w->pending[k - 1];
+        w->indexed_end = MOVI_FOURCC_OFF + last->offset + chunk_size(last->len);
+        w->npending -= k;
+        memmove(w->pending, w->pending + k, w->npending * sizeof(pending_t));
+    }
+    uint32_t us_per_frame = w->frames > 1 ?
+                            (uint32_t)((w->last_ts - w->first_ts) / (w->frames - 1)) : 0;
+    uint32_t max_frame = w->max_frame;
+    pthread_mutex_unlock(&w->lock);
+
+    if (!us_per_frame) {
+        us_per_frame = 1000000 / (w->cfg.fps > 0 ? w->cfg.fps : 1);
+    }
+    w->indexed += k;
+    patch_rate(w->header, us_per_frame, max_frame);
+    patch_header(w->header, w->indexed, w->indexed_end, false);
+
+    w->checkpoint_at = now_us(w);
+    return write_all(w->idx_fd, w->idx_out, k * IDX_ENTRY) && fsync(w->idx_fd) == 0 &&
+           fsync(w->fd) == 0 && pwrite_all(w->fd, w->header, AVI_HEADER_SIZE, 0) && fsync(w->fd) == 0;
+}
+
+static void *writer_thread(void *arg)
+{
+    avi_writer_t *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    while (true) {
+        int i = w->next_write;
+        while (!w->full[i] && !w->closing) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (!w->full[i]) {
+            break;
+        }
+        size_t len = w->fill[i];
+        bool failed = w->failed;
+        pthread_mutex_unlock(&w->lock);
+
+        int64_t t0 = now_us(w);
+        bool ok = failed || write_all(w->fd, w->buf[i], len);
+        uint32_t us = now_us(w) - t0;
+
+        pthread_mutex_lock(&w->lock);
+        w->full[i] = false;
+        w->fill[i] = 0;
+        w->next_write = !i;
+        if (!ok) {
+            w->failed = true;
+        } else if (!failed) {
+            w->written += len;
+            w->stats.batches++;
+            w->stats.bytes += len;
+            w->stats.write_us += us;
+            if (us > w->stats.max_write_us) {
+                w->stats.max_write_us = us;
+            }
+        }
+
+        bool due = !w->cfg.clock_us || now_us(w) - w->checkpoint_at >= w->cfg.checkpoint_us;
+        if (due && !w->failed && !w->closing) {
+            pthread_mutex_unlock(&w->lock);
+            ok = checkpoint(w);
+            pthread_mutex_lock(&w->lock);
+            if (!ok) {
+                w->failed = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static void *batch_alloc(size_t size)
+{
+#ifdef ESP_PLATFORM
+    // Far too big for internal RAM
+    return heap_caps_aligned_alloc(64, size, MALLOC_CAP_SPIRAM);
+#else
+    return aligned_alloc(64, size);
+#endif
+}
+
+static void writer_free(avi_writer_t *w)
+{
+    free(w->buf[0]);
+    free(w->buf[1]);
+    free(w->pending);
+    free(w->idx_out);
+    free(w);
+}
+
+avi_writer_t *avi_writer_open(const char *path, const avi_writer_config_t *cfg)
+{
+    if (!cfg->batch_size || cfg->batch_size % 512 || cfg->width <= 0 || cfg->height <= 0) {
+        return NULL;
+    }
+    avi_writer_t *w = calloc(1, sizeof(*w));
+    if (!w) {
+        return NULL;
+    }
+    w->cfg = *cfg;
+    w->fd = w->idx_fd = -1;
+    w->buf[0] = batch_alloc(cfg->batch_size);
+    w->buf[1] = batch_alloc(cfg->batch_size);
+    if (!w->buf[0] || !w->buf[1] || !avi_writer_index_path(path, w->idx_path, sizeof(w->idx_path))) {
+        writer_free(w);
+        return NULL;
+    }
+
+    w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    w->idx_fd = open(w->idx_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0 || w->idx_fd < 0) {
+        goto fail;
+    }
+
+    // The header goes out with the first batch and is patched in place
+    build_header(w->header, cfg->width, cfg->height, 1000000 / (cfg->fps > 0 ? cfg->fps : 1));
+    memcpy(w->buf[0], w->header, AVI_HEADER_SIZE);
+    w->fill[0] = AVI_HEADER_SIZE;
+    w->queued = AVI_HEADER_SIZE;
+    w->indexed_end = AVI_HEADER_SIZE;
+    w->checkpoint_at = now_us(w);
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        goto fail;
+    }
+    return w;
+
+fail:
+    if (w->fd >= 0) {
+        close(w->fd);
+        unlink(path);
+    }
+    if (w->idx_fd >= 0) {
+        close(w->idx_fd);
+        unlink(w->idx_path);
+    }
+    writer_free(w);
+    return NULL;
+}
+
+// Copy into the current buffer, handing it to the writer thread whenever
+// it fills up. The caller has checked that there is room.
+static void append(avi_writer_t *w, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len) {
+        size_t n = w->cfg.batch_size - w->fill[w->cur];
+        if (n > len) {
+            n = len;
+        }
+        memcpy(w->buf[w->cur] + w->fill[w->cur], p, n);
+        w->fill[w->cur] += n;
+        p += n;
+        len -= n;
+
+        if (w->fill[w->cur] == w->cfg.batch_size) {
+            pthread_mutex_lock(&w->lock);
+            w->full[w->cur] = true;
+            w->cur = !w->cur;
+            pthread_cond_signal(&w->cond);
+            pthread_mutex_unlock(&w->lock);
+        }
+    }
+}
+
+bool avi_writer_add(avi_writer_t *w, const void *jpeg, size_t len, int64_t timestamp_us)
+{
+    int64_t t0 = now_us(w);
+    uint64_t need = chunk_size(len);
+
+    pthread_mutex_lock(&w->lock);
+    uint64_t room = 0;
+    if (!w->full[w->cur]) {
+        room = w->cfg.batch_size - w->fill[w->cur];
+        if (!w->full[!w->cur]) {
+            room += w->cfg.batch_size;
+        }
+    }
+    uint64_t final_size = w->queued + need + CHUNK_HDR + (uint64_t)(w->frames + 1) * IDX_ENTRY;
+    bool ok = !w->failed && need <= w->cfg.batch_size && need <= room &&
+              final_size <= AVI_WRITER_MAX_BYTES;
+
+    if (ok && w->npending == w->pending_cap) {
+        size_t cap = w->pending_cap ? w->pending_cap * 2 : PENDING_MIN;
+        pending_t *p = realloc(w->pending, cap * sizeof(pending_t));
+        if (p) {
+            w->pending = p;
+            w->pending_cap = cap;
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        w->stats.dropped++;
+        pthread_mutex_unlock(&w->lock);
+        return false;
+    }
+
+    w->pending[w->npending++] = (pending_t){
+        .offset = w->queued - MOVI_FOURCC_OFF,
+        .len = len,
+    };
+    w->queued += need;
+    if (!w->frames) {
+        w->first_ts = timestamp_us;
+    }
+    w->last_ts = timestamp_us;
+    w->frames++;
+    if (len > w->max_frame) {
+        w->max_frame = len;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    uint8_t hdr[CHUNK_HDR];
+    memcpy(hdr, "00dc", 4);
+    put_u32(hdr + 4, len);
+    append(w, hdr, CHUNK_HDR);
+    append(w, jpeg, len);
+    if (len & 1) {
+        append(w, "", 1);
+    }
+
+    uint32_t us = now_us(w) - t0;
+    pthread_mutex_lock(&w->lock);
+    w->stats.frames++;
+    if (us > w->stats.max_add_us) {
+        w->stats.max_add_us = us;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+uint64_t avi_writer_bytes(avi_writer_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    uint64_t bytes = w->queued;
+    pthread_mutex_unlock(&w->lock);
+    return bytes;
+}
+
+bool avi_writer_failed(avi_writer_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    bool failed = w->failed;
+    pthread_mutex_unlock(&w->lock);
+    return failed;
+}
+
+void avi_writer_take_stats(avi_writer_t *w, avi_writer_stats_t *stats)
+{
+    pthread_mutex_lock(&w->lock);
+    *stats = w->stats;
+    memset(&w->stats, 0, sizeof(w->stats));
+    pthread_mutex_unlock(&w->lock);
+}
+
+bool avi_writer_close(avi_writer_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    if (w->fill[w->cur]) {
+        w->full[w->cur] = true;     // Short final batch
+    }
+    w->closing = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    bool ok = !w->failed && checkpoint(w) &&
+              finalize(w->fd, w->idx_fd, w->header, w->indexed_end, w->indexed,
+                       w->buf[0], w->cfg.batch_size);
+    ok = close(w->fd) == 0 && ok;
+    close(w->idx_fd);
+    if (ok) {
+        unlink(w->idx_path);
+    }
+
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    writer_free(w);
+    return ok;
+}
+
+bool avi_writer_recover(const char *path)
+{
+    char idx_path[AVI_PATH_MAX];
+    uint8_t h[AVI_HEADER_SIZE];
+    struct stat st, ist;
+
+    if (!avi_writer_index_path(path, idx_path, sizeof(idx_path))) {
+        return false;
+    }
+    int fd = open(path, O_RDWR);
+    int idx_fd = fd >= 0 ? open(idx_path, O_RDWR | O_CREAT, 0644) : -1;
+    uint8_t *scratch = malloc(RECOVER_SCRATCH);
+    bool ok = fd >= 0 && idx_fd >= 0 && scratch &&
+              fstat(fd, &st) == 0 && fstat(idx_fd, &ist) == 0 &&
+              pread_all(fd, h, AVI_HEADER_SIZE, 0) && header_valid(h);
+    uint64_t size = ok ? (uint64_t)st.st_size : 0;
+    uint64_t movi_end = AVI_HEADER_SIZE;
+    uint32_t frames = ok ? ist.st_size / IDX_ENTRY : 0;
+
+    // Trust the sidecar up to the last frame that is fully in the file
+    while (ok && frames) {
+        uint8_t e[IDX_ENTRY];
+        ok = pread_all(idx_fd, e, IDX_ENTRY, (off_t)(frames - 1) * IDX_ENTRY);
+        uint64_t end = MOVI_FOURCC_OFF + (uint64_t)get_u32(e + 8) + chunk_size(get_u32(e + 12));
+        if (ok && end <= size) {
+            movi_end = end;
+            break;
+        }
+        frames--;
+    }
+    ok = ok && ftruncate(idx_fd, (off_t)frames * IDX_ENTRY) == 0 &&
+         lseek(idx_fd, 0, SEEK_END) >= 0;
+
+    // Frames that reached the file after the last checkpoint
+    size_t batched = 0;
+    while (ok && movi_end + CHUNK_HDR <= size) {
+        uint8_t c[CHUNK_HDR];
+        if (!pread_all(fd, c, CHUNK_HDR, movi_end) || memcmp(c, "00dc", 4)) {
+            break;
+        }
+        uint32_t len = get_u32(c + 4);
+        uint64_t end = movi_end + chunk_size(len);
+        if (end > size) {
+            break;
+        }
+        put_entry(scratch + batched, movi_end - MOVI_FOURCC_OFF, len);
+        batched += IDX_ENTRY;
+        frames++;
+        movi_end = end;
+        if (batched == RECOVER_SCRATCH) {
+            ok = write_all(idx_fd, scratch, batched);
+            batched = 0;
+        }
+    }
+    ok = ok && write_all(idx_fd, scratch, batched) &&
+         finalize(fd, idx_fd, h, movi_end, frames, scratch, RECOVER_SCRATCH);
+
+    if (fd >= 0) {
+        ok = close(fd) == 0 && ok;
+    }
+    if (idx_fd >= 0) {
+        close(idx_fd);
+    }
+    free(scratch);
+    if (ok) {
+        unlink(idx_path);
+    }
+    return ok;
+}
+
+bool avi_writer_index_path(const char *path, char *out, size_t cap)
+{
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    size_t base = strlen(path);
+    bool upper = false;
+
+    if (dot && (!slash || dot > slash)) {
+        base = dot - path;
+        upper = isupper((unsigned char)dot[1]);
+    }
+    int n = snprintf(out, cap, "%.*s%s", (int)base, path, upper ? ".IDX" : ".idx");
+    return n > 0 && (size_t)n < cap;
+}
@@ -0,0 +1,84 @@
+/*
+ * MJPEG AVI writer
+ *
+ * Muxes JPEG frames into an AVI 1.0 file (one MJPG video stream). The
+ * caller copies each frame into one of two large batch buffers; a writer
+ * thread writes a buffer out only when it is full, so every write() is a
+ * whole batch at a batch-aligned file offset and FATFS can send it to the
+ * card without read-modify-write. The caller never waits for the card: if
+ * both buffers are still busy the frame is refused and counted as dropped.
+ *
+ * The index is built incrementally. Every checkpoint the writer appends
+ * the entries of frames that reached the file to a sidecar index file
+ * (same name, .idx extension), patches the AVI header to cover them and
+ * syncs both. A file cut short by power loss is therefore a valid AVI up to
+ * the last checkpoint, and avi_writer_recover() turns file + sidecar back
+ * into a complete, indexed AVI. On close the same path appends idx1.
+ *
+ * Pure C on POSIX file descriptors and pthreads; runs on ESP-IDF (FATFS
+ * VFS) and on Linux alike.
+ */
+
+#ifndef AVI_WRITER_H
+#define AVI_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// AVI 1.0 keeps sizes in 32 bits and many players reject a RIFF over 1 GB;
+// frames that would grow the file past this are refused.
+#define AVI_WRITER_MAX_BYTES    (1u << 30)
+
+typedef struct {
+    int width;
+    int height;
+    int fps;                        // Nominal; the header gets the measured rate
+    size_t batch_size;              // Multiple of 512, larger than any frame
+    int64_t checkpoint_us;          // Index/header sync interval, 0 = every batch
+    int64_t (*clock_us)(void);      // Optional, enables checkpoint timing and stats
+} avi_writer_config_t;
+
+// Accumulated since the last avi_writer_take_stats(). Times are only
+// filled in when the writer has a clock.
+typedef struct {
+    uint32_t frames;                // Accepted
+    uint32_t dropped;               // Refused: buffers busy, file full or failed
+    uint32_t batches;
+    uint64_t bytes;                 // Written to the file
+    uint64_t write_us;              // Spent in write() for those bytes
+    uint32_t max_write_us;          // Slowest single batch write
+    uint32_t max_add_us;            // Longest avi_writer_add() call
+} avi_writer_stats_t;
+
+typedef struct avi_writer avi_writer_t;
+
+// Create path (and its sidecar index) and start the writer thread.
+avi_writer_t *avi_writer_open(const char *path, const avi_writer_config_t *cfg);
+
+// Queue one JPEG frame. Returns false if it was dropped.
+bool avi_writer_add(avi_writer_t *w, const void *jpeg, size_t len, int64_t timestamp_us);
+
+// Bytes the file will hold once everything queued is written
+uint64_t avi_writer_bytes(avi_writer_t *w);
+
+// True once a write has failed; later frames are dropped.
+bool avi_writer_failed(avi_writer_t *w);
+
+// Copy out the stats and start a new accumulation period
+void avi_writer_take_stats(avi_writer_t *w, avi_writer_stats_t *stats);
+
+// Write out what is queued, append idx1, remove the sidecar and free w.
+// Returns false if any of that failed; the file is then left for recovery.
+bool avi_writer_close(avi_writer_t *w);
+
+// Finish a file that was never closed: trim a partial last frame, index
+// every complete one (from the sidecar, then by scanning the rest) and
+// append idx1. Safe to run on a file that was closed cleanly.
+bool avi_writer_recover(const char *path);
+
+// Sidecar index path for an AVI path: the extension is replaced by .idx
+// (.IDX for an upper-case one, to stay within 8.3 names).
+bool avi_writer_index_path(const char *path, char *out, size_t cap);
+
+#endif // AVI_WRITER_H
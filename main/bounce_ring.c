@@ -0,0 +1,121 @@
+/*
+ * Bounce buffer ring - copy-ahead of PSRAM payloads into internal SRAM
+ */
+
+#include <string.h>
+
+#include "bounce_ring.h"
+
+void bounce_ring_init(bounce_ring_t *r, const bounce_ring_config_t *cfg)
+{
+    memset(r, 0, sizeof(*r));
+    r->cfg = *cfg;
+}
+
+// Start a copy into every slot whose block has been consumed
+static void fill(bounce_ring_t *r)
+{
+    size_t bs = r->cfg.block_size;
+
+    while (r->issued < r->len) {
+        size_t block = r->issued / bs;
+        if (block >= r->sent / bs + r->cfg.blocks) {
+            break;                  // Slot still holds an unsent block
+        }
+        size_t n = r->len - r->issued < bs ? r->len - r->issued : bs;
+        uint8_t *dst = r->cfg.buf + (block % r->cfg.blocks) * bs;
+        const uint8_t *src = r->src + r->issued;
+
+        r->issued += n;
+        r->started++;
+        if (r->cfg.copy) {
+            r->cfg.copy(dst, src, n, r);
+        } else {
+            memcpy(dst, src, n);
+            bounce_ring_copied(r);
+        }
+    }
+}
+
+void bounce_ring_start(bounce_ring_t *r, const uint8_t *src, size_t len)
+{
+    r->src = src;
+    r->len = len;
+    r->issued = 0;
+    r->sent = 0;
+    r->base = r->started;
+    fill(r);
+}
+
+size_t bounce_ring_peek(bounce_ring_t *r, const uint8_t **data)
+{
+    size_t bs = r->cfg.block_size;
+
+    fill(r);
+    if (r->sent >= r->len) {
+        return 0;
+    }
+    size_t block = r->sent / bs;
+    size_t done = atomic_load_explicit(&r->completed, memory_order_acquire) - r->base;
+    if (done <= block) {
+        return 0;
+    }
+
+    // Ready blocks are contiguous up to the end of the ring
+    size_t last = done - 1;
+    size_t wrap = block - block % r->cfg.blocks + r->cfg.blocks - 1;
+    if (last > wrap) {
+        last = wrap;
+    }
+    size_t end = (last + 1) * bs < r->len ? (last + 1) * bs : r->len;
+    *data = r->cfg.buf + (block % r->cfg.blocks) * bs + r->sent % bs;
+    return end - r->sent;
+}
+
+void bounce_ring_consume(bounce_ring_t *r, size_t n)
+{
+    r->sent += n;
+    fill(r);
+}
+
+// Until the next copy completion, or just once round if there is no hook
+static inline void pause_for_copy(bounce_ring_t *r)
+{
+    if (r->cfg.wait) {
+        r->cfg.wait(r);
+    }
+}
+
+void bounce_ring_wait(bounce_ring_t *r)
+{
+    size_t block = r->sent / r->cfg.block_size;
+
+    fill(r);
+    if (r->sent >= r->len ||
+        atomic_load_explicit(&r->completed, memory_order_acquire) - r->base > block) {
+        return;
+    }
+    r->stalls++;
+    while (atomic_load_explicit(&r->completed, memory_order_acquire) - r->base <= block) {
+        pause_for_copy(r);
+    }
+}
+
+void bounce_ring_settle(bounce_ring_t *r)
+{
+    // started already counts the copy the hook is doing
+    if (atomic_load_explicit(&r->completed, memory_order_acquire) == r->started - 1) {
+        return;
+    }
+    r->stalls++;
+    while (atomic_load_explicit(&r->completed, memory_order_acquire) != r->started - 1) {
+        pause_for_copy(r);
+    }
+}
+
+void bounce_ring_drain(bounce_ring_t *r)
+{
+    while (atomic_load_explicit(&r->completed, memory_order_acquire) != r->started) {
+        pause_for_copy(r);
+    }
+}
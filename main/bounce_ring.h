@@ -0,0 +1,91 @@
+/*
+ * Bounce buffer ring
+ *
+ * Streams one payload out of slow memory (PSRAM) through a ring of small
+ * blocks in fast memory (internal SRAM), so whoever consumes it, here
+ * lwIP building TCP segments, never reads the slow memory itself. Copies
+ * are started ahead of the consumer as soon as a block is free, by an
+ * asynchronous copier (GDMA) if there is one, so copying the next block
+ * overlaps with sending the current one:
+ *
+ *   payload   | 0 | 1 | 2 | 3 | 4 | ...
+ *   ring        slot 0   slot 1   slot 2   slot 0 ...
+ *               sent     copied   copying
+ *
+ * Block k lives in slot k % blocks and is refilled with block k + blocks
+ * once it has been consumed completely. Copies finish in the order they
+ * were started, which async copiers guarantee. A copy hook that does some
+ * copies itself, with the CPU, calls bounce_ring_settle() first, so that
+ * one does not finish ahead of an async copy still in flight.
+ *
+ * A consumer that runs ahead of the copies blocks in the wait hook, which
+ * the copier's completion wakes (a semaphore given from the DMA interrupt
+ * on ESP-IDF); without one it spins.
+ *
+ * Pure C11 atomics; runs on ESP-IDF and on Linux alike. One thread drives
+ * a ring; bounce_ring_copied() may be called from any context.
+ */
+
+#ifndef BOUNCE_RING_H
+#define BOUNCE_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct bounce_ring bounce_ring_t;
+
+typedef struct {
+    uint8_t *buf;                   // blocks * block_size bytes, the caller's
+    size_t block_size;
+    size_t blocks;                  // At least 2 for any overlap
+    // Start copying n bytes and call bounce_ring_copied() when done, from
+    // any context, possibly before returning. NULL copies with memcpy().
+    void (*copy)(void *dst, const void *src, size_t n, bounce_ring_t *ring);
+    // Block until a copy finishes. Must return at once if one finished
+    // since it last returned; returning early is harmless. NULL spins.
+    void (*wait)(bounce_ring_t *ring);
+    void *arg;                      // For copy and wait
+} bounce_ring_config_t;
+
+struct bounce_ring {
+    bounce_ring_config_t cfg;
+    const uint8_t *src;             // Current payload
+    size_t len;
+    size_t issued;                  // Payload bytes being or done copying
+    size_t sent;                    // Payload bytes consumed
+    uint32_t base;                  // Copies started before this payload
+    uint32_t started;               // Copies started in total
+    atomic_uint completed;          // Copies finished in total
+    uint32_t stalls;                // Waits for a copy, never reset here
+};
+
+void bounce_ring_init(bounce_ring_t *r, const bounce_ring_config_t *cfg);
+
+// Start on a new payload; the previous one must be done or drained
+void bounce_ring_start(bounce_ring_t *r, const uint8_t *src, size_t len);
+
+// Contiguous payload bytes ready in fast memory at *data, 0 if the next
+// block is still being copied. Starts copies for any free slot.
+size_t bounce_ring_peek(bounce_ring_t *r, const uint8_t **data);
+
+// The first n bytes from bounce_ring_peek() have been used
+void bounce_ring_consume(bounce_ring_t *r, size_t n);
+
+// Wait until the block at the consume position is copied
+void bounce_ring_wait(bounce_ring_t *r);
+
+// Wait for every copy in flight, before the buffer or payload go away
+void bounce_ring_drain(bounce_ring_t *r);
+
+// From the copy hook: wait for every copy started before this one, so the
+// hook can do this one itself and still complete it in start order
+void bounce_ring_settle(bounce_ring_t *r);
+
+// Copy completion, in start order
+static inline void bounce_ring_copied(bounce_ring_t *r)
+{
+    atomic_fetch_add_explicit(&r->completed, 1, memory_order_release);
+}
+
+#endif // BOUNCE_RING_H
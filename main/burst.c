@@ -0,0 +1,234 @@
+/*
+ * Burst capture - consecutive frames into a PSRAM arena, sent afterwards
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "burst.h"
+#include "clock_sync.h"
+#include "metrics.h"
+#include "mjpeg_part.h"
+
+static const char *TAG = "BURST";
+
+// A burst is given up when the camera sends nothing for this long
+#define BURST_FRAME_TIMEOUT_MS  3000
+// The budget allows every frame to be this much larger than the first
+#define BURST_MARGIN_PERCENT    25
+#define BURST_ALIGN             8
+
+typedef struct {
+    size_t offset;                  // Into the arena
+    size_t len;
+    uint32_t seq;                   // Hub sequence number
+    int64_t captured_us;            // Driver timestamp, boot clock
+} burst_frame_t;
+
+static frame_hub_t *s_hub;
+static uint8_t *s_arena;
+static size_t s_size;
+static burst_frame_t s_frames[CONFIG_BURST_MAX_FRAMES];
+static SemaphoreHandle_t s_lock;    // Held for a whole burst, capture and send
+static volatile bool s_subscribed;  // Holding a hub subscription
+
+static inline int64_t frame_captured_us(const hub_frame_t *frame)
+{
+    return (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+}
+
+static inline size_t aligned(size_t len)
+{
+    return (len + BURST_ALIGN - 1) & ~(size_t)(BURST_ALIGN - 1);
+}
+
+esp_err_t burst_start(frame_hub_t *hub)
+{
+    s_size = (size_t)CONFIG_BURST_BUFFER_KB * 1024;
+    s_arena = heap_caps_malloc(s_size, MALLOC_CAP_SPIRAM);
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_arena || !s_lock) {
+        ESP_LOGE(TAG, "No memory for a %u KB burst buffer", CONFIG_BURST_BUFFER_KB);
+        return ESP_ERR_NO_MEM;
+    }
+    s_hub = hub;
+    ESP_LOGI(TAG, "Bursts of up to %d frames in %u KB", CONFIG_BURST_MAX_FRAMES,
+             CONFIG_BURST_BUFFER_KB);
+    return ESP_OK;
+}
+
+// Take n frames in a row. Returns how many were kept, 0 with *refused set
+// when the first frame shows the burst cannot fit.
+static int take_frames(frame_sub_t *sub, int n, size_t *first_len, bool *refused)
+{
+    int64_t start = esp_timer_get_time();
+    size_t used = 0;
+    int count = 0;
+
+    *refused = false;
+    while (count < n) {
+        hub_frame_t *frame = frame_hub_wait(sub, pdMS_TO_TICKS(BURST_FRAME_TIMEOUT_MS));
+        if (!frame) {
+            ESP_LOGW(TAG, "Camera stopped after %d frames", count);
+            break;
+        }
+        if (frame_captured_us(frame) < start) {
+            frame_hub_release(frame);   // Taken before the request came in
+            continue;
+        }
+
+        if (count == 0) {
+            // The rest of the burst will be about as large as its first frame
+            *first_len = frame->len;
+            size_t need = (size_t)n * aligned(frame->len + frame->len * BURST_MARGIN_PERCENT / 100);
+            if (need > s_size) {
+                frame_hub_release(frame);
+                *refused = true;
+                return 0;
+            }
+        }
+        if (used + frame->len > s_size) {
+            ESP_LOGW(TAG, "Buffer full after %d frames", count);
+            frame_hub_release(frame);
+            break;
+        }
+
+        memcpy(s_arena + used, frame->buf, frame->len);
+        s_frames[count] = (burst_frame_t){
+            .offset = used,
+            .len = frame->len,
+            .seq = frame->seq,
+            .captured_us = frame_captured_us(frame),
+        };
+        used += aligned(frame->len);
+        count++;
+        frame_hub_release(frame);
+    }
+    return count;
+}
+
+static esp_err_t send_frame(httpd_req_t *req, const burst_frame_t *f, int64_t offset)
+{
+    char head[160];
+    mjpeg_part_meta_t meta = {
+        .seq = f->seq,
+        .timestamp_us = f->captured_us + offset,
+        .clock_offset_us = offset,
+    };
+    size_t hlen = mjpeg_part_head(head, sizeof(head), f->len, &meta);
+
+    esp_err_t res = httpd_resp_send_chunk(req, head, hlen);
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, (const char *)s_arena + f->offset, f->len);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, MJPEG_PART_DELIM, MJPEG_PART_DELIM_LEN);
+    }
+    return res;
+}
+
+esp_err_t burst_capture(httpd_req_t *req)
+{
+    char query[32];
+    char value[8];
+    char text[128];
+    int n = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "n", value, sizeof(value)) == ESP_OK) {
+        n = atoi(value);
+    }
+    if (n < 1 || n > CONFIG_BURST_MAX_FRAMES) {
+        snprintf(text, sizeof(text), "n must be 1 to %d", CONFIG_BURST_MAX_FRAMES);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, text);
+    }
+
+    if (!s_arena || !s_lock) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Bursts not available");
+    }
+    if (xSemaphoreTake(s_lock, 0) != pdTRUE) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Burst in progress", HTTPD_RESP_USE_STRLEN);
+    }
+    frame_sub_t *sub = frame_hub_subscribe(s_hub);
+    if (!sub) {
+        xSemaphoreGive(s_lock);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Too many viewers", HTTPD_RESP_USE_STRLEN);
+    }
+    s_subscribed = true;
+
+    size_t first_len = 0;
+    bool refused;
+    int count = take_frames(sub, n, &first_len, &refused);
+    uint32_t skipped = frame_hub_dropped(sub);
+    frame_hub_unsubscribe(sub);
+    s_subscribed = false;
+
+    if (refused) {
+        xSemaphoreGive(s_lock);
+        size_t each = aligned(first_len + first_len * BURST_MARGIN_PERCENT / 100);
+        snprintf(text, sizeof(text),
+                 "%d frames of about %u KB do not fit in %u KB, at most %u at this size\n",
+                 n, (unsigned)(first_len / 1024), CONFIG_BURST_BUFFER_KB, (unsigned)(s_size / each));
+        httpd_resp_set_status(req, "507 Insufficient Storage");
+        return httpd_resp_send(req, text, HTTPD_RESP_USE_STRLEN);
+    }
+    if (count == 0) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGE(TAG, "Camera capture failed");
+        return httpd_resp_send_500(req);
+    }
+
+    int64_t span_us = s_frames[count - 1].captured_us - s_frames[0].captured_us;
+    int64_t max_us = 0;
+    for (int i = 1; i < count; i++) {
+        int64_t interval = s_frames[i].captured_us - s_frames[i - 1].captured_us;
+        metrics_observe(METRIC_BURST_INTERVAL_US, interval);
+        if (interval > max_us) {
+            max_us = interval;
+        }
+    }
+    int64_t mean_us = count > 1 ? span_us / (count - 1) : 0;
+    ESP_LOGI(TAG, "%d frames in %lld ms, interval mean %lld us, max %lld us, %lu skipped",
+             count, (long long)(span_us / 1000), (long long)mean_us, (long long)max_us,
+             (unsigned long)skipped);
+
+    char frames_hdr[12], interval_hdr[24], skipped_hdr[12], disposition[64];
+    snprintf(frames_hdr, sizeof(frames_hdr), "%d", count);
+    snprintf(interval_hdr, sizeof(interval_hdr), "%lld", (long long)mean_us);
+    snprintf(skipped_hdr, sizeof(skipped_hdr), "%lu", (unsigned long)skipped);
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"burst-%lu.mjpeg\"",
+             (unsigned long)s_frames[0].seq);
+    httpd_resp_set_type(req, MJPEG_CONTENT_TYPE);
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "X-Burst-Frames", frames_hdr);
+    httpd_resp_set_hdr(req, "X-Burst-Interval-Us", interval_hdr);
+    httpd_resp_set_hdr(req, "X-Burst-Skipped", skipped_hdr);
+
+    // Frames are all taken; from here on the link sets the pace
+    int64_t offset = clock_sync_offset_us();
+    esp_err_t res = httpd_resp_send_chunk(req, MJPEG_PART_DELIM + 2, MJPEG_PART_DELIM_LEN - 2);
+    for (int i = 0; res == ESP_OK && i < count; i++) {
+        res = send_frame(req, &s_frames[i], offset);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    xSemaphoreGive(s_lock);
+    return res;
+}
+
+bool burst_subscribed(void)
+{
+    return s_subscribed;
+}
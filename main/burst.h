@@ -0,0 +1,34 @@
+/*
+ * Burst capture
+ *
+ * GET /burst?n=N takes N consecutive frames off the frame hub into a PSRAM
+ * arena reserved at boot, as fast as the sensor delivers them, and only
+ * then sends them as one multipart MJPEG response. Unlike /stream, the
+ * network never sets the pace, so the interval between frames is the
+ * sensor's frame time. Each part carries its capture time and sequence
+ * number in the same headers as /stream.
+ *
+ * The memory budget is checked against the first frame before the rest
+ * are taken: a burst that would not fit is refused instead of cut short.
+ * One burst runs at a time; its subscription wakes the sensor if it is in
+ * standby.
+ */
+
+#ifndef BURST_H
+#define BURST_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "frame_hub.h"
+
+// Reserve the arena. Bursts take frames from hub.
+esp_err_t burst_start(frame_hub_t *hub);
+
+// Serve GET /burst?n=N from an httpd handler. Blocks the worker for the
+// capture and the transfer.
+esp_err_t burst_capture(httpd_req_t *req);
+
+// True while a burst is subscribed to the hub, which is not a viewer
+bool burst_subscribed(void);
+
+#endif // BURST_H
@@ -0,0 +1,297 @@
+/*
+ * Capture benchmark - settings matrix driver and CSV/JSON report
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "camera_bench.h"
+
+#define AXES 5
+
+static const camera_bench_axis_t *axis(const camera_bench_config_t *cfg, size_t i)
+{
+    const camera_bench_axis_t *axes[AXES] = {
+        &cfg->frame_size, &cfg->jpeg_quality, &cfg->xclk_hz, &cfg->fb_count, &cfg->grab_mode,
+    };
+    return axes[i];
+}
+
+bool camera_bench_parse_axis(const char *list, const char *const *names, size_t name_count,
+                             camera_bench_axis_t *out)
+{
+    char item[16];
+
+    out->count = 0;
+    while (*list) {
+        size_t n = strcspn(list, ",");
+        if (n == 0 || n >= sizeof(item) || out->count == CAMERA_BENCH_MAX_VALUES) {
+            return false;
+        }
+        memcpy(item, list, n);
+        item[n] = '\0';
+        list += n + (list[n] == ',');
+
+        long v;
+        if (names) {
+            for (v = 0; (size_t)v < name_count; v++) {
+                if (names[v] && strcasecmp(names[v], item) == 0) {
+                    break;
+                }
+            }
+            if ((size_t)v == name_count) {
+                return false;
+            }
+        } else {
+            char *end;
+            v = strtol(item, &end, 10);
+            if (*end) {
+                return false;
+            }
+        }
+        out->values[out->count++] = v;
+    }
+    return out->count > 0;
+}
+
+camera_bench_t *camera_bench_create(const camera_bench_config_t *cfg)
+{
+    size_t points = 1;
+    for (size_t i = 0; i < AXES; i++) {
+        points *= axis(cfg, i)->count;
+    }
+    if (!points) {
+        return NULL;
+    }
+
+    camera_bench_t *b = calloc(1, sizeof(*b));
+    if (!b) {
+        return NULL;
+    }
+    b->cfg = *cfg;
+    b->points = points;
+    b->results = calloc(points, sizeof(*b->results));
+    b->samples = malloc(CAMERA_BENCH_MAX_SAMPLES * sizeof(*b->samples));
+    if (!b->results || !b->samples) {
+        camera_bench_free(b);
+        return NULL;
+    }
+    atomic_init(&b->done, 0);
+
+    // Odometer over the axes, the last one turning fastest
+    for (size_t p = 0; p < points; p++) {
+        int v[AXES];
+        size_t rest = p;
+        for (size_t i = AXES; i-- > 0; ) {
+            const camera_bench_axis_t *a = axis(cfg, i);
+            v[i] = a->values[rest % a->count];
+            rest /= a->count;
+        }
+        b->results[p].point = (camera_bench_point_t){
+            .frame_size = v[0],
+            .jpeg_quality = v[1],
+            .xclk_hz = v[2],
+            .fb_count = v[3],
+            .grab_mode = v[4],
+        };
+    }
+    return b;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(camera_bench_t *b, camera_bench_result_t *r, const camera_bench_sample_t *base)
+{
+    const camera_bench_config_t *cfg = &b->cfg;
+    camera_bench_sample_t s0, s1;
+    uint32_t misses = 0;
+    uint64_t total = 0;
+    size_t len;
+
+    // Let AEC settle and the driver fill its buffers; the clock for the
+    // frame rate starts at the last frame of the warm-up
+    int64_t start = cfg->clock_us();
+    int64_t end = start + cfg->warmup_us;
+    while (misses < cfg->max_failures) {
+        if (!cfg->frame(cfg->arg, &len)) {
+            misses++;
+            r->failed++;
+            continue;
+        }
+        misses = 0;
+        start = cfg->clock_us();
+        if (start >= end) {
+            break;
+        }
+    }
+
+    cfg->sample(cfg->arg, &s0);
+    int64_t last = start;
+    end = start + cfg->measure_us;
+    while (misses < cfg->max_failures && last < end) {
+        if (!cfg->frame(cfg->arg, &len)) {
+            misses++;
+            r->failed++;
+            continue;
+        }
+        misses = 0;
+        last = cfg->clock_us();
+        if (r->frames < CAMERA_BENCH_MAX_SAMPLES) {
+            b->samples[r->frames] = len;
+        }
+        r->frames++;
+        total += len;
+        if (len > r->max_bytes) {
+            r->max_bytes = len;
+        }
+    }
+    cfg->sample(cfg->arg, &s1);
+
+    if (r->frames) {
+        size_t kept = r->frames < CAMERA_BENCH_MAX_SAMPLES ? r->frames : CAMERA_BENCH_MAX_SAMPLES;
+        qsort(b->samples, kept, sizeof(*b->samples), cmp_u32);
+        r->mean_bytes = total / r->frames;
+        r->p99_bytes = b->samples[(kept * 99 + 99) / 100 - 1];
+        if (last > start) {
+            r->fps_x100 = (uint64_t)r->frames * 100000000 / (last - start);
+        }
+    }
+    r->no_eoi = s1.no_eoi - s0.no_eoi;
+    r->fb_ovf = s1.fb_ovf - s0.fb_ovf;
+    size_t internal_free = s0.internal_free < s1.internal_free ? s0.internal_free : s1.internal_free;
+    size_t psram_free = s0.psram_free < s1.psram_free ? s0.psram_free : s1.psram_free;
+    r->internal_used = (int64_t)base->internal_free - (int64_t)internal_free;
+    r->psram_used = (int64_t)base->psram_free - (int64_t)psram_free;
+}
+
+void camera_bench_run(camera_bench_t *b)
+{
+    const camera_bench_config_t *cfg = &b->cfg;
+    camera_bench_sample_t base;
+
+    cfg->sample(cfg->arg, &base);
+    for (size_t p = 0; p < b->points; p++) {
+        camera_bench_result_t *r = &b->results[p];
+        r->err = cfg->setup(&r->point, cfg->arg);
+        if (r->err == 0) {
+            measure(b, r, &base);
+        }
+        atomic_store_explicit(&b->done, p + 1, memory_order_release);
+    }
+    if (cfg->finish) {
+        cfg->finish(cfg->arg);
+    }
+}
+
+size_t camera_bench_done(camera_bench_t *b)
+{
+    return atomic_load_explicit(&b->done, memory_order_acquire);
+}
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t pos;                     // Total bytes produced so far
+} out_t;
+
+static void out_printf(out_t *out, const char *fmt, ...)
+{
+    va_list ap;
+    size_t room = out->pos < out->len ? out->len - out->pos : 0;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(room ? out->buf + out->pos : NULL, room, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        out->pos += n;
+    }
+}
+
+// Label of an enum value, or the number itself
+static void out_label(out_t *out, const char *const *names, size_t count, int v, bool quote)
+{
+    if (v >= 0 && (size_t)v < count && names[v]) {
+        out_printf(out, quote ? "\"%s\"" : "%s", names[v]);
+    } else {
+        out_printf(out, "%d", v);
+    }
+}
+
+static void csv_row(out_t *out, const camera_bench_config_t *cfg, const camera_bench_result_t *r)
+{
+    const camera_bench_point_t *pt = &r->point;
+
+    out_label(out, cfg->frame_size_names, cfg->frame_size_name_count, pt->frame_size, false);
+    out_printf(out, ",%d,%d,%d,", pt->jpeg_quality, pt->xclk_hz, pt->fb_count);
+    out_label(out, cfg->grab_mode_names, cfg->grab_mode_name_count, pt->grab_mode, false);
+    out_printf(out, ",%d,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ".%02" PRIu32
+               ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32
+               ",%" PRId64 ",%" PRId64 "\n",
+               r->err, r->frames, r->failed, r->fps_x100 / 100, r->fps_x100 % 100,
+               r->mean_bytes, r->p99_bytes, r->max_bytes, r->no_eoi, r->fb_ovf,
+               r->internal_used, r->psram_used);
+}
+
+static void json_row(out_t *out, const camera_bench_config_t *cfg, const camera_bench_result_t *r)
+{
+    const camera_bench_point_t *pt = &r->point;
+
+    out_printf(out, "{\"frame_size\":");
+    out_label(out, cfg->frame_size_names, cfg->frame_size_name_count, pt->frame_size, true);
+    out_printf(out, ",\"jpeg_quality\":%d,\"xclk_hz\":%d,\"fb_count\":%d,\"grab_mode\":",
+               pt->jpeg_quality, pt->xclk_hz, pt->fb_count);
+    out_label(out, cfg->grab_mode_names, cfg->grab_mode_name_count, pt->grab_mode, true);
+    out_printf(out, ",\"err\":%d,\"frames\":%" PRIu32 ",\"failed\":%" PRIu32
+               ",\"fps\":%" PRIu32 ".%02" PRIu32
+               ",\"mean_bytes\":%" PRIu32 ",\"p99_bytes\":%" PRIu32 ",\"max_bytes\":%" PRIu32
+               ",\"no_eoi\":%" PRIu32 ",\"fb_ovf\":%" PRIu32
+               ",\"internal_used\":%" PRId64 ",\"psram_used\":%" PRId64 "}",
+               r->err, r->frames, r->failed, r->fps_x100 / 100, r->fps_x100 % 100,
+               r->mean_bytes, r->p99_bytes, r->max_bytes, r->no_eoi, r->fb_ovf,
+               r->internal_used, r->psram_used);
+}
+
+size_t camera_bench_format(camera_bench_t *b, camera_bench_format_t fmt, char *buf, size_t len)
+{
+    out_t out = { .buf = buf, .len = len, .pos = 0 };
+    size_t done = camera_bench_done(b);
+
+    if (buf && len) {
+        buf[0] = '\0';
+    }
+
+    if (fmt == CAMERA_BENCH_JSON) {
+        out_printf(&out, "{\"points\":%u,\"done\":%u,\"results\":[",
+                   (unsigned)b->points, (unsigned)done);
+        for (size_t p = 0; p < done; p++) {
+            out_printf(&out, p ? ",\n" : "\n");
+            json_row(&out, &b->cfg, &b->results[p]);
+        }
+        out_printf(&out, "\n]}\n");
+    } else {
+        out_printf(&out, "frame_size,jpeg_quality,xclk_hz,fb_count,grab_mode,err,frames,failed,fps,"
+                         "mean_bytes,p99_bytes,max_bytes,no_eoi,fb_ovf,internal_used,psram_used\n");
+        for (size_t p = 0; p < done; p++) {
+            csv_row(&out, &b->cfg, &b->results[p]);
+        }
+    }
+    return out.pos;
+}
+
+void camera_bench_free(camera_bench_t *b)
+{
+    if (b) {
+        free(b->results);
+        free(b->samples);
+        free(b);
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * Capture benchmark
+ *
+ * Walks a matrix of camera settings, frame size x jpeg_quality x XCLK x
+ * fb_count x grab mode, and for every combination reinitializes the camera,
+ * lets it settle, then pulls frames as fast as the driver delivers them for
+ * a fixed time. Each point records the sustained frame rate, mean, p99 and
+ * largest frame, the NO-EOI and FB-OVF events the driver logged and how
+ * much heap the camera took. The report renders as CSV or JSON and can be
+ * read while the run is still going; rows appear as points finish.
+ *
+ * The camera is reached only through hooks, so this is pure C11 and runs
+ * on a host against a simulated camera as well as on the device.
+ */
+
+#ifndef CAMERA_BENCH_H
+#define CAMERA_BENCH_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAMERA_BENCH_MAX_VALUES     8
+// Frame sizes kept per point for the p99; later frames still count
+#define CAMERA_BENCH_MAX_SAMPLES    2048
+
+typedef struct {
+    int values[CAMERA_BENCH_MAX_VALUES];
+    size_t count;
+} camera_bench_axis_t;
+
+// One combination. frame_size and grab_mode are the driver's enums.
+typedef struct {
+    int frame_size;
+    int jpeg_quality;
+    int xclk_hz;
+    int fb_count;
+    int grab_mode;
+} camera_bench_point_t;
+
+// Driver events and free heap at one moment
+typedef struct {
+    uint32_t no_eoi;
+    uint32_t fb_ovf;
+    size_t internal_free;
+    size_t psram_free;
+} camera_bench_sample_t;
+
+typedef struct {
+    camera_bench_point_t point;
+    int err;                        // From setup(), 0 if the point ran
+    uint32_t frames;                // Measured, after the warm-up
+    uint32_t failed;                // frame() calls that got nothing
+    uint32_t fps_x100;
+    uint32_t mean_bytes;
+    uint32_t p99_bytes;
+    uint32_t max_bytes;
+    uint32_t no_eoi;
+    uint32_t fb_ovf;
+    int64_t internal_used;          // Against the heap before the first point
+    int64_t psram_used;
+} camera_bench_result_t;
+
+typedef struct {
+    camera_bench_axis_t frame_size;
+    camera_bench_axis_t jpeg_quality;
+    camera_bench_axis_t xclk_hz;
+    camera_bench_axis_t fb_count;
+    camera_bench_axis_t grab_mode;
+    // Report labels for the enum axes, indexed by value. Values without a
+    // label are printed as numbers.
+    const char *const *frame_size_names;
+    size_t frame_size_name_count;
+    const char *const *grab_mode_names;
+    size_t grab_mode_name_count;
+    int64_t warmup_us;              // Frames dropped after each reinit
+    int64_t measure_us;
+    // Point given up after this many frame() failures in a row, at least 1
+    uint32_t max_failures;
+
+    // (Re)initialize the camera with p. Nonzero skips the point and is
+    // reported as its error.
+    int (*setup)(const camera_bench_point_t *p, void *arg);
+    // Take one frame, note its length and hand it back. False if none came.
+    bool (*frame)(void *arg, size_t *len);
+    void (*sample)(void *arg, camera_bench_sample_t *s);
+    // Release the camera after the last point. Optional.
+    void (*finish)(void *arg);
+    int64_t (*clock_us)(void);
+    void *arg;
+} camera_bench_config_t;
+
+typedef struct {
+    camera_bench_config_t cfg;
+    camera_bench_result_t *results; // One per point, in matrix order
+    size_t points;
+    atomic_size_t done;             // Results final so far
+    uint32_t *samples;
+} camera_bench_t;
+
+typedef enum {
+    CAMERA_BENCH_CSV,
+    CAMERA_BENCH_JSON,
+} camera_bench_format_t;
+
+// Parse a comma separated list into axis. Items are numbers, or with names
+// one of names (matched case-insensitively, giving its index). Returns
+// false on an unknown item or more than CAMERA_BENCH_MAX_VALUES of them.
+bool camera_bench_parse_axis(const char *list, const char *const *names, size_t name_count,
+                             camera_bench_axis_t *axis);
+
+// Allocate the results for cfg's matrix. NULL if out of memory or an
+// axis is empty.
+camera_bench_t *camera_bench_create(const camera_bench_config_t *cfg);
+
+// Measure every point, in order. Blocks for the whole run.
+void camera_bench_run(camera_bench_t *b);
+
+// Points measured so far, out of b->points
+size_t camera_bench_done(camera_bench_t *b);
+
+// Render the finished points. Works like snprintf: writes at most len
+// bytes (NUL-terminated) and returns the full length needed.
+size_t camera_bench_format(camera_bench_t *b, camera_bench_format_t fmt, char *buf, size_t len);
+
+void camera_bench_free(camera_bench_t *b);
+
+#endif // CAMERA_BENCH_H
@@ -0,0 +1,676 @@
+/*
+ * Camera capture pipeline - capture and process stages
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_pthread.h"
+
+#include "camera_capture.h"
+#include "abr_controller.h"
+#include "clock_sync.h"
+#include "jpeg_check.h"
+#include "jpeg_dc.h"
+#include "jpeg_encoder.h"
+#include "metrics.h"
+#include "motion_detector.h"
+#include "pipeline_stage.h"
+#include "sensor_profile.h"
+#include "sensor_window.h"
+
+static const char *TAG = "CAPTURE";
+
+#define CAPTURE_TASK_STACK  4096
+#define PROCESS_TASK_STACK  4096
+
+#define STAGE_CORE(core)    ((core) < 0 ? tskNO_AFFINITY : (core))
+
+#define ABR_WINDOW_US       (1000 * 1000)
+
+#ifdef CONFIG_CAMERA_SW_JPEG_QUALITY
+#define SW_JPEG_QUALITY     CONFIG_CAMERA_SW_JPEG_QUALITY
+#else
+#define SW_JPEG_QUALITY     80
+#endif
+// Software-encoded frames between per-stage throughput log lines
+#define SW_JPEG_LOG_FRAMES  100
+
+// Room after a sensor JPEG for the EOI a truncated frame is repaired with
+#define JPEG_REPAIR_ROOM    2
+// Integrity step-down: judged once a second, from at least this many
+// frames, and left to settle for a few windows after every step
+#define INTEGRITY_WINDOW_US         (1000 * 1000)
+#define INTEGRITY_MIN_FRAMES        5
+#define INTEGRITY_COOLDOWN_WINDOWS  5
+#define INTEGRITY_QUALITY_STEP      2
+#ifdef CONFIG_CAMERA_ABR_QUALITY_WORST
+#define INTEGRITY_QUALITY_WORST     CONFIG_CAMERA_ABR_QUALITY_WORST
+#else
+#define INTEGRITY_QUALITY_WORST     30
+#endif
+#define INTEGRITY_XCLK_STEP_MHZ     4
+#define INTEGRITY_XCLK_MIN_MHZ      8
+
+#define STANDBY_DELAY_US    (CONFIG_CAMERA_STANDBY_DELAY_MS * 1000LL)
+
+// Frame sizes the controller may pick from, smallest first. Rungs above the
+// size the camera was initialized with are never used: the driver sized
+// its frame buffers for that.
+static const framesize_t s_abr_ladder[] = {
+    FRAMESIZE_QVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA, FRAMESIZE_HD,
+};
+
+static frame_hub_t *s_hub;
+static frame_source_t *s_source;
+
+// Handed from the capture stage to the process stage
+typedef struct {
+    camera_fb_t *fb;                // Raw frame, given back once encoded
+    hub_frame_t *frame;             // JPEG frame, already copied into the hub
+} capture_item_t;
+
+// Queued items, the one being processed and the one being filled
+static capture_item_t s_items[CAMERA_CAPTURE_FRAMES_IN_FLIGHT];
+static size_t s_next_item;
+static pipeline_stage_t *s_process;
+static atomic_uint_fast64_t s_capture_busy_us;
+// Size of the last software-encoded frame, for the controller
+static atomic_size_t s_encoded_len;
+
+#if CONFIG_CAMERA_JPEG_CHECK
+// Counted by the process stage, judged by the capture stage
+static atomic_uint s_checked;
+static atomic_uint s_corrupt;
+#endif
+
+#if CONFIG_PM_ENABLE
+// Held while frames flow: full CPU clock, no light sleep
+static esp_pm_lock_handle_t s_cpu_lock;
+static esp_pm_lock_handle_t s_sleep_lock;
+#endif
+
+// Written by sender tasks, drained once per control window
+static atomic_uint_fast64_t s_sent_bytes;
+static atomic_uint_fast64_t s_send_us;
+static atomic_uint s_sends;
+
+// Software JPEG path for raw sensor formats, owned by the process stage
+static jpeg_encoder_t *s_encoder;
+static uint8_t *s_jpeg_buf;
+static size_t s_jpeg_cap;
+static int s_jpeg_width;
+static uint32_t s_jpeg_frames;
+
+#if CONFIG_STREAM_MOTION_GATE
+static motion_t s_motion;
+static uint8_t *s_thumb;
+static size_t s_thumb_cap;
+#endif
+
+void camera_capture_report_send(size_t bytes, int64_t send_us)
+{
+    atomic_fetch_add(&s_sent_bytes, bytes);
+    atomic_fetch_add(&s_send_us, send_us > 0 ? send_us : 0);
+    atomic_fetch_add(&s_sends, 1);
+}
+
+#if CONFIG_CAMERA_ABR
+
+static void abr_setup(abr_t *abr, sensor_t *s)
+{
+    int rungs = 0;
+    int rung = 0;
+
+    for (size_t i = 0; i < sizeof(s_abr_ladder) / sizeof(s_abr_ladder[0]); i++) {
+        if (s_abr_ladder[i] <= s->status.framesize) {
+            rungs = i + 1;
+            rung = i;
+        }
+    }
+
+    abr_config_t cfg = {
+        .target_fps = CONFIG_STREAM_TARGET_FPS > 0 ? CONFIG_STREAM_TARGET_FPS : 25,
+        .target_latency_us = CONFIG_CAMERA_ABR_LATENCY_MS * 1000,
+        .quality_best = s->status.quality,
+        .quality_worst = CONFIG_CAMERA_ABR_QUALITY_WORST,
+        .quality_step = 2,
+        .rungs = rungs,
+        .up_windows = 3,
+        .cooldown_windows = 2,
+    };
+    abr_init(abr, &cfg, s->status.quality, rung);
+}
+
+static void abr_window(abr_t *abr, sensor_t *s)
+{
+    abr_on_send(abr, atomic_exchange(&s_sent_bytes, 0),
+                atomic_exchange(&s_send_us, 0), atomic_exchange(&s_sends, 0));
+
+    int rung = abr->rung;
+    if (!abr_update(abr)) {
+        return;
+    }
+    if (abr->rung != rung && sensor_window_active()) {
+        abr->rung = rung;           // A frame size would undo the window
+    } else if (abr->rung != rung) {
+        s->set_framesize(s, s_abr_ladder[abr->rung]);
+    }
+    s->set_quality(s, abr->quality);
+    ESP_LOGI(TAG, "ABR: quality %d, frame size %d", abr->quality, (int)s_abr_ladder[abr->rung]);
+}
+
+#endif
+
+static unsigned long mps_x100(uint64_t pixels, uint64_t us)
+{
+    return us ? (unsigned long)(pixels * 100 / us) : 0;
+}
+
+static void sw_jpeg_log(void)
+{
+    jpeg_enc_stats_t st;
+    jpeg_encoder_take_stats(s_encoder, &st);
+
+    unsigned long conv = mps_x100(st.pixels, st.convert_us);
+    unsigned long xform = mps_x100(st.pixels, st.transform_us);
+    unsigned long entropy = mps_x100(st.pixels, st.entropy_us);
+    ESP_LOGI(TAG, "SW JPEG MP/s: convert %lu.%02lu, DCT+quant %lu.%02lu, entropy %lu.%02lu",
+             conv / 100, conv % 100, xform / 100, xform % 100, entropy / 100, entropy % 100);
+}
+
+// Encode a raw frame into s_jpeg_buf. Returns the JPEG size, 0 on failure.
+static size_t sw_jpeg_encode(const camera_fb_t *fb)
+{
+    jpeg_enc_input_t input;
+    if (fb->format == PIXFORMAT_RGB565) {
+        input = JPEG_ENC_RGB565;
+    } else if (fb->format == PIXFORMAT_YUV422) {
+        input = JPEG_ENC_YUYV;
+    } else {
+        ESP_LOGE(TAG, "Unsupported pixel format %d", (int)fb->format);
+        return 0;
+    }
+
+    // One byte per pixel is far above what the encoder produces at any
+    // sensible quality. Frame sizes only shrink at runtime, so this
+    // normally happens once.
+    size_t cap = fb->width * fb->height;
+    if (!s_encoder || !s_jpeg_buf || (int)fb->width > s_jpeg_width || cap > s_jpeg_cap) {
+        jpeg_encoder_destroy(s_encoder);
+        free(s_jpeg_buf);
+        jpeg_encoder_config_t cfg = {
+            .max_width = fb->width,
+            .quality = SW_JPEG_QUALITY,
+            .clock_us = esp_timer_get_time,
+        };
+        s_encoder = jpeg_encoder_create(&cfg);
+        s_jpeg_buf = heap_caps_malloc(cap, MALLOC_CAP_SPIRAM);
+        s_jpeg_cap = cap;
+        s_jpeg_width = fb->width;
+        if (!s_encoder || !s_jpeg_buf) {
+            ESP_LOGE(TAG, "No memory for software JPEG at %ux%u",
+                     (unsigned)fb->width, (unsigned)fb->height);
+            return 0;
+        }
+    }
+
+    int64_t start = esp_timer_get_time();
+    size_t len = jpeg_encode(s_encoder, fb->buf, fb->width, fb->height, input,
+                             s_jpeg_buf, s_jpeg_cap);
+    metrics_observe(METRIC_SW_ENCODE_US, esp_timer_get_time() - start);
+    if (!len) {
+        ESP_LOGW(TAG, "Software JPEG encode failed (%ux%u)",
+                 (unsigned)fb->width, (unsigned)fb->height);
+        return 0;
+    }
+
+    if (++s_jpeg_frames % SW_JPEG_LOG_FRAMES == 0) {
+        sw_jpeg_log();
+    }
+    return len;
+}
+
+#if CONFIG_STREAM_MOTION_GATE
+
+// Scene number of a JPEG frame, from its DC thumbnail
+static uint32_t motion_scene(const uint8_t *jpg, size_t len)
+{
+    int64_t start = esp_timer_get_time();
+    size_t cells = jpeg_dc_cells(jpg, len);
+    int w, h;
+
+    if (cells > s_thumb_cap) {
+        free(s_thumb);
+        s_thumb = malloc(cells);
+        s_thumb_cap = s_thumb ? cells : 0;
+    }
+    if (cells && s_thumb && jpeg_dc_thumbnail(jpg, len, s_thumb, s_thumb_cap, &w, &h)) {
+        motion_update(&s_motion, s_thumb, w, h);
+    } else {
+        motion_force(&s_motion);    // Can't tell, assume it changed
+    }
+    metrics_observe(METRIC_MOTION_DETECT_US, esp_timer_get_time() - start);
+    return s_motion.scene;
+}
+
+#endif
+
+#if CONFIG_CAMERA_JPEG_CHECK
+
+// Validate a sensor JPEG; trims padding and repairs truncation in place.
+// Returns false if the frame is not fit to publish.
+static bool check_frame(hub_frame_t *frame)
+{
+    static uint32_t corrupt;
+    jpeg_check_info_t info;
+
+    int64_t start = esp_timer_get_time();
+    jpeg_check_result_t res = jpeg_check(frame->buf, frame->len, frame->len + JPEG_REPAIR_ROOM, &info);
+    metrics_observe(METRIC_JPEG_CHECK_US, esp_timer_get_time() - start);
+    atomic_fetch_add(&s_checked, 1);
+    if (res == JPEG_CHECK_OK) {
+        frame->len = info.len;
+        return true;
+    }
+
+    atomic_fetch_add(&s_corrupt, 1);
+#if CONFIG_CAMERA_JPEG_REPAIR
+    bool keep = res == JPEG_CHECK_REPAIRED;
+#else
+    bool keep = false;
+#endif
+    metrics_inc(keep ? METRIC_JPEG_REPAIRED : METRIC_JPEG_DROPPED);
+    if ((++corrupt % 50) == 1) {
+        ESP_LOGW(TAG, "Corrupt JPEG (%s), %s; %lu so far", info.reason,
+                 keep ? "closed early" : "dropped", (unsigned long)corrupt);
+    }
+    if (keep) {
+        frame->len = info.len;
+    }
+    return keep;
+}
+
+typedef struct {
+    int64_t deadline;
+    int cooldown;
+    bool exhausted;
+} integrity_t;
+
+// Too many corrupt frames: ask less of the sensor link. Quality first, as
+// smaller frames are less likely to overrun the DMA buffers, then XCLK.
+// Never steps back up; the cause is usually the board, not the scene.
+static void integrity_window(integrity_t *ig, sensor_t *s, abr_t *abr)
+{
+    unsigned checked = atomic_exchange(&s_checked, 0);
+    unsigned corrupt = atomic_exchange(&s_corrupt, 0);
+    if (ig->cooldown > 0) {
+        ig->cooldown--;
+        return;
+    }
+    if (ig->exhausted || checked < INTEGRITY_MIN_FRAMES ||
+        corrupt * 1000 < checked * CONFIG_CAMERA_JPEG_STEPDOWN_PERMILLE) {
+        return;
+    }
+
+    int quality = s->status.quality + INTEGRITY_QUALITY_STEP;
+    int xclk_mhz = s->xclk_freq_hz / 1000000 - INTEGRITY_XCLK_STEP_MHZ;
+    if (quality <= INTEGRITY_QUALITY_WORST) {
+        s->set_quality(s, quality);
+        if (abr) {
+            // Keep the controller from walking it back
+            abr->cfg.quality_best = quality;
+            if (abr->quality < quality) {
+                abr->quality = quality;
+            }
+        }
+        ESP_LOGW(TAG, "%u of %u frames corrupt, quality down to %d", corrupt, checked, quality);
+    } else if (xclk_mhz >= INTEGRITY_XCLK_MIN_MHZ) {
+        s->set_xclk(s, CAMERA_XCLK_TIMER, xclk_mhz);
+        ESP_LOGW(TAG, "%u of %u frames corrupt, XCLK down to %d MHz", corrupt, checked, xclk_mhz);
+    } else {
+        ESP_LOGE(TAG, "%u of %u frames corrupt at the lowest quality and XCLK", corrupt, checked);
+        ig->exhausted = true;
+        return;
+    }
+    metrics_inc(METRIC_JPEG_STEPDOWNS);
+    ig->cooldown = INTEGRITY_COOLDOWN_WINDOWS;
+}
+
+#endif
+
+// Leave the CPU clock and light sleep to the power manager, or take them back
+static void hold_power(bool hold)
+{
+#if CONFIG_PM_ENABLE
+    if (!s_cpu_lock || !s_sleep_lock) {
+        return;
+    }
+    if (hold) {
+        esp_pm_lock_acquire(s_cpu_lock);
+        esp_pm_lock_acquire(s_sleep_lock);
+    } else {
+        esp_pm_lock_release(s_sleep_lock);
+        esp_pm_lock_release(s_cpu_lock);
+    }
+#endif
+}
+
+typedef struct {
+    int64_t idle_since;             // Since no one is watching, 0 if someone is
+    int64_t resumed_at;             // Until the first fresh frame after standby
+    bool suspended;
+} standby_t;
+
+// No viewers: once that has lasted long enough, park the sensor
+static void standby_idle(standby_t *sb, frame_source_t *source)
+{
+    int64_t now = esp_timer_get_time();
+    if (sb->suspended || !source->suspend || CONFIG_CAMERA_STANDBY_DELAY_MS <= 0) {
+        return;
+    }
+    if (!sb->idle_since) {
+        sb->idle_since = now;
+        return;
+    }
+    if (now - sb->idle_since < STANDBY_DELAY_US) {
+        return;
+    }
+
+    esp_err_t err = source->suspend(source);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Sensor standby failed: %s", esp_err_to_name(err));
+        sb->idle_since = now;       // Try again after another delay
+        return;
+    }
+    sb->suspended = true;
+    hold_power(false);
+    metrics_set(METRIC_CAMERA_STANDBY, 1);
+    metrics_inc(METRIC_CAMERA_STANDBYS);
+    ESP_LOGI(TAG, "No viewers for %d ms, sensor in standby", CONFIG_CAMERA_STANDBY_DELAY_MS);
+}
+
+// Someone is watching: wake the sensor if it is parked
+static void standby_wake(standby_t *sb, frame_source_t *source)
+{
+    sb->idle_since = 0;
+    if (!sb->suspended) {
+        return;
+    }
+
+    hold_power(true);
+    sb->resumed_at = esp_timer_get_time();
+    sb->suspended = false;
+    metrics_set(METRIC_CAMERA_STANDBY, 0);
+    esp_err_t err = source->resume(source);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sensor resume failed: %s", esp_err_to_name(err));
+        return;
+    }
+    // Standby keeps the registers; the profile is replayed in full anyway
+    // so the image settings are known good, for a few ms of resume time
+    if (source->sensor) {
+        sensor_profile_restore(source->sensor, NULL);
+    }
+}
+
+// The driver still holds the frames it had filled before standby. Those
+// are skipped; the first one taken after resume() is timed.
+static bool standby_stale(standby_t *sb, const camera_fb_t *fb, int64_t now)
+{
+    if (!sb->resumed_at) {
+        return false;
+    }
+    int64_t taken = fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec;
+    if (taken < sb->resumed_at) {
+        return true;
+    }
+    metrics_observe(METRIC_CAMERA_RESUME_US, now - sb->resumed_at);
+    ESP_LOGI(TAG, "Sensor resumed, first frame after %lld ms",
+             (long long)(now - sb->resumed_at) / 1000);
+    sb->resumed_at = 0;
+    return false;
+}
+
+// Process stage: check or encode frames, judge the scene, publish
+static void process_frame(void *arg, void *unused)
+{
+    capture_item_t *item = arg;
+    hub_frame_t *frame = item->frame;
+
+    if (item->fb) {
+        camera_fb_t *fb = item->fb;
+        size_t len = sw_jpeg_encode(fb);
+        frame = len ? frame_hub_acquire(s_hub, len) : NULL;
+        if (frame) {
+            memcpy(frame->buf, s_jpeg_buf, len);
+            frame->len = len;
+            frame->width = fb->width;
+            frame->height = fb->height;
+            frame->format = PIXFORMAT_JPEG;
+            frame->timestamp = fb->timestamp;
+            metrics_observe(METRIC_FRAME_BYTES, len);
+            atomic_store(&s_encoded_len, len);
+        } else {
+            metrics_inc(len ? METRIC_FRAMES_OVERRUN : METRIC_CAPTURE_FAILED);
+        }
+        s_source->put(s_source, fb);
+        if (!frame) {
+            return;
+        }
+    }
+
+#if CONFIG_CAMERA_JPEG_CHECK
+    // Sensor JPEG is only as good as the DMA transfer that brought it
+    if (!item->fb && !check_frame(frame)) {
+        frame_hub_discard(s_hub, frame);
+        return;
+    }
+#endif
+
+#if CONFIG_STREAM_MOTION_GATE
+    frame->scene = motion_scene(frame->buf, frame->len);
+#else
+    static uint32_t scene;
+    frame->scene = ++scene;         // Every frame is news
+#endif
+    // Taken once here so every response about this frame agrees on it
+    frame->wall_us = (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec +
+                     clock_sync_offset_us();
+    frame_hub_publish(s_hub, frame);
+}
+
+// Capture stage: keep the driver's buffers moving and nothing else
+static void capture_task(void *arg)
+{
+    frame_hub_t *hub = s_hub;
+    frame_source_t *source = s_source;
+    uint32_t dropped = 0;
+    int64_t last_frame_us = 0;
+    standby_t standby = { 0 };
+    int64_t window_at = 0;          // Window switched, older frames are stale
+    int window_w = 0, window_h = 0;
+
+#if CONFIG_STREAM_MOTION_GATE
+    motion_config_t motion_cfg = {
+        .threshold = CONFIG_STREAM_MOTION_THRESHOLD,
+        .area_permille = CONFIG_STREAM_MOTION_AREA,
+    };
+    motion_init(&s_motion, &motion_cfg);
+#endif
+
+#if CONFIG_CAMERA_ABR
+    sensor_t *s = source->sensor;
+    abr_t abr;
+    if (s) {
+        abr_setup(&abr, s);
+    }
+    int64_t abr_deadline = esp_timer_get_time() + ABR_WINDOW_US;
+#endif
+#if CONFIG_CAMERA_JPEG_CHECK
+    integrity_t integrity = { .deadline = esp_timer_get_time() + INTEGRITY_WINDOW_US };
+#if CONFIG_CAMERA_ABR
+    abr_t *integrity_abr = s ? &abr : NULL;
+#else
+    abr_t *integrity_abr = NULL;
+#endif
+#endif
+
+    while (true) {
+        // Profile switches are applied here, between frames, so they never
+        // interleave with the controller's sensor writes. A parked sensor
+        // picks the new profile up when it resumes.
+        if (source->sensor && !standby.suspended) {
+            sensor_profile_service(source->sensor);
+            if (sensor_window_service(source->sensor)) {
+                window_at = esp_timer_get_time();
+                if (!sensor_window_size(&window_w, &window_h)) {
+                    window_w = window_h = 0;
+                }
+            }
+        }
+
+        // Leave the sensor alone until someone is watching
+        if (!frame_hub_wait_subscribers(hub, pdMS_TO_TICKS(1000))) {
+            standby_idle(&standby, source);
+            continue;
+        }
+        standby_wake(&standby, source);
+
+        int64_t wait_start = esp_timer_get_time();
+        camera_fb_t *fb = source->get(source);
+        int64_t now = esp_timer_get_time();
+        metrics_observe(METRIC_FB_GET_WAIT_US, now - wait_start);
+        if (!fb) {
+            ESP_LOGE(TAG, "Camera capture failed");
+            metrics_inc(METRIC_CAPTURE_FAILED);
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        if (standby_stale(&standby, fb, now) ||
+            fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec < window_at) {
+            source->put(source, fb);
+            metrics_inc(METRIC_FRAMES_STALE);
+            continue;
+        }
+
+        metrics_inc(METRIC_FRAMES_CAPTURED);
+        if (last_frame_us) {
+            metrics_observe(METRIC_FRAME_INTERVAL_US, now - last_frame_us);
+        }
+        last_frame_us = now;
+
+        // Raw frames travel as they are: encoding is the process stage's
+        // job. JPEG is copied into a hub slot here so the driver buffer
+        // goes straight back and DMA can continue.
+        capture_item_t *item = &s_items[s_next_item];
+        item->fb = NULL;
+        item->frame = NULL;
+        size_t len = fb->len;
+        if (fb->format != PIXFORMAT_JPEG) {
+            item->fb = fb;
+            len = atomic_load(&s_encoded_len);
+        } else {
+            metrics_observe(METRIC_FRAME_BYTES, len);
+            item->frame = frame_hub_acquire(hub, len + JPEG_REPAIR_ROOM);
+            if (item->frame) {
+                hub_frame_t *frame = item->frame;
+                memcpy(frame->buf, fb->buf, len);
+                frame->len = len;
+                // The driver reports the size it was initialized with
+                frame->width = window_w ? (size_t)window_w : fb->width;
+                frame->height = window_h ? (size_t)window_h : fb->height;
+                frame->format = PIXFORMAT_JPEG;
+                frame->timestamp = fb->timestamp;
+            }
+            source->put(source, fb);
+        }
+
+#if CONFIG_CAMERA_ABR
+        abr_on_frame(&abr, len);
+        if (s && esp_timer_get_time() >= abr_deadline) {
+            abr_window(&abr, s);
+            abr_deadline = esp_timer_get_time() + ABR_WINDOW_US;
+        }
+#endif
+#if CONFIG_CAMERA_JPEG_CHECK
+        if (source->sensor && esp_timer_get_time() >= integrity.deadline) {
+            integrity_window(&integrity, source->sensor, integrity_abr);
+            integrity.deadline = esp_timer_get_time() + INTEGRITY_WINDOW_US;
+        }
+#endif
+
+        // A full queue means processing cannot keep up: drop this frame
+        // rather than stall the sensor
+        if ((item->fb || item->frame) && pipeline_stage_submit(s_process, item)) {
+            s_next_item = (s_next_item + 1) % CAMERA_CAPTURE_FRAMES_IN_FLIGHT;
+        } else {
+            if (item->fb) {
+                source->put(source, item->fb);
+            } else if (item->frame) {
+                frame_hub_discard(hub, item->frame);
+            }
+            metrics_inc(METRIC_FRAMES_OVERRUN);
+            if ((++dropped % 100) == 1) {
+                ESP_LOGW(TAG, "Pipeline full or no frame slot, dropped %lu frames",
+                         (unsigned long)dropped);
+            }
+        }
+        atomic_fetch_add(&s_capture_busy_us, esp_timer_get_time() - now);
+    }
+}
+
+void camera_capture_take_stats(camera_capture_stats_t *stats)
+{
+    stats->capture_busy_us = atomic_exchange(&s_capture_busy_us, 0);
+    if (s_process) {
+        pipeline_stage_take_stats(s_process, &stats->process);
+    } else {
+        memset(&stats->process, 0, sizeof(stats->process));
+    }
+}
+
+esp_err_t camera_capture_start(frame_hub_t *hub, frame_source_t *source)
+{
+    s_hub = hub;
+    s_source = source;
+
+    esp_pthread_cfg_t thread = esp_pthread_get_default_config();
+    thread.stack_size = PROCESS_TASK_STACK;
+    thread.prio = CONFIG_PIPELINE_PROCESS_PRIO;
+    thread.pin_to_core = STAGE_CORE(CONFIG_PIPELINE_PROCESS_CORE);
+    thread.thread_name = "cam_process";
+    esp_pthread_set_cfg(&thread);
+
+    pipeline_stage_config_t cfg = {
+        .name = "process",
+        .process = process_frame,
+        .queue_len = CONFIG_PIPELINE_QUEUE_LEN,
+        .clock_us = esp_timer_get_time,
+    };
+    s_process = pipeline_stage_start(&cfg);
+    if (!s_process) {
+        return ESP_ERR_NO_MEM;
+    }
+
+#if CONFIG_PM_ENABLE
+    // Taken while streaming, so frequency scaling and light sleep only
+    // happen once the sensor is in standby
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "camera", &s_cpu_lock) != ESP_OK ||
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "camera", &s_sleep_lock) != ESP_OK) {
+        ESP_LOGW(TAG, "No PM locks, streaming may be slowed by power management");
+    }
+#endif
+    hold_power(true);
+
+    BaseType_t ok = xTaskCreatePinnedToCore(capture_task, "cam_capture", CAPTURE_TASK_STACK,
+                                            NULL, CONFIG_PIPELINE_CAPTURE_PRIO, NULL,
+                                            STAGE_CORE(CONFIG_PIPELINE_CAPTURE_CORE));
+    return ok == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
@@ -0,0 +1,48 @@
+/*
+ * Camera capture pipeline
+ *
+ * Owns the frame source (normally the sensor): it is the only caller of
+ * esp_camera_fb_get(). Two stages, each pinned to its own core by default:
+ *
+ *   capture  grabs frames, copies JPEG into a frame hub slot and hands the
+ *            driver buffer straight back, so slow consumers can never
+ *            starve the camera DMA
+ *   process  JPEG-encodes raw RGB565/YUV422 frames in software, runs the
+ *            motion gate and publishes to the hub, which only ever holds JPEG
+ *
+ * They are joined by a short lock-free queue. When processing falls behind
+ * the queue fills and capture drops the newest frame instead of waiting.
+ * The hub's subscribers (stream senders, recorder, scaler) are the third,
+ * send stage.
+ */
+
+#ifndef CAMERA_CAPTURE_H
+#define CAMERA_CAPTURE_H
+
+#include "esp_err.h"
+#include "frame_hub.h"
+#include "frame_source.h"
+#include "pipeline_stage.h"
+
+// Hub frames the pipeline may hold unpublished: a full queue, the one
+// being processed and the one being filled
+#define CAMERA_CAPTURE_FRAMES_IN_FLIGHT (CONFIG_PIPELINE_QUEUE_LEN + 2)
+
+// Accumulated since the last camera_capture_take_stats()
+typedef struct {
+    uint64_t capture_busy_us;       // Capture stage, not counting waits
+    pipeline_stage_stats_t process;
+} camera_capture_stats_t;
+
+// Start the capture and process stages feeding hub from source. Frames are only grabbed
+// while the hub has subscribers.
+esp_err_t camera_capture_start(frame_hub_t *hub, frame_source_t *source);
+
+// Report a frame delivered to a client: bytes written and the time it took.
+// Feeds the adaptive quality/frame size controller. Safe from any task.
+void camera_capture_report_send(size_t bytes, int64_t send_us);
+
+// Copy out the per-stage stats and start a new accumulation period
+void camera_capture_take_stats(camera_capture_stats_t *stats);
+
+#endif // CAMERA_CAPTURE_H
@@ -1,13 +1,17 @@
 /*
  * Working XIAO ESP32S3 OV3660 Camera Stream
- * Uses RGB565 format with JPEG conversion
+ * Sensor JPEG, or RGB565/YUV422 with software JPEG encoding
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/event_groups.h"
 #include "esp_system.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
@@ -15,9 +19,29 @@
 #include "esp_netif.h"
 #include "esp_http_server.h"
 #include "esp_camera.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 
 #include "pins.h"
+#include "frame_hub.h"
+#include "camera_capture.h"
+#include "clock_sync.h"
+#include "frame_source.h"
+#include "camera_bench.h"
+#include "frame_pacer.h"
+#include "stream_sender.h"
+#include "mjpeg_part.h"
+#include "metrics.h"
+#include "power.h"
+#include "preevent.h"
+#include "burst.h"
+#include "recorder.h"
+#include "sd_card.h"
+#include "rtsp_server.h"
+#include "frame_scaler.h"
+#include "sensor_profile.h"
+#include "sensor_window.h"
+#include "wifi_sta.h"
 
 static const char *TAG = "XIAO_CAM";
 
@@ -25,15 +49,64 @@ static const char *TAG = "XIAO_CAM";
 // WiFi credentials from sdkconfig
 #define ESP_WIFI_SSID      CONFIG_ESP_WIFI_SSID
 #define ESP_WIFI_PASS      CONFIG_ESP_WIFI_PASSWORD
-#define ESP_MAXIMUM_RETRY  5
 
+// How long a viewer waits for the capture task before giving up
+#define STREAM_FRAME_TIMEOUT_MS 3000
+// How long a profile or window switch may take before the request gets a
+// 202: an idle capture task only looks for switches once a second, so
+// allow two of its polls
+#define PROFILE_SWITCH_TIMEOUT_MS 2000
 
-static EventGroupHandle_t s_wifi_event_group;
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
+// Hub subscribers that are not viewers
+#if CONFIG_PREEVENT_RECORDER && CONFIG_RECORDER_SD
+#define HUB_INTERNAL_SUBSCRIBERS 2
+#elif CONFIG_PREEVENT_RECORDER || CONFIG_RECORDER_SD
+#define HUB_INTERNAL_SUBSCRIBERS 1
+#else
+#define HUB_INTERNAL_SUBSCRIBERS 0
+#endif
+
+// The scaler subscribes while it has scaled viewers to feed
+#if CONFIG_STREAM_SCALED
+#define HUB_SCALER_SUBSCRIBERS 1
+#else
+#define HUB_SCALER_SUBSCRIBERS 0
+#endif
+
+// A burst subscribes while it takes its frames
+#if CONFIG_BURST_CAPTURE
+#define HUB_BURST_SUBSCRIBERS 1
+#else
+#define HUB_BURST_SUBSCRIBERS 0
+#endif
+
+// RTSP sessions subscribe on their own, next to the /stream viewers
+#if CONFIG_RTSP_SERVER
+#define HUB_RTSP_SUBSCRIBERS CONFIG_RTSP_MAX_SESSIONS
+#else
+#define HUB_RTSP_SUBSCRIBERS 0
+#endif
 
-static int s_retry_num = 0;
 static httpd_handle_t camera_httpd = NULL;
+static frame_hub_t *s_frame_hub = NULL;
+static uint32_t s_boot_id;              // Keeps ETags unique across reboots
+
+// Raw formats are JPEG-encoded in software by the capture task
+#if CONFIG_CAMERA_PIXFORMAT_RGB565
+#define CAMERA_PIXEL_FORMAT PIXFORMAT_RGB565
+#elif CONFIG_CAMERA_PIXFORMAT_YUV422
+#define CAMERA_PIXEL_FORMAT PIXFORMAT_YUV422
+#else
+#define CAMERA_PIXEL_FORMAT PIXFORMAT_JPEG
+#endif
+
+#if CONFIG_CAMERA_PROFILE_DAYLIGHT
+#define CAMERA_PROFILE "daylight"
+#elif CONFIG_CAMERA_PROFILE_MAXFPS
+#define CAMERA_PROFILE "maxfps"
+#else
+#define CAMERA_PROFILE "lowlight"
+#endif
 
 // Working OV3660 config
 static camera_config_t camera_config = {
@@ -56,10 +129,10 @@ static camera_config_t camera_config = {
     .pin_pclk     = XIAO_CAM_PIN_PCLK,
     
     .xclk_freq_hz = 20000000,
-    .ledc_timer   = LEDC_TIMER_0,
+    .ledc_timer   = CAMERA_XCLK_TIMER,
     .ledc_channel = LEDC_CHANNEL_0,
     
-    .pixel_format = PIXFORMAT_JPEG,     // Try JPEG first
+    .pixel_format = CAMERA_PIXEL_FORMAT,
     //WORKING .frame_size   = FRAMESIZE_QVGA,     // 800x600
     .frame_size   = FRAMESIZE_HD,     // 800x600
     .jpeg_quality = 5,
@@ -69,79 +142,7 @@ static camera_config_t camera_config = {
     .sccb_i2c_port = 1
 };
 
-// WiFi event handler
-static void wifi_event_handler(void* arg, esp_event_base_t event_base,
-                                int32_t event_id, void* event_data)
-{
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < ESP_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "Retry connecting to WiFi (%d/%d)", s_retry_num, ESP_MAXIMUM_RETRY);
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        ESP_LOGI(TAG, "Got IP Address: " IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-    }
-}
-
-// WiFi init
-static void wifi_init_sta(void)
-{
-    s_wifi_event_group = xEventGroupCreate();
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = ESP_WIFI_SSID,
-            .password = ESP_WIFI_PASS,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-        },
-    };
-    
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-
-    ESP_LOGI(TAG, "WiFi connecting to %s...", ESP_WIFI_SSID);
-
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-            pdFALSE,
-            pdFALSE,
-            portMAX_DELAY);
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to WiFi");
-    } else {
-        ESP_LOGI(TAG, "Failed to connect to WiFi");
-    }
-}
-
+#if !CONFIG_CAMERA_BENCH
 // Camera init
 static esp_err_t init_camera(void)
 {
@@ -153,219 +154,705 @@ static esp_err_t init_camera(void)
         return err;
     }
     
+    // Image tuning is a profile: only settings that differ from the
+    // driver's defaults are written
     sensor_t *s = esp_camera_sensor_get();
-    // Initial settings
-    s->set_brightness(s, 3);
-    s->set_contrast(s, 0);
-    s->set_saturation(s, 0);
-    s->set_sharpness(s, 3);
-    s->set_whitebal(s, 1);
-    s->set_awb_gain(s, 1);
-    s->set_wb_mode(s, 0);
-    s->set_exposure_ctrl(s, 1);
-    s->set_aec2(s, 0);
-    s->set_ae_level(s, 0);
-    s->set_aec_value(s, 300);
-    s->set_gain_ctrl(s, 1);
-    s->set_agc_gain(s, 0);
-    s->set_gainceiling(s, (gainceiling_t)0);
-    s->set_bpc(s, 0);
-    s->set_wpc(s, 1);
-    s->set_raw_gma(s, 1);
-    s->set_lenc(s, 1);
-    s->set_hmirror(s, 0);
-    s->set_vflip(s, 0);
-    s->set_dcw(s, 1);
-    s->set_colorbar(s, 0);
-
-    // CRITICAL: Better exposure for dark scenes
-    s->set_exposure_ctrl(s, 1);     // Enable auto-exposure
-    s->set_aec2(s, 1);              // Enable advanced exposure control
-    s->set_ae_level(s, 2);          // Increase exposure level (range: -2 to 2)
-    s->set_aec_value(s, 600);       // Longer exposure time (default: 300)
-    
-    // Better gain for low light
-    s->set_gain_ctrl(s, 1);         // Enable auto gain
-    s->set_agc_gain(s, 15);         // Increase gain (range: 0-30)
-    s->set_gainceiling(s, GAINCEILING_128X);  // Higher gain ceiling
-    
-    // White balance for better colors
-    s->set_whitebal(s, 1);          // Enable auto white balance
-    s->set_awb_gain(s, 1);          // Enable AWB gain
-    
-    // Other improvements
-    s->set_lenc(s, 1);              // Enable lens correction
-    s->set_raw_gma(s, 1);           // Enable gamma correction
-    s->set_dcw(s, 1);               // Enable downsize
+    sensor_profile_apply(s, sensor_profile_find(CAMERA_PROFILE), NULL);
+    if (sensor_window_init(s) != ESP_OK) {
+        ESP_LOGI(TAG, "No sensor windowing (needs OV3660/OV5640 and JPEG), ?roi= disabled");
+    }
     
     ESP_LOGI(TAG, "✓ Camera initialized");
     return ESP_OK;
 }
+#endif
 
 
-#if 1
+// /profile lists the sensor profiles, /profile?name=X switches to one
+static esp_err_t profile_handler(httpd_req_t *req)
+{
+    char query[64];
+    char name[24];
+    char body[256];
+    size_t n = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "name", name, sizeof(name)) == ESP_OK) {
+        const sensor_profile_t *p = sensor_profile_find(name);
+        if (!p) {
+            return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such profile");
+        }
+        sensor_profile_result_t res;
+        esp_err_t err = sensor_profile_switch(p, pdMS_TO_TICKS(PROFILE_SWITCH_TIMEOUT_MS), &res);
+        if (err == ESP_ERR_INVALID_STATE) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No sensor to tune");
+        }
+        if (err == ESP_ERR_TIMEOUT) {
+            httpd_resp_set_status(req, "202 Accepted");
+            return httpd_resp_send(req, "Switch pending\n", HTTPD_RESP_USE_STRLEN);
+        }
+        n = snprintf(body, sizeof(body), "%s: %d settings changed in %lld us%s\n",
+                     p->name, res.writes, (long long)res.apply_us,
+                     err == ESP_OK ? "" : ", some rejected");
+    } else {
+        const sensor_profile_t *current = sensor_profile_current();
+        for (size_t i = 0; i < sensor_profile_count() && n < sizeof(body); i++) {
+            const sensor_profile_t *p = sensor_profile_get(i);
+            n += snprintf(body + n, sizeof(body) - n, "%s%s\n", p->name,
+                          p == current ? " *" : "");
+        }
+    }
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_send(req, body, n < sizeof(body) ? n : sizeof(body) - 1);
+}
+
+// Per-client frame rate: ?fps=N overrides CONFIG_STREAM_TARGET_FPS
+static int stream_target_fps(httpd_req_t *req)
+{
+    char query[64];
+    char value[8];
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "fps", value, sizeof(value)) == ESP_OK) {
+        int fps = atoi(value);
+        if (fps >= 0 && fps <= 60) {
+            return fps;
+        }
+    }
+    return CONFIG_STREAM_TARGET_FPS;
+}
+
+// ?scale=N picks a downscaled stream. NULL for a scale that is not served.
+static frame_hub_t *stream_source(httpd_req_t *req)
+{
+    char query[64];
+    char value[8];
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "scale", value, sizeof(value)) == ESP_OK &&
+        atoi(value) != 1) {
+#if CONFIG_STREAM_SCALED
+        return frame_scaler_hub(atoi(value));
+#else
+        return NULL;
+#endif
+    }
+    return s_frame_hub;
+}
+
+// ?roi=x,y,w,h narrows the sensor window for every viewer, ?roi=full
+// widens it again. Returns why the request is bad, NULL if it is not.
+static const char *stream_window(httpd_req_t *req)
+{
+    char query[128];
+    char value[32];
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "roi", value, sizeof(value)) != ESP_OK) {
+        return NULL;
+    }
+    sensor_roi_t roi = { 0 };
+    if (strcmp(value, "full") != 0 &&
+        sscanf(value, "%d,%d,%d,%d", &roi.x, &roi.y, &roi.width, &roi.height) != 4) {
+        return "roi must be x,y,w,h or full";
+    }
+
+    sensor_window_result_t res;
+    esp_err_t err = sensor_window_set(&roi, pdMS_TO_TICKS(PROFILE_SWITCH_TIMEOUT_MS), &res);
+    switch (err) {
+    case ESP_OK:
+    case ESP_ERR_TIMEOUT:           // Applied once the sensor wakes up
+        return NULL;
+    case ESP_ERR_INVALID_ARG:
+        return "roi outside the frame or smaller than 64x64";
+    case ESP_ERR_INVALID_STATE:
+        return "This sensor cannot be windowed";
+    default:
+        return "Sensor rejected the window";
+    }
+}
+
+static esp_err_t stream_bad_scale(httpd_req_t *req)
+{
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "scale must be 1, 2, 4 or 8");
+}
+
+// Driver timestamps come from esp_timer, so age is relative to boot time
+static int64_t frame_age_us(const hub_frame_t *frame)
+{
+    int64_t captured = (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+    return esp_timer_get_time() - captured;
+}
+
+static esp_err_t stream_reject(httpd_req_t *req)
+{
+    ESP_LOGW(TAG, "Stream rejected, %d clients already connected", CONFIG_STREAM_MAX_CLIENTS);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, "Too many viewers", HTTPD_RESP_USE_STRLEN);
+}
+
+#if CONFIG_STREAM_ASYNC_SENDER
+
+// Hand the stream to the sender pool so this httpd worker is free again
+static esp_err_t stream_handler(httpd_req_t *req)
+{
+    frame_hub_t *hub = stream_source(req);
+    if (!hub) {
+        return stream_bad_scale(req);
+    }
+    const char *bad = stream_window(req);
+    if (bad) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, bad);
+    }
+    esp_err_t err = stream_sender_attach(req, hub, stream_target_fps(req));
+    if (err == ESP_ERR_NO_MEM) {
+        return stream_reject(req);
+    }
+    return err;
+}
+
+// Same stream as WebSocket binary messages, paced by the client's acks
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    frame_hub_t *hub = stream_source(req);
+    if (!hub) {
+        return stream_bad_scale(req);
+    }
+    const char *bad = stream_window(req);
+    if (bad) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, bad);
+    }
+    esp_err_t err = stream_sender_attach_ws(req, hub, stream_target_fps(req));
+    if (err == ESP_ERR_INVALID_ARG) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "WebSocket upgrade expected");
+    }
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        httpd_resp_set_status(req, "426 Upgrade Required");
+        httpd_resp_set_hdr(req, "Sec-WebSocket-Version", "13");
+        return httpd_resp_send(req, "WebSocket version 13 required", HTTPD_RESP_USE_STRLEN);
+    }
+    if (err == ESP_ERR_NO_MEM) {
+        return stream_reject(req);
+    }
+    return err;
+}
+
+#else
+
+static esp_err_t stream_send_chunk(httpd_req_t *req, const char *buf, size_t len)
+{
+    int64_t start = esp_timer_get_time();
+    esp_err_t res = httpd_resp_send_chunk(req, buf, len);
+    metrics_observe(METRIC_SEND_CHUNK_US, esp_timer_get_time() - start);
+    return res;
+}
 
 static esp_err_t stream_handler(httpd_req_t *req)
 {
-    camera_fb_t *fb = NULL;
     esp_err_t res = ESP_OK;
-    char part_buf[128];
+    char part_buf[160];
+    frame_pacer_t pacer;
+
+    frame_hub_t *hub = stream_source(req);
+    if (!hub) {
+        return stream_bad_scale(req);
+    }
+    const char *bad = stream_window(req);
+    if (bad) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, bad);
+    }
+    frame_sub_t *sub = frame_hub_subscribe(hub);
+    if (!sub) {
+        return stream_reject(req);
+    }
 
     // Set content type AND additional headers for Chrome
-    httpd_resp_set_type(req, "multipart/x-mixed-replace; boundary=frame");
+    httpd_resp_set_type(req, MJPEG_CONTENT_TYPE);
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    httpd_resp_set_hdr(req, "X-Framerate", "30");
-    
-    ESP_LOGI(TAG, "Stream started");  // Add logging
+
+    int target_fps = stream_target_fps(req);
+    frame_pacer_init(&pacer, target_fps);
+#if CONFIG_STREAM_MOTION_GATE
+    uint32_t sent_scene = 0;
+    int64_t sent_us = 0;
+    bool sent_any = false;
+#endif
+    ESP_LOGI(TAG, "Stream started, target %d fps", target_fps);
 
     while (true) {
-        fb = esp_camera_fb_get();
-        if (!fb) {
+        frame_pacer_begin(&pacer, esp_timer_get_time());
+        hub_frame_t *frame = frame_hub_wait(sub, pdMS_TO_TICKS(STREAM_FRAME_TIMEOUT_MS));
+        if (!frame) {
             ESP_LOGE(TAG, "Camera capture failed");
+            res = ESP_FAIL;
             break;
         }
 
-        if (fb->format != PIXFORMAT_JPEG) {
+        if (frame->format != PIXFORMAT_JPEG) {
             ESP_LOGE(TAG, "Non-JPEG format");
-            esp_camera_fb_return(fb);
+            frame_hub_release(frame);
+            res = ESP_FAIL;
             break;
         }
 
-        size_t hlen = snprintf(part_buf, 128,
-                             "Content-Type: image/jpeg\r\n"
-                             "Content-Length: %u\r\n"
-                             "\r\n",
-                             fb->len);
-        
-        res = httpd_resp_send_chunk(req, part_buf, hlen);
+#if CONFIG_STREAM_MOTION_GATE
+        // Same picture the client already has: skip unless a refresh is due
+        int64_t now = esp_timer_get_time();
+        if (sent_any && frame->scene == sent_scene &&
+            now - sent_us < CONFIG_STREAM_MOTION_REFRESH_MS * 1000LL) {
+            metrics_inc(METRIC_FRAMES_UNCHANGED);
+            metrics_add(METRIC_BYTES_SUPPRESSED, frame->len);
+            frame_hub_release(frame);
+            continue;
+        }
+        sent_scene = frame->scene;
+        sent_us = now;
+        sent_any = true;
+#endif
+        frame_pacer_captured(&pacer, esp_timer_get_time());
+
+        int64_t offset = clock_sync_offset_us();
+        mjpeg_part_meta_t meta = {
+            .seq = frame->seq,
+            .timestamp_us = (int64_t)frame->timestamp.tv_sec * 1000000 +
+                            frame->timestamp.tv_usec + offset,
+            .clock_offset_us = offset,
+        };
+        size_t hlen = mjpeg_part_head(part_buf, sizeof(part_buf), frame->len, &meta);
+
+        res = stream_send_chunk(req, part_buf, hlen);
         if (res == ESP_OK) {
-            res = httpd_resp_send_chunk(req, (const char *)fb->buf, fb->len);
+            res = stream_send_chunk(req, (const char *)frame->buf, frame->len);
         }
         if (res == ESP_OK) {
-            res = httpd_resp_send_chunk(req, "\r\n--frame\r\n", 14);
+            res = stream_send_chunk(req, MJPEG_PART_DELIM, MJPEG_PART_DELIM_LEN);
         }
 
-        esp_camera_fb_return(fb);
+        size_t part_len = hlen + frame->len + MJPEG_PART_DELIM_LEN;
+        int64_t age_us = frame_age_us(frame);
+        frame_hub_release(frame);
 
         if (res != ESP_OK) {
             ESP_LOGE(TAG, "Stream send failed");
             break;
         }
-        
-        vTaskDelay(pdMS_TO_TICKS(30));
+        int64_t send_us = esp_timer_get_time() - pacer.captured_us;
+        metrics_inc(METRIC_FRAMES_SENT);
+        metrics_add(METRIC_BYTES_SENT, part_len);
+        metrics_observe(METRIC_FRAME_SEND_US, send_us);
+        metrics_observe(METRIC_STREAM_FRAME_AGE_US, age_us);
+        camera_capture_report_send(part_len, send_us);
+
+        // Sleep only what is left of this frame's budget
+        int64_t delay_us = frame_pacer_end(&pacer, esp_timer_get_time());
+        if (delay_us > 0) {
+            vTaskDelay(pdMS_TO_TICKS((delay_us + 999) / 1000));
+        }
     }
 
-    ESP_LOGI(TAG, "Stream ended");
+    ESP_LOGI(TAG, "Stream ended, %lu frames dropped, budget %lu mfps",
+             (unsigned long)frame_hub_dropped(sub), (unsigned long)frame_pacer_budget_mfps(&pacer));
+    frame_hub_unsubscribe(sub);
     return res;
 }
 
-#else
+#endif
 
-static esp_err_t stream_handler(httpd_req_t *req)
+// Snapshot source: the latest frame if it is fresh enough, otherwise
+// subscribe just long enough to receive a fresh one.
+static hub_frame_t *capture_get_frame(void)
 {
-    ESP_LOGI(TAG, "Stream request started");  // ADD THIS
-    
-    camera_fb_t *fb = NULL;
-    esp_err_t res = ESP_OK;
-    char part_buf[64];
+    const int64_t max_age_us = (int64_t)CONFIG_CAPTURE_MAX_AGE_MS * 1000;
+
+    hub_frame_t *frame = frame_hub_latest(s_frame_hub);
+    if (frame && frame_age_us(frame) <= max_age_us) {
+        return frame;
+    }
 
-    httpd_resp_set_type(req, "multipart/x-mixed-replace; boundary=frame");
+    frame_sub_t *sub = frame_hub_subscribe(s_frame_hub);
+    if (!sub) {
+        return frame;               // Hub is full: stale beats nothing
+    }
 
-    int frame_count = 0;  // ADD THIS
-    
-    while (true) {
-        fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGE(TAG, "Capture failed");
+    // The driver may still hold frames from before it went idle; skip them
+    int64_t deadline = esp_timer_get_time() + STREAM_FRAME_TIMEOUT_MS * 1000;
+    while (esp_timer_get_time() < deadline) {
+        hub_frame_t *fresh = frame_hub_wait(sub, pdMS_TO_TICKS(STREAM_FRAME_TIMEOUT_MS));
+        if (!fresh) {
             break;
         }
-
-        frame_count++;  // ADD THIS
-        if (frame_count % 10 == 0) {  // ADD THIS
-            ESP_LOGI(TAG, "Streamed %d frames", frame_count);
-        }
-
-        size_t hlen = snprintf(part_buf, 64,
-                             "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
-                             fb->len);
-        
-        res = httpd_resp_send_chunk(req, part_buf, hlen);
-        if (res == ESP_OK) {
-            res = httpd_resp_send_chunk(req, (const char *)fb->buf, fb->len);
+        if (frame) {
+            frame_hub_release(frame);
         }
-        if (res == ESP_OK) {
-            res = httpd_resp_send_chunk(req, "\r\n--frame\r\n", 14);
+        frame = fresh;
+        if (frame_age_us(frame) <= max_age_us) {
+            break;
         }
+    }
+    frame_hub_unsubscribe(sub);
+    return frame;
+}
 
-        esp_camera_fb_return(fb);
+// Parse an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT"), the only form
+// Last-Modified is sent in. newlib has no timegm(), so days are counted
+// from the civil date directly.
+static bool http_date_parse(const char *s, time_t *out)
+{
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char mon[4];
+    int d, y, hh, mm, ss;
 
-        if (res != ESP_OK) {
-            ESP_LOGE(TAG, "Stream failed at frame %d", frame_count);  // ADD THIS
-            break;
-        }
-        
-        vTaskDelay(pdMS_TO_TICKS(30));
+    if (sscanf(s, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &d, mon, &y, &hh, &mm, &ss) != 6) {
+        return false;
+    }
+    const char *m = strstr(months, mon);
+    if (!m || strlen(mon) != 3 || (m - months) % 3 || d < 1 || d > 31 || y < 1970) {
+        return false;
     }
+    int month = (m - months) / 3 + 1;
+    // Days since 1970-01-01, counting years from March so the leap day
+    // comes last
+    int yy = y - (month <= 2);
+    int era_day = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t days = (int64_t)yy * 365 + yy / 4 - yy / 100 + yy / 400 + era_day - 719468;
+    *out = (time_t)(days * 86400 + hh * 3600 + mm * 60 + ss);
+    return true;
+}
+
+// Snapshot handler with ETag / Last-Modified revalidation
+static esp_err_t capture_handler(httpd_req_t *req)
+{
+    char etag[32];
+    char last_modified[32];
+    char cond[48];
 
-    ESP_LOGI(TAG, "Stream ended");  // ADD THIS
+    hub_frame_t *frame = capture_get_frame();
+    if (!frame) {
+        ESP_LOGE(TAG, "Camera capture failed");
+        return httpd_resp_send_500(req);
+    }
+    if (frame->format != PIXFORMAT_JPEG) {
+        ESP_LOGE(TAG, "Non-JPEG format");
+        frame_hub_release(frame);
+        return httpd_resp_send_500(req);
+    }
+
+    snprintf(etag, sizeof(etag), "\"%08lx-%lu\"",
+             (unsigned long)s_boot_id, (unsigned long)frame->seq);
+
+    time_t modified = (time_t)(frame->wall_us / 1000000);
+    struct tm tm;
+    gmtime_r(&modified, &tm);
+    strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Last-Modified", last_modified);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    bool unchanged = false;
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", cond, sizeof(cond)) == ESP_OK) {
+        unchanged = strcmp(cond, etag) == 0;
+    } else if (httpd_req_get_hdr_value_str(req, "If-Modified-Since", cond, sizeof(cond)) == ESP_OK) {
+        time_t since;
+        unchanged = http_date_parse(cond, &since) && modified <= since;
+    }
+
+    esp_err_t res;
+    if (unchanged) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        res = httpd_resp_send(req, NULL, 0);
+    } else {
+        httpd_resp_set_type(req, "image/jpeg");
+        httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+        res = httpd_resp_send(req, (const char *)frame->buf, frame->len);
+    }
+
+    frame_hub_release(frame);
     return res;
 }
 
-//#else
+// Stage load and light sleep, per mille of the time since the last scrape
+static void load_metrics(void)
+{
+    static int64_t last_us;
+    int64_t now = esp_timer_get_time();
+    int64_t period = now - last_us;
+    last_us = now;
 
-// Stream handler
-static esp_err_t stream_handler(httpd_req_t *req)
+    camera_capture_stats_t st;
+    camera_capture_take_stats(&st);
+
+    metrics_add(METRIC_PIPELINE_REFUSED, st.process.refused);
+    metrics_set(METRIC_PIPELINE_QUEUE_MAX, st.process.max_depth);
+    if (period > 0) {
+        metrics_set(METRIC_PIPELINE_CAPTURE_LOAD, st.capture_busy_us * 1000 / period);
+        metrics_set(METRIC_PIPELINE_PROCESS_LOAD, st.process.busy_us * 1000 / period);
+#if CONFIG_STREAM_ASYNC_SENDER
+        uint64_t send_us = stream_sender_take_busy_us() / CONFIG_STREAM_SENDER_TASKS;
+        metrics_set(METRIC_PIPELINE_SEND_LOAD, send_us * 1000 / period);
+#endif
+        metrics_set(METRIC_LIGHT_SLEEP_LOAD, power_take_light_sleep_us() * 1000 / period);
+    }
+}
+
+// Prometheus scrape endpoint
+static esp_err_t metrics_handler(httpd_req_t *req)
 {
-    camera_fb_t *fb = NULL;
-    esp_err_t res = ESP_OK;
-    char part_buf[64];
+    load_metrics();
+    metrics_set(METRIC_HEAP_INTERNAL_FREE, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    metrics_set(METRIC_HEAP_INTERNAL_MIN_FREE, heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    metrics_set(METRIC_HEAP_PSRAM_FREE, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    metrics_set(METRIC_HEAP_PSRAM_MIN_FREE, heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+    int64_t viewers = (int64_t)frame_hub_subscriber_count(s_frame_hub) - HUB_INTERNAL_SUBSCRIBERS;
+#if CONFIG_RTSP_SERVER
+    viewers -= (int64_t)rtsp_server_session_count();
+#endif
+#if CONFIG_BURST_CAPTURE
+    viewers -= burst_subscribed() ? HUB_BURST_SUBSCRIBERS : 0;
+#endif
+#if CONFIG_STREAM_SCALED
+    size_t scaled = frame_scaler_viewers();
+    viewers += (int64_t)scaled - (scaled ? HUB_SCALER_SUBSCRIBERS : 0);
+#endif
+    metrics_set(METRIC_STREAM_CLIENTS, viewers);
 
-    httpd_resp_set_type(req, "multipart/x-mixed-replace; boundary=frame");
+    size_t len = metrics_format(NULL, 0) + 1;
+    char *buf = heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) {
+        return httpd_resp_send_500(req);
+    }
+    len = metrics_format(buf, len);
 
-    while (true) {
-        fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGE(TAG, "Camera capture failed");
-            httpd_resp_send_500(req);
-            return ESP_FAIL;
-        }
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t res = httpd_resp_send(req, buf, len);
+    heap_caps_free(buf);
+    return res;
+}
 
-        if (fb->format != PIXFORMAT_JPEG) {
-            ESP_LOGE(TAG, "Non-JPEG frame");
-            esp_camera_fb_return(fb);
-            httpd_resp_send_500(req);
-            return ESP_FAIL;
-        }
+#if CONFIG_PREEVENT_RECORDER
+// Trigger: download the frames recorded before this request
+static esp_err_t preevent_handler(httpd_req_t *req)
+{
+    return preevent_export(req);
+}
+#endif
 
-        size_t hlen = snprintf(part_buf, 64,
-                             "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
-                             fb->len);
-        
-        res = httpd_resp_send_chunk(req, part_buf, hlen);
-        if (res == ESP_OK) {
-            res = httpd_resp_send_chunk(req, (const char *)fb->buf, fb->len);
-        }
-        if (res == ESP_OK) {
-            res = httpd_resp_send_chunk(req, "\r\n--frame\r\n", 14);
-        }
+#if CONFIG_BURST_CAPTURE
+// N frames in a row, sent once all are taken
+static esp_err_t burst_handler(httpd_req_t *req)
+{
+    return burst_capture(req);
+}
+#endif
 
-        esp_camera_fb_return(fb);
+#if CONFIG_CAMERA_BENCH
+// Report labels, by the driver's enum values
+static const char *const s_bench_sizes[FRAMESIZE_INVALID] = {
+    [FRAMESIZE_QQVGA] = "QQVGA", [FRAMESIZE_QVGA] = "QVGA", [FRAMESIZE_CIF] = "CIF",
+    [FRAMESIZE_HVGA] = "HVGA", [FRAMESIZE_VGA] = "VGA", [FRAMESIZE_SVGA] = "SVGA",
+    [FRAMESIZE_XGA] = "XGA", [FRAMESIZE_HD] = "HD", [FRAMESIZE_SXGA] = "SXGA",
+    [FRAMESIZE_UXGA] = "UXGA", [FRAMESIZE_FHD] = "FHD", [FRAMESIZE_QXGA] = "QXGA",
+};
+static const char *const s_bench_grab[] = {
+    [CAMERA_GRAB_WHEN_EMPTY] = "empty",
+    [CAMERA_GRAB_LATEST] = "latest",
+};
+static camera_bench_t *s_bench;
 
-        if (res != ESP_OK) {
-            break;
+// Same pins and profile as streaming, only the settings under test differ
+static int bench_setup(const camera_bench_point_t *p, void *arg)
+{
+    camera_config_t cfg = camera_config;
+    cfg.frame_size = p->frame_size;
+    cfg.jpeg_quality = p->jpeg_quality;
+    cfg.xclk_freq_hz = p->xclk_hz;
+    cfg.fb_count = p->fb_count;
+    cfg.grab_mode = p->grab_mode;
+
+    esp_camera_deinit();
+    ESP_LOGI(TAG, "Bench: %s q%d %d MHz fb_count %d %s", s_bench_sizes[p->frame_size],
+             p->jpeg_quality, p->xclk_hz / 1000000, p->fb_count, s_bench_grab[p->grab_mode]);
+    esp_err_t err = esp_camera_init(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Bench: camera init failed: 0x%x", err);
+        return err;
+    }
+    sensor_profile_apply(esp_camera_sensor_get(), sensor_profile_find(CAMERA_PROFILE), NULL);
+    return ESP_OK;
+}
+
+static bool bench_frame(void *arg, size_t *len)
+{
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (!fb) {
+        return false;
+    }
+    *len = fb->len;
+    esp_camera_fb_return(fb);
+    return true;
+}
+
+static void bench_sample(void *arg, camera_bench_sample_t *s)
+{
+    s->no_eoi = metrics_counter(METRIC_NO_EOI);
+    s->fb_ovf = metrics_counter(METRIC_FB_OVF);
+    s->internal_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    s->psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+
+static void bench_finish(void *arg)
+{
+    esp_camera_deinit();
+    ESP_LOGI(TAG, "Bench: done, report at /bench");
+}
+
+static void bench_task(void *arg)
+{
+    camera_bench_run(s_bench);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t bench_start(void)
+{
+    camera_bench_config_t cfg = {
+        .frame_size_names = s_bench_sizes,
+        .frame_size_name_count = FRAMESIZE_INVALID,
+        .grab_mode_names = s_bench_grab,
+        .grab_mode_name_count = sizeof(s_bench_grab) / sizeof(s_bench_grab[0]),
+        .warmup_us = CONFIG_CAMERA_BENCH_WARMUP_S * 1000000LL,
+        .measure_us = CONFIG_CAMERA_BENCH_MEASURE_S * 1000000LL,
+        .max_failures = 3,
+        .setup = bench_setup,
+        .frame = bench_frame,
+        .sample = bench_sample,
+        .finish = bench_finish,
+        .clock_us = esp_timer_get_time,
+    };
+    if (!camera_bench_parse_axis(CONFIG_CAMERA_BENCH_FRAMESIZES, s_bench_sizes,
+                                 FRAMESIZE_INVALID, &cfg.frame_size) ||
+        !camera_bench_parse_axis(CONFIG_CAMERA_BENCH_QUALITIES, NULL, 0, &cfg.jpeg_quality) ||
+        !camera_bench_parse_axis(CONFIG_CAMERA_BENCH_XCLK_MHZ, NULL, 0, &cfg.xclk_hz) ||
+        !camera_bench_parse_axis(CONFIG_CAMERA_BENCH_FB_COUNTS, NULL, 0, &cfg.fb_count) ||
+        !camera_bench_parse_axis(CONFIG_CAMERA_BENCH_GRAB_MODES, s_bench_grab,
+                                 cfg.grab_mode_name_count, &cfg.grab_mode)) {
+        ESP_LOGE(TAG, "Bench: bad setting list");
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < cfg.xclk_hz.count; i++) {
+        cfg.xclk_hz.values[i] *= 1000000;
+    }
+
+    s_bench = camera_bench_create(&cfg);
+    if (!s_bench) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Bench: %u combinations, about %u s", (unsigned)s_bench->points,
+             (unsigned)(s_bench->points * (CONFIG_CAMERA_BENCH_WARMUP_S + CONFIG_CAMERA_BENCH_MEASURE_S + 1)));
+    int core = CONFIG_PIPELINE_CAPTURE_CORE < 0 ? tskNO_AFFINITY : CONFIG_PIPELINE_CAPTURE_CORE;
+    if (xTaskCreatePinnedToCore(bench_task, "cam_bench", 4096, NULL, CONFIG_PIPELINE_CAPTURE_PRIO,
+                                NULL, core) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// Benchmark report so far: CSV, or JSON with ?format=json
+static esp_err_t bench_handler(httpd_req_t *req)
+{
+    char query[32];
+    char value[8];
+    char progress[24];
+    camera_bench_format_t fmt = CAMERA_BENCH_CSV;
+
+    if (!s_bench) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Benchmark not running");
+    }
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK &&
+        strcmp(value, "json") == 0) {
+        fmt = CAMERA_BENCH_JSON;
+    }
+
+    // A row may finish between sizing and formatting; size again then
+    char *buf = NULL;
+    size_t len = 0;
+    size_t need;
+    while ((need = camera_bench_format(s_bench, fmt, buf, len)) >= len) {
+        heap_caps_free(buf);
+        len = need + 1;
+        buf = heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!buf) {
+            return httpd_resp_send_500(req);
         }
-        
-        // Small delay to prevent overload
-        vTaskDelay(pdMS_TO_TICKS(30));
     }
 
+    snprintf(progress, sizeof(progress), "%u/%u", (unsigned)camera_bench_done(s_bench),
+             (unsigned)s_bench->points);
+    httpd_resp_set_hdr(req, "X-Bench-Progress", progress);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    if (fmt == CAMERA_BENCH_JSON) {
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=bench.json");
+    } else {
+        httpd_resp_set_type(req, "text/csv");
+        httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=bench.csv");
+    }
+    esp_err_t res = httpd_resp_send(req, buf, need);
+    heap_caps_free(buf);
     return res;
 }
 #endif
 
+// Count camera driver overflow / truncation warnings as they are logged
+static vprintf_like_t s_log_vprintf;
+
+static int log_metrics_hook(const char *fmt, va_list args)
+{
+    if (strstr(fmt, "FB-OVF")) {
+        metrics_inc(METRIC_FB_OVF);
+    } else if (strstr(fmt, "NO-EOI")) {
+        metrics_inc(METRIC_NO_EOI);
+    }
+    return s_log_vprintf(fmt, args);
+}
+
 // Index handler
 static esp_err_t index_handler(httpd_req_t *req)
 {
+#if CONFIG_STREAM_ASYNC_SENDER
+    // Frames arrive over /ws and are drawn to a canvas; each is acked once
+    // drawn. Latency is measured on the device, capture to ack.
+    const char *html =
+        "<!DOCTYPE html><html><head>"
+        "<meta name='viewport' content='width=device-width'>"
+        "<title>XIAO Camera</title>"
+        "<style>body{margin:0;text-align:center;background:#000;color:#fff;font-family:sans-serif}"
+        "canvas{max-width:100%;height:auto}</style>"
+        "</head><body>"
+        "<h1>XIAO ESP32S3 Camera</h1>"
+        "<canvas id='v'></canvas>"
+        "<p id='s'>connecting</p>"
+        "<script>"
+        "const c=document.getElementById('v'),g=c.getContext('2d'),s=document.getElementById('s');"
+        "let n=0,t=performance.now(),age=0,lat=0;"
+        "function go(){"
+        "const w=new WebSocket('ws://'+location.host+'/ws'+location.search);"
+        "w.binaryType='arraybuffer';"
+        "w.onmessage=async e=>{"
+        "const d=new DataView(e.data),q=d.getUint32(0);age=d.getUint32(4);lat=d.getUint32(8);"
+        "const b=await createImageBitmap(new Blob([new Uint8Array(e.data,12)],{type:'image/jpeg'}));"
+        "if(c.width!=b.width){c.width=b.width;c.height=b.height}"
+        "g.drawImage(b,0,0);b.close();n++;"
+        "if(w.readyState==1)w.send(String(q))};"
+        "w.onclose=()=>{s.textContent='reconnecting';setTimeout(go,1000)}}"
+        "setInterval(()=>{const m=performance.now();"
+        "s.textContent=(n*1000/(m-t)).toFixed(1)+' fps, latency '+(lat/1000).toFixed(0)+' ms (send at '+(age/1000).toFixed(0)+' ms)';"
+        "n=0;t=m},1000);"
+        "go();"
+        "</script>"
+        "</body></html>";
+#else
     const char *html = 
         "<!DOCTYPE html><html><head>"
         "<meta name='viewport' content='width=device-width'>"
@@ -376,16 +863,24 @@ static esp_err_t index_handler(httpd_req_t *req)
         "<h1 style='color:#fff'>XIAO ESP32S3 Camera</h1>"
         "<img id='stream' src='/stream'>"
         "</body></html>";
+#endif
     
     return httpd_resp_send(req, html, HTTPD_RESP_USE_STRLEN);
 }
 
+// Boot timeline for startup benchmarking, in ms since reset
+static void boot_phase(const char *phase)
+{
+    ESP_LOGI(TAG, "Boot: %s at %lld ms", phase, (long long)(esp_timer_get_time() / 1000));
+}
+
 // Start server
 static void start_webserver(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
     config.ctrl_port = 32768;
+    config.max_uri_handlers = 12;
 
     if (httpd_start(&camera_httpd, &config) == ESP_OK) {
         httpd_uri_t index_uri = {
@@ -402,6 +897,63 @@ static void start_webserver(void)
         };
         httpd_register_uri_handler(camera_httpd, &stream_uri);
 
+#if CONFIG_STREAM_ASYNC_SENDER
+        httpd_uri_t ws_uri = {
+            .uri = "/ws",
+            .method = HTTP_GET,
+            .handler = ws_handler,
+        };
+        httpd_register_uri_handler(camera_httpd, &ws_uri);
+#endif
+
+        httpd_uri_t capture_uri = {
+            .uri = "/capture",
+            .method = HTTP_GET,
+            .handler = capture_handler,
+        };
+        httpd_register_uri_handler(camera_httpd, &capture_uri);
+
+        httpd_uri_t profile_uri = {
+            .uri = "/profile",
+            .method = HTTP_GET,
+            .handler = profile_handler,
+        };
+        httpd_register_uri_handler(camera_httpd, &profile_uri);
+
+        httpd_uri_t metrics_uri = {
+            .uri = "/metrics",
+            .method = HTTP_GET,
+            .handler = metrics_handler,
+        };
+        httpd_register_uri_handler(camera_httpd, &metrics_uri);
+
+#if CONFIG_PREEVENT_RECORDER
+        httpd_uri_t preevent_uri = {
+            .uri = "/preevent",
+            .method = HTTP_GET,
+            .handler = preevent_handler,
+        };
+        httpd_register_uri_handler(camera_httpd, &preevent_uri);
+#endif
+
+#if CONFIG_BURST_CAPTURE
+        httpd_uri_t burst_uri = {
+            .uri = "/burst",
+            .method = HTTP_GET,
+            .handler = burst_handler,
+        };
+        httpd_register_uri_handler(camera_httpd, &burst_uri);
+#endif
+
+#if CONFIG_CAMERA_BENCH
+        httpd_uri_t bench_uri = {
+            .uri = "/bench",
+            .method = HTTP_GET,
+            .handler = bench_handler,
+        };
+        httpd_register_uri_handler(camera_httpd, &bench_uri);
+#endif
+
         ESP_LOGI(TAG, "✓ Web server started");
     }
 }
@@ -412,6 +964,8 @@ void app_main(void)
     ESP_LOGI(TAG, "  XIAO ESP32S3 Camera Stream");
     ESP_LOGI(TAG, "========================================");
     
+    s_log_vprintf = esp_log_set_vprintf(log_metrics_hook);
+
     gpio_reset_pin(XIAO_LED_RGB_GPIO);
     gpio_set_direction(XIAO_LED_RGB_GPIO, GPIO_MODE_OUTPUT);
     
@@ -421,16 +975,120 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
-    
+
+#if !CONFIG_CAMERA_BENCH
+    // Benchmarks run at full speed, without light sleep
+    power_init();
+#endif
+
+    // Startup order follows the dependencies, not a fixed sequence: Wi-Fi
+    // associates in the background from here on, the servers come up
+    // without waiting for an address, and the camera initializes while
+    // the radio is still busy. Nothing waits for the link until the end.
+    ESP_ERROR_CHECK(wifi_sta_start(ESP_WIFI_SSID, ESP_WIFI_PASS));
+    boot_phase("Wi-Fi started");
+    if (CONFIG_CLOCK_SNTP_SERVER[0]) {
+        clock_sync_start(CONFIG_CLOCK_SNTP_SERVER);
+    }
+
+#if CONFIG_RECORDER_SD || CONFIG_CAMERA_SOURCE_REPLAY
+    if (sd_card_mount() != ESP_OK) {
+        ESP_LOGW(TAG, "No SD card");
+    }
+#endif
+
+    // Consumers subscribe before the first frame, so the servers can take
+    // clients as soon as there is a link
+    s_boot_id = esp_random();
+    s_frame_hub = frame_hub_create(CONFIG_STREAM_MAX_CLIENTS + HUB_RTSP_SUBSCRIBERS +
+                                   HUB_SCALER_SUBSCRIBERS + HUB_BURST_SUBSCRIBERS +
+                                   HUB_INTERNAL_SUBSCRIBERS,
+                                   CAMERA_CAPTURE_FRAMES_IN_FLIGHT);
+    if (!s_frame_hub) {
+        ESP_LOGE(TAG, "No memory for the frame hub!");
+        return;
+    }
+
+#if CONFIG_STREAM_ASYNC_SENDER
+    if (stream_sender_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Stream sender failed!");
+        return;
+    }
+#endif
+
+#if CONFIG_PREEVENT_RECORDER
+    if (preevent_start(s_frame_hub) != ESP_OK) {
+        ESP_LOGW(TAG, "Pre-event recorder not running");
+    }
+#endif
+
+#if CONFIG_BURST_CAPTURE
+    if (burst_start(s_frame_hub) != ESP_OK) {
+        ESP_LOGW(TAG, "Bursts not available");
+    }
+#endif
+
+#if CONFIG_RECORDER_SD
+    if (!sd_card_mounted() || recorder_start(s_frame_hub) != ESP_OK) {
+        ESP_LOGW(TAG, "SD recorder not running");
+    }
+#endif
+
+#if CONFIG_STREAM_SCALED
+    if (frame_scaler_start(s_frame_hub) != ESP_OK) {
+        ESP_LOGW(TAG, "Scaled streams not available");
+    }
+#endif
+
+    start_webserver();
+
+#if CONFIG_RTSP_SERVER
+    if (rtsp_server_start(s_frame_hub) != ESP_OK) {
+        ESP_LOGW(TAG, "RTSP server not running");
+    }
+#endif
+    boot_phase("Servers listening");
+
+#if CONFIG_CAMERA_BENCH
+    // The benchmark owns the camera; the servers only serve its report
+    if (bench_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Benchmark failed!");
+        return;
+    }
+    boot_phase("Benchmark running");
+#else
+#if CONFIG_CAMERA_SOURCE_REPLAY
+    frame_source_t *source = frame_source_replay_create(CONFIG_CAMERA_REPLAY_DIR,
+                                                        CONFIG_CAMERA_REPLAY_FPS);
+#else
     if (init_camera() != ESP_OK) {
         ESP_LOGE(TAG, "Camera failed!");
         return;
     }
-    
-    wifi_init_sta();
-    start_webserver();
-    
+    frame_source_t *source = frame_source_camera();
+#endif
+    if (!source) {
+        ESP_LOGE(TAG, "No frame source!");
+        return;
+    }
+    if (camera_capture_start(s_frame_hub, source) != ESP_OK) {
+        ESP_LOGE(TAG, "Capture task failed!");
+        return;
+    }
+    boot_phase("Capture running");
+#endif
+
+    // Reconnects after this are handled in the background
+    wifi_sta_wait_connected(portMAX_DELAY);
+    boot_phase("Ready");
     ESP_LOGI(TAG, "✓ Ready! Open browser to your IP");
+
+#if CONFIG_RECORDER_SD || CONFIG_CAMERA_SOURCE_REPLAY
+    // The SD card's chip select is the LED pin
+    if (sd_card_mounted()) {
+        return;
+    }
+#endif
     
     while (1) {
         gpio_set_level(XIAO_LED_RGB_GPIO, 1);
@@ -0,0 +1,46 @@
+/*
+ * Device clock sync - SNTP in smooth mode, wall/boot clock offset
+ */
+
+#include <stdatomic.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+
+#include "clock_sync.h"
+
+static const char *TAG = "CLOCK";
+
+static atomic_bool s_synced;
+
+static void on_sync(struct timeval *tv)
+{
+    if (!atomic_exchange(&s_synced, true)) {
+        ESP_LOGI(TAG, "Wall clock set over SNTP, offset to boot clock %lld us",
+                 (long long)clock_sync_offset_us());
+    }
+}
+
+esp_err_t clock_sync_start(const char *server)
+{
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, server);
+    sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
+    sntp_set_time_sync_notification_cb(on_sync);
+    esp_sntp_init();
+    ESP_LOGI(TAG, "Syncing wall clock from %s", server);
+    return ESP_OK;
+}
+
+bool clock_sync_done(void)
+{
+    return atomic_load(&s_synced);
+}
+
+int64_t clock_sync_offset_us(void)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_usec - esp_timer_get_time();
+}
@@ -0,0 +1,32 @@
+/*
+ * Device clock sync
+ *
+ * Frame timestamps come from esp_timer, which counts from boot. To tell a
+ * client when a frame was captured in terms it can compare with its own
+ * clock, the wall clock is synced over SNTP and the offset between the two
+ * is added to each timestamp.
+ *
+ * SNTP runs in smooth mode: after the first sync steps the wall clock,
+ * later corrections are slewed with adjtime(), so timestamps keep moving
+ * forward and the offset drifts by microseconds, not jumps.
+ */
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Start SNTP against server. Can be called before the network is up;
+// the first request goes out once there is a link.
+esp_err_t clock_sync_start(const char *server);
+
+// True once the wall clock has been set from the network
+bool clock_sync_done(void);
+
+// Wall clock minus esp_timer, in microseconds. Add it to an esp_timer
+// timestamp to get microseconds since the Unix epoch.
+int64_t clock_sync_offset_us(void);
+
+#endif // CLOCK_SYNC_H
@@ -0,0 +1,303 @@
+/*
+ * Frame hub - reference-counted fan-out of captured frames
+ */
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "frame_hub.h"
+#include "metrics.h"
+
+static const char *TAG = "FRAME_HUB";
+
+// Slots needed in the worst case: one frame held by every subscriber, the
+// latest published frame, the frames the producer is filling and one spare
+// for short-lived readers such as snapshot requests.
+#define HUB_EXTRA_SLOTS 2
+
+struct frame_sub {
+    frame_hub_t *hub;
+    SemaphoreHandle_t ready;        // Given when pending changes
+    hub_frame_t *pending;           // Latest frame not yet taken
+    TaskHandle_t notify;            // Optional task woken on publish
+    uint32_t dropped;
+    bool in_use;
+};
+
+struct frame_hub {
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t active;       // Given when a subscriber arrives
+    hub_frame_t *latest;
+    hub_frame_t *slots;
+    size_t slot_count;
+    frame_sub_t *subs;
+    size_t max_subs;
+    size_t sub_count;
+    uint32_t seq;
+};
+
+frame_hub_t *frame_hub_create(size_t max_subscribers, size_t producer_frames)
+{
+    frame_hub_t *hub = calloc(1, sizeof(*hub));
+    if (!hub) {
+        return NULL;
+    }
+
+    hub->max_subs = max_subscribers;
+    hub->slot_count = max_subscribers + producer_frames + HUB_EXTRA_SLOTS;
+    hub->slots = calloc(hub->slot_count, sizeof(hub_frame_t));
+    hub->subs = calloc(max_subscribers, sizeof(frame_sub_t));
+    hub->lock = xSemaphoreCreateMutex();
+    hub->active = xSemaphoreCreateBinary();
+    if (!hub->slots || !hub->subs || !hub->lock || !hub->active) {
+        goto fail;
+    }
+
+    for (size_t i = 0; i < hub->slot_count; i++) {
+        hub->slots[i].hub = hub;
+    }
+    for (size_t i = 0; i < max_subscribers; i++) {
+        hub->subs[i].hub = hub;
+        hub->subs[i].ready = xSemaphoreCreateBinary();
+        if (!hub->subs[i].ready) {
+            goto fail;
+        }
+    }
+    return hub;
+
+fail:
+    ESP_LOGE(TAG, "Out of memory creating hub");
+    if (hub->subs) {
+        for (size_t i = 0; i < max_subscribers; i++) {
+            if (hub->subs[i].ready) {
+                vSemaphoreDelete(hub->subs[i].ready);
+            }
+        }
+    }
+    if (hub->lock) {
+        vSemaphoreDelete(hub->lock);
+    }
+    if (hub->active) {
+        vSemaphoreDelete(hub->active);
+    }
+    free(hub->subs);
+    free(hub->slots);
+    free(hub);
+    return NULL;
+}
+
+// Caller holds hub->lock. A slot with no references is free for reuse.
+static void frame_unref_locked(hub_frame_t *frame)
+{
+    frame->refs--;
+}
+
+hub_frame_t *frame_hub_acquire(frame_hub_t *hub, size_t len)
+{
+    hub_frame_t *frame = NULL;
+
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    for (size_t i = 0; i < hub->slot_count; i++) {
+        if (hub->slots[i].refs == 0) {
+            frame = &hub->slots[i];
+            frame->refs = 1;
+            break;
+        }
+    }
+    xSemaphoreGive(hub->lock);
+
+    if (!frame) {
+        return NULL;
+    }
+
+    // Slots only grow, so after warm-up this never allocates. They start on
+    // a cache line so GDMA can copy them out.
+    if (frame->cap < len) {
+        heap_caps_free(frame->buf);
+        frame->cap = 0;
+        uint8_t *buf = heap_caps_aligned_alloc(64, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!buf) {
+            ESP_LOGE(TAG, "No PSRAM for %u byte frame", (unsigned)len);
+            frame_hub_discard(hub, frame);
+            return NULL;
+        }
+        frame->buf = buf;
+        frame->cap = len;
+    }
+    frame->len = 0;
+    return frame;
+}
+
+void frame_hub_discard(frame_hub_t *hub, hub_frame_t *frame)
+{
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    frame->refs = 0;
+    xSemaphoreGive(hub->lock);
+}
+
+void frame_hub_publish(frame_hub_t *hub, hub_frame_t *frame)
+{
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+
+    frame->seq = ++hub->seq;
+
+    // The producer's reference becomes the hub's "latest" reference.
+    if (hub->latest) {
+        frame_unref_locked(hub->latest);
+    }
+    hub->latest = frame;
+
+    for (size_t i = 0; i < hub->max_subs; i++) {
+        frame_sub_t *sub = &hub->subs[i];
+        if (!sub->in_use) {
+            continue;
+        }
+        if (sub->pending) {
+            frame_unref_locked(sub->pending);
+            sub->dropped++;
+            metrics_inc(METRIC_FRAMES_SUPERSEDED);
+        }
+        frame->refs++;
+        sub->pending = frame;
+        xSemaphoreGive(sub->ready);
+        if (sub->notify) {
+            xTaskNotifyGive(sub->notify);
+        }
+    }
+
+    xSemaphoreGive(hub->lock);
+}
+
+hub_frame_t *frame_hub_latest(frame_hub_t *hub)
+{
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    hub_frame_t *frame = hub->latest;
+    if (frame) {
+        frame->refs++;
+    }
+    xSemaphoreGive(hub->lock);
+    return frame;
+}
+
+bool frame_hub_wait_subscribers(frame_hub_t *hub, TickType_t timeout)
+{
+    if (frame_hub_subscriber_count(hub) > 0) {
+        return true;
+    }
+    xSemaphoreTake(hub->active, timeout);
+    return frame_hub_subscriber_count(hub) > 0;
+}
+
+size_t frame_hub_subscriber_count(frame_hub_t *hub)
+{
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    size_t count = hub->sub_count;
+    xSemaphoreGive(hub->lock);
+    return count;
+}
+
+frame_sub_t *frame_hub_subscribe(frame_hub_t *hub)
+{
+    frame_sub_t *sub = NULL;
+
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    for (size_t i = 0; i < hub->max_subs; i++) {
+        if (!hub->subs[i].in_use) {
+            sub = &hub->subs[i];
+            sub->in_use = true;
+            sub->pending = NULL;
+            sub->dropped = 0;
+            sub->notify = NULL;
+            xSemaphoreTake(sub->ready, 0);
+            hub->sub_count++;
+            break;
+        }
+    }
+    xSemaphoreGive(hub->lock);
+
+    if (sub) {
+        xSemaphoreGive(hub->active);
+    }
+    return sub;
+}
+
+void frame_hub_unsubscribe(frame_sub_t *sub)
+{
+    frame_hub_t *hub = sub->hub;
+
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    if (sub->pending) {
+        frame_unref_locked(sub->pending);
+        sub->pending = NULL;
+    }
+    sub->in_use = false;
+    hub->sub_count--;
+    xSemaphoreGive(hub->lock);
+}
+
+hub_frame_t *frame_hub_wait(frame_sub_t *sub, TickType_t timeout)
+{
+    frame_hub_t *hub = sub->hub;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t left = timeout;
+
+    // A publish between taking ready and taking the lock gives ready again
+    // for the frame this call then takes, so a wake-up can find nothing
+    // pending. Such a stale one is not a timeout: wait out the rest.
+    for (;;) {
+        if (xSemaphoreTake(sub->ready, left) != pdTRUE) {
+            return NULL;
+        }
+
+        xSemaphoreTake(hub->lock, portMAX_DELAY);
+        hub_frame_t *frame = sub->pending;  // Reference moves to the caller
+        sub->pending = NULL;
+        xSemaphoreGive(hub->lock);
+
+        if (frame) {
+            return frame;
+        }
+        if (timeout != portMAX_DELAY) {
+            TickType_t spent = xTaskGetTickCount() - start;
+            if (spent >= timeout) {
+                return NULL;
+            }
+            left = timeout - spent;
+        }
+    }
+}
+
+void frame_hub_set_notify(frame_sub_t *sub, TaskHandle_t task)
+{
+    frame_hub_t *hub = sub->hub;
+
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    sub->notify = task;
+    xSemaphoreGive(hub->lock);
+}
+
+uint32_t frame_hub_dropped(const frame_sub_t *sub)
+{
+    return sub->dropped;
+}
+
+void frame_hub_retain(hub_frame_t *frame)
+{
+    frame_hub_t *hub = frame->hub;
+
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    frame->refs++;
+    xSemaphoreGive(hub->lock);
+}
+
+void frame_hub_release(hub_frame_t *frame)
+{
+    frame_hub_t *hub = frame->hub;
+
+    xSemaphoreTake(hub->lock, portMAX_DELAY);
+    frame_unref_locked(frame);
+    xSemaphoreGive(hub->lock);
+}
@@ -0,0 +1,85 @@
+/*
+ * Frame hub - one producer, many subscribers
+ *
+ * The capture task publishes every frame into a hub. Frames are
+ * reference-counted and read-only once published. Each subscriber holds a
+ * single "pending" slot with latest-frame-wins semantics: if a subscriber is
+ * still busy with the previous frame, the older pending frame is dropped
+ * instead of stalling the producer or the other subscribers.
+ */
+
+#ifndef FRAME_HUB_H
+#define FRAME_HUB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sensor.h"
+
+typedef struct frame_hub frame_hub_t;
+typedef struct frame_sub frame_sub_t;
+
+typedef struct hub_frame {
+    uint8_t *buf;                   // Frame payload (read-only once published)
+    size_t len;                     // Payload length in bytes
+    size_t cap;                     // Allocated size of buf
+    size_t width;
+    size_t height;
+    pixformat_t format;
+    struct timeval timestamp;       // Capture time reported by the driver
+    int64_t wall_us;                // Same, on the wall clock, fixed at publish
+    uint32_t seq;                   // Publish sequence number, starts at 1
+    uint32_t scene;                 // Changes only when the picture does
+    int refs;                       // Owned by the hub lock
+    frame_hub_t *hub;
+} hub_frame_t;
+
+// Create a hub that serves up to max_subscribers concurrent subscribers.
+// producer_frames is how many acquired frames the producer may hold before
+// publishing them, normally 1.
+frame_hub_t *frame_hub_create(size_t max_subscribers, size_t producer_frames);
+
+// Producer side: take a free slot able to hold len bytes. The caller owns
+// the returned frame until it is passed to frame_hub_publish(). Returns NULL
+// when every slot is still referenced (the frame should be dropped).
+hub_frame_t *frame_hub_acquire(frame_hub_t *hub, size_t len);
+
+// Publish a frame obtained from frame_hub_acquire(). Ownership moves to the
+// hub; every subscriber is woken with the new frame as its pending frame.
+void frame_hub_publish(frame_hub_t *hub, hub_frame_t *frame);
+
+// Give back an acquired frame without publishing it.
+void frame_hub_discard(frame_hub_t *hub, hub_frame_t *frame);
+
+// Most recently published frame with a reference held for the caller, or
+// NULL before the first publish. Release with frame_hub_release().
+hub_frame_t *frame_hub_latest(frame_hub_t *hub);
+
+// Block until at least one subscriber exists. Returns false on timeout.
+bool frame_hub_wait_subscribers(frame_hub_t *hub, TickType_t timeout);
+
+size_t frame_hub_subscriber_count(frame_hub_t *hub);
+
+// Subscriber side. Returns NULL when the hub is full.
+frame_sub_t *frame_hub_subscribe(frame_hub_t *hub);
+void frame_hub_unsubscribe(frame_sub_t *sub);
+
+// Wait for the next frame newer than the last one returned to this
+// subscriber. The returned frame holds a reference that must be dropped with
+// frame_hub_release(). Returns NULL on timeout.
+hub_frame_t *frame_hub_wait(frame_sub_t *sub, TickType_t timeout);
+
+// Also send a task notification to task on every publish, so one task can
+// wait for several subscribers at once. Pass NULL to stop notifying.
+void frame_hub_set_notify(frame_sub_t *sub, TaskHandle_t task);
+
+// Frames published while this subscriber was busy and then superseded.
+uint32_t frame_hub_dropped(const frame_sub_t *sub);
+
+void frame_hub_retain(hub_frame_t *frame);
+void frame_hub_release(hub_frame_t *frame);
+
+#endif // FRAME_HUB_H
@@ -0,0 +1,76 @@
+/*
+ * Adaptive per-client frame pacing
+ */
+
+#include "frame_pacer.h"
+
+// EWMA weight 1/8
+#define PACER_EWMA_SHIFT    3
+// Never back off below 1 fps
+#define PACER_MAX_US        1000000
+// Sends slower than 7/8 of the budget count as lagging
+#define PACER_LAG_NUM       7
+#define PACER_LAG_DEN       8
+
+static int64_t ewma(int64_t avg, int64_t sample)
+{
+    if (avg == 0) {
+        return sample;
+    }
+    return avg + ((sample - avg) >> PACER_EWMA_SHIFT);
+}
+
+void frame_pacer_init(frame_pacer_t *p, int target_fps)
+{
+    *p = (frame_pacer_t){ 0 };
+    p->target_us = target_fps > 0 ? 1000000 / target_fps : 0;
+    p->max_us = PACER_MAX_US;
+    p->interval_us = p->target_us;
+}
+
+void frame_pacer_begin(frame_pacer_t *p, int64_t now_us)
+{
+    p->start_us = now_us;
+    p->captured_us = now_us;
+}
+
+void frame_pacer_captured(frame_pacer_t *p, int64_t now_us)
+{
+    p->captured_us = now_us;
+}
+
+int64_t frame_pacer_end(frame_pacer_t *p, int64_t now_us)
+{
+    int64_t capture_us = p->captured_us - p->start_us;
+    int64_t send_us = now_us - p->captured_us;
+
+    p->capture_avg_us = ewma(p->capture_avg_us, capture_us);
+    p->send_avg_us = ewma(p->send_avg_us, send_us);
+
+    if (p->target_us == 0) {
+        return 0;
+    }
+
+    if (p->send_avg_us * PACER_LAG_DEN > p->interval_us * PACER_LAG_NUM) {
+        // Link is falling behind: stretch the budget by 25%
+        p->interval_us += p->interval_us / 4;
+        if (p->interval_us > p->max_us) {
+            p->interval_us = p->max_us;
+        }
+    } else if (p->interval_us > p->target_us) {
+        // Recover gently, 1/16 of the excess per frame
+        int64_t step = (p->interval_us - p->target_us) / 16;
+        p->interval_us -= step > 0 ? step : p->interval_us - p->target_us;
+    }
+
+    int64_t remaining = p->interval_us - (now_us - p->start_us);
+    return remaining > 0 ? remaining : 0;
+}
+
+uint32_t frame_pacer_budget_mfps(const frame_pacer_t *p)
+{
+    if (p->interval_us == 0) {
+        return 0;
+    }
+    return (uint32_t)(1000000000LL / p->interval_us);
+}
@@ -0,0 +1,42 @@
+/*
+ * Adaptive per-client frame pacing
+ *
+ * Replaces a fixed sleep between frames. The pacer measures how long each
+ * frame took to obtain and to send, and sleeps only for what is left of the
+ * frame budget. When sends take longer than the budget the interval backs
+ * off multiplicatively; once the link recovers it creeps back towards the
+ * target. Pure C with caller-supplied timestamps, so it runs anywhere.
+ */
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <stdint.h>
+
+typedef struct {
+    int64_t target_us;          // Budget at the requested fps
+    int64_t max_us;             // Slowest interval backoff may reach
+    int64_t interval_us;        // Current budget, >= target_us
+    int64_t capture_avg_us;     // EWMA of time spent waiting for a frame
+    int64_t send_avg_us;        // EWMA of time spent sending a frame
+    int64_t start_us;           // Start of the current frame
+    int64_t captured_us;        // When the current frame became available
+} frame_pacer_t;
+
+// target_fps <= 0 disables pacing (frames go out as fast as they arrive).
+void frame_pacer_init(frame_pacer_t *p, int target_fps);
+
+// Mark the start of a frame cycle, before waiting for the frame.
+void frame_pacer_begin(frame_pacer_t *p, int64_t now_us);
+
+// Mark that the frame is available and sending starts.
+void frame_pacer_captured(frame_pacer_t *p, int64_t now_us);
+
+// Mark that the frame has been sent. Returns how long to sleep, in
+// microseconds, before starting the next cycle.
+int64_t frame_pacer_end(frame_pacer_t *p, int64_t now_us);
+
+// Current effective frame rate budget in milli-fps, for logging.
+uint32_t frame_pacer_budget_mfps(const frame_pacer_t *p);
+
+#endif // FRAME_PACER_H
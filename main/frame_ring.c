@@ -0,0 +1,166 @@
+/*
+ * Frame ring - contiguous records, oldest-first reclamation
+ */
+
+#include <string.h>
+
+#include "frame_ring.h"
+
+#define REC_ALIGN   8
+
+static inline size_t rec_size(size_t len)
+{
+    return (sizeof(frame_ring_rec_t) + len + REC_ALIGN - 1) & ~(size_t)(REC_ALIGN - 1);
+}
+
+static inline frame_ring_rec_t *rec_at(const frame_ring_t *r, size_t off)
+{
+    return (frame_ring_rec_t *)(r->arena + off);
+}
+
+// Offset of the record after the one at off
+static inline size_t rec_next(const frame_ring_t *r, size_t off)
+{
+    off += rec_at(r, off)->size;
+    if (r->wrapped && off == r->wrap_end) {
+        off = 0;
+    }
+    return off;
+}
+
+void frame_ring_init(frame_ring_t *r, void *arena, size_t size, int64_t max_age_us)
+{
+    memset(r, 0, sizeof(*r));
+    // Keep the arena end aligned so record headers always are
+    r->arena = arena;
+    r->size = size & ~(size_t)(REC_ALIGN - 1);
+    r->max_age_us = max_age_us;
+    r->next_seq = 1;
+}
+
+static bool evict_oldest(frame_ring_t *r)
+{
+    if (!r->count) {
+        return false;
+    }
+    frame_ring_rec_t *rec = rec_at(r, r->head);
+    if (r->pin && rec->seq >= r->pin) {
+        return false;
+    }
+
+    r->used -= rec->size;
+    r->count--;
+    r->head += rec->size;
+    if (r->wrapped && r->head == r->wrap_end) {
+        r->head = 0;
+        r->wrapped = false;
+    }
+    if (!r->count) {
+        r->head = r->tail = 0;
+        r->wrapped = false;
+    }
+    return true;
+}
+
+// Find room for need bytes, evicting as required. Returns false if the
+// pin is in the way.
+static bool make_room(frame_ring_t *r, size_t need)
+{
+    while (true) {
+        if (r->wrapped) {
+            if (r->head - r->tail >= need) {
+                return true;
+            }
+        } else {
+            if (r->size - r->tail >= need) {
+                return true;
+            }
+            // Not enough above the tail: continue at the bottom if the
+            // space below the oldest record is large enough
+            if (r->count && r->head >= need) {
+                r->wrap_end = r->tail;
+                r->tail = 0;
+                r->wrapped = true;
+                return true;
+            }
+        }
+        if (!evict_oldest(r)) {
+            return false;
+        }
+    }
+}
+
+uint32_t frame_ring_push(frame_ring_t *r, const void *data, size_t len,
+                         uint16_t width, uint16_t height, int64_t timestamp_us)
+{
+    size_t need = rec_size(len);
+    if (need > r->size) {
+        r->dropped++;
+        return 0;
+    }
+
+    while (r->max_age_us && r->count &&
+           rec_at(r, r->head)->timestamp_us < timestamp_us - r->max_age_us) {
+        if (!evict_oldest(r)) {
+            break;
+        }
+    }
+
+    if (!make_room(r, need)) {
+        r->dropped++;
+        return 0;
+    }
+
+    frame_ring_rec_t *rec = rec_at(r, r->tail);
+    *rec = (frame_ring_rec_t){
+        .size = need,
+        .len = len,
+        .seq = r->next_seq++,
+        .width = width,
+        .height = height,
+        .timestamp_us = timestamp_us,
+    };
+    memcpy(rec + 1, data, len);
+
+    r->tail += need;
+    r->used += need;
+    r->count++;
+    if (!r->next_seq) {
+        r->next_seq = 1;            // 0 means "none"
+    }
+    return rec->seq;
+}
+
+const frame_ring_rec_t *frame_ring_find(const frame_ring_t *r, uint32_t seq)
+{
+    size_t off = r->head;
+
+    for (size_t i = 0; i < r->count; i++) {
+        const frame_ring_rec_t *rec = rec_at(r, off);
+        if (rec->seq >= seq) {
+            return rec;
+        }
+        off = rec_next(r, off);
+    }
+    return NULL;
+}
+
+bool frame_ring_span(const frame_ring_t *r, uint32_t *first, uint32_t *last)
+{
+    if (!r->count) {
+        return false;
+    }
+    *first = rec_at(r, r->head)->seq;
+    *last = r->next_seq - 1 ? r->next_seq - 1 : UINT32_MAX;
+    return true;
+}
+
+void frame_ring_pin(frame_ring_t *r, uint32_t seq)
+{
+    r->pin = seq;
+}
+
+void frame_ring_unpin(frame_ring_t *r)
+{
+    r->pin = 0;
+}
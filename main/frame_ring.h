@@ -0,0 +1,71 @@
+/*
+ * Frame ring - variable-size frame records in one fixed arena
+ *
+ * Frames are copied into a caller-supplied arena as contiguous records
+ * (header + payload, 8-byte aligned). A record that does not fit before
+ * the end of the arena starts again at offset 0, so payloads are never
+ * split. Space is reclaimed strictly oldest-first, either to make room or
+ * because a record is older than max_age_us. No allocation after init, no
+ * fragmentation.
+ *
+ * A reader can pin a sequence number: records from there on are never
+ * evicted, and pushes that would need them fail instead. That lets an
+ * export send pinned payloads straight from the arena.
+ *
+ * Pure C and not thread-safe; callers serialize access.
+ */
+
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t size;                  // Whole record, header and padding
+    uint32_t len;                   // Payload bytes
+    uint32_t seq;
+    uint16_t width;
+    uint16_t height;
+    int64_t timestamp_us;
+} frame_ring_rec_t;
+
+typedef struct {
+    uint8_t *arena;
+    size_t size;
+    int64_t max_age_us;             // 0 = bounded by size only
+    size_t head;                    // Oldest record
+    size_t tail;                    // Next write position
+    size_t wrap_end;                // End of the upper part while wrapped
+    bool wrapped;                   // Records live in [head, wrap_end) + [0, tail)
+    size_t count;
+    size_t used;                    // Bytes held by records
+    uint32_t next_seq;
+    uint32_t pin;                   // 0 = nothing pinned
+    uint32_t dropped;               // Pushes refused (too big or pinned)
+} frame_ring_t;
+
+void frame_ring_init(frame_ring_t *r, void *arena, size_t size, int64_t max_age_us);
+
+// Copy a frame in, evicting the oldest records as needed. Returns its
+// sequence number (starting at 1), or 0 if it could not be stored.
+uint32_t frame_ring_push(frame_ring_t *r, const void *data, size_t len,
+                         uint16_t width, uint16_t height, int64_t timestamp_us);
+
+// Record with the lowest sequence number >= seq, or NULL.
+const frame_ring_rec_t *frame_ring_find(const frame_ring_t *r, uint32_t seq);
+
+// Oldest and newest stored sequence numbers; false when empty.
+bool frame_ring_span(const frame_ring_t *r, uint32_t *first, uint32_t *last);
+
+// Protect records >= seq from eviction until unpinned.
+void frame_ring_pin(frame_ring_t *r, uint32_t seq);
+void frame_ring_unpin(frame_ring_t *r);
+
+static inline const uint8_t *frame_ring_payload(const frame_ring_rec_t *rec)
+{
+    return (const uint8_t *)(rec + 1);
+}
+
+#endif // FRAME_RING_H
@@ -0,0 +1,215 @@
+/*
+ * Scaled streams - DCT-domain downscale and re-encode of captured frames
+ */
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "frame_scaler.h"
+#include "jpeg_dc.h"
+#include "jpeg_encoder.h"
+#include "metrics.h"
+
+static const char *TAG = "SCALER";
+
+#define SCALER_TASK_STACK   4096
+#define SCALER_TASK_PRIO    4
+// How often an idle scaler looks for viewers
+#define SCALER_IDLE_MS      100
+#define SCALER_LOG_FRAMES   100
+// Room for the JPEG headers on top of one byte per pixel
+#define SCALER_HEADER_ROOM  1024
+#define SCALE_COUNT         3
+
+typedef struct {
+    int scale;
+    frame_hub_t *hub;
+    uint32_t frames;                // Since the last log line
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+    uint64_t decode_us;
+    uint64_t encode_us;
+    bool rejected;                  // Logged that frames cannot be scaled
+} scaled_stream_t;
+
+static scaled_stream_t s_streams[SCALE_COUNT] = {
+    { .scale = 2 }, { .scale = 4 }, { .scale = 8 },
+};
+static frame_hub_t *s_source;
+static jpeg_encoder_t *s_encoder;
+static int s_encoder_width;
+static uint8_t *s_yuyv;             // Downscaled frame, PSRAM
+static size_t s_yuyv_cap;
+
+static void stream_log(scaled_stream_t *ss, int width, int height)
+{
+    uint32_t n = ss->frames;
+    unsigned long pct = ss->in_bytes ? (unsigned long)(ss->out_bytes * 100 / ss->in_bytes) : 0;
+    ESP_LOGI(TAG, "1/%d: %dx%d, decode %lu us, encode %lu us, %lu bytes/frame (%lu%% of full size)",
+             ss->scale, width, height, (unsigned long)(ss->decode_us / n),
+             (unsigned long)(ss->encode_us / n), (unsigned long)(ss->out_bytes / n), pct);
+    ss->frames = 0;
+    ss->in_bytes = ss->out_bytes = ss->decode_us = ss->encode_us = 0;
+}
+
+// Buffers grow to the largest scaled size seen, normally once
+static bool ensure_buffers(int width, int height)
+{
+    size_t raw = (size_t)width * height * 2;
+    if (raw > s_yuyv_cap) {
+        free(s_yuyv);
+        s_yuyv = heap_caps_malloc(raw, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        s_yuyv_cap = s_yuyv ? raw : 0;
+    }
+    if (width > s_encoder_width) {
+        jpeg_encoder_destroy(s_encoder);
+        jpeg_encoder_config_t cfg = {
+            .max_width = width,
+            .quality = CONFIG_STREAM_SCALE_QUALITY,
+        };
+        s_encoder = jpeg_encoder_create(&cfg);
+        s_encoder_width = s_encoder ? width : 0;
+    }
+    if (!s_yuyv || !s_encoder) {
+        ESP_LOGE(TAG, "No memory to scale to %dx%d", width, height);
+        return false;
+    }
+    return true;
+}
+
+static void scale_frame(scaled_stream_t *ss, const hub_frame_t *src)
+{
+    int width, height;
+    if (src->format != PIXFORMAT_JPEG ||
+        !jpeg_dc_scaled_size(src->buf, src->len, ss->scale, &width, &height)) {
+        if (!ss->rejected) {
+            ESP_LOGW(TAG, "Frames cannot be scaled by 1/%d", ss->scale);
+            ss->rejected = true;
+        }
+        return;
+    }
+    if (!ensure_buffers(width, height)) {
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    if (!jpeg_dc_scale(src->buf, src->len, ss->scale, s_yuyv, s_yuyv_cap, &width, &height)) {
+        return;                     // Corrupt frame
+    }
+    int64_t decoded = esp_timer_get_time();
+
+    hub_frame_t *out = frame_hub_acquire(ss->hub, (size_t)width * height + SCALER_HEADER_ROOM);
+    if (!out) {
+        return;
+    }
+    size_t len = jpeg_encode(s_encoder, s_yuyv, width, height, JPEG_ENC_YUYV, out->buf, out->cap);
+    if (!len) {
+        frame_hub_discard(ss->hub, out);
+        return;
+    }
+    int64_t done = esp_timer_get_time();
+
+    // Same capture time and scene as the source, so age and motion
+    // gating work as on the full stream
+    out->len = len;
+    out->width = width;
+    out->height = height;
+    out->format = PIXFORMAT_JPEG;
+    out->timestamp = src->timestamp;
+    out->wall_us = src->wall_us;
+    out->scene = src->scene;
+    frame_hub_publish(ss->hub, out);
+
+    metrics_observe(METRIC_SCALE_US, done - start);
+    ss->decode_us += decoded - start;
+    ss->encode_us += done - decoded;
+    ss->in_bytes += src->len;
+    ss->out_bytes += len;
+    if (++ss->frames == SCALER_LOG_FRAMES) {
+        stream_log(ss, width, height);
+    }
+}
+
+static void scaler_task(void *arg)
+{
+    frame_sub_t *sub = NULL;
+    bool wanted[SCALE_COUNT];
+
+    while (true) {
+        bool any = false;
+        for (int i = 0; i < SCALE_COUNT; i++) {
+            wanted[i] = frame_hub_subscriber_count(s_streams[i].hub) > 0;
+            any |= wanted[i];
+        }
+
+        // Stay off the capture hub while nobody watches, so the sensor can
+        // idle
+        if (!any) {
+            if (sub) {
+                frame_hub_unsubscribe(sub);
+                sub = NULL;
+            }
+            vTaskDelay(pdMS_TO_TICKS(SCALER_IDLE_MS));
+            continue;
+        }
+        if (!sub && !(sub = frame_hub_subscribe(s_source))) {
+            vTaskDelay(pdMS_TO_TICKS(SCALER_IDLE_MS));
+            continue;
+        }
+
+        hub_frame_t *frame = frame_hub_wait(sub, pdMS_TO_TICKS(SCALER_IDLE_MS));
+        if (!frame) {
+            continue;
+        }
+        for (int i = 0; i < SCALE_COUNT; i++) {
+            if (wanted[i]) {
+                scale_frame(&s_streams[i], frame);
+            }
+        }
+        frame_hub_release(frame);
+    }
+}
+
+frame_hub_t *frame_scaler_hub(int scale)
+{
+    for (int i = 0; i < SCALE_COUNT; i++) {
+        if (s_streams[i].scale == scale) {
+            return s_streams[i].hub;
+        }
+    }
+    return NULL;
+}
+
+size_t frame_scaler_viewers(void)
+{
+    size_t viewers = 0;
+    for (int i = 0; i < SCALE_COUNT; i++) {
+        if (s_streams[i].hub) {
+            viewers += frame_hub_subscriber_count(s_streams[i].hub);
+        }
+    }
+    return viewers;
+}
+
+esp_err_t frame_scaler_start(frame_hub_t *source)
+{
+    s_source = source;
+    for (int i = 0; i < SCALE_COUNT; i++) {
+        s_streams[i].hub = frame_hub_create(CONFIG_STREAM_MAX_CLIENTS, 1);
+        if (!s_streams[i].hub) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    // Decoding is processing work: keep it off the capture core
+    int core = CONFIG_PIPELINE_PROCESS_CORE < 0 ? tskNO_AFFINITY : CONFIG_PIPELINE_PROCESS_CORE;
+    if (xTaskCreatePinnedToCore(scaler_task, "scaler", SCALER_TASK_STACK, NULL,
+                                SCALER_TASK_PRIO, NULL, core) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Scaled streams at 1/2, 1/4 and 1/8, quality %d", CONFIG_STREAM_SCALE_QUALITY);
+    return ESP_OK;
+}
@@ -0,0 +1,29 @@
+/*
+ * Scaled streams
+ *
+ * /stream?scale=N (N = 2, 4 or 8) serves the capture downscaled by N for
+ * dashboards and thumbnails. While any scaled viewer is connected, one
+ * scaler task subscribes to the capture hub. It decodes each frame at 1/N
+ * in the DCT domain (jpeg_dc_scale), re-encodes it with the software
+ * encoder and publishes the result into a hub of its own for that scale.
+ * All viewers of a scale share its hub, so each frame is scaled once per
+ * scale no matter how many clients watch. The sensor configuration is
+ * never touched.
+ */
+
+#ifndef FRAME_SCALER_H
+#define FRAME_SCALER_H
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "frame_hub.h"
+
+esp_err_t frame_scaler_start(frame_hub_t *source);
+
+// Hub carrying the stream at 1/scale, NULL unless scale is 2, 4 or 8
+frame_hub_t *frame_scaler_hub(int scale);
+
+// Viewers subscribed to any scaled stream
+size_t frame_scaler_viewers(void);
+
+#endif // FRAME_SCALER_H
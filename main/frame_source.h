@@ -0,0 +1,52 @@
+/*
+ * Frame source interface
+ *
+ * Where the capture task gets its frames from. The live implementation wraps
+ * esp_camera; the replay implementation plays a directory of JPEG files at a
+ * fixed rate, so the rest of the pipeline (hub, pacing, senders, metrics)
+ * can be exercised and benchmarked without a sensor.
+ *
+ * Frames use the driver's camera_fb_t so the capture path is identical for
+ * both sources.
+ *
+ * A source may also be put into standby while nobody wants frames. The
+ * live camera then parks the sensor in its power-down mode and stops XCLK;
+ * the driver's DMA has already stopped by itself once every frame buffer
+ * was full.
+ */
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "esp_err.h"
+#include "esp_camera.h"
+
+// LEDC timer that drives the sensor's XCLK, as given to esp_camera_init()
+#define CAMERA_XCLK_TIMER   LEDC_TIMER_0
+
+typedef struct frame_source frame_source_t;
+
+struct frame_source {
+    const char *name;
+    // Block until the next frame is available. NULL on failure.
+    camera_fb_t *(*get)(frame_source_t *src);
+    // Hand a frame from get() back to the source.
+    void (*put)(frame_source_t *src, camera_fb_t *fb);
+    // Stop producing frames to save power, and start again. Frames from
+    // before suspend() may still come out of get() after resume(). Both
+    // NULL when the source has nothing to save.
+    esp_err_t (*suspend)(frame_source_t *src);
+    esp_err_t (*resume)(frame_source_t *src);
+    // Sensor to tune at runtime, NULL when the source has none
+    sensor_t *sensor;
+    void *ctx;
+};
+
+// Live frames from an initialized esp_camera driver.
+frame_source_t *frame_source_camera(void);
+
+// Replay every *.jpg / *.jpeg file in dir, in name order, looping, at fps
+// frames per second. Files are read one at a time into a reused buffer.
+frame_source_t *frame_source_replay_create(const char *dir, int fps);
+
+#endif // FRAME_SOURCE_H
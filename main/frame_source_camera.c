@@ -0,0 +1,64 @@
+/*
+ * Frame source - live esp_camera frames
+ */
+
+#include "driver/ledc.h"
+
+#include "frame_source.h"
+
+// OV3660/OV5640 SYSTEM CTROL0: bit 6 powers the sensor core down. The
+// registers keep their values, so it picks up where it stopped.
+#define OV3660_SYSTEM_CTRL0     0x3008
+#define OV3660_POWER_DOWN       0x40
+
+static camera_fb_t *camera_get(frame_source_t *src)
+{
+    return esp_camera_fb_get();
+}
+
+static void camera_put(frame_source_t *src, camera_fb_t *fb)
+{
+    esp_camera_fb_return(fb);
+}
+
+static bool has_power_down(const sensor_t *s)
+{
+    return s && (s->id.PID == OV3660_PID || s->id.PID == OV5640_PID);
+}
+
+// The sensor still needs XCLK to take the power-down write over SCCB, so
+// the clock stops last and starts first
+static esp_err_t camera_suspend(frame_source_t *src)
+{
+    sensor_t *s = src->sensor;
+    if (has_power_down(s) && s->set_reg(s, OV3660_SYSTEM_CTRL0, OV3660_POWER_DOWN,
+                                        OV3660_POWER_DOWN) != 0) {
+        return ESP_FAIL;
+    }
+    return ledc_timer_pause(LEDC_LOW_SPEED_MODE, CAMERA_XCLK_TIMER);
+}
+
+static esp_err_t camera_resume(frame_source_t *src)
+{
+    sensor_t *s = src->sensor;
+    esp_err_t err = ledc_timer_resume(LEDC_LOW_SPEED_MODE, CAMERA_XCLK_TIMER);
+    if (err == ESP_OK && has_power_down(s) &&
+        s->set_reg(s, OV3660_SYSTEM_CTRL0, OV3660_POWER_DOWN, 0) != 0) {
+        err = ESP_FAIL;
+    }
+    return err;
+}
+
+frame_source_t *frame_source_camera(void)
+{
+    static frame_source_t s_source = {
+        .name = "camera",
+        .get = camera_get,
+        .put = camera_put,
+        .suspend = camera_suspend,
+        .resume = camera_resume,
+    };
+
+    s_source.sensor = esp_camera_sensor_get();
+    return &s_source;
+}
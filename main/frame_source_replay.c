@@ -0,0 +1,193 @@
+/*
+ * Frame source - replay a directory of JPEG files
+ *
+ * POSIX only (dirent, stdio, clock_gettime), so it works against any mounted
+ * VFS path on the device and on a Linux host.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_log.h"
+
+#include "frame_source.h"
+
+static const char *TAG = "REPLAY";
+
+typedef struct {
+    frame_source_t src;
+    char **files;
+    size_t count;
+    size_t next;
+    uint8_t *buf;
+    size_t cap;
+    camera_fb_t fb;
+    int64_t interval_us;
+    int64_t due_us;
+} replay_t;
+
+static int64_t mono_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool is_jpeg_name(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    return ext && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0);
+}
+
+static int name_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Width and height from the first SOF0..SOF3 marker, 0 if not found
+static void jpeg_dimensions(const uint8_t *p, size_t len, size_t *w, size_t *h)
+{
+    size_t pos = 2;
+
+    *w = *h = 0;
+    while (pos + 4 <= len && p[pos] == 0xFF) {
+        uint8_t marker = p[pos + 1];
+        if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) {
+            pos += 2;
+            continue;
+        }
+        size_t seg = ((size_t)p[pos + 2] << 8) | p[pos + 3];
+        if (marker >= 0xC0 && marker <= 0xC3 && pos + 9 <= len) {
+            *h = ((size_t)p[pos + 5] << 8) | p[pos + 6];
+            *w = ((size_t)p[pos + 7] << 8) | p[pos + 8];
+            return;
+        }
+        if (marker == 0xDA) {
+            return;                 // Scan data follows, no SOF seen
+        }
+        pos += 2 + seg;
+    }
+}
+
+static bool replay_load(replay_t *r, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = false;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        rewind(f);
+        if (size > 0) {
+            if ((size_t)size > r->cap) {
+                uint8_t *buf = realloc(r->buf, size);
+                if (buf) {
+                    r->buf = buf;
+                    r->cap = size;
+                }
+            }
+            if ((size_t)size <= r->cap && fread(r->buf, 1, size, f) == (size_t)size) {
+                r->fb.buf = r->buf;
+                r->fb.len = size;
+                ok = true;
+            }
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static camera_fb_t *replay_get(frame_source_t *src)
+{
+    replay_t *r = src->ctx;
+
+    // Hold the configured rate: sleep until this frame is due
+    int64_t now = mono_us();
+    if (r->due_us > now) {
+        usleep(r->due_us - now);
+        now = r->due_us;
+    }
+    r->due_us = now + r->interval_us;
+
+    for (size_t tries = 0; tries < r->count; tries++) {
+        const char *path = r->files[r->next];
+        r->next = (r->next + 1) % r->count;
+        if (replay_load(r, path)) {
+            jpeg_dimensions(r->fb.buf, r->fb.len, &r->fb.width, &r->fb.height);
+            r->fb.format = PIXFORMAT_JPEG;
+            int64_t ts = mono_us();
+            r->fb.timestamp.tv_sec = ts / 1000000;
+            r->fb.timestamp.tv_usec = ts % 1000000;
+            return &r->fb;
+        }
+        ESP_LOGW(TAG, "Skipping unreadable %s", path);
+    }
+    return NULL;
+}
+
+static void replay_put(frame_source_t *src, camera_fb_t *fb)
+{
+    // Buffer is reused by the next get()
+}
+
+frame_source_t *frame_source_replay_create(const char *dir, int fps)
+{
+    DIR *d = opendir(dir);
+    if (!d) {
+        ESP_LOGE(TAG, "Cannot open %s", dir);
+        return NULL;
+    }
+
+    replay_t *r = calloc(1, sizeof(*r));
+    if (!r) {
+        closedir(d);
+        return NULL;
+    }
+
+    struct dirent *e;
+    size_t dir_len = strlen(dir);
+    while ((e = readdir(d)) != NULL) {
+        if (!is_jpeg_name(e->d_name)) {
+            continue;
+        }
+        char **files = realloc(r->files, (r->count + 1) * sizeof(char *));
+        char *path = malloc(dir_len + strlen(e->d_name) + 2);
+        if (!files || !path) {
+            free(path);
+            if (files) {
+                r->files = files;
+            }
+            break;
+        }
+        r->files = files;
+        sprintf(path, "%s/%s", dir, e->d_name);
+        r->files[r->count++] = path;
+    }
+    closedir(d);
+
+    if (r->count == 0) {
+        ESP_LOGE(TAG, "No JPEG files in %s", dir);
+        free(r->files);
+        free(r);
+        return NULL;
+    }
+    qsort(r->files, r->count, sizeof(char *), name_cmp);
+
+    r->interval_us = fps > 0 ? 1000000 / fps : 0;
+    r->src = (frame_source_t){
+        .name = "replay",
+        .get = replay_get,
+        .put = replay_put,
+        .sensor = NULL,
+        .ctx = r,
+    };
+    ESP_LOGI(TAG, "Replaying %u files from %s at %d fps", (unsigned)r->count, dir, fps);
+    return &r->src;
+}
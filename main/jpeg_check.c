@@ -0,0 +1,215 @@
+/*
+ * JPEG frame integrity check - header walk, word-at-a-time scan validation
+ */
+
+#include <string.h>
+
+#include "jpeg_check.h"
+
+// One machine word: 32 bits on the ESP32, 64 on most hosts
+typedef uintptr_t scan_word_t;
+
+#define WORD_ONES   ((scan_word_t)-1 / 0xFF)        // 0x0101...
+#define WORD_HIGHS  (WORD_ONES * 0x80)              // 0x8080...
+
+typedef struct {
+    size_t scan;                    // First byte of entropy-coded data
+    uint32_t expected_restarts;     // 0 if unknown
+    uint16_t dri;
+    bool sequential;                // One scan; anything else is not walked
+} jpeg_layout_t;
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+size_t jpeg_find_ff(const uint8_t *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+
+    while (p < end && ((uintptr_t)p & (sizeof(scan_word_t) - 1))) {
+        if (*p == 0xFF) {
+            return p - buf;
+        }
+        p++;
+    }
+    // Inverted, a 0xFF byte is a zero byte, which the classic has-zero
+    // test finds without looking at bytes one by one
+    while (p + sizeof(scan_word_t) <= end) {
+        scan_word_t w;
+        memcpy(&w, p, sizeof(w));
+        w = ~w;
+        if ((w - WORD_ONES) & ~w & WORD_HIGHS) {
+            break;
+        }
+        p += sizeof(scan_word_t);
+    }
+    while (p < end && *p != 0xFF) {
+        p++;
+    }
+    return p - buf;
+}
+
+// Walk the markers up to the start of the scan
+static const char *parse_layout(const uint8_t *buf, size_t len, jpeg_layout_t *layout)
+{
+    int width = 0, height = 0, comps = 0, h_max = 1, v_max = 1;
+
+    memset(layout, 0, sizeof(*layout));
+    if (len < 4 || buf[0] != 0xFF || buf[1] != 0xD8) {
+        return "no SOI";
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (buf[pos] != 0xFF) {
+            return "bad header marker";
+        }
+        uint8_t marker = buf[pos + 1];
+        if (marker == 0xFF) {
+            pos++;                  // Fill byte
+            continue;
+        }
+        size_t seg = get_be16(buf + pos + 2);
+        if (seg < 2 || pos + 2 + seg > len) {
+            return "header segment past the end";
+        }
+        const uint8_t *p = buf + pos + 4;
+
+        switch (marker) {
+        case 0xC0: case 0xC1:       // SOF0/SOF1, sequential Huffman
+        case 0xC2:                  // SOF2, progressive
+            if (seg < 8) {
+                return "short SOF";
+            }
+            height = get_be16(p + 1);
+            width = get_be16(p + 3);
+            comps = p[5];
+            if (seg < 8 + 3 * (size_t)comps) {
+                return "short SOF";
+            }
+            for (int i = 0; i < comps; i++) {
+                int h = p[6 + 3 * i + 1] >> 4;
+                int v = p[6 + 3 * i + 1] & 15;
+                h_max = h > h_max ? h : h_max;
+                v_max = v > v_max ? v : v_max;
+            }
+            layout->sequential = marker != 0xC2;
+            break;
+        case 0xDD:                  // DRI
+            if (seg < 4) {
+                return "short DRI";
+            }
+            layout->dri = get_be16(p);
+            break;
+        case 0xDA:                  // SOS: the scan follows
+            if (!width) {
+                return "no SOF before SOS";
+            }
+            layout->scan = pos + 2 + seg;
+            // Interleaved scans code one MCU of h_max x v_max blocks at a
+            // time; a single-component scan codes single blocks
+            if (layout->dri && height) {
+                int mcu_w = comps > 1 ? 8 * h_max : 8;
+                int mcu_h = comps > 1 ? 8 * v_max : 8;
+                uint32_t mcus = ((width + mcu_w - 1) / mcu_w) * ((height + mcu_h - 1) / mcu_h);
+                layout->expected_restarts = (mcus - 1) / layout->dri;
+            }
+            return NULL;
+        case 0xD9:
+            return "EOI before the scan";
+        default:
+            break;
+        }
+        pos += 2 + seg;
+    }
+    return "no SOS";
+}
+
+// Close the frame at cut with an EOI
+static jpeg_check_result_t repair(uint8_t *buf, size_t cut, size_t cap, const jpeg_layout_t *layout,
+                                  uint32_t restarts, const char *reason, jpeg_check_info_t *info)
+{
+    info->reason = reason;
+    if (cut <= layout->scan || cut + 2 > cap) {
+        return JPEG_CHECK_BAD;
+    }
+    buf[cut] = 0xFF;
+    buf[cut + 1] = 0xD9;
+    info->len = cut + 2;
+    info->restarts = restarts;
+    return JPEG_CHECK_REPAIRED;
+}
+
+jpeg_check_result_t jpeg_check(uint8_t *buf, size_t len, size_t cap, jpeg_check_info_t *info)
+{
+    jpeg_layout_t layout;
+
+    memset(info, 0, sizeof(*info));
+    info->reason = parse_layout(buf, len, &layout);
+    if (info->reason) {
+        return JPEG_CHECK_BAD;
+    }
+
+    // Progressive frames are not the sensor's: only look for the end
+    if (!layout.sequential) {
+        for (size_t end = len; end >= layout.scan + 2; end--) {
+            if (buf[end - 2] == 0xFF && buf[end - 1] == 0xD9) {
+                info->len = end;
+                info->padding = len - end;
+                return JPEG_CHECK_OK;
+            }
+        }
+        info->reason = "no EOI";
+        return JPEG_CHECK_BAD;
+    }
+
+    uint32_t restarts = 0;
+    size_t last_restart = layout.scan; // Cut here and every interval before is whole
+    size_t pos = layout.scan;
+
+    while (true) {
+        pos += jpeg_find_ff(buf + pos, len - pos);
+        if (pos + 1 >= len) {
+            // Ran out of data: keep what arrived, less a dangling 0xFF
+            size_t cut = pos < len ? pos : len;
+            if (cut + 2 > cap && restarts) {
+                cut = last_restart;
+            }
+            return repair(buf, cut, cap, &layout, restarts, "no EOI", info);
+        }
+
+        uint8_t marker = buf[pos + 1];
+        if (marker == 0x00) {
+            pos += 2;               // Stuffed 0xFF data byte
+        } else if (marker == 0xFF) {
+            pos += 1;               // Fill byte
+        } else if (marker >= 0xD0 && marker <= 0xD7) {
+            if (marker != 0xD0 + (restarts & 7)) {
+                return repair(buf, last_restart, cap, &layout, restarts,
+                              "restart marker out of order", info);
+            }
+            if (layout.expected_restarts && restarts == layout.expected_restarts) {
+                // The picture is complete; what follows is someone else's
+                return repair(buf, pos, cap, &layout, restarts, "data past the last restart", info);
+            }
+            restarts++;
+            last_restart = pos;
+            pos += 2;
+        } else if (marker == 0xD9) {
+            if (layout.expected_restarts && restarts != layout.expected_restarts) {
+                info->reason = "restart intervals missing";
+                return JPEG_CHECK_BAD;
+            }
+            info->len = pos + 2;
+            info->padding = len - info->len;
+            info->restarts = restarts;
+            return JPEG_CHECK_OK;
+        } else {
+            return repair(buf, last_restart > layout.scan ? last_restart : pos, cap, &layout,
+                          restarts, "marker inside the scan", info);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * JPEG frame integrity check
+ *
+ * The camera DMA can hand over a frame whose scan was cut short (buffer
+ * overflow, lost lines) or, worse, whose tail is stale data from an
+ * earlier, larger frame that happened to end in an EOI. Both decode to
+ * corrupt tiles. This walks the headers and then the whole entropy-coded
+ * scan, which may only contain stuffed 0xFF00 bytes, fill bytes and
+ * restart markers in strict RST0..RST7 order, up to the EOI:
+ *
+ *   intact      EOI found where the restart count says it should be;
+ *               any padding after it is trimmed
+ *   repairable  the scan breaks off (no EOI, a foreign marker, restart
+ *               markers out of order); the frame is cut at the last point
+ *               known to be good and closed with an EOI, so decoders draw
+ *               the top of the picture and leave the rest gray
+ *   bad         no SOI, broken headers, or nothing left worth showing
+ *
+ * The scan is searched for 0xFF a machine word at a time, since marker
+ * bytes are rare in entropy-coded data. Pure C, no ESP-IDF dependencies.
+ */
+
+#ifndef JPEG_CHECK_H
+#define JPEG_CHECK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    JPEG_CHECK_OK,
+    JPEG_CHECK_REPAIRED,
+    JPEG_CHECK_BAD,
+} jpeg_check_result_t;
+
+typedef struct {
+    size_t len;                     // Bytes to keep, EOI included
+    size_t padding;                 // Trimmed after the EOI
+    uint32_t restarts;              // Restart markers in the kept scan
+    const char *reason;             // Why it was repaired or rejected
+} jpeg_check_info_t;
+
+// Check the len-byte frame in buf and repair it in place if possible.
+// Repairing writes an EOI at the cut, which needs 2 bytes beyond len when
+// the scan simply ran out, so cap should be at least len + 2.
+jpeg_check_result_t jpeg_check(uint8_t *buf, size_t len, size_t cap, jpeg_check_info_t *info);
+
+// Offset of the first 0xFF byte in buf, len if there is none
+size_t jpeg_find_ff(const uint8_t *buf, size_t len);
+
+#endif // JPEG_CHECK_H
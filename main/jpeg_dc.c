@@ -0,0 +1,611 @@
+/*
+ * JPEG DC thumbnail and downscaling - entropy decode with AC skipping
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "jpeg_dc.h"
+
+#define MAX_COMPONENTS  3
+// Huffman lookahead: codes up to this long decode with one table hit
+#define LOOKAHEAD       9
+// Zero bytes fed past a marker before the scan is treated as truncated
+#define MAX_OVERRUN     8
+
+typedef struct {
+    uint16_t fast[1 << LOOKAHEAD];  // (length << 8) | symbol, 0 = slow path
+    int32_t maxcode[17];
+    int32_t valptr[17];
+    int32_t mincode[17];
+    uint8_t vals[256];
+} huff_t;
+
+typedef struct {
+    uint8_t id;
+    uint8_t h, v;
+    uint8_t tq;
+    uint8_t td, ta;                 // From the scan header
+} component_t;
+
+typedef struct {
+    int width, height;
+    int ncomp;
+    component_t comp[MAX_COMPONENTS];
+    uint8_t scan_comp[MAX_COMPONENTS];  // Indices into comp, scan order
+    int nscan;
+    int hmax, vmax;
+    int restart;                    // MCUs per restart interval, 0 = none
+    uint16_t qt[4][64];             // Quantizers, zigzag order
+    huff_t dc[4];
+    huff_t ac[4];
+    const uint8_t *scan;            // First entropy-coded byte
+    const uint8_t *end;
+} jpeg_info_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t acc;                   // MSB-aligned
+    int bits;
+    int overrun;
+    bool marker;                    // Stopped in front of a marker
+} bit_reader_t;
+
+static void huff_build(huff_t *t, const uint8_t bits[16], const uint8_t *vals, int n)
+{
+    int32_t code = 0;
+    int k = 0;
+
+    memset(t, 0, sizeof(*t));
+    memcpy(t->vals, vals, n);
+    for (int len = 1; len <= 16; len++) {
+        t->valptr[len] = k;
+        t->mincode[len] = code;
+        for (int i = 0; i < bits[len - 1]; i++, k++, code++) {
+            if (len <= LOOKAHEAD) {
+                int shift = LOOKAHEAD - len;
+                for (int j = 0; j < (1 << shift); j++) {
+                    t->fast[(code << shift) | j] = (len << 8) | vals[k];
+                }
+            }
+        }
+        t->maxcode[len] = bits[len - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+}
+
+static bool parse_headers(const uint8_t *p, size_t len, jpeg_info_t *info)
+{
+    const uint8_t *end = p + len;
+
+    memset(info, 0, sizeof(*info));
+    if (len < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+        return false;
+    }
+    p += 2;
+
+    while (p + 4 <= end) {
+        if (p[0] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = p[1];
+        if (marker == 0xFF) {
+            p++;                    // Fill byte
+            continue;
+        }
+        size_t seg = ((size_t)p[2] << 8) | p[3];
+        const uint8_t *s = p + 4;
+        const uint8_t *s_end = p + 2 + seg;
+        if (seg < 2 || s_end > end) {
+            return false;
+        }
+
+        switch (marker) {
+        case 0xDB:                  // DQT
+            while (s < s_end) {
+                int pq = s[0] >> 4, tq = s[0] & 3;
+                if (s + 1 + (pq ? 128 : 64) > s_end) {
+                    return false;
+                }
+                for (int i = 0; i < 64; i++) {
+                    info->qt[tq][i] = pq ? ((s[1 + 2 * i] << 8) | s[2 + 2 * i]) : s[1 + i];
+                }
+                s += 1 + (pq ? 128 : 64);
+            }
+            break;
+        case 0xC0:                  // SOF0/SOF1, baseline and extended Huffman
+        case 0xC1:
+            if (seg < 8 || s[0] != 8) {
+                return false;
+            }
+            info->height = (s[1] << 8) | s[2];
+            info->width = (s[3] << 8) | s[4];
+            info->ncomp = s[5];
+            if (info->ncomp < 1 || info->ncomp > MAX_COMPONENTS || seg < 8 + 3u * info->ncomp) {
+                return false;
+            }
+            for (int i = 0; i < info->ncomp; i++) {
+                component_t *c = &info->comp[i];
+                c->id = s[6 + 3 * i];
+                c->h = s[7 + 3 * i] >> 4;
+                c->v = s[7 + 3 * i] & 15;
+                c->tq = s[8 + 3 * i] & 3;
+                if (!c->h || !c->v) {
+                    return false;
+                }
+                info->hmax = c->h > info->hmax ? c->h : info->hmax;
+                info->vmax = c->v > info->vmax ? c->v : info->vmax;
+            }
+            break;
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            return false;           // Progressive, lossless or arithmetic
+        case 0xC4:                  // DHT
+            while (s + 17 <= s_end) {
+                int tc = s[0] >> 4, th = s[0] & 3;
+                int n = 0;
+                for (int i = 0; i < 16; i++) {
+                    n += s[1 + i];
+                }
+                if (n > 256 || s + 17 + n > s_end) {
+                    return false;
+                }
+                huff_build(tc ? &info->ac[th] : &info->dc[th], s + 1, s + 17, n);
+                s += 17 + n;
+            }
+            break;
+        case 0xDD:                  // DRI
+            info->restart = (s[0] << 8) | s[1];
+            break;
+        case 0xDA:                  // SOS
+            if (!info->ncomp) {
+                return false;
+            }
+            info->nscan = s[0];
+            if (info->nscan < 1 || info->nscan > info->ncomp) {
+                return false;
+            }
+            for (int i = 0; i < info->nscan; i++) {
+                int k = 0;
+                while (k < info->ncomp && info->comp[k].id != s[1 + 2 * i]) {
+                    k++;
+                }
+                if (k == info->ncomp) {
+                    return false;
+                }
+                info->comp[k].td = s[2 + 2 * i] >> 4;
+                info->comp[k].ta = s[2 + 2 * i] & 3;
+                info->scan_comp[i] = k;
+            }
+            // Only a scan that starts with luma is useful
+            if (info->scan_comp[0] != 0) {
+                return false;
+            }
+            info->scan = s_end;
+            info->end = end;
+            return true;
+        default:
+            break;
+        }
+        p = s_end;
+    }
+    return false;
+}
+
+// A single-component scan is not interleaved: one block per MCU
+static void mcu_grid(const jpeg_info_t *info, int *mcus_x, int *mcus_y, int *bw, int *bh)
+{
+    const component_t *y = &info->comp[0];
+
+    if (info->nscan == 1) {
+        int w = (info->width * y->h + info->hmax - 1) / info->hmax;
+        int h = (info->height * y->v + info->vmax - 1) / info->vmax;
+        *mcus_x = (w + 7) / 8;
+        *mcus_y = (h + 7) / 8;
+        *bw = *bh = 1;
+    } else {
+        *mcus_x = (info->width + 8 * info->hmax - 1) / (8 * info->hmax);
+        *mcus_y = (info->height + 8 * info->vmax - 1) / (8 * info->vmax);
+        *bw = y->h;
+        *bh = y->v;
+    }
+}
+
+size_t jpeg_dc_cells(const uint8_t *jpg, size_t len)
+{
+    jpeg_info_t info;
+    int mx, my, bw, bh;
+
+    if (!parse_headers(jpg, len, &info)) {
+        return 0;
+    }
+    mcu_grid(&info, &mx, &my, &bw, &bh);
+    return (size_t)mx * bw * my * bh;
+}
+
+// ---- Bit reader -------------------------------------------------------
+
+static inline void br_fill(bit_reader_t *br)
+{
+    while (br->bits <= 24) {
+        uint32_t byte = 0;
+        if (!br->marker && br->p < br->end) {
+            byte = *br->p;
+            if (byte == 0xFF) {
+                if (br->p + 1 < br->end && br->p[1] == 0x00) {
+                    br->p += 2;     // Stuffed 0xFF
+                } else {
+                    br->marker = true;
+                    byte = 0;
+                }
+            } else {
+                br->p++;
+            }
+        }
+        if (br->marker || br->p >= br->end) {
+            br->overrun++;
+        }
+        br->acc |= byte << (24 - br->bits);
+        br->bits += 8;
+    }
+}
+
+static inline uint32_t br_get(bit_reader_t *br, int n)
+{
+    uint32_t v = br->acc >> (32 - n);
+    br->acc <<= n;
+    br->bits -= n;
+    return v;
+}
+
+static inline int huff_decode(bit_reader_t *br, const huff_t *t)
+{
+    br_fill(br);
+
+    uint16_t e = t->fast[br->acc >> (32 - LOOKAHEAD)];
+    if (e) {
+        br_get(br, e >> 8);
+        return e & 0xFF;
+    }
+
+    int32_t code = 0;
+    for (int len = 1; len <= 16; len++) {
+        code = (code << 1) | br_get(br, 1);
+        if (code <= t->maxcode[len]) {
+            return t->vals[t->valptr[len] + code - t->mincode[len]];
+        }
+    }
+    return 0;                       // Corrupt: decode as zero
+}
+
+// Skip to just past the next RSTn marker
+static void br_restart(bit_reader_t *br)
+{
+    const uint8_t *p = br->p;
+    while (p + 1 < br->end && !(p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7)) {
+        p++;
+    }
+    br->p = p + 2 <= br->end ? p + 2 : br->end;
+    br->acc = 0;
+    br->bits = 0;
+    br->overrun = 0;
+    br->marker = false;
+}
+
+// ---- Scan -------------------------------------------------------------
+
+// Decode one block; returns the DC difference, AC values are skipped
+static inline int decode_block(bit_reader_t *br, const huff_t *dc, const huff_t *ac)
+{
+    int s = huff_decode(br, dc);
+    int diff = 0;
+    if (s) {
+        br_fill(br);
+        diff = br_get(br, s);
+        if (diff < (1 << (s - 1))) {
+            diff -= (1 << s) - 1;
+        }
+    }
+
+    for (int k = 1; k < 64; ) {
+        int rs = huff_decode(br, ac);
+        int r = rs >> 4;
+        s = rs & 15;
+        if (!s) {
+            if (r != 15) {
+                break;              // EOB
+            }
+            k += 16;
+            continue;
+        }
+        br_fill(br);
+        br_get(br, s);
+        k += r + 1;
+    }
+    return diff;
+}
+
+bool jpeg_dc_thumbnail(const uint8_t *jpg, size_t len, uint8_t *thumb, size_t cap,
+                       int *width, int *height)
+{
+    jpeg_info_t info;
+    int mcus_x, mcus_y, bw, bh;
+
+    if (!parse_headers(jpg, len, &info)) {
+        return false;
+    }
+    mcu_grid(&info, &mcus_x, &mcus_y, &bw, &bh);
+
+    int tw = mcus_x * bw;
+    int th = mcus_y * bh;
+    if ((size_t)tw * th > cap) {
+        return false;
+    }
+
+    bit_reader_t br = { .p = info.scan, .end = info.end };
+    int pred[MAX_COMPONENTS] = { 0 };
+    int q0 = info.qt[info.comp[0].tq][0] ? info.qt[info.comp[0].tq][0] : 1;
+    int todo = info.restart;
+
+    for (int my = 0; my < mcus_y; my++) {
+        for (int mx = 0; mx < mcus_x; mx++) {
+            if (info.restart && todo-- == 0) {
+                br_restart(&br);
+                memset(pred, 0, sizeof(pred));
+                todo = info.restart - 1;
+            }
+
+            for (int i = 0; i < info.nscan; i++) {
+                int ci = info.scan_comp[i];
+                const component_t *c = &info.comp[ci];
+                int nh = info.nscan == 1 ? 1 : c->h;
+                int nv = info.nscan == 1 ? 1 : c->v;
+
+                for (int by = 0; by < nv; by++) {
+                    for (int bx = 0; bx < nh; bx++) {
+                        pred[ci] += decode_block(&br, &info.dc[c->td], &info.ac[c->ta]);
+                        if (ci != 0) {
+                            continue;
+                        }
+                        // Dequantized DC is 8x the level-shifted block mean
+                        int mean = ((pred[0] * q0) >> 3) + 128;
+                        thumb[(my * bh + by) * tw + mx * bw + bx] =
+                            mean < 0 ? 0 : mean > 255 ? 255 : mean;
+                    }
+                }
+            }
+            if (br.overrun > MAX_OVERRUN) {
+                return false;       // Ran off the end of the data
+            }
+        }
+    }
+
+    *width = tw;
+    *height = th;
+    return true;
+}
+
+// ---- Downscaling ------------------------------------------------------
+
+// Natural (row-major) position of each zigzag index
+static const uint8_t s_zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+#define IDCT_BITS       12
+#define KEEP_NONE       0xFF
+
+typedef struct {
+    int k;                          // Output samples per block side
+    uint8_t keep[64];               // Zigzag index -> k x k position
+    int32_t cos[4][4];              // [x][u], IDCT_BITS fraction
+} reduce_t;
+
+// The k-point inverse DCT of the lowest k coefficients gives the block
+// averaged down to k samples: f(x) = 1/2 sum c(u) F(u) cos((2x+1)u pi/2k)
+static void reduce_init(reduce_t *r, int k)
+{
+    r->k = k;
+    for (int i = 0; i < 64; i++) {
+        int row = s_zigzag[i] / 8, col = s_zigzag[i] % 8;
+        r->keep[i] = row < k && col < k ? row * k + col : KEEP_NONE;
+    }
+    for (int x = 0; x < k; x++) {
+        for (int u = 0; u < k; u++) {
+            double c = (u ? 1.0 : M_SQRT1_2) * cos((2 * x + 1) * u * M_PI / (2 * k));
+            r->cos[x][u] = lround(0.5 * c * (1 << IDCT_BITS));
+        }
+    }
+}
+
+// Decode one block, dequantizing the coefficients r keeps into coef
+// (k x k, natural order; DC left for the caller). Returns the DC
+// difference.
+static inline int decode_block_reduced(bit_reader_t *br, const huff_t *dc, const huff_t *ac,
+                                       const reduce_t *r, const uint16_t *q, int32_t *coef)
+{
+    int s = huff_decode(br, dc);
+    int diff = 0;
+    if (s) {
+        br_fill(br);
+        diff = br_get(br, s);
+        if (diff < (1 << (s - 1))) {
+            diff -= (1 << s) - 1;
+        }
+    }
+
+    memset(coef, 0, r->k * r->k * sizeof(*coef));
+    for (int k = 1; k < 64; ) {
+        int rs = huff_decode(br, ac);
+        int run = rs >> 4;
+        s = rs & 15;
+        if (!s) {
+            if (run != 15) {
+                break;              // EOB
+            }
+            k += 16;
+            continue;
+        }
+        k += run;
+        br_fill(br);
+        int v = br_get(br, s);
+        if (v < (1 << (s - 1))) {
+            v -= (1 << s) - 1;
+        }
+        if (k < 64 && r->keep[k] != KEEP_NONE) {
+            coef[r->keep[k]] = v * q[k];
+        }
+        k++;
+    }
+    return diff;
+}
+
+// Separable k x k inverse DCT of coef into out (stride in bytes, step
+// bytes between samples of a row)
+static inline void idct_reduced(const reduce_t *r, const int32_t *coef, uint8_t *out,
+                                int stride, int step, int w, int h)
+{
+    int64_t tmp[4][4];
+    int k = r->k;
+
+    for (int v = 0; v < k; v++) {
+        for (int x = 0; x < k; x++) {
+            int64_t sum = 0;
+            for (int u = 0; u < k; u++) {
+                sum += (int64_t)r->cos[x][u] * coef[v * k + u];
+            }
+            tmp[v][x] = sum;
+        }
+    }
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int64_t sum = 0;
+            for (int v = 0; v < k; v++) {
+                sum += r->cos[y][v] * tmp[v][x];
+            }
+            int p = (int)((sum + (1 << (2 * IDCT_BITS - 1))) >> (2 * IDCT_BITS)) + 128;
+            out[y * stride + x * step] = p < 0 ? 0 : p > 255 ? 255 : p;
+        }
+    }
+}
+
+bool jpeg_dc_scaled_size(const uint8_t *jpg, size_t len, int scale, int *width, int *height)
+{
+    jpeg_info_t info;
+
+    if ((scale != 2 && scale != 4 && scale != 8) || !parse_headers(jpg, len, &info)) {
+        return false;
+    }
+    *width = (info.width / scale) & ~1;
+    *height = info.height / scale;
+    return *width > 0 && *height > 0;
+}
+
+bool jpeg_dc_scale(const uint8_t *jpg, size_t len, int scale, uint8_t *yuyv, size_t cap,
+                   int *width, int *height)
+{
+    jpeg_info_t info;
+    int mcus_x, mcus_y, bw, bh;
+
+    if (!jpeg_dc_scaled_size(jpg, len, scale, width, height) ||
+        (size_t)*width * *height * 2 > cap) {
+        return false;
+    }
+    parse_headers(jpg, len, &info);
+    // Colour needs all components in one interleaved scan, chroma at full,
+    // half or quarter (4:2:0) resolution
+    if (info.nscan != info.ncomp) {
+        return false;
+    }
+    for (int i = 1; i < info.ncomp; i++) {
+        int hs = info.hmax / info.comp[i].h, vs = info.vmax / info.comp[i].v;
+        if (hs > 2 || vs > 2 || info.hmax % info.comp[i].h || info.vmax % info.comp[i].v) {
+            return false;
+        }
+    }
+    mcu_grid(&info, &mcus_x, &mcus_y, &bw, &bh);
+
+    int ow = *width, oh = *height;
+    int stride = ow * 2;
+    if (info.ncomp == 1) {
+        for (int i = 0; i < ow * oh; i++) {
+            yuyv[2 * i + 1] = 128;
+        }
+    }
+
+    reduce_t r;
+    reduce_init(&r, 8 / scale);
+    int k = r.k;
+    int32_t coef[16];
+    uint8_t block[16];
+
+    bit_reader_t br = { .p = info.scan, .end = info.end };
+    int pred[MAX_COMPONENTS] = { 0 };
+    int todo = info.restart;
+
+    for (int my = 0; my < mcus_y; my++) {
+        for (int mx = 0; mx < mcus_x; mx++) {
+            if (info.restart && todo-- == 0) {
+                br_restart(&br);
+                memset(pred, 0, sizeof(pred));
+                todo = info.restart - 1;
+            }
+
+            for (int i = 0; i < info.nscan; i++) {
+                int ci = info.scan_comp[i];
+                const component_t *c = &info.comp[ci];
+                const uint16_t *q = info.qt[c->tq];
+                int nh = info.nscan == 1 ? 1 : c->h;
+                int nv = info.nscan == 1 ? 1 : c->v;
+                int hs = info.hmax / c->h, vs = info.vmax / c->v;
+
+                for (int by = 0; by < nv; by++) {
+                    for (int bx = 0; bx < nh; bx++) {
+                        pred[ci] += decode_block_reduced(&br, &info.dc[c->td], &info.ac[c->ta],
+                                                         &r, q, coef);
+                        coef[0] = pred[ci] * q[0];
+
+                        // Block origin in output luma pixels
+                        int x0 = (mx * nh + bx) * k * hs;
+                        int y0 = (my * nv + by) * k * vs;
+                        if (x0 >= ow || y0 >= oh) {
+                            continue;
+                        }
+                        if (ci == 0) {
+                            int w = ow - x0 < k ? ow - x0 : k;
+                            int h = oh - y0 < k ? oh - y0 : k;
+                            idct_reduced(&r, coef, yuyv + y0 * stride + x0 * 2, stride, 2, w, h);
+                            continue;
+                        }
+
+                        // Chroma: one sample per luma pair, repeated down
+                        // the rows it covers
+                        idct_reduced(&r, coef, block, k, 1, k, k);
+                        for (int sy = 0; sy < k; sy++) {
+                            for (int sx = 0; sx < k; sx++) {
+                                int px = x0 + sx * hs;
+                                if (px >= ow || (px & 1)) {
+                                    continue;
+                                }
+                                for (int dy = 0; dy < vs; dy++) {
+                                    int py = y0 + sy * vs + dy;
+                                    if (py < oh) {
+                                        yuyv[py * stride + px * 2 + (ci == 1 ? 1 : 3)] = block[sy * k + sx];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            if (br.overrun > MAX_OVERRUN) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+/*
+ * JPEG DC thumbnail and DCT-domain downscaling
+ *
+ * Pulls the luma DC coefficient of every 8x8 block out of a baseline JPEG
+ * without running any inverse transform: the entropy stream is Huffman
+ * decoded, AC values are skipped, and each DC becomes the mean brightness
+ * of its block. The result is a 1/8-scale grayscale thumbnail, which is
+ * all a change detector needs.
+ *
+ * The same decoder scales colour frames by 1/2, 1/4 or 1/8: only the
+ * lowest 4x4, 2x2 or 1x1 coefficients of each block are kept, and a
+ * reduced inverse DCT turns them straight into 4x4, 2x2 or 1x1 pixels.
+ * Full-size pixels are never produced. Pure C, no ESP-IDF dependencies.
+ */
+
+#ifndef JPEG_DC_H
+#define JPEG_DC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Luma blocks of a frame (cells of the thumbnail), 0 if jpg is not a
+// baseline JPEG. Rounded up to whole MCUs.
+size_t jpeg_dc_cells(const uint8_t *jpg, size_t len);
+
+// Fill thumb (row-major, *width x *height cells of 0..255) from jpg.
+// Returns false if the stream is not baseline Huffman JPEG, does not fit
+// in cap cells, or ends before the last MCU.
+bool jpeg_dc_thumbnail(const uint8_t *jpg, size_t len, uint8_t *thumb, size_t cap,
+                       int *width, int *height);
+
+// Output size of jpg at 1/scale (2, 4 or 8); width is rounded down to even.
+// False if jpg is not a baseline JPEG.
+bool jpeg_dc_scaled_size(const uint8_t *jpg, size_t len, int scale, int *width, int *height);
+
+// Decode jpg at 1/scale into yuyv (Y0 U Y1 V, as the software encoder
+// takes it) and return its size. Returns false as jpeg_dc_thumbnail() does,
+// for chroma subsampling other than 4:4:4, 4:2:2 and 4:2:0, or if the
+// image does not fit in cap bytes.
+bool jpeg_dc_scale(const uint8_t *jpg, size_t len, int scale, uint8_t *yuyv, size_t cap,
+                   int *width, int *height);
+
+#endif // JPEG_DC_H
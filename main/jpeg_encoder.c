@@ -0,0 +1,475 @@
+/*
+ * Software JPEG encoder - MCU row pipeline and baseline Huffman coding
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jpeg_encoder.h"
+#include "jpeg_kernels.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+// MCUs transformed before the entropy coder runs over them
+#define MCU_BATCH       8
+// 16x16 MCU: four luma blocks, one Cb, one Cr
+#define MCU_BLOCKS      6
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t size[256];
+} huff_table_t;
+
+struct jpeg_encoder {
+    int max_width;
+    bool reference;
+    int64_t (*clock_us)(void);
+    uint8_t qt[2][64];              // Natural order
+    uint16_t div[2][64];            // qt times JPEG_DCT_SCALE
+    jpeg_qrecip_t rq[2];
+    huff_table_t dc[2];
+    huff_table_t ac[2];
+    uint8_t *strip;                 // 16 luma rows, then 8 Cb and 8 Cr rows
+    int16_t (*coef)[64];            // MCU_BATCH * MCU_BLOCKS blocks
+    jpeg_enc_stats_t stats;
+};
+
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+    uint32_t acc;
+    int bits;
+    bool overflow;
+} bit_writer_t;
+
+static const uint8_t s_zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// ITU-T T.81 Annex K tables
+static const uint8_t s_base_qt[2][64] = {
+    {
+        16, 11, 10, 16,  24,  40,  51,  61,
+        12, 12, 14, 19,  26,  58,  60,  55,
+        14, 13, 16, 24,  40,  57,  69,  56,
+        14, 17, 22, 29,  51,  87,  80,  62,
+        18, 22, 37, 56,  68, 109, 103,  77,
+        24, 35, 55, 64,  81, 104, 113,  92,
+        49, 64, 78, 87, 103, 121, 120, 101,
+        72, 92, 95, 98, 112, 100, 103,  99,
+    },
+    {
+        17, 18, 24, 47, 99, 99, 99, 99,
+        18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99,
+        47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+    },
+};
+
+static const uint8_t s_dc_bits[2][16] = {
+    { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 },
+};
+
+static const uint8_t s_dc_vals[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t s_ac_bits[2][16] = {
+    { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d },
+    { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 },
+};
+
+static const uint8_t s_ac_vals[2][162] = {
+    {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+    },
+    {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+        0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+    },
+};
+
+static void *strip_alloc(size_t size)
+{
+#ifdef ESP_PLATFORM
+    // The strips are hit for every pixel; keep them out of PSRAM if we can
+    void *p = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (p) {
+        return p;
+    }
+#endif
+    return malloc(size);
+}
+
+// Canonical code assignment, T.81 Annex C
+static void huff_build(huff_table_t *t, const uint8_t bits[16], const uint8_t *vals)
+{
+    uint16_t code = 0;
+    int k = 0;
+
+    memset(t, 0, sizeof(*t));
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++) {
+            t->code[vals[k]] = code++;
+            t->size[vals[k]] = len;
+            k++;
+        }
+        code <<= 1;
+    }
+}
+
+// libjpeg quality scaling
+static void quant_build(uint8_t qt[64], const uint8_t base[64], int quality)
+{
+    if (quality < 1) {
+        quality = 1;
+    } else if (quality > 100) {
+        quality = 100;
+    }
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+    for (int i = 0; i < 64; i++) {
+        int q = (base[i] * scale + 50) / 100;
+        qt[i] = q < 1 ? 1 : q > 255 ? 255 : q;
+    }
+}
+
+jpeg_encoder_t *jpeg_encoder_create(const jpeg_encoder_config_t *cfg)
+{
+    if (cfg->max_width <= 0) {
+        return NULL;
+    }
+
+    jpeg_encoder_t *enc = calloc(1, sizeof(*enc));
+    if (!enc) {
+        return NULL;
+    }
+
+    enc->max_width = cfg->max_width;
+    enc->reference = cfg->reference;
+    enc->clock_us = cfg->clock_us;
+
+    size_t pw = (cfg->max_width + 15) & ~15;
+    enc->strip = strip_alloc(pw * 16 + pw * 8);
+    enc->coef = strip_alloc(MCU_BATCH * MCU_BLOCKS * sizeof(*enc->coef));
+    if (!enc->strip || !enc->coef) {
+        jpeg_encoder_destroy(enc);
+        return NULL;
+    }
+
+    for (int t = 0; t < 2; t++) {
+        quant_build(enc->qt[t], s_base_qt[t], cfg->quality);
+        for (int i = 0; i < 64; i++) {
+            enc->div[t][i] = enc->qt[t][i] * JPEG_DCT_SCALE;
+        }
+        jpeg_qrecip_init(&enc->rq[t], enc->div[t]);
+        huff_build(&enc->dc[t], s_dc_bits[t], s_dc_vals);
+        huff_build(&enc->ac[t], s_ac_bits[t], s_ac_vals[t]);
+    }
+    return enc;
+}
+
+void jpeg_encoder_destroy(jpeg_encoder_t *enc)
+{
+    if (enc) {
+        free(enc->strip);
+        free(enc->coef);
+        free(enc);
+    }
+}
+
+void jpeg_encoder_take_stats(jpeg_encoder_t *enc, jpeg_enc_stats_t *stats)
+{
+    *stats = enc->stats;
+    memset(&enc->stats, 0, sizeof(enc->stats));
+}
+
+static inline int64_t stage_clock(const jpeg_encoder_t *enc)
+{
+    return enc->clock_us ? enc->clock_us() : 0;
+}
+
+// ---- Headers ----------------------------------------------------------
+
+static uint8_t *put_marker(uint8_t *p, uint8_t marker, size_t len)
+{
+    p[0] = 0xFF;
+    p[1] = marker;
+    p[2] = len >> 8;
+    p[3] = len & 0xFF;
+    return p + 4;
+}
+
+static uint8_t *put_huff_table(uint8_t *p, uint8_t id, const uint8_t bits[16],
+                               const uint8_t *vals)
+{
+    size_t n = 0;
+
+    *p++ = id;
+    for (int i = 0; i < 16; i++) {
+        *p++ = bits[i];
+        n += bits[i];
+    }
+    memcpy(p, vals, n);
+    return p + n;
+}
+
+// Worst case size of everything up to the first scan byte
+#define HEADER_MAX      640
+
+static uint8_t *write_headers(const jpeg_encoder_t *enc, uint8_t *p, int width, int height)
+{
+    static const uint8_t jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+
+    *p++ = 0xFF;
+    *p++ = 0xD8;
+
+    p = put_marker(p, 0xE0, 2 + sizeof(jfif));
+    memcpy(p, jfif, sizeof(jfif));
+    p += sizeof(jfif);
+
+    p = put_marker(p, 0xDB, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++) {
+        *p++ = t;
+        for (int i = 0; i < 64; i++) {
+            *p++ = enc->qt[t][s_zigzag[i]];
+        }
+    }
+
+    p = put_marker(p, 0xC0, 17);
+    *p++ = 8;
+    *p++ = height >> 8;
+    *p++ = height & 0xFF;
+    *p++ = width >> 8;
+    *p++ = width & 0xFF;
+    *p++ = 3;
+    static const uint8_t components[] = { 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    memcpy(p, components, sizeof(components));
+    p += sizeof(components);
+
+    p = put_marker(p, 0xC4, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+    for (int t = 0; t < 2; t++) {
+        p = put_huff_table(p, 0x00 | t, s_dc_bits[t], s_dc_vals);
+        p = put_huff_table(p, 0x10 | t, s_ac_bits[t], s_ac_vals[t]);
+    }
+
+    p = put_marker(p, 0xDA, 12);
+    static const uint8_t scan[] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+    memcpy(p, scan, sizeof(scan));
+    return p + sizeof(scan);
+}
+
+// ---- Entropy coding ---------------------------------------------------
+
+static inline void put_bits(bit_writer_t *w, uint32_t code, int len)
+{
+    // A flush below emits at most two bytes per input byte (0xFF stuffing)
+    if (w->end - w->p < 6) {
+        w->overflow = true;
+        return;
+    }
+
+    w->acc = (w->acc << len) | code;
+    w->bits += len;
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        uint8_t byte = w->acc >> w->bits;
+        *w->p++ = byte;
+        if (byte == 0xFF) {
+            *w->p++ = 0;
+        }
+    }
+}
+
+static inline int bit_length(uint32_t v)
+{
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+// Category code followed by the value bits; negative values are sent as
+// their ones' complement
+static inline void put_value(bit_writer_t *w, const huff_table_t *t, int symbol_base, int v)
+{
+    uint32_t mag = v < 0 ? -v : v;
+    int cat = bit_length(mag);
+
+    put_bits(w, t->code[symbol_base | cat], t->size[symbol_base | cat]);
+    if (cat) {
+        put_bits(w, (v < 0 ? v - 1 : v) & ((1u << cat) - 1), cat);
+    }
+}
+
+static void encode_block(bit_writer_t *w, const int16_t q[64], int *dc_pred,
+                         const huff_table_t *dc, const huff_table_t *ac)
+{
+    put_value(w, dc, 0, q[0] - *dc_pred);
+    *dc_pred = q[0];
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int v = q[s_zigzag[k]];
+        if (v == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            put_bits(w, ac->code[0xF0], ac->size[0xF0]);
+            run -= 16;
+        }
+        put_value(w, ac, run << 4, v);
+        run = 0;
+    }
+    if (run) {
+        put_bits(w, ac->code[0x00], ac->size[0x00]);
+    }
+}
+
+// ---- Pipeline ---------------------------------------------------------
+
+// Fill one MCU row of strips from source rows [y, y + 16), replicating the
+// last row and column into the padding
+static void convert_rows(jpeg_encoder_t *enc, const uint8_t *src, int width, int height,
+                         int y, jpeg_enc_input_t input, int pw)
+{
+    jpeg_rows_fn rows;
+    if (input == JPEG_ENC_RGB565) {
+        rows = enc->reference ? jpeg_rgb565_rows_ref : jpeg_rgb565_rows_fast;
+    } else {
+        rows = enc->reference ? jpeg_yuyv_rows_ref : jpeg_yuyv_rows_fast;
+    }
+
+    uint8_t *luma = enc->strip;
+    uint8_t *cb = luma + pw * 16;
+    uint8_t *cr = cb + (pw / 2) * 8;
+    size_t stride = (size_t)width * 2;
+    int cw = pw / 2;
+
+    for (int r = 0; r < 8; r++) {
+        int y0 = y + 2 * r < height ? y + 2 * r : height - 1;
+        int y1 = y0 + 1 < height ? y0 + 1 : height - 1;
+        uint8_t *l0 = luma + (2 * r) * pw;
+        uint8_t *l1 = l0 + pw;
+        uint8_t *b = cb + r * cw;
+        uint8_t *c = cr + r * cw;
+
+        rows(src + y0 * stride, src + y1 * stride, width, l0, l1, b, c);
+        if (pw > width) {
+            memset(l0 + width, l0[width - 1], pw - width);
+            memset(l1 + width, l1[width - 1], pw - width);
+            memset(b + width / 2, b[width / 2 - 1], cw - width / 2);
+            memset(c + width / 2, c[width / 2 - 1], cw - width / 2);
+        }
+    }
+}
+
+static void transform_mcu(jpeg_encoder_t *enc, int mx, int pw, int16_t (*out)[64])
+{
+    void (*fdct)(const uint8_t *, int, int32_t *) = enc->reference ? jpeg_fdct_ref : jpeg_fdct_fast;
+    const uint8_t *luma = enc->strip + mx * 16;
+    const uint8_t *cb = enc->strip + pw * 16 + mx * 8;
+    const uint8_t *cr = cb + (pw / 2) * 8;
+    const uint8_t *blocks[MCU_BLOCKS] = {
+        luma, luma + 8, luma + 8 * pw, luma + 8 * pw + 8, cb, cr,
+    };
+    int32_t dct[64];
+
+    for (int b = 0; b < MCU_BLOCKS; b++) {
+        int chroma = b >= 4;
+        fdct(blocks[b], chroma ? pw / 2 : pw, dct);
+        if (enc->reference) {
+            jpeg_quantize_ref(dct, enc->div[chroma], out[b]);
+        } else {
+            jpeg_quantize_fast(dct, &enc->rq[chroma], out[b]);
+        }
+    }
+}
+
+size_t jpeg_encode(jpeg_encoder_t *enc, const uint8_t *src, int width, int height,
+                   jpeg_enc_input_t input, uint8_t *out, size_t out_cap)
+{
+    if (width <= 0 || height <= 0 || (width & 1) || width > enc->max_width ||
+        height > 0xFFFF || out_cap < HEADER_MAX + 2) {
+        return 0;
+    }
+
+    int pw = (width + 15) & ~15;
+    int mcus = pw / 16;
+    int dc_pred[3] = { 0 };
+    int64_t t0, t1;
+
+    bit_writer_t w = {
+        .p = write_headers(enc, out, width, height),
+        .end = out + out_cap - 2,   // Room for EOI
+    };
+
+    for (int y = 0; y < height && !w.overflow; y += 16) {
+        t0 = stage_clock(enc);
+        convert_rows(enc, src, width, height, y, input, pw);
+        t1 = stage_clock(enc);
+        enc->stats.convert_us += t1 - t0;
+
+        for (int mx = 0; mx < mcus && !w.overflow; mx += MCU_BATCH) {
+            int n = mcus - mx < MCU_BATCH ? mcus - mx : MCU_BATCH;
+
+            t0 = stage_clock(enc);
+            for (int i = 0; i < n; i++) {
+                transform_mcu(enc, mx + i, pw, enc->coef + i * MCU_BLOCKS);
+            }
+            t1 = stage_clock(enc);
+            enc->stats.transform_us += t1 - t0;
+
+            for (int i = 0; i < n; i++) {
+                int16_t (*blk)[64] = enc->coef + i * MCU_BLOCKS;
+                for (int b = 0; b < 4; b++) {
+                    encode_block(&w, blk[b], &dc_pred[0], &enc->dc[0], &enc->ac[0]);
+                }
+                encode_block(&w, blk[4], &dc_pred[1], &enc->dc[1], &enc->ac[1]);
+                encode_block(&w, blk[5], &dc_pred[2], &enc->dc[1], &enc->ac[1]);
+            }
+            t0 = stage_clock(enc);
+            enc->stats.entropy_us += t0 - t1;
+        }
+    }
+
+    // Pad the last byte with ones
+    if (w.bits > 0) {
+        put_bits(&w, (1u << (8 - w.bits)) - 1, 8 - w.bits);
+    }
+    if (w.overflow) {
+        return 0;
+    }
+
+    *w.p++ = 0xFF;
+    *w.p++ = 0xD9;
+
+    enc->stats.frames++;
+    enc->stats.pixels += (uint64_t)width * height;
+    return w.p - out;
+}
@@ -0,0 +1,57 @@
+/*
+ * Software JPEG encoder
+ *
+ * Baseline JFIF, 4:2:0, standard Huffman tables. Input is a raw RGB565
+ * (big-endian, as the camera driver delivers it) or YUYV frame. Work runs
+ * one 16-line MCU row at a time: the row is converted into small luma and
+ * chroma strips (kept in internal RAM when possible), then transformed and
+ * entropy coded in batches of MCUs. This keeps the PSRAM frame read once,
+ * sequentially.
+ *
+ * Pure C; only the strip allocation prefers internal RAM on ESP-IDF.
+ */
+
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    JPEG_ENC_RGB565,
+    JPEG_ENC_YUYV,
+} jpeg_enc_input_t;
+
+typedef struct {
+    int max_width;                  // Widest frame this encoder accepts
+    int quality;                    // 1..100, libjpeg scale
+    bool reference;                 // Use the scalar reference kernels
+    int64_t (*clock_us)(void);      // Optional, enables per-stage timing
+} jpeg_encoder_config_t;
+
+// Accumulated since the last jpeg_encoder_take_stats(). Stage times are
+// only filled in when the encoder has a clock.
+typedef struct {
+    uint32_t frames;
+    uint64_t pixels;
+    uint64_t convert_us;            // Color conversion and subsampling
+    uint64_t transform_us;          // Forward DCT and quantization
+    uint64_t entropy_us;            // Huffman coding and bit packing
+} jpeg_enc_stats_t;
+
+typedef struct jpeg_encoder jpeg_encoder_t;
+
+jpeg_encoder_t *jpeg_encoder_create(const jpeg_encoder_config_t *cfg);
+void jpeg_encoder_destroy(jpeg_encoder_t *enc);
+
+// Encode one frame into out. width must be even and no larger than
+// max_width. Returns the JPEG size, or 0 if it did not fit in out_cap or
+// the frame was rejected.
+size_t jpeg_encode(jpeg_encoder_t *enc, const uint8_t *src, int width, int height,
+                   jpeg_enc_input_t input, uint8_t *out, size_t out_cap);
+
+// Copy out the stats and start a new accumulation period
+void jpeg_encoder_take_stats(jpeg_encoder_t *enc, jpeg_enc_stats_t *stats);
+
+#endif // JPEG_ENCODER_H
@@ -0,0 +1,322 @@
+/*
+ * JPEG encoder kernels - color conversion, forward DCT, quantization
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "jpeg_kernels.h"
+
+// JFIF YCbCr, 16-bit fixed point
+#define FIX(x)          ((int32_t)((x) * 65536 + 0.5))
+#define Y_R             FIX(0.29900)
+#define Y_G             FIX(0.58700)
+#define Y_B             FIX(0.11400)
+#define CB_R            (-FIX(0.16874))
+#define CB_G            (-FIX(0.33126))
+#define CB_B            FIX(0.50000)
+#define CR_R            FIX(0.50000)
+#define CR_G            (-FIX(0.41869))
+#define CR_B            (-FIX(0.08131))
+#define ROUND_HALF      (1 << 15)
+#define CHROMA_BIAS     ((128 << 16) + ROUND_HALF - 1)
+
+// Pixels per group in the fast conversion kernels
+#define GROUP           16
+
+static inline uint8_t ycc_y(int r, int g, int b)
+{
+    return (Y_R * r + Y_G * g + Y_B * b + ROUND_HALF) >> 16;
+}
+
+static inline uint8_t ycc_cb(int r, int g, int b)
+{
+    return (CB_R * r + CB_G * g + CB_B * b + CHROMA_BIAS) >> 16;
+}
+
+static inline uint8_t ycc_cr(int r, int g, int b)
+{
+    return (CR_R * r + CR_G * g + CR_B * b + CHROMA_BIAS) >> 16;
+}
+
+static inline void rgb565_unpack(const uint8_t *p, int *r, int *g, int *b)
+{
+    unsigned v = ((unsigned)p[0] << 8) | p[1];
+    unsigned r5 = v >> 11, g6 = (v >> 5) & 0x3F, b5 = v & 0x1F;
+    *r = (r5 << 3) | (r5 >> 2);
+    *g = (g6 << 2) | (g6 >> 4);
+    *b = (b5 << 3) | (b5 >> 2);
+}
+
+// ---- Color conversion: reference --------------------------------------
+
+void jpeg_rgb565_rows_ref(const uint8_t *row0, const uint8_t *row1, int width,
+                          uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    for (int x = 0; x < width; x += 2) {
+        int cb_sum = 0, cr_sum = 0;
+        for (int dy = 0; dy < 2; dy++) {
+            const uint8_t *src = dy ? row1 : row0;
+            uint8_t *dst = dy ? y1 : y0;
+            for (int dx = 0; dx < 2; dx++) {
+                int r, g, b;
+                rgb565_unpack(src + 2 * (x + dx), &r, &g, &b);
+                dst[x + dx] = ycc_y(r, g, b);
+                cb_sum += ycc_cb(r, g, b);
+                cr_sum += ycc_cr(r, g, b);
+            }
+        }
+        cb[x / 2] = (cb_sum + 2) >> 2;
+        cr[x / 2] = (cr_sum + 2) >> 2;
+    }
+}
+
+void jpeg_yuyv_rows_ref(const uint8_t *row0, const uint8_t *row1, int width,
+                        uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    for (int x = 0; x < width; x += 2) {
+        const uint8_t *a = row0 + 2 * x;
+        const uint8_t *b = row1 + 2 * x;
+        y0[x] = a[0];
+        y0[x + 1] = a[2];
+        y1[x] = b[0];
+        y1[x + 1] = b[2];
+        cb[x / 2] = (a[1] + b[1] + 1) >> 1;
+        cr[x / 2] = (a[3] + b[3] + 1) >> 1;
+    }
+}
+
+// ---- Color conversion: fast -------------------------------------------
+//
+// Each group of GROUP pixels per row is unpacked into planar int arrays,
+// then every output is produced by a flat, branch-free loop over those
+// arrays. Fixed trip counts and restrict-qualified pointers let the
+// compiler keep everything in registers or vectorize outright.
+
+static inline void rgb565_unpack_group(const uint8_t *restrict p, int n,
+                                       int32_t *restrict r, int32_t *restrict g,
+                                       int32_t *restrict b)
+{
+    for (int i = 0; i < n; i++) {
+        uint32_t v = ((uint32_t)p[2 * i] << 8) | p[2 * i + 1];
+        uint32_t r5 = v >> 11, g6 = (v >> 5) & 0x3F, b5 = v & 0x1F;
+        r[i] = (r5 << 3) | (r5 >> 2);
+        g[i] = (g6 << 2) | (g6 >> 4);
+        b[i] = (b5 << 3) | (b5 >> 2);
+    }
+}
+
+static inline void ycc_group(int n, const int32_t *restrict r, const int32_t *restrict g,
+                             const int32_t *restrict b, uint8_t *restrict y,
+                             int32_t *restrict cb, int32_t *restrict cr)
+{
+    for (int i = 0; i < n; i++) {
+        y[i] = (Y_R * r[i] + Y_G * g[i] + Y_B * b[i] + ROUND_HALF) >> 16;
+        cb[i] = (CB_R * r[i] + CB_G * g[i] + CB_B * b[i] + CHROMA_BIAS) >> 16;
+        cr[i] = (CR_R * r[i] + CR_G * g[i] + CR_B * b[i] + CHROMA_BIAS) >> 16;
+    }
+}
+
+void jpeg_rgb565_rows_fast(const uint8_t *row0, const uint8_t *row1, int width,
+                           uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    int32_t r[GROUP], g[GROUP], b[GROUP];
+    int32_t cb0[GROUP], cr0[GROUP], cb1[GROUP], cr1[GROUP];
+
+    for (int x = 0; x < width; x += GROUP) {
+        int n = width - x < GROUP ? width - x : GROUP;
+
+        rgb565_unpack_group(row0 + 2 * x, n, r, g, b);
+        ycc_group(n, r, g, b, y0 + x, cb0, cr0);
+        rgb565_unpack_group(row1 + 2 * x, n, r, g, b);
+        ycc_group(n, r, g, b, y1 + x, cb1, cr1);
+
+        uint8_t *restrict cbo = cb + x / 2;
+        uint8_t *restrict cro = cr + x / 2;
+        for (int i = 0; i < n / 2; i++) {
+            cbo[i] = (cb0[2 * i] + cb0[2 * i + 1] + cb1[2 * i] + cb1[2 * i + 1] + 2) >> 2;
+            cro[i] = (cr0[2 * i] + cr0[2 * i + 1] + cr1[2 * i] + cr1[2 * i + 1] + 2) >> 2;
+        }
+    }
+}
+
+void jpeg_yuyv_rows_fast(const uint8_t *row0, const uint8_t *row1, int width,
+                         uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    // Four bytes per pixel pair: read as words, split with shifts
+    for (int x = 0; x < width; x += GROUP) {
+        int n = (width - x < GROUP ? width - x : GROUP) / 2;
+        const uint8_t *restrict a = row0 + 2 * x;
+        const uint8_t *restrict b = row1 + 2 * x;
+        uint8_t *restrict ya = y0 + x;
+        uint8_t *restrict yb = y1 + x;
+        uint8_t *restrict cbo = cb + x / 2;
+        uint8_t *restrict cro = cr + x / 2;
+
+        for (int i = 0; i < n; i++) {
+            uint32_t wa = a[4 * i] | (a[4 * i + 1] << 8) | (a[4 * i + 2] << 16) | ((uint32_t)a[4 * i + 3] << 24);
+            uint32_t wb = b[4 * i] | (b[4 * i + 1] << 8) | (b[4 * i + 2] << 16) | ((uint32_t)b[4 * i + 3] << 24);
+            ya[2 * i] = wa;
+            ya[2 * i + 1] = wa >> 16;
+            yb[2 * i] = wb;
+            yb[2 * i + 1] = wb >> 16;
+            cbo[i] = (((wa >> 8) & 0xFF) + ((wb >> 8) & 0xFF) + 1) >> 1;
+            cro[i] = ((wa >> 24) + (wb >> 24) + 1) >> 1;
+        }
+    }
+}
+
+// ---- Forward DCT: reference -------------------------------------------
+
+void jpeg_fdct_ref(const uint8_t *src, int stride, int32_t out[64])
+{
+    static double cos_table[8][8];
+    static bool ready;
+
+    if (!ready) {
+        for (int x = 0; x < 8; x++) {
+            for (int u = 0; u < 8; u++) {
+                cos_table[x][u] = cos((2 * x + 1) * u * M_PI / 16);
+            }
+        }
+        ready = true;
+    }
+
+    for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+            double sum = 0;
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 8; x++) {
+                    sum += (src[y * stride + x] - 128) * cos_table[x][u] * cos_table[y][v];
+                }
+            }
+            double cu = u ? 1 : M_SQRT1_2;
+            double cv = v ? 1 : M_SQRT1_2;
+            out[v * 8 + u] = lround(0.25 * cu * cv * sum * JPEG_DCT_SCALE);
+        }
+    }
+}
+
+// ---- Forward DCT: fast ------------------------------------------------
+//
+// Loeffler-Ligtenberg-Moschytz, 12 multiplies per 1-D pass, integer only.
+// Rows keep PASS1_BITS of extra precision for the column pass; the result
+// carries an overall factor of 8 (JPEG_DCT_SCALE).
+
+#define CONST_BITS      13
+#define PASS1_BITS      2
+#define DESCALE(x, n)   (((x) + (1 << ((n) - 1))) >> (n))
+
+#define FIX_0_298631336 2446
+#define FIX_0_390180644 3196
+#define FIX_0_541196100 4433
+#define FIX_0_765366865 6270
+#define FIX_0_899976223 7373
+#define FIX_1_175875602 9633
+#define FIX_1_501321110 12299
+#define FIX_1_847759065 15137
+#define FIX_1_961570560 16069
+#define FIX_2_053119869 16819
+#define FIX_2_562915447 20995
+#define FIX_3_072711026 25172
+
+// One in-place 1-D pass over 8 values spaced step apart. The row pass
+// scales up by PASS1_BITS, the column pass removes it again.
+static inline void fdct_1d(int32_t *d, int step, bool rows)
+{
+    int32_t tmp0 = d[0] + d[7 * step], tmp7 = d[0] - d[7 * step];
+    int32_t tmp1 = d[step] + d[6 * step], tmp6 = d[step] - d[6 * step];
+    int32_t tmp2 = d[2 * step] + d[5 * step], tmp5 = d[2 * step] - d[5 * step];
+    int32_t tmp3 = d[3 * step] + d[4 * step], tmp4 = d[3 * step] - d[4 * step];
+
+    int32_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    int32_t tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+    int shift = rows ? CONST_BITS - PASS1_BITS : CONST_BITS + PASS1_BITS;
+
+    if (rows) {
+        d[0] = (tmp10 + tmp11) << PASS1_BITS;
+        d[4 * step] = (tmp10 - tmp11) << PASS1_BITS;
+    } else {
+        d[0] = DESCALE(tmp10 + tmp11, PASS1_BITS);
+        d[4 * step] = DESCALE(tmp10 - tmp11, PASS1_BITS);
+    }
+
+    int32_t z1 = (tmp12 + tmp13) * FIX_0_541196100;
+    d[2 * step] = DESCALE(z1 + tmp13 * FIX_0_765366865, shift);
+    d[6 * step] = DESCALE(z1 - tmp12 * FIX_1_847759065, shift);
+
+    z1 = tmp4 + tmp7;
+    int32_t z2 = tmp5 + tmp6;
+    int32_t z3 = tmp4 + tmp6;
+    int32_t z4 = tmp5 + tmp7;
+    int32_t z5 = (z3 + z4) * FIX_1_175875602;
+
+    tmp4 *= FIX_0_298631336;
+    tmp5 *= FIX_2_053119869;
+    tmp6 *= FIX_3_072711026;
+    tmp7 *= FIX_1_501321110;
+    z1 *= -FIX_0_899976223;
+    z2 *= -FIX_2_562915447;
+    z3 = z3 * -FIX_1_961570560 + z5;
+    z4 = z4 * -FIX_0_390180644 + z5;
+
+    d[7 * step] = DESCALE(tmp4 + z1 + z3, shift);
+    d[5 * step] = DESCALE(tmp5 + z2 + z4, shift);
+    d[3 * step] = DESCALE(tmp6 + z2 + z3, shift);
+    d[step] = DESCALE(tmp7 + z1 + z4, shift);
+}
+
+void jpeg_fdct_fast(const uint8_t *src, int stride, int32_t out[64])
+{
+    for (int y = 0; y < 8; y++) {
+        const uint8_t *s = src + y * stride;
+        int32_t *d = out + y * 8;
+        for (int x = 0; x < 8; x++) {
+            d[x] = s[x] - 128;
+        }
+        fdct_1d(d, 1, true);
+    }
+    for (int x = 0; x < 8; x++) {
+        fdct_1d(out + x, 8, false);
+    }
+}
+
+// ---- Quantization -----------------------------------------------------
+
+void jpeg_quantize_ref(const int32_t in[64], const uint16_t divisors[64], int16_t out[64])
+{
+    for (int i = 0; i < 64; i++) {
+        int32_t d = divisors[i];
+        int32_t v = in[i];
+        out[i] = v >= 0 ? (v + d / 2) / d : -((-v + d / 2) / d);
+    }
+}
+
+// floor(n / d) == (n * mul) >> shift for every n < 2^16 when
+// shift = 16 + bit_length(d) and mul = ceil(2^shift / d): the rounding
+// error of mul is below d, so n times it stays below 2^shift.
+void jpeg_qrecip_init(jpeg_qrecip_t *rq, const uint16_t divisors[64])
+{
+    for (int i = 0; i < 64; i++) {
+        uint32_t d = divisors[i] ? divisors[i] : 1;
+        int bits = 0;
+        while ((1u << bits) <= d) {
+            bits++;
+        }
+        rq->shift[i] = 16 + bits;
+        rq->mul[i] = (uint32_t)(((1ull << rq->shift[i]) + d - 1) / d);
+        rq->half[i] = d / 2;
+    }
+}
+
+void jpeg_quantize_fast(const int32_t in[64], const jpeg_qrecip_t *rq, int16_t out[64])
+{
+    for (int i = 0; i < 64; i++) {
+        int32_t v = in[i];
+        int32_t sign = v >> 31;
+        uint32_t mag = (uint32_t)((v ^ sign) - sign) + rq->half[i];
+        int32_t q = (int32_t)(((uint64_t)mag * rq->mul[i]) >> rq->shift[i]);
+        out[i] = (q ^ sign) - sign;
+    }
+}
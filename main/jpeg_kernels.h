@@ -0,0 +1,59 @@
+/*
+ * JPEG encoder kernels
+ *
+ * The per-stage building blocks of the software JPEG path: color conversion
+ * with 2x2 chroma subsampling, forward DCT and quantization. Every stage has
+ * a straightforward scalar reference and a fast variant:
+ *
+ *  - Color conversion: the fast kernels unpack fixed 16-pixel groups into
+ *    small planar arrays and run branch-free loops over them (SIMD and
+ *    auto-vectorizer friendly). They are bit-exact with the reference.
+ *  - DCT: the reference is the textbook double-precision formula; the fast
+ *    one is the separable integer LLM transform. They agree to within
+ *    rounding; compare by PSNR.
+ *  - Quantization: the fast kernel multiplies by exact reciprocals and is
+ *    bit-exact with the reference division.
+ *
+ * Pure C, no ESP-IDF dependencies.
+ */
+
+#ifndef JPEG_KERNELS_H
+#define JPEG_KERNELS_H
+
+#include <stdint.h>
+
+// Forward DCT output is scaled up by this factor; quantizers divide it out.
+#define JPEG_DCT_SCALE  8
+
+// Two source rows in, two luma rows and one 2x2-subsampled Cb and Cr row
+// out. width must be even. RGB565 is big-endian per pixel, as delivered by
+// the camera driver; YUYV is Y0 U Y1 V.
+typedef void (*jpeg_rows_fn)(const uint8_t *row0, const uint8_t *row1, int width,
+                             uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+
+void jpeg_rgb565_rows_ref(const uint8_t *row0, const uint8_t *row1, int width,
+                          uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+void jpeg_rgb565_rows_fast(const uint8_t *row0, const uint8_t *row1, int width,
+                           uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+void jpeg_yuyv_rows_ref(const uint8_t *row0, const uint8_t *row1, int width,
+                        uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+void jpeg_yuyv_rows_fast(const uint8_t *row0, const uint8_t *row1, int width,
+                         uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+
+// 8x8 forward DCT of level-shifted samples read from src with stride.
+// Output in natural order, scaled by JPEG_DCT_SCALE.
+void jpeg_fdct_ref(const uint8_t *src, int stride, int32_t out[64]);
+void jpeg_fdct_fast(const uint8_t *src, int stride, int32_t out[64]);
+
+// Divisors are quant table entries times JPEG_DCT_SCALE, natural order.
+typedef struct {
+    uint32_t mul[64];
+    uint8_t shift[64];
+    uint16_t half[64];
+} jpeg_qrecip_t;
+
+void jpeg_qrecip_init(jpeg_qrecip_t *rq, const uint16_t divisors[64]);
+void jpeg_quantize_ref(const int32_t in[64], const uint16_t divisors[64], int16_t out[64]);
+void jpeg_quantize_fast(const int32_t in[64], const jpeg_qrecip_t *rq, int16_t out[64]);
+
+#endif // JPEG_KERNELS_H
@@ -0,0 +1,263 @@
+/*
+ * Lock-free runtime metrics
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "metrics.h"
+
+#define METRICS_MAX_BUCKETS 12
+
+typedef struct {
+    const char *name;
+    const char *help;
+    uint32_t scale;                 // Printed values are divided by this
+    uint32_t bounds[METRICS_MAX_BUCKETS];   // Ascending, zero-terminated
+} hist_desc_t;
+
+typedef struct {
+    const char *name;
+    const char *help;
+} scalar_desc_t;
+
+static const hist_desc_t s_hist_desc[METRIC_HIST_COUNT] = {
+    [METRIC_FB_GET_WAIT_US] = {
+        "camera_fb_get_wait_seconds", "Time blocked waiting for a frame from the driver", 1000000,
+        { 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000 },
+    },
+    [METRIC_SEND_CHUNK_US] = {
+        "stream_send_chunk_seconds", "Duration of a single socket write", 1000000,
+        { 100, 500, 1000, 5000, 10000, 50000, 100000, 500000 },
+    },
+    [METRIC_FRAME_SEND_US] = {
+        "stream_frame_send_seconds", "Time to deliver one frame to one client", 1000000,
+        { 1000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000 },
+    },
+    [METRIC_FRAME_BYTES] = {
+        "camera_frame_size_bytes", "Captured JPEG frame size", 1,
+        { 8192, 16384, 32768, 65536, 131072, 262144, 524288 },
+    },
+    [METRIC_FRAME_INTERVAL_US] = {
+        "camera_frame_interval_seconds", "Time between consecutive captured frames", 1000000,
+        { 10000, 20000, 33000, 50000, 66000, 100000, 200000, 500000, 1000000 },
+    },
+    [METRIC_SW_ENCODE_US] = {
+        "camera_sw_encode_seconds", "Software JPEG encode time of a raw frame", 1000000,
+        { 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000 },
+    },
+    [METRIC_MOTION_DETECT_US] = {
+        "camera_motion_detect_seconds", "Scene change check of one frame", 1000000,
+        { 250, 500, 1000, 2000, 5000, 10000, 20000, 50000 },
+    },
+    [METRIC_STREAM_FRAME_AGE_US] = {
+        "stream_frame_age_seconds", "Capture to last byte of a frame sent on /stream", 1000000,
+        { 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000 },
+    },
+    [METRIC_RTP_FRAME_AGE_US] = {
+        "rtp_frame_age_seconds", "Capture to last RTP packet of a frame sent", 1000000,
+        { 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000 },
+    },
+    [METRIC_RTP_FRAME_SEND_US] = {
+        "rtp_frame_send_seconds", "Time to packetize and send one frame to one RTSP session", 1000000,
+        { 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000 },
+    },
+    [METRIC_WS_ACK_LATENCY_US] = {
+        "stream_ws_ack_latency_seconds", "Capture to a /ws client acking the drawn frame", 1000000,
+        { 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000 },
+    },
+    [METRIC_SCALE_US] = {
+        "stream_scale_seconds", "Downscale and re-encode of one frame for one scale", 1000000,
+        { 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000 },
+    },
+    [METRIC_SENSOR_PROFILE_US] = {
+        "camera_profile_apply_seconds", "Applying a sensor profile, changed settings only", 1000000,
+        { 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000 },
+    },
+    [METRIC_JPEG_CHECK_US] = {
+        "camera_jpeg_check_seconds", "Integrity check of one sensor JPEG", 1000000,
+        { 50, 100, 200, 500, 1000, 2000, 5000, 10000 },
+    },
+    [METRIC_CAMERA_RESUME_US] = {
+        "camera_resume_seconds", "Sensor standby exit to the first fresh frame", 1000000,
+        { 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000 },
+    },
+    [METRIC_BURST_INTERVAL_US] = {
+        "burst_frame_interval_seconds", "Capture interval between consecutive frames of a /burst", 1000000,
+        { 10000, 20000, 30000, 40000, 50000, 70000, 100000, 200000 },
+    },
+};
+
+static const scalar_desc_t s_counter_desc[METRIC_COUNTER_COUNT] = {
+    [METRIC_FRAMES_CAPTURED] = { "camera_frames_total", "Frames captured from the sensor" },
+    [METRIC_FRAMES_SENT] = { "stream_frames_sent_total", "Frames delivered to stream clients" },
+    [METRIC_FRAMES_SUPERSEDED] = { "stream_frames_superseded_total", "Frames replaced by a newer one before a client took them" },
+    [METRIC_FRAMES_OVERRUN] = { "camera_frames_overrun_total", "Captured frames dropped for lack of a hub slot or process queue room" },
+    [METRIC_FRAMES_STALE] = { "camera_frames_stale_total", "Frames discarded as captured before a standby exit or window change" },
+    [METRIC_CAPTURE_FAILED] = { "camera_capture_failures_total", "No frame from the driver, or a raw frame that failed to encode" },
+    [METRIC_FB_OVF] = { "camera_fb_ovf_total", "Driver FB-OVF events" },
+    [METRIC_NO_EOI] = { "camera_no_eoi_total", "Driver NO-EOI events" },
+    [METRIC_BYTES_SENT] = { "stream_bytes_sent_total", "Stream bytes delivered to clients" },
+    [METRIC_FRAMES_UNCHANGED] = { "stream_frames_unchanged_total", "Frames skipped because the scene had not changed" },
+    [METRIC_BYTES_SUPPRESSED] = { "stream_bytes_suppressed_total", "Bytes of frames skipped because the scene had not changed" },
+    [METRIC_RECORD_FRAMES] = { "record_frames_total", "Frames queued for the SD card recording" },
+    [METRIC_RECORD_DROPPED] = { "record_frames_dropped_total", "Frames missing from the recording" },
+    [METRIC_RECORD_BYTES] = { "record_bytes_total", "Bytes written to the SD card" },
+    [METRIC_RTP_FRAMES_SENT] = { "rtp_frames_sent_total", "Frames sent to RTSP sessions" },
+    [METRIC_RTP_PACKETS_SENT] = { "rtp_packets_sent_total", "RTP packets sent" },
+    [METRIC_RTP_FRAMES_REJECTED] = { "rtp_frames_rejected_total", "Frames RTP/JPEG cannot carry" },
+    [METRIC_SENSOR_WRITES] = { "camera_sensor_writes_total", "Sensor settings written by profiles" },
+    [METRIC_PIPELINE_REFUSED] = { "pipeline_process_refused_total", "Frames dropped because the process queue was full" },
+    [METRIC_JPEG_REPAIRED] = { "camera_jpeg_repaired_total", "Corrupt sensor JPEGs cut short and closed with an EOI" },
+    [METRIC_JPEG_DROPPED] = { "camera_jpeg_dropped_total", "Corrupt sensor JPEGs dropped" },
+    [METRIC_JPEG_STEPDOWNS] = { "camera_jpeg_stepdowns_total", "Quality or XCLK reductions because of corrupt frames" },
+    [METRIC_CAMERA_STANDBYS] = { "camera_standby_total", "Times the sensor went into standby for lack of viewers" },
+    [METRIC_BOUNCE_BYTES] = { "stream_bounce_bytes_total", "Stream payload sent from internal RAM bounce buffers" },
+    [METRIC_BOUNCE_STALLS] = { "stream_bounce_stalls_total", "Times a stream send waited for a bounce buffer copy" },
+};
+
+static const scalar_desc_t s_gauge_desc[METRIC_GAUGE_COUNT] = {
+    [METRIC_HEAP_INTERNAL_FREE] = { "heap_internal_free_bytes", "Free internal RAM" },
+    [METRIC_HEAP_INTERNAL_MIN_FREE] = { "heap_internal_min_free_bytes", "Lowest free internal RAM since boot" },
+    [METRIC_HEAP_PSRAM_FREE] = { "heap_psram_free_bytes", "Free PSRAM" },
+    [METRIC_HEAP_PSRAM_MIN_FREE] = { "heap_psram_min_free_bytes", "Lowest free PSRAM since boot" },
+    [METRIC_STREAM_CLIENTS] = { "stream_clients", "Connected stream clients" },
+    [METRIC_RECORD_WRITE_MAX_US] = { "record_write_max_microseconds", "Slowest SD card batch write in the last report period" },
+    [METRIC_RECORD_HANDOFF_MAX_US] = { "record_handoff_max_microseconds", "Longest frame hand-off to the SD writer in the last report period" },
+    [METRIC_RTSP_SESSIONS] = { "rtsp_sessions", "RTSP sessions set up" },
+    [METRIC_PIPELINE_CAPTURE_LOAD] = { "pipeline_capture_busy_permille", "Capture stage busy time per mille since the last scrape" },
+    [METRIC_PIPELINE_PROCESS_LOAD] = { "pipeline_process_busy_permille", "Process stage busy time per mille since the last scrape" },
+    [METRIC_PIPELINE_SEND_LOAD] = { "pipeline_send_busy_permille", "Sender task busy time per mille since the last scrape, averaged" },
+    [METRIC_PIPELINE_QUEUE_MAX] = { "pipeline_process_queue_max_depth", "Deepest the process queue got since the last scrape" },
+    [METRIC_CAMERA_STANDBY] = { "camera_standby", "1 while the sensor is in standby" },
+    [METRIC_LIGHT_SLEEP_LOAD] = { "power_light_sleep_permille", "Time in light sleep per mille since the last scrape" },
+};
+
+typedef struct {
+    atomic_uint_least32_t buckets[METRICS_MAX_BUCKETS + 1]; // Last is +Inf
+    atomic_uint_least32_t sum;
+} hist_state_t;
+
+static hist_state_t s_hist[METRIC_HIST_COUNT];
+static atomic_uint_least32_t s_counters[METRIC_COUNTER_COUNT];
+static atomic_int_least32_t s_gauges[METRIC_GAUGE_COUNT];
+
+void metrics_observe(metrics_hist_t id, uint32_t value)
+{
+    const uint32_t *bounds = s_hist_desc[id].bounds;
+    hist_state_t *h = &s_hist[id];
+    size_t i = 0;
+
+    while (i < METRICS_MAX_BUCKETS && bounds[i] && value > bounds[i]) {
+        i++;
+    }
+    if (i < METRICS_MAX_BUCKETS && !bounds[i]) {
+        i = METRICS_MAX_BUCKETS;    // Past the last bound: +Inf
+    }
+
+    atomic_fetch_add_explicit(&h->buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+}
+
+void metrics_add(metrics_counter_t id, uint32_t n)
+{
+    atomic_fetch_add_explicit(&s_counters[id], n, memory_order_relaxed);
+}
+
+uint32_t metrics_counter(metrics_counter_t id)
+{
+    return atomic_load_explicit(&s_counters[id], memory_order_relaxed);
+}
+
+void metrics_set(metrics_gauge_t id, int32_t value)
+{
+    atomic_store_explicit(&s_gauges[id], value, memory_order_relaxed);
+}
+
+void metrics_reset(void)
+{
+    for (size_t i = 0; i < METRIC_HIST_COUNT; i++) {
+        for (size_t b = 0; b <= METRICS_MAX_BUCKETS; b++) {
+            atomic_store(&s_hist[i].buckets[b], 0);
+        }
+        atomic_store(&s_hist[i].sum, 0);
+    }
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        atomic_store(&s_counters[i], 0);
+    }
+}
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t pos;                     // Total bytes produced so far
+} out_t;
+
+static void out_printf(out_t *out, const char *fmt, ...)
+{
+    va_list ap;
+    size_t room = out->pos < out->len ? out->len - out->pos : 0;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(room ? out->buf + out->pos : NULL, room, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        out->pos += n;
+    }
+}
+
+// Print value / scale without floating point
+static void out_scaled(out_t *out, uint32_t value, uint32_t scale)
+{
+    if (scale == 1) {
+        out_printf(out, "%" PRIu32, value);
+    } else {
+        out_printf(out, "%" PRIu32 ".%06" PRIu32, value / scale,
+                   (uint32_t)((uint64_t)(value % scale) * 1000000 / scale));
+    }
+}
+
+size_t metrics_format(char *buf, size_t len)
+{
+    out_t out = { .buf = buf, .len = len, .pos = 0 };
+
+    if (buf && len) {
+        buf[0] = '\0';
+    }
+
+    for (size_t i = 0; i < METRIC_HIST_COUNT; i++) {
+        const hist_desc_t *d = &s_hist_desc[i];
+        hist_state_t *h = &s_hist[i];
+        uint32_t cumulative = 0;
+
+        out_printf(&out, "# HELP %s %s\n# TYPE %s histogram\n", d->name, d->help, d->name);
+        for (size_t b = 0; b < METRICS_MAX_BUCKETS && d->bounds[b]; b++) {
+            cumulative += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+            out_printf(&out, "%s_bucket{le=\"", d->name);
+            out_scaled(&out, d->bounds[b], d->scale);
+            out_printf(&out, "\"} %" PRIu32 "\n", cumulative);
+        }
+        cumulative += atomic_load_explicit(&h->buckets[METRICS_MAX_BUCKETS], memory_order_relaxed);
+        out_printf(&out, "%s_bucket{le=\"+Inf\"} %" PRIu32 "\n%s_sum ", d->name, cumulative, d->name);
+        out_scaled(&out, atomic_load_explicit(&h->sum, memory_order_relaxed), d->scale);
+        out_printf(&out, "\n%s_count %" PRIu32 "\n", d->name, cumulative);
+    }
+
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        const scalar_desc_t *d = &s_counter_desc[i];
+        out_printf(&out, "# HELP %s %s\n# TYPE %s counter\n%s %" PRIu32 "\n",
+                   d->name, d->help, d->name, d->name,
+                   (uint32_t)atomic_load_explicit(&s_counters[i], memory_order_relaxed));
+    }
+
+    for (size_t i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        const scalar_desc_t *d = &s_gauge_desc[i];
+        out_printf(&out, "# HELP %s %s\n# TYPE %s gauge\n%s %" PRId32 "\n",
+                   d->name, d->help, d->name, d->name,
+                   (int32_t)atomic_load_explicit(&s_gauges[i], memory_order_relaxed));
+    }
+
+    return out.pos;
+}
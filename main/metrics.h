@@ -0,0 +1,108 @@
+/*
+ * Lock-free runtime metrics
+ *
+ * Fixed-bucket histograms, counters and gauges updated from hot paths with
+ * relaxed atomics only (no locks, no allocation), and rendered on demand in
+ * Prometheus text exposition format. The set of metrics is a static table
+ * indexed by the enums below. Pure C11, no ESP-IDF dependencies.
+ *
+ * All state is 32 bits wide: Xtensa has no 64-bit atomic instructions, and
+ * wider atomics would fall back to libatomic's locks. Counters and
+ * histogram sums therefore wrap at 2^32; Prometheus treats the drop as a
+ * counter reset, so rate() stays correct as long as it is scraped more
+ * often than a counter wraps (stream_bytes_sent_total at 2 MB/s: ~35 min).
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    METRIC_FB_GET_WAIT_US,          // Time blocked in esp_camera_fb_get()
+    METRIC_SEND_CHUNK_US,           // One socket write / send_chunk call
+    METRIC_FRAME_SEND_US,           // Whole frame, first byte to last
+    METRIC_FRAME_BYTES,             // JPEG size
+    METRIC_FRAME_INTERVAL_US,       // Between consecutive captured frames
+    METRIC_SW_ENCODE_US,            // Software JPEG encode of a raw frame
+    METRIC_MOTION_DETECT_US,        // Scene change check of one frame
+    METRIC_STREAM_FRAME_AGE_US,     // Capture to last MJPEG byte sent
+    METRIC_RTP_FRAME_AGE_US,        // Capture to last RTP packet sent
+    METRIC_RTP_FRAME_SEND_US,       // Packetizing and sending one frame
+    METRIC_WS_ACK_LATENCY_US,       // Capture to the /ws client's ack
+    METRIC_SCALE_US,                // Downscale and re-encode, per scale
+    METRIC_SENSOR_PROFILE_US,       // Applying a sensor profile
+    METRIC_JPEG_CHECK_US,           // Integrity check of one sensor JPEG
+    METRIC_CAMERA_RESUME_US,        // Standby exit to the first fresh frame
+    METRIC_BURST_INTERVAL_US,       // Between consecutive frames of a burst
+    METRIC_HIST_COUNT
+} metrics_hist_t;
+
+typedef enum {
+    METRIC_FRAMES_CAPTURED,
+    METRIC_FRAMES_SENT,
+    METRIC_FRAMES_SUPERSEDED,       // Replaced before a client took them
+    METRIC_FRAMES_OVERRUN,          // Captured, but no slot or queue room
+    METRIC_FRAMES_STALE,            // Captured before a standby exit or resize
+    METRIC_CAPTURE_FAILED,          // No frame from the driver or encoder
+    METRIC_FB_OVF,
+    METRIC_NO_EOI,
+    METRIC_BYTES_SENT,              // Stream payload put on the wire
+    METRIC_FRAMES_UNCHANGED,        // Not sent, scene had not changed
+    METRIC_BYTES_SUPPRESSED,        // Payload of those frames
+    METRIC_RECORD_FRAMES,           // Queued for the SD card
+    METRIC_RECORD_DROPPED,          // Not recorded: writer busy or missed
+    METRIC_RECORD_BYTES,            // Written to the SD card
+    METRIC_RTP_FRAMES_SENT,
+    METRIC_RTP_PACKETS_SENT,
+    METRIC_RTP_FRAMES_REJECTED,     // Not RFC 2435 compatible
+    METRIC_SENSOR_WRITES,           // Sensor setters called by profiles
+    METRIC_PIPELINE_REFUSED,        // Frames the process stage had no room for
+    METRIC_JPEG_REPAIRED,           // Truncated sensor JPEGs closed early
+    METRIC_JPEG_DROPPED,            // Sensor JPEGs beyond repair
+    METRIC_JPEG_STEPDOWNS,          // Quality/XCLK reduced for corruption
+    METRIC_CAMERA_STANDBYS,         // Times the sensor went into standby
+    METRIC_BOUNCE_BYTES,            // Payload sent out of internal RAM blocks
+    METRIC_BOUNCE_STALLS,           // Sends that waited for a block copy
+    METRIC_COUNTER_COUNT
+} metrics_counter_t;
+
+typedef enum {
+    METRIC_HEAP_INTERNAL_FREE,
+    METRIC_HEAP_INTERNAL_MIN_FREE,
+    METRIC_HEAP_PSRAM_FREE,
+    METRIC_HEAP_PSRAM_MIN_FREE,
+    METRIC_STREAM_CLIENTS,
+    METRIC_RECORD_WRITE_MAX_US,     // Slowest SD batch write, last period
+    METRIC_RECORD_HANDOFF_MAX_US,   // Longest frame hand-off to the writer
+    METRIC_RTSP_SESSIONS,
+    METRIC_PIPELINE_CAPTURE_LOAD,   // Per mille busy since the last scrape
+    METRIC_PIPELINE_PROCESS_LOAD,
+    METRIC_PIPELINE_SEND_LOAD,      // Average over the sender tasks
+    METRIC_PIPELINE_QUEUE_MAX,      // Deepest process queue since the last scrape
+    METRIC_CAMERA_STANDBY,          // 1 while the sensor is in standby
+    METRIC_LIGHT_SLEEP_LOAD,        // Per mille in light sleep since the last scrape
+    METRIC_GAUGE_COUNT
+} metrics_gauge_t;
+
+void metrics_observe(metrics_hist_t id, uint32_t value);
+void metrics_add(metrics_counter_t id, uint32_t n);
+void metrics_set(metrics_gauge_t id, int32_t value);
+
+static inline void metrics_inc(metrics_counter_t id)
+{
+    metrics_add(id, 1);
+}
+
+// Current value of a counter, modulo 2^32
+uint32_t metrics_counter(metrics_counter_t id);
+
+// Render every metric as Prometheus text. Works like snprintf: writes at
+// most len bytes (NUL-terminated) and returns the full length needed.
+size_t metrics_format(char *buf, size_t len);
+
+// Zero all histograms and counters (gauges are left alone).
+void metrics_reset(void);
+
+#endif // METRICS_H
@@ -0,0 +1,124 @@
+/*
+ * Raw multipart/x-mixed-replace part writer
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mjpeg_part.h"
+
+size_t mjpeg_part_head(char *buf, size_t cap, size_t len, const mjpeg_part_meta_t *meta)
+{
+    int n;
+    if (meta) {
+        n = snprintf(buf, cap,
+                     "Content-Type: image/jpeg\r\n"
+                     "Content-Length: %u\r\n"
+                     "X-Timestamp: %lld.%06lld\r\n"
+                     "X-Sequence: %lu\r\n"
+                     "X-Clock-Offset: %lld\r\n"
+                     "\r\n",
+                     (unsigned)len,
+                     (long long)(meta->timestamp_us / 1000000),
+                     (long long)(meta->timestamp_us % 1000000),
+                     (unsigned long)meta->seq, (long long)meta->clock_offset_us);
+    } else {
+        n = snprintf(buf, cap,
+                     "Content-Type: image/jpeg\r\n"
+                     "Content-Length: %u\r\n"
+                     "\r\n",
+                     (unsigned)len);
+    }
+    return n < 0 ? 0 : (size_t)n < cap ? (size_t)n : cap - 1;
+}
+
+void mjpeg_part_init(mjpeg_part_t *part, const uint8_t *payload, size_t len,
+                     const mjpeg_part_meta_t *meta)
+{
+    size_t hlen = mjpeg_part_head(part->head, sizeof(part->head), len, meta);
+
+    part->iov[0] = (struct iovec){ .iov_base = part->head, .iov_len = hlen };
+    part->iov[1] = (struct iovec){ .iov_base = (void *)payload, .iov_len = len };
+    part->iov[2] = (struct iovec){ .iov_base = (void *)MJPEG_PART_DELIM, .iov_len = MJPEG_PART_DELIM_LEN };
+    part->iov_cnt = 3;
+    part->iov_idx = 0;
+    part->total = hlen + len + MJPEG_PART_DELIM_LEN;
+    part->sent = 0;
+    part->writes = 0;
+    part->bounce = NULL;
+}
+
+void mjpeg_part_bounce(mjpeg_part_t *part, bounce_ring_t *ring)
+{
+    struct iovec *v = &part->iov[MJPEG_PART_PAYLOAD];
+    bounce_ring_start(ring, v->iov_base, v->iov_len);
+    part->bounce = ring;
+}
+
+// Vectors for the next write. A bounced payload goes out as far as it has
+// been copied, and nothing after it before it is complete.
+static size_t gather(mjpeg_part_t *part, struct iovec *vec)
+{
+    size_t cnt = 0;
+    for (size_t i = part->iov_idx; i < part->iov_cnt; i++) {
+        if (i != MJPEG_PART_PAYLOAD || !part->bounce) {
+            vec[cnt++] = part->iov[i];
+            continue;
+        }
+        const uint8_t *data;
+        size_t n = bounce_ring_peek(part->bounce, &data);
+        if (n) {
+            vec[cnt++] = (struct iovec){ .iov_base = (void *)data, .iov_len = n };
+        }
+        if (n < part->iov[i].iov_len) {
+            break;
+        }
+    }
+    return cnt;
+}
+
+mjpeg_part_status_t mjpeg_part_write(mjpeg_part_t *part, int fd)
+{
+    while (part->sent < part->total) {
+        struct iovec vec[sizeof(part->iov) / sizeof(part->iov[0])];
+        size_t cnt = gather(part, vec);
+        if (!cnt) {
+            bounce_ring_wait(part->bounce);
+            continue;
+        }
+        struct msghdr msg = {
+            .msg_iov = vec,
+            .msg_iovlen = cnt,
+        };
+        ssize_t w = sendmsg(fd, &msg, MSG_DONTWAIT);
+        part->writes++;
+        if (w < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return MJPEG_PART_WOULD_BLOCK;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return MJPEG_PART_ERROR;
+        }
+        part->sent += w;
+
+        // Skip fully written vectors and trim the first partial one
+        size_t n = w;
+        while (n > 0 && part->iov_idx < part->iov_cnt) {
+            struct iovec *v = &part->iov[part->iov_idx];
+            size_t used = n < v->iov_len ? n : v->iov_len;
+            if (part->iov_idx == MJPEG_PART_PAYLOAD && part->bounce) {
+                bounce_ring_consume(part->bounce, used);
+            }
+            v->iov_base = (uint8_t *)v->iov_base + used;
+            v->iov_len -= used;
+            n -= used;
+            if (!v->iov_len) {
+                part->iov_idx++;
+            }
+        }
+    }
+    return MJPEG_PART_DONE;
+}
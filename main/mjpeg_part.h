@@ -0,0 +1,79 @@
+/*
+ * Raw multipart/x-mixed-replace part writer
+ *
+ * Sends the part header, the JPEG payload and the trailing boundary of one
+ * frame with a single gather write straight from the frame buffer: no
+ * intermediate copy, no chunked-transfer framing. Partial writes on
+ * non-blocking sockets resume where they stopped. Plain POSIX sockets, so it
+ * builds against lwIP and on Linux alike.
+ *
+ * Each part header can carry when and in what order its frame was taken:
+ *
+ *   X-Timestamp: 1760000000.123456     capture time, device wall clock (s)
+ *   X-Sequence: 1234                   frame number, gaps are skipped frames
+ *   X-Clock-Offset: 1759999990123456   device wall clock minus boot clock (us)
+ *
+ * With the device clock synced over SNTP, a client with a synced clock gets
+ * the frame's end-to-end latency as its arrival time minus X-Timestamp.
+ *
+ * A part can instead send its payload through a bounce ring, from internal
+ * RAM block by block; header and boundary still go out in the same writes.
+ */
+
+#ifndef MJPEG_PART_H
+#define MJPEG_PART_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "bounce_ring.h"
+
+#define MJPEG_BOUNDARY          "frame"
+#define MJPEG_CONTENT_TYPE      "multipart/x-mixed-replace; boundary=" MJPEG_BOUNDARY
+#define MJPEG_PART_DELIM        "\r\n--" MJPEG_BOUNDARY "\r\n"
+#define MJPEG_PART_DELIM_LEN    (sizeof(MJPEG_PART_DELIM) - 1)
+// iov[] index of the payload, in MJPEG and WebSocket parts alike
+#define MJPEG_PART_PAYLOAD      1
+
+typedef enum {
+    MJPEG_PART_DONE,
+    MJPEG_PART_WOULD_BLOCK,
+    MJPEG_PART_ERROR,               // errno holds the socket error
+} mjpeg_part_status_t;
+
+typedef struct {
+    uint32_t seq;
+    int64_t timestamp_us;           // Capture time, microseconds since the epoch
+    int64_t clock_offset_us;
+} mjpeg_part_meta_t;
+
+typedef struct {
+    char head[160];
+    struct iovec iov[3];            // Header, payload, boundary
+    size_t iov_cnt;
+    size_t iov_idx;                 // First iovec with bytes left
+    size_t total;                   // Bytes in the whole part
+    size_t sent;
+    uint32_t writes;                // Send calls spent on this part
+    bounce_ring_t *bounce;          // Payload source, NULL to send it in place
+} mjpeg_part_t;
+
+// Format the header of a part of len bytes into buf. meta may be NULL for
+// a plain header. Returns its length.
+size_t mjpeg_part_head(char *buf, size_t cap, size_t len, const mjpeg_part_meta_t *meta);
+
+// Prepare a part for payload. The payload must stay valid until the part is
+// done. meta as for mjpeg_part_head().
+void mjpeg_part_init(mjpeg_part_t *part, const uint8_t *payload, size_t len,
+                     const mjpeg_part_meta_t *meta);
+
+// Send the payload of a prepared part through ring instead of in place
+void mjpeg_part_bounce(mjpeg_part_t *part, bounce_ring_t *ring);
+
+// Write as much of the part as fd accepts without blocking on the socket.
+// With a bounce ring it may wait for a copy to finish, in the ring's wait
+// hook.
+mjpeg_part_status_t mjpeg_part_write(mjpeg_part_t *part, int fd);
+
+#endif // MJPEG_PART_H
@@ -0,0 +1,67 @@
+/*
+ * Motion detector - thumbnail differencing against the current scene
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "motion_detector.h"
+
+void motion_init(motion_t *m, const motion_config_t *cfg)
+{
+    memset(m, 0, sizeof(*m));
+    m->cfg = *cfg;
+    if (m->cfg.threshold < 1) {
+        m->cfg.threshold = 1;
+    }
+    if (m->cfg.area_permille < 1) {
+        m->cfg.area_permille = 1;
+    }
+}
+
+static bool scene_changed(const motion_t *m, const uint8_t *thumb, size_t cells)
+{
+    size_t limit = cells * m->cfg.area_permille / 1000;
+    size_t changed = 0;
+    int threshold = m->cfg.threshold;
+
+    for (size_t i = 0; i < cells; i++) {
+        int d = thumb[i] - m->ref[i];
+        if (d > threshold || d < -threshold) {
+            if (++changed > limit) {
+                return true;        // No need to look further
+            }
+        }
+    }
+    return false;
+}
+
+bool motion_update(motion_t *m, const uint8_t *thumb, int width, int height)
+{
+    size_t cells = (size_t)width * height;
+
+    if (m->width == width && m->height == height && !scene_changed(m, thumb, cells)) {
+        return false;
+    }
+
+    if (cells > m->cap) {
+        uint8_t *ref = realloc(m->ref, cells);
+        if (!ref) {
+            motion_force(m);
+            return true;
+        }
+        m->ref = ref;
+        m->cap = cells;
+    }
+    memcpy(m->ref, thumb, cells);
+    m->width = width;
+    m->height = height;
+    m->scene++;
+    return true;
+}
+
+void motion_force(motion_t *m)
+{
+    m->width = m->height = 0;
+    m->scene++;
+}
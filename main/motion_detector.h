@@ -0,0 +1,43 @@
+/*
+ * Motion detector - scene change decision on luma thumbnails
+ *
+ * Each thumbnail is compared against the one that last counted as a
+ * change, not against the previous frame, so slow drift still adds up to a
+ * change eventually. A frame is "changed" when more than area_permille of
+ * its cells moved by more than threshold brightness levels. Every change
+ * bumps the scene number; consumers that already delivered a scene can
+ * skip frames until it moves on. Pure C, no ESP-IDF dependencies.
+ */
+
+#ifndef MOTION_DETECTOR_H
+#define MOTION_DETECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    int threshold;                  // Per-cell brightness change, 1..255
+    int area_permille;              // Changed cells needed, 1..1000
+} motion_config_t;
+
+typedef struct {
+    motion_config_t cfg;
+    uint8_t *ref;                   // Thumbnail of the current scene
+    size_t cap;
+    int width;                      // 0 until the first frame
+    int height;
+    uint32_t scene;
+} motion_t;
+
+void motion_init(motion_t *m, const motion_config_t *cfg);
+
+// Compare a thumbnail with the current scene. Returns true (and starts a
+// new scene) if it changed; a size change always counts.
+bool motion_update(motion_t *m, const uint8_t *thumb, int width, int height);
+
+// Start a new scene unconditionally, e.g. for a frame that could not be
+// analysed. The next thumbnail becomes the reference.
+void motion_force(motion_t *m);
+
+#endif // MOTION_DETECTOR_H
@@ -0,0 +1,136 @@
+/*
+ * Pipeline stage - worker thread behind a lock-free SPSC queue
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "pipeline_stage.h"
+#include "spsc_queue.h"
+
+struct pipeline_stage {
+    pipeline_stage_config_t cfg;
+    spsc_queue_t queue;
+    pthread_t thread;
+    pthread_mutex_t lock;           // Only for sleeping and waking
+    pthread_cond_t cond;
+    atomic_bool sleeping;
+    bool stopping;                  // Under lock
+
+    atomic_uint items;
+    atomic_uint refused;
+    atomic_uint max_depth;
+    atomic_uint_fast64_t busy_us;
+};
+
+// Next item, sleeping until one arrives. NULL once stopping and drained.
+static void *next_item(pipeline_stage_t *st)
+{
+    void *item = spsc_queue_pop(&st->queue);
+    if (item) {
+        return item;
+    }
+
+    pthread_mutex_lock(&st->lock);
+    // Announce the sleep before the last look, so a push that this pop
+    // misses is guaranteed to see the flag and signal
+    atomic_store(&st->sleeping, true);
+    while (!(item = spsc_queue_pop(&st->queue)) && !st->stopping) {
+        pthread_cond_wait(&st->cond, &st->lock);
+    }
+    atomic_store(&st->sleeping, false);
+    pthread_mutex_unlock(&st->lock);
+    return item;
+}
+
+static void *stage_thread(void *arg)
+{
+    pipeline_stage_t *st = arg;
+    void *item;
+
+    while ((item = next_item(st))) {
+        int64_t start = st->cfg.clock_us ? st->cfg.clock_us() : 0;
+        st->cfg.process(item, st->cfg.arg);
+        if (st->cfg.clock_us) {
+            atomic_fetch_add_explicit(&st->busy_us, st->cfg.clock_us() - start,
+                                      memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(&st->items, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+pipeline_stage_t *pipeline_stage_start(const pipeline_stage_config_t *cfg)
+{
+    if (!cfg->process || !cfg->queue_len) {
+        return NULL;
+    }
+    pipeline_stage_t *st = calloc(1, sizeof(*st));
+    if (!st) {
+        return NULL;
+    }
+    st->cfg = *cfg;
+    if (!spsc_queue_init(&st->queue, cfg->queue_len)) {
+        free(st);
+        return NULL;
+    }
+
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_cond_init(&st->cond, NULL);
+    if (pthread_create(&st->thread, NULL, stage_thread, st) != 0) {
+        pthread_cond_destroy(&st->cond);
+        pthread_mutex_destroy(&st->lock);
+        spsc_queue_free(&st->queue);
+        free(st);
+        return NULL;
+    }
+    return st;
+}
+
+bool pipeline_stage_submit(pipeline_stage_t *st, void *item)
+{
+    if (!spsc_queue_push(&st->queue, item)) {
+        atomic_fetch_add_explicit(&st->refused, 1, memory_order_relaxed);
+        return false;
+    }
+
+    unsigned depth = spsc_queue_depth(&st->queue);
+    if (depth > atomic_load_explicit(&st->max_depth, memory_order_relaxed)) {
+        atomic_store_explicit(&st->max_depth, depth, memory_order_relaxed);
+    }
+
+    if (atomic_load(&st->sleeping)) {
+        pthread_mutex_lock(&st->lock);
+        pthread_cond_signal(&st->cond);
+        pthread_mutex_unlock(&st->lock);
+    }
+    return true;
+}
+
+size_t pipeline_stage_depth(pipeline_stage_t *st)
+{
+    return spsc_queue_depth(&st->queue);
+}
+
+void pipeline_stage_take_stats(pipeline_stage_t *st, pipeline_stage_stats_t *stats)
+{
+    stats->items = atomic_exchange_explicit(&st->items, 0, memory_order_relaxed);
+    stats->refused = atomic_exchange_explicit(&st->refused, 0, memory_order_relaxed);
+    stats->max_depth = atomic_exchange_explicit(&st->max_depth, 0, memory_order_relaxed);
+    stats->busy_us = atomic_exchange_explicit(&st->busy_us, 0, memory_order_relaxed);
+}
+
+void pipeline_stage_stop(pipeline_stage_t *st)
+{
+    pthread_mutex_lock(&st->lock);
+    st->stopping = true;
+    pthread_cond_signal(&st->cond);
+    pthread_mutex_unlock(&st->lock);
+    pthread_join(st->thread, NULL);
+
+    pthread_cond_destroy(&st->cond);
+    pthread_mutex_destroy(&st->lock);
+    spsc_queue_free(&st->queue);
+    free(st);
+}
@@ -0,0 +1,60 @@
+/*
+ * Pipeline stage
+ *
+ * One worker thread fed by a bounded SPSC queue. An upstream stage submits
+ * items without ever blocking: if the queue is full the item is refused
+ * and the caller drops it, so a slow stage sheds load instead of stalling
+ * the one before it. The worker handles items in order and sleeps on a
+ * condition variable only when its queue runs dry; the producer signals it
+ * only if it is actually asleep, so a busy pipeline takes no locks.
+ *
+ * Each stage counts items, refusals, the deepest its queue got and the
+ * time spent working, which is what shows where a pipeline saturates.
+ *
+ * Plain pthreads, like the AVI writer: on ESP-IDF the caller sets the
+ * worker's core, priority and stack with esp_pthread_set_cfg() first.
+ */
+
+#ifndef PIPELINE_STAGE_H
+#define PIPELINE_STAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char *name;
+    // Handle one item; the stage is done with it when this returns
+    void (*process)(void *item, void *arg);
+    void *arg;
+    size_t queue_len;               // Items that can wait
+    int64_t (*clock_us)(void);      // Optional, enables busy time
+} pipeline_stage_config_t;
+
+// Accumulated since the last pipeline_stage_take_stats()
+typedef struct {
+    uint32_t items;                 // Processed
+    uint32_t refused;               // Submitted while the queue was full
+    uint32_t max_depth;             // Deepest the queue got
+    uint64_t busy_us;               // Spent in process()
+} pipeline_stage_stats_t;
+
+typedef struct pipeline_stage pipeline_stage_t;
+
+// Create the queue and start the worker thread
+pipeline_stage_t *pipeline_stage_start(const pipeline_stage_config_t *cfg);
+
+// Queue item for the worker. Only one thread may submit to a stage.
+// Returns false if the queue is full; the item then stays the caller's.
+bool pipeline_stage_submit(pipeline_stage_t *st, void *item);
+
+// Items waiting right now
+size_t pipeline_stage_depth(pipeline_stage_t *st);
+
+// Copy out the stats and start a new accumulation period
+void pipeline_stage_take_stats(pipeline_stage_t *st, pipeline_stage_stats_t *stats);
+
+// Process what is queued, stop the worker and free st
+void pipeline_stage_stop(pipeline_stage_t *st);
+
+#endif // PIPELINE_STAGE_H
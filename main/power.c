@@ -0,0 +1,70 @@
+/*
+ * Power management - DFS and automatic light sleep, sleep time accounting
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+
+#include "power.h"
+
+static const char *TAG = "POWER";
+
+// Lowest CPU clock when idle. Wi-Fi needs at least 40 MHz (the XTAL).
+#define POWER_MIN_CPU_MHZ   40
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t s_sleep_us;
+
+// Runs on the way out of every light sleep, with interrupts off
+static esp_err_t IRAM_ATTR on_light_sleep_exit(int64_t sleep_time_us, void *arg)
+{
+    portENTER_CRITICAL_ISR(&s_lock);
+    s_sleep_us += sleep_time_us;
+    portEXIT_CRITICAL_ISR(&s_lock);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t power_init(void)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t cfg = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_CPU_MHZ,
+#if CONFIG_POWER_LIGHT_SLEEP && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Power management not configured: %s", esp_err_to_name(err));
+        return err;
+    }
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .exit_cb = on_light_sleep_exit,
+    };
+    esp_pm_light_sleep_register_cbs(&cbs);
+#endif
+    ESP_LOGI(TAG, "CPU %d-%d MHz, light sleep %s", POWER_MIN_CPU_MHZ,
+             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, cfg.light_sleep_enable ? "on" : "off");
+#endif
+    return ESP_OK;
+}
+
+uint64_t power_take_light_sleep_us(void)
+{
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    portENTER_CRITICAL(&s_lock);
+    uint64_t us = s_sleep_us;
+    s_sleep_us = 0;
+    portEXIT_CRITICAL(&s_lock);
+    return us;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,27 @@
+/*
+ * Power management
+ *
+ * With CONFIG_PM_ENABLE the chip scales its CPU clock down and, with
+ * tickless idle, light-sleeps between ticks whenever nothing holds a PM
+ * lock. Wi-Fi stays associated through light sleep in modem-sleep mode,
+ * waking for each DTIM beacon. The capture pipeline holds a CPU frequency
+ * and a no-light-sleep lock while frames flow, so all of this only kicks
+ * in while the sensor is in standby.
+ *
+ * Time spent in light sleep is counted from the PM exit callback and is
+ * the best idle-current proxy there is without a meter on the supply.
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Configure frequency scaling and light sleep. Harmless without PM.
+esp_err_t power_init(void);
+
+// Microseconds spent in light sleep since the last call, 0 if not counted
+uint64_t power_take_light_sleep_us(void);
+
+#endif // POWER_H
@@ -0,0 +1,149 @@
+/*
+ * Pre-event recorder - hub subscriber feeding a PSRAM frame ring
+ */
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "preevent.h"
+#include "frame_ring.h"
+#include "mjpeg_part.h"
+
+static const char *TAG = "PREEVENT";
+
+#define RECORDER_TASK_STACK 3072
+#define RECORDER_TASK_PRIO  4
+
+static frame_ring_t s_ring;
+static SemaphoreHandle_t s_lock;    // Guards s_ring
+static frame_sub_t *s_sub;
+
+static void recorder_task(void *arg)
+{
+    while (true) {
+        hub_frame_t *frame = frame_hub_wait(s_sub, portMAX_DELAY);
+        if (!frame) {
+            continue;
+        }
+
+        int64_t ts = (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+        size_t len = frame->len;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        uint32_t seq = frame_ring_push(&s_ring, frame->buf, len, frame->width, frame->height, ts);
+        xSemaphoreGive(s_lock);
+        frame_hub_release(frame);
+
+        if (!seq) {
+            ESP_LOGW(TAG, "Frame of %u bytes not recorded", (unsigned)len);
+        }
+    }
+}
+
+esp_err_t preevent_start(frame_hub_t *hub)
+{
+    size_t size = (size_t)CONFIG_PREEVENT_BUFFER_KB * 1024;
+    uint8_t *arena = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    s_lock = xSemaphoreCreateMutex();
+    if (!arena || !s_lock) {
+        ESP_LOGE(TAG, "No memory for a %u KB pre-event buffer", CONFIG_PREEVENT_BUFFER_KB);
+        return ESP_ERR_NO_MEM;
+    }
+    frame_ring_init(&s_ring, arena, size, (int64_t)CONFIG_PREEVENT_SECONDS * 1000000);
+
+    s_sub = frame_hub_subscribe(hub);
+    if (!s_sub) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(recorder_task, "preevent", RECORDER_TASK_STACK, NULL,
+                    RECORDER_TASK_PRIO, NULL) != pdPASS) {
+        frame_hub_unsubscribe(s_sub);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Recording the last %d s (at most %u KB)",
+             CONFIG_PREEVENT_SECONDS, CONFIG_PREEVENT_BUFFER_KB);
+    return ESP_OK;
+}
+
+static esp_err_t send_record(httpd_req_t *req, const frame_ring_rec_t *rec)
+{
+    char head[128];
+    int hlen = snprintf(head, sizeof(head),
+                        "Content-Type: image/jpeg\r\n"
+                        "Content-Length: %u\r\n"
+                        "X-Timestamp: %lld.%06ld\r\n"
+                        "\r\n",
+                        (unsigned)rec->len,
+                        (long long)(rec->timestamp_us / 1000000),
+                        (long)(rec->timestamp_us % 1000000));
+
+    esp_err_t res = httpd_resp_send_chunk(req, head, hlen);
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, (const char *)frame_ring_payload(rec), rec->len);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, MJPEG_PART_DELIM, MJPEG_PART_DELIM_LEN);
+    }
+    return res;
+}
+
+esp_err_t preevent_export(httpd_req_t *req)
+{
+    uint32_t first = 0, last = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool busy = s_ring.pin != 0;
+    bool have = !busy && frame_ring_span(&s_ring, &first, &last);
+    if (have) {
+        frame_ring_pin(&s_ring, first);
+    }
+    xSemaphoreGive(s_lock);
+
+    if (busy) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Export in progress", HTTPD_RESP_USE_STRLEN);
+    }
+    if (!have) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Nothing recorded yet");
+    }
+
+    char disposition[64];
+    snprintf(disposition, sizeof(disposition),
+             "attachment; filename=\"preevent-%lu.mjpeg\"", (unsigned long)last);
+    httpd_resp_set_type(req, MJPEG_CONTENT_TYPE);
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    esp_err_t res = httpd_resp_send_chunk(req, MJPEG_PART_DELIM + 2, MJPEG_PART_DELIM_LEN - 2);
+    uint32_t frames = 0;
+    size_t bytes = 0;
+
+    // Pinned records stay put, so payloads go out straight from the arena
+    for (uint32_t seq = first; res == ESP_OK && seq <= last; ) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        const frame_ring_rec_t *rec = frame_ring_find(&s_ring, seq);
+        xSemaphoreGive(s_lock);
+        if (!rec || rec->seq > last) {
+            break;
+        }
+        res = send_record(req, rec);
+        frames++;
+        bytes += rec->len;
+        seq = rec->seq + 1;
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    frame_ring_unpin(&s_ring);
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Exported %lu frames, %u bytes%s", (unsigned long)frames,
+             (unsigned)bytes, res == ESP_OK ? "" : " (client gone)");
+    return res;
+}
@@ -0,0 +1,25 @@
+/*
+ * Pre-event recorder
+ *
+ * Subscribes to the frame hub like a viewer and copies every frame into a
+ * PSRAM frame ring, so the last CONFIG_PREEVENT_SECONDS (or
+ * CONFIG_PREEVENT_BUFFER_KB) of video are always at hand. Because it is a
+ * permanent subscriber, the sensor keeps capturing even with no viewers.
+ */
+
+#ifndef PREEVENT_H
+#define PREEVENT_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "frame_hub.h"
+
+// Allocate the ring and start recording from hub. Takes one hub subscriber.
+esp_err_t preevent_start(frame_hub_t *hub);
+
+// Trigger: send everything recorded up to now as a multipart MJPEG
+// download. Recording continues meanwhile; the exported frames are pinned
+// so they cannot be overwritten mid-download. One export at a time.
+esp_err_t preevent_export(httpd_req_t *req);
+
+#endif // PREEVENT_H
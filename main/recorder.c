@@ -0,0 +1,250 @@
+/*
+ * SD card recorder - hub subscriber writing MJPEG AVI segments
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pthread.h"
+
+#include "recorder.h"
+#include "avi_writer.h"
+#include "metrics.h"
+
+static const char *TAG = "RECORDER";
+
+#define RECORDER_TASK_STACK 4096
+#define RECORDER_TASK_PRIO  4
+// The writer thread only waits on the card; keep it below capture and senders
+#define WRITER_STACK        4096
+#define WRITER_PRIO         3
+
+// Header frame rate until the first checkpoint measures the real one
+#define RECORD_NOMINAL_FPS  25
+#define RECORD_STATS_US     (10 * 1000000LL)
+#define RECORD_RETRY_MS     5000
+// Unfinished files repaired per start; one per power cut is the norm
+#define RECOVER_MAX         8
+
+static frame_sub_t *s_sub;
+static avi_writer_t *s_avi;
+static char s_path[64];
+static unsigned s_next_file;
+static size_t s_width;
+static size_t s_height;
+static int64_t s_opened_us;
+
+// Report period
+static avi_writer_stats_t s_stats;
+static int64_t s_stats_us;
+static uint32_t s_hub_dropped;
+
+static void segment_path(char *buf, size_t len, unsigned n)
+{
+    // 8.3 names, FATFS long file names are off by default
+    snprintf(buf, len, "%s/REC%05u.AVI", CONFIG_RECORD_DIR, n);
+}
+
+// Finish files a power cut left open and find the next free file number
+static void recover_files(void)
+{
+    unsigned todo[RECOVER_MAX];
+    size_t ntodo = 0;
+    unsigned n;
+
+    DIR *dir = opendir(CONFIG_RECORD_DIR);
+    if (!dir) {
+        return;
+    }
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        if (sscanf(e->d_name, "REC%5u", &n) != 1) {
+            continue;
+        }
+        if (n >= s_next_file) {
+            s_next_file = n + 1;
+        }
+        const char *ext = strrchr(e->d_name, '.');
+        if (ext && !strcasecmp(ext, ".idx") && ntodo < RECOVER_MAX) {
+            todo[ntodo++] = n;
+        }
+    }
+    closedir(dir);
+
+    for (size_t i = 0; i < ntodo; i++) {
+        char path[64];
+        segment_path(path, sizeof(path), todo[i]);
+        int64_t t0 = esp_timer_get_time();
+        if (avi_writer_recover(path)) {
+            ESP_LOGI(TAG, "Recovered %s in %lld ms", path,
+                     (long long)(esp_timer_get_time() - t0) / 1000);
+        } else {
+            ESP_LOGW(TAG, "Could not recover %s", path);
+        }
+    }
+}
+
+static void take_stats(void)
+{
+    avi_writer_stats_t st;
+    avi_writer_take_stats(s_avi, &st);
+
+    s_stats.frames += st.frames;
+    s_stats.dropped += st.dropped;
+    s_stats.batches += st.batches;
+    s_stats.bytes += st.bytes;
+    s_stats.write_us += st.write_us;
+    if (st.max_write_us > s_stats.max_write_us) {
+        s_stats.max_write_us = st.max_write_us;
+    }
+    if (st.max_add_us > s_stats.max_add_us) {
+        s_stats.max_add_us = st.max_add_us;
+    }
+}
+
+static void report_stats(int64_t now)
+{
+    if (s_avi) {
+        take_stats();
+    }
+    uint32_t hub_dropped = frame_hub_dropped(s_sub);
+    uint32_t missed = hub_dropped - s_hub_dropped;
+    s_hub_dropped = hub_dropped;
+
+    // Sustained is what the card kept up with over wall time; card rate
+    // only counts time spent inside write()
+    int64_t period = now - s_stats_us;
+    unsigned long sustained = period > 0 ? s_stats.bytes * 100 / period : 0;
+    unsigned long card = s_stats.write_us ? s_stats.bytes * 100 / s_stats.write_us : 0;
+
+    metrics_add(METRIC_RECORD_FRAMES, s_stats.frames);
+    metrics_add(METRIC_RECORD_DROPPED, s_stats.dropped + missed);
+    metrics_add(METRIC_RECORD_BYTES, s_stats.bytes);
+    metrics_set(METRIC_RECORD_WRITE_MAX_US, s_stats.max_write_us);
+    metrics_set(METRIC_RECORD_HANDOFF_MAX_US, s_stats.max_add_us);
+
+    ESP_LOGI(TAG, "%lu frames, %lu.%02lu MB/s sustained (card %lu.%02lu MB/s), "
+             "worst write %lu ms, worst hand-off %lu us, dropped %lu + %lu missed",
+             (unsigned long)s_stats.frames, sustained / 100, sustained % 100,
+             card / 100, card % 100, (unsigned long)(s_stats.max_write_us / 1000),
+             (unsigned long)s_stats.max_add_us, (unsigned long)s_stats.dropped,
+             (unsigned long)missed);
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats_us = now;
+}
+
+static bool open_segment(const hub_frame_t *frame)
+{
+    avi_writer_config_t cfg = {
+        .width = frame->width,
+        .height = frame->height,
+        .fps = RECORD_NOMINAL_FPS,
+        .batch_size = (size_t)CONFIG_RECORD_BATCH_KB * 1024,
+        .checkpoint_us = (int64_t)CONFIG_RECORD_CHECKPOINT_S * 1000000,
+        .clock_us = esp_timer_get_time,
+    };
+
+    esp_pthread_cfg_t thread = esp_pthread_get_default_config();
+    thread.stack_size = WRITER_STACK;
+    thread.prio = WRITER_PRIO;
+    thread.thread_name = "avi_writer";
+    esp_pthread_set_cfg(&thread);
+
+    segment_path(s_path, sizeof(s_path), s_next_file++);
+    s_avi = avi_writer_open(s_path, &cfg);
+    if (!s_avi) {
+        ESP_LOGE(TAG, "Cannot create %s (errno %d)", s_path, errno);
+        return false;
+    }
+    s_width = frame->width;
+    s_height = frame->height;
+    s_opened_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Recording %ux%u to %s", (unsigned)s_width, (unsigned)s_height, s_path);
+    return true;
+}
+
+static void close_segment(void)
+{
+    take_stats();
+    int64_t t0 = esp_timer_get_time();
+    bool ok = avi_writer_close(s_avi);
+    s_avi = NULL;
+    if (ok) {
+        ESP_LOGI(TAG, "Closed %s in %lld ms", s_path,
+                 (long long)(esp_timer_get_time() - t0) / 1000);
+    } else {
+        ESP_LOGE(TAG, "Write to %s failed, left for recovery", s_path);
+    }
+}
+
+static bool segment_done(const hub_frame_t *frame, int64_t now)
+{
+    return frame->width != s_width || frame->height != s_height ||
+           now - s_opened_us >= (int64_t)CONFIG_RECORD_SEGMENT_MIN * 60 * 1000000 ||
+           avi_writer_bytes(s_avi) + frame->len + CONFIG_RECORD_BATCH_KB * 1024 > AVI_WRITER_MAX_BYTES;
+}
+
+static void recorder_task(void *arg)
+{
+    recover_files();
+    s_stats_us = esp_timer_get_time();
+
+    while (true) {
+        hub_frame_t *frame = frame_hub_wait(s_sub, portMAX_DELAY);
+        if (!frame) {
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+
+        if (s_avi && segment_done(frame, now)) {
+            close_segment();
+        }
+        if (!s_avi && !open_segment(frame)) {
+            frame_hub_release(frame);
+            vTaskDelay(pdMS_TO_TICKS(RECORD_RETRY_MS));
+            continue;
+        }
+
+        int64_t ts = (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+        avi_writer_add(s_avi, frame->buf, frame->len, ts);
+        frame_hub_release(frame);
+
+        if (avi_writer_failed(s_avi)) {
+            close_segment();
+        }
+        if (now - s_stats_us >= RECORD_STATS_US) {
+            report_stats(now);
+        }
+    }
+}
+
+esp_err_t recorder_start(frame_hub_t *hub)
+{
+    if (mkdir(CONFIG_RECORD_DIR, 0775) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG, "Cannot create %s (errno %d)", CONFIG_RECORD_DIR, errno);
+        return ESP_FAIL;
+    }
+
+    s_sub = frame_hub_subscribe(hub);
+    if (!s_sub) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(recorder_task, "recorder", RECORDER_TASK_STACK, NULL,
+                    RECORDER_TASK_PRIO, NULL) != pdPASS) {
+        frame_hub_unsubscribe(s_sub);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Recording to %s, %d min per file", CONFIG_RECORD_DIR,
+             CONFIG_RECORD_SEGMENT_MIN);
+    return ESP_OK;
+}
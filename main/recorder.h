@@ -0,0 +1,22 @@
+/*
+ * SD card recorder
+ *
+ * Subscribes to the frame hub and muxes every frame into MJPEG AVI files
+ * under CONFIG_RECORD_DIR, starting a new file every
+ * CONFIG_RECORD_SEGMENT_MIN minutes, on a resolution change and before the
+ * AVI size limit. Writes go through avi_writer's batch buffers, so a slow
+ * card costs recorded frames, never captured ones. Files left open by a
+ * power cut are finished when the recorder starts.
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "esp_err.h"
+#include "frame_hub.h"
+
+// Start recording from hub. The SD card must be mounted. Takes one hub
+// subscriber.
+esp_err_t recorder_start(frame_hub_t *hub);
+
+#endif // RECORDER_H
@@ -0,0 +1,313 @@
+/*
+ * RTP/JPEG packetizer - RFC 2435 payload, zero-copy gather sends
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "rtp_jpeg.h"
+
+#define RTP_HDR         12
+#define JPEG_HDR        8
+#define RESTART_HDR     4
+#define QTABLE_HDR      4
+#define QTABLE_BYTES    64
+#define Q_DYNAMIC       255         // Tables travel in-band
+#define MAX_DIMENSION   2040
+
+// lwIP reports a full Wi-Fi queue as ENOMEM; give it a moment to drain
+#define SEND_RETRIES    10
+#define SEND_RETRY_US   1000
+
+#define RTCP_SR         200
+#define RTCP_SDES       202
+#define SDES_CNAME      1
+#define NTP_UNIX_OFFSET 2208988800u // 1900 to 1970 in seconds
+
+static inline uint8_t *put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+    return p + 2;
+}
+
+static inline uint8_t *put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+// Locate EOI from the end; sensor frames may carry padding after it
+static size_t scan_end(const uint8_t *jpg, size_t start, size_t len)
+{
+    for (size_t end = len; end >= start + 2; end--) {
+        if (jpg[end - 2] == 0xFF && jpg[end - 1] == 0xD9) {
+            return end - 2;
+        }
+    }
+    return 0;
+}
+
+bool rtp_jpeg_parse(const uint8_t *jpg, size_t len, rtp_jpeg_frame_t *f)
+{
+    const uint8_t *dqt[4] = { NULL };
+    uint8_t comp_tq[3] = { 0 };
+    uint8_t y_sampling = 0;
+    int width = 0, height = 0;
+    bool have_sof = false;
+
+    memset(f, 0, sizeof(*f));
+    if (len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8) {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (jpg[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = jpg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;                  // Fill byte
+            continue;
+        }
+        size_t seg = get_be16(jpg + pos + 2);
+        if (seg < 2 || pos + 2 + seg > len) {
+            return false;
+        }
+        const uint8_t *p = jpg + pos + 4;
+        size_t plen = seg - 2;
+
+        switch (marker) {
+        case 0xDB:                  // DQT, one or more tables
+            while (plen >= 1 + QTABLE_BYTES) {
+                if (p[0] >> 4) {
+                    return false;   // 16-bit precision
+                }
+                dqt[p[0] & 3] = p + 1;
+                p += 1 + QTABLE_BYTES;
+                plen -= 1 + QTABLE_BYTES;
+            }
+            break;
+        case 0xC0:                  // SOF0, baseline
+            if (plen < 6 + 3 * 3 || p[0] != 8 || p[5] != 3) {
+                return false;
+            }
+            height = get_be16(p + 1);
+            width = get_be16(p + 3);
+            for (int i = 0; i < 3; i++) {
+                uint8_t sampling = p[6 + 3 * i + 1];
+                comp_tq[i] = p[6 + 3 * i + 2] & 3;
+                if (i == 0) {
+                    y_sampling = sampling;
+                } else if (sampling != 0x11) {
+                    return false;
+                }
+            }
+            have_sof = true;
+            break;
+        case 0xC1: case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            return false;           // Not baseline
+        case 0xDD:                  // DRI
+            if (plen < 2) {
+                return false;
+            }
+            f->dri = get_be16(p);
+            break;
+        case 0xDA: {                // SOS: the scan follows
+            size_t start = pos + 2 + seg;
+            size_t end = scan_end(jpg, start, len);
+            if (!have_sof || end <= start) {
+                return false;
+            }
+            f->scan = jpg + start;
+            f->scan_len = end - start;
+            goto scan_found;
+        }
+        default:                    // DHT, APPn, COM: rebuilt or not needed
+            break;
+        }
+        pos += 2 + seg;
+    }
+    return false;
+
+scan_found:
+    if (y_sampling == 0x21) {
+        f->type = 0;
+    } else if (y_sampling == 0x22) {
+        f->type = 1;
+    } else {
+        return false;
+    }
+    if (f->dri) {
+        f->type += 64;
+    }
+    if (width <= 0 || height <= 0 || width > MAX_DIMENSION || height > MAX_DIMENSION) {
+        return false;
+    }
+    f->width8 = (width + 7) / 8;
+    f->height8 = (height + 7) / 8;
+
+    // Both chroma components must share one table
+    f->qt[0] = dqt[comp_tq[0]];
+    f->qt[1] = dqt[comp_tq[1]];
+    return f->qt[0] && f->qt[1] && comp_tq[1] == comp_tq[2];
+}
+
+bool rtp_stream_init(rtp_stream_t *s, int fd, const struct sockaddr_in *dest,
+                     uint32_t ssrc, uint16_t seq, size_t mtu)
+{
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    if (mtu < RTP_JPEG_MIN_MTU) {
+        return false;
+    }
+    s->fd = fd;
+    s->dest = *dest;
+    s->ssrc = ssrc;
+    s->seq = seq;
+    s->mtu = mtu;
+    return true;
+}
+
+static ssize_t send_packet(rtp_stream_t *s, struct iovec *iov, size_t iovcnt)
+{
+    struct msghdr msg = {
+        .msg_name = &s->dest,
+        .msg_namelen = sizeof(s->dest),
+        .msg_iov = iov,
+        .msg_iovlen = iovcnt,
+    };
+
+    for (int tries = 0; ; tries++) {
+        ssize_t n = sendmsg(s->fd, &msg, 0);
+        if (n >= 0 || tries == SEND_RETRIES ||
+            (errno != ENOMEM && errno != ENOBUFS && errno != EAGAIN)) {
+            return n;
+        }
+        usleep(SEND_RETRY_US);
+    }
+}
+
+int rtp_jpeg_send(rtp_stream_t *s, const rtp_jpeg_frame_t *f, uint32_t ts)
+{
+    uint8_t hdr[RTP_HDR + JPEG_HDR + RESTART_HDR + QTABLE_HDR];
+    size_t fixed = RTP_HDR + JPEG_HDR + (f->type >= 64 ? RESTART_HDR : 0);
+    size_t off = 0;
+    int packets = 0;
+
+    // mtu - fixed - tables below must leave room for scan data
+    if (s->mtu < RTP_JPEG_MIN_MTU) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    do {
+        // Tables ride in the first packet of each frame only
+        size_t tables = off == 0 ? QTABLE_HDR + 2 * QTABLE_BYTES : 0;
+        size_t n = s->mtu - fixed - tables;
+        if (n > f->scan_len - off) {
+            n = f->scan_len - off;
+        }
+        bool last = off + n == f->scan_len;
+
+        uint8_t *p = hdr;
+        *p++ = 0x80;                // V=2
+        *p++ = (last ? 0x80 : 0) | RTP_PT_JPEG;
+        p = put_be16(p, s->seq);
+        p = put_be32(p, ts);
+        p = put_be32(p, s->ssrc);
+
+        p = put_be32(p, off);       // Type-specific 0, 24-bit fragment offset
+        *p++ = f->type;
+        *p++ = Q_DYNAMIC;
+        *p++ = f->width8;
+        *p++ = f->height8;
+
+        if (f->type >= 64) {
+            p = put_be16(p, f->dri);
+            p = put_be16(p, 0xFFFF);    // F=1 L=1, count 0x3FFF: not aligned
+        }
+        if (tables) {
+            *p++ = 0;               // MBZ
+            *p++ = 0;               // Precision: both 8-bit
+            p = put_be16(p, 2 * QTABLE_BYTES);
+        }
+
+        struct iovec iov[4];
+        size_t cnt = 0;
+        iov[cnt++] = (struct iovec){ hdr, p - hdr };
+        if (tables) {
+            iov[cnt++] = (struct iovec){ (void *)f->qt[0], QTABLE_BYTES };
+            iov[cnt++] = (struct iovec){ (void *)f->qt[1], QTABLE_BYTES };
+        }
+        iov[cnt++] = (struct iovec){ (void *)(f->scan + off), n };
+
+        ssize_t sent = send_packet(s, iov, cnt);
+        s->seq++;
+        if (sent < 0) {
+            return -1;
+        }
+        s->packets++;
+        s->octets += sent - RTP_HDR;
+        packets++;
+        off += n;
+    } while (off < f->scan_len);
+
+    s->last_ts = ts;
+    return packets;
+}
+
+size_t rtcp_sender_report(const rtp_stream_t *s, uint64_t ntp, uint32_t ts,
+                          const char *cname, uint8_t *buf, size_t cap)
+{
+    size_t cname_len = strlen(cname);
+    if (cname_len > 255) {
+        cname_len = 255;
+    }
+    // SDES chunk: SSRC, CNAME item, end-of-list, padded to 32 bits
+    size_t chunk = (4 + 2 + cname_len + 1 + 3) & ~(size_t)3;
+    size_t len = 28 + 4 + chunk;
+    if (cap < len) {
+        return 0;
+    }
+    memset(buf, 0, len);
+
+    uint8_t *p = buf;
+    *p++ = 0x80;                    // V=2, no reception reports
+    *p++ = RTCP_SR;
+    p = put_be16(p, 28 / 4 - 1);
+    p = put_be32(p, s->ssrc);
+    p = put_be32(p, ntp >> 32);
+    p = put_be32(p, (uint32_t)ntp);
+    p = put_be32(p, ts);
+    p = put_be32(p, s->packets);
+    p = put_be32(p, s->octets);
+
+    *p++ = 0x81;                    // V=2, one chunk
+    *p++ = RTCP_SDES;
+    p = put_be16(p, (4 + chunk) / 4 - 1);
+    p = put_be32(p, s->ssrc);
+    *p++ = SDES_CNAME;
+    *p++ = cname_len;
+    memcpy(p, cname, cname_len);
+    return len;
+}
+
+uint64_t rtcp_ntp_time(int64_t unix_us)
+{
+    uint64_t sec = (uint64_t)(unix_us / 1000000) + NTP_UNIX_OFFSET;
+    uint64_t frac = ((uint64_t)(unix_us % 1000000) << 32) / 1000000;
+    return sec << 32 | frac;
+}
@@ -0,0 +1,77 @@
+/*
+ * RTP/JPEG packetizer (RFC 2435) and RTCP sender reports (RFC 3550)
+ *
+ * A baseline JPEG is reduced to what RFC 2435 carries: type, size in 8x8
+ * blocks, restart interval, the two quantization tables (sent in-band with
+ * Q = 255 in the first packet of each frame) and the entropy-coded scan.
+ * Every other marker segment is stripped; receivers rebuild the headers,
+ * assuming the standard Huffman tables the sensor and software encoder
+ * use.
+ *
+ * Packets are sent with one gather write each: the RTP and JPEG headers
+ * come from the stack, tables and scan data straight from the frame
+ * buffer, so a frame is never copied. Plain POSIX sockets, so it builds
+ * against lwIP and on Linux alike.
+ */
+
+#ifndef RTP_JPEG_H
+#define RTP_JPEG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define RTP_PT_JPEG         26
+#define RTP_JPEG_CLOCK_HZ   90000
+
+// Smallest mtu that still fits a byte of scan data after the RTP, JPEG,
+// restart and table headers and both tables of a first packet
+#define RTP_JPEG_MIN_MTU    (12 + 8 + 4 + 4 + 2 * 64 + 1)
+
+// One JPEG, as RFC 2435 sees it. Pointers are into the source frame.
+typedef struct {
+    uint8_t type;                   // 0 = 4:2:2, 1 = 4:2:0, +64 with restart markers
+    uint8_t width8;                 // Width / 8
+    uint8_t height8;
+    uint16_t dri;                   // Restart interval in MCUs, 0 = none
+    const uint8_t *qt[2];           // Luma and chroma tables, 64 bytes, zigzag
+    const uint8_t *scan;            // Entropy-coded data, without EOI
+    size_t scan_len;
+} rtp_jpeg_frame_t;
+
+typedef struct {
+    int fd;                         // UDP socket the packets go out on
+    struct sockaddr_in dest;
+    uint32_t ssrc;
+    uint16_t seq;
+    size_t mtu;                     // Largest UDP payload
+    uint32_t packets;               // Totals for sender reports
+    uint32_t octets;                // RTP payload bytes
+    uint32_t last_ts;
+} rtp_stream_t;
+
+// Fill f from a JPEG. Returns false for anything RFC 2435 cannot carry:
+// progressive or 12-bit, not YCbCr 4:2:2 / 4:2:0, 16-bit tables, or
+// larger than 2040 pixels.
+bool rtp_jpeg_parse(const uint8_t *jpg, size_t len, rtp_jpeg_frame_t *f);
+
+// Returns false, leaving s unusable, if mtu is below RTP_JPEG_MIN_MTU.
+bool rtp_stream_init(rtp_stream_t *s, int fd, const struct sockaddr_in *dest,
+                     uint32_t ssrc, uint16_t seq, size_t mtu);
+
+// Send one frame with RTP timestamp ts, the marker bit on its last packet.
+// Returns the number of packets, or -1 with errno set if a send failed;
+// the rest of the frame is then skipped.
+int rtp_jpeg_send(rtp_stream_t *s, const rtp_jpeg_frame_t *f, uint32_t ts);
+
+// Build a compound RTCP packet (SR + SDES CNAME) for s into buf. ntp is
+// the 64-bit NTP time matching RTP timestamp ts. Returns its length, 0 if
+// cap is too small.
+size_t rtcp_sender_report(const rtp_stream_t *s, uint64_t ntp, uint32_t ts,
+                          const char *cname, uint8_t *buf, size_t cap);
+
+// NTP timestamp for Unix time in microseconds
+uint64_t rtcp_ntp_time(int64_t unix_us);
+
+#endif // RTP_JPEG_H
@@ -0,0 +1,284 @@
+/*
+ * RTSP 1.0 request parsing and responses
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "rtsp_proto.h"
+
+#define RTSP_TRACK      "track1"
+
+static const struct {
+    const char *name;
+    rtsp_method_t method;
+} s_methods[] = {
+    { "OPTIONS", RTSP_OPTIONS },
+    { "DESCRIBE", RTSP_DESCRIBE },
+    { "SETUP", RTSP_SETUP },
+    { "PLAY", RTSP_PLAY },
+    { "PAUSE", RTSP_PAUSE },
+    { "TEARDOWN", RTSP_TEARDOWN },
+    { "GET_PARAMETER", RTSP_GET_PARAMETER },
+};
+
+// Offset just past the blank line ending the headers, 0 if not there yet
+static size_t header_end(const char *buf, size_t len)
+{
+    for (size_t i = 3; i < len; i++) {
+        if (buf[i] == '\n' && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// First unicast UDP option of a Transport header, e.g.
+// "RTP/AVP/TCP;interleaved=0-1,RTP/AVP;unicast;client_port=5000-5001"
+static void parse_transport(const char *value, rtsp_request_t *req)
+{
+    req->has_transport = true;
+    while (*value) {
+        const char *end = strchr(value, ',');
+        size_t n = end ? (size_t)(end - value) : strlen(value);
+        char spec[128];
+        if (n >= sizeof(spec)) {
+            n = sizeof(spec) - 1;
+        }
+        memcpy(spec, value, n);
+        spec[n] = '\0';
+
+        const char *ports = strstr(spec, "client_port=");
+        bool udp = (!strncmp(spec, "RTP/AVP;", 8) || !strncmp(spec, "RTP/AVP/UDP;", 12)) &&
+                   !strstr(spec, "multicast");
+        unsigned rtp = 0, rtcp = 0;
+        if (udp && ports) {
+            int got = sscanf(ports + 12, "%u-%u", &rtp, &rtcp);
+            if (got >= 1 && rtp && rtp < 65535) {
+                req->transport_udp = true;
+                req->client_rtp_port = rtp;
+                req->client_rtcp_port = got == 2 && rtcp && rtcp <= 65535 ? rtcp : rtp + 1;
+                return;
+            }
+        }
+        if (!end) {
+            break;
+        }
+        value = end + 1;
+    }
+}
+
+int rtsp_parse_request(const char *buf, size_t len, rtsp_request_t *req)
+{
+    size_t head = header_end(buf, len);
+    if (!head) {
+        return 0;
+    }
+    memset(req, 0, sizeof(*req));
+    req->method = RTSP_UNKNOWN;
+    req->cseq = -1;
+
+    // Request line: METHOD URI RTSP/1.0
+    const char *line_end = strstr(buf, "\r\n");
+    const char *sp1 = memchr(buf, ' ', line_end - buf);
+    const char *sp2 = sp1 ? memchr(sp1 + 1, ' ', line_end - sp1 - 1) : NULL;
+    if (!sp2 || strncmp(sp2 + 1, "RTSP/1.0", 8)) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(s_methods) / sizeof(s_methods[0]); i++) {
+        size_t n = strlen(s_methods[i].name);
+        if ((size_t)(sp1 - buf) == n && !strncmp(buf, s_methods[i].name, n)) {
+            req->method = s_methods[i].method;
+        }
+    }
+    size_t uri_len = sp2 - sp1 - 1;
+    if (uri_len >= sizeof(req->uri)) {
+        return -1;
+    }
+    memcpy(req->uri, sp1 + 1, uri_len);
+
+    // Headers, one per line, names case-insensitive
+    size_t body = 0;
+    const char *line = line_end + 2;
+    while (line < buf + head - 2) {
+        const char *eol = strstr(line, "\r\n");
+        const char *colon = memchr(line, ':', eol - line);
+        if (colon) {
+            char value[160];
+            const char *v = colon + 1;
+            while (*v == ' ') {
+                v++;
+            }
+            size_t n = eol - v < (long)sizeof(value) ? (size_t)(eol - v) : sizeof(value) - 1;
+            memcpy(value, v, n);
+            value[n] = '\0';
+            size_t name_len = colon - line;
+
+            if (name_len == 4 && !strncasecmp(line, "CSeq", 4)) {
+                req->cseq = atoi(value);
+            } else if (name_len == 7 && !strncasecmp(line, "Session", 7)) {
+                req->session = strtoul(value, NULL, 16);
+            } else if (name_len == 9 && !strncasecmp(line, "Transport", 9)) {
+                parse_transport(value, req);
+            } else if (name_len == 14 && !strncasecmp(line, "Content-Length", 14)) {
+                body = strtoul(value, NULL, 10);
+            }
+        }
+        line = eol + 2;
+    }
+    if (req->cseq < 0) {
+        return -1;
+    }
+    if (head + body > len) {
+        return 0;
+    }
+    return head + body;
+}
+
+// Formatted append that stops at cap; *n then reports overflow
+static void append(char *out, size_t cap, size_t *n, const char *fmt, ...)
+{
+    if (*n >= cap) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int r = vsnprintf(out + *n, cap - *n, fmt, ap);
+    va_end(ap);
+    *n = r < 0 ? cap : *n + r;
+}
+
+// Status line, CSeq and Session; the caller appends the rest
+static size_t begin_response(char *out, size_t cap, int code, const char *reason,
+                             const rtsp_request_t *req, uint32_t session)
+{
+    size_t n = 0;
+    append(out, cap, &n, "RTSP/1.0 %d %s\r\nCSeq: %d\r\n", code, reason, req->cseq);
+    if (session) {
+        append(out, cap, &n, "Session: %08lX;timeout=%d\r\n",
+               (unsigned long)session, RTSP_SESSION_TIMEOUT_S);
+    }
+    return n;
+}
+
+static size_t finish(size_t n, size_t cap)
+{
+    return n < cap ? n : 0;
+}
+
+static size_t respond_error(char *out, size_t cap, int code, const char *reason,
+                            const rtsp_request_t *req)
+{
+    size_t n = begin_response(out, cap, code, reason, req, 0);
+    append(out, cap, &n, "\r\n");
+    return finish(n, cap);
+}
+
+static size_t respond_describe(const rtsp_request_t *req, const rtsp_env_t *env,
+                               char *out, size_t cap)
+{
+    char sdp[256];
+    int sdp_len = snprintf(sdp, sizeof(sdp),
+                           "v=0\r\n"
+                           "o=- %lu 1 IN IP4 %s\r\n"
+                           "s=XIAO ESP32S3 Camera\r\n"
+                           "c=IN IP4 0.0.0.0\r\n"
+                           "t=0 0\r\n"
+                           "m=video 0 RTP/AVP 26\r\n"
+                           "a=rtpmap:26 JPEG/90000\r\n"
+                           "a=control:" RTSP_TRACK "\r\n",
+                           (unsigned long)env->new_session, env->local_ip);
+    if (sdp_len < 0 || (size_t)sdp_len >= sizeof(sdp)) {
+        return 0;
+    }
+
+    size_t uri_len = strlen(req->uri);
+    const char *slash = uri_len && req->uri[uri_len - 1] == '/' ? "" : "/";
+    size_t n = begin_response(out, cap, 200, "OK", req, 0);
+    append(out, cap, &n,
+           "Content-Base: %s%s\r\n"
+           "Content-Type: application/sdp\r\n"
+           "Content-Length: %d\r\n"
+           "\r\n"
+           "%s",
+           req->uri, slash, sdp_len, sdp);
+    return finish(n, cap);
+}
+
+static size_t respond_setup(rtsp_conn_t *c, const rtsp_request_t *req, const rtsp_env_t *env,
+                            char *out, size_t cap)
+{
+    if (!req->transport_udp) {
+        return respond_error(out, cap, 461, "Unsupported Transport", req);
+    }
+    if (c->session && req->session != c->session) {
+        return respond_error(out, cap, 454, "Session Not Found", req);
+    }
+    if (!c->session) {
+        c->session = env->new_session;
+    }
+    c->client_rtp_port = req->client_rtp_port;
+    c->client_rtcp_port = req->client_rtcp_port;
+    if (c->state == RTSP_STATE_INIT) {
+        c->state = RTSP_STATE_READY;
+    }
+
+    size_t n = begin_response(out, cap, 200, "OK", req, c->session);
+    append(out, cap, &n,
+           "Transport: RTP/AVP;unicast;client_port=%u-%u;server_port=%u-%u;ssrc=%08lX\r\n"
+           "\r\n",
+           c->client_rtp_port, c->client_rtcp_port,
+           env->server_rtp_port, env->server_rtp_port + 1,
+           (unsigned long)c->session);
+    return finish(n, cap);
+}
+
+size_t rtsp_respond(rtsp_conn_t *c, const rtsp_request_t *req, const rtsp_env_t *env,
+                    char *out, size_t cap)
+{
+    size_t n;
+
+    switch (req->method) {
+    case RTSP_OPTIONS:
+        n = begin_response(out, cap, 200, "OK", req, c->session);
+        append(out, cap, &n,
+               "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER\r\n"
+               "\r\n");
+        return finish(n, cap);
+    case RTSP_DESCRIBE:
+        return respond_describe(req, env, out, cap);
+    case RTSP_SETUP:
+        return respond_setup(c, req, env, out, cap);
+    case RTSP_UNKNOWN:
+        return respond_error(out, cap, 501, "Not Implemented", req);
+    default:
+        break;
+    }
+
+    // The rest act on an established session
+    if (!c->session || req->session != c->session) {
+        return respond_error(out, cap, 454, "Session Not Found", req);
+    }
+    switch (req->method) {
+    case RTSP_PLAY:
+        c->state = RTSP_STATE_PLAYING;
+        n = begin_response(out, cap, 200, "OK", req, c->session);
+        append(out, cap, &n, "Range: npt=0.000-\r\n\r\n");
+        return finish(n, cap);
+    case RTSP_PAUSE:
+        c->state = RTSP_STATE_READY;
+        break;
+    case RTSP_TEARDOWN:
+        c->state = RTSP_STATE_INIT;
+        c->session = 0;
+        return respond_error(out, cap, 200, "OK", req);
+    default:                        // GET_PARAMETER: keepalive
+        break;
+    }
+    n = begin_response(out, cap, 200, "OK", req, c->session);
+    append(out, cap, &n, "\r\n");
+    return finish(n, cap);
+}
@@ -0,0 +1,75 @@
+/*
+ * RTSP 1.0 request parsing and responses (RFC 2326)
+ *
+ * Just enough of RTSP for NVRs and players to pull the camera's single
+ * RTP/JPEG track over unicast UDP: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE,
+ * TEARDOWN and GET_PARAMETER as keepalive. Interleaved (RTP over TCP)
+ * transport is refused with 461, so clients fall back to UDP.
+ *
+ * No I/O here: the server feeds in complete requests and sends back the
+ * text this produces. Pure C.
+ */
+
+#ifndef RTSP_PROTO_H
+#define RTSP_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RTSP_SESSION_TIMEOUT_S  60
+
+typedef enum {
+    RTSP_OPTIONS,
+    RTSP_DESCRIBE,
+    RTSP_SETUP,
+    RTSP_PLAY,
+    RTSP_PAUSE,
+    RTSP_TEARDOWN,
+    RTSP_GET_PARAMETER,
+    RTSP_UNKNOWN,
+} rtsp_method_t;
+
+typedef struct {
+    rtsp_method_t method;
+    char uri[128];
+    int cseq;
+    uint32_t session;               // 0 when absent
+    bool has_transport;
+    bool transport_udp;             // A unicast UDP option was offered
+    uint16_t client_rtp_port;
+    uint16_t client_rtcp_port;
+} rtsp_request_t;
+
+typedef enum {
+    RTSP_STATE_INIT,
+    RTSP_STATE_READY,               // Set up, not sending
+    RTSP_STATE_PLAYING,
+} rtsp_state_t;
+
+// One control connection
+typedef struct {
+    rtsp_state_t state;
+    uint32_t session;               // Also used as the RTP SSRC
+    uint16_t client_rtp_port;
+    uint16_t client_rtcp_port;
+} rtsp_conn_t;
+
+// What the server tells the protocol about itself
+typedef struct {
+    const char *local_ip;           // For the SDP origin line
+    uint16_t server_rtp_port;       // RTCP is the next port up
+    uint32_t new_session;           // Handed out by the next SETUP, non-zero
+} rtsp_env_t;
+
+// Parse one request at the start of buf, which must be NUL-terminated at
+// len. Returns the bytes it spans, headers and body, 0 if it is not
+// complete yet, -1 if it is malformed.
+int rtsp_parse_request(const char *buf, size_t len, rtsp_request_t *req);
+
+// Apply req to c and write the response into out. Returns its length, 0
+// if it did not fit.
+size_t rtsp_respond(rtsp_conn_t *c, const rtsp_request_t *req, const rtsp_env_t *env,
+                    char *out, size_t cap);
+
+#endif // RTSP_PROTO_H
@@ -0,0 +1,414 @@
+/*
+ * RTSP server - control connections, RTP/JPEG and RTCP over UDP
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#include "rtsp_server.h"
+#include "rtsp_proto.h"
+#include "rtp_jpeg.h"
+#include "metrics.h"
+
+static const char *TAG = "RTSP";
+
+#define RTSP_TASK_STACK     4096
+#define RTSP_TASK_PRIO      5
+#define RTP_TASK_STACK      4096
+#define RTP_TASK_PRIO       5
+
+#define RTSP_BUF_SIZE       1024
+#define RTSP_SELECT_MS      1000
+// Room for IP/UDP headers in a 1500-byte Ethernet/Wi-Fi frame
+#define RTP_MTU             1400
+#if RTP_MTU < RTP_JPEG_MIN_MTU
+#error "RTP_MTU leaves no room for scan data in a packet"
+#endif
+#define RTCP_INTERVAL_US    (5 * 1000000LL)
+#define RTSP_CNAME          "xiao-esp32s3"
+
+typedef struct {
+    int fd;                         // Control connection, -1 when free
+    char in[RTSP_BUF_SIZE + 1];     // Request bytes, NUL-terminated
+    size_t in_len;
+    struct sockaddr_in peer;
+    rtsp_conn_t rtsp;
+    int64_t seen_us;                // Last request or RTCP from the client
+
+    // Under s_lock: the RTP task reads these while playing
+    frame_sub_t *sub;               // Taken at SETUP
+    bool playing;
+    rtp_stream_t rtp;
+    struct sockaddr_in rtcp_dest;
+    uint32_t ts_origin;             // Random RTP timestamp offset
+    int64_t sr_us;
+    uint32_t frames;
+    uint32_t rejected;
+} rtsp_client_t;
+
+static rtsp_client_t s_clients[CONFIG_RTSP_MAX_SESSIONS];
+static SemaphoreHandle_t s_lock;
+static TaskHandle_t s_rtp_task;
+static frame_hub_t *s_hub;
+static int s_listen_fd = -1;
+static int s_rtp_fd = -1;
+static int s_rtcp_fd = -1;
+static volatile size_t s_sessions;  // Holding a hub subscription
+
+static inline int64_t frame_time_us(const hub_frame_t *frame)
+{
+    return (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+}
+
+// RTP time of a moment on the esp_timer clock, which frames are stamped with
+static inline uint32_t rtp_time(const rtsp_client_t *c, int64_t us)
+{
+    return c->ts_origin + (uint32_t)(us * (RTP_JPEG_CLOCK_HZ / 1000) / 1000);
+}
+
+static void send_frame(rtsp_client_t *c, const hub_frame_t *frame)
+{
+    rtp_jpeg_frame_t jf;
+    if (frame->format != PIXFORMAT_JPEG || !rtp_jpeg_parse(frame->buf, frame->len, &jf)) {
+        metrics_inc(METRIC_RTP_FRAMES_REJECTED);
+        if (!c->rejected++) {
+            ESP_LOGW(TAG, "Frame %ux%u cannot be sent as RTP/JPEG",
+                     (unsigned)frame->width, (unsigned)frame->height);
+        }
+        return;
+    }
+
+    int64_t captured = frame_time_us(frame);
+    int64_t start = esp_timer_get_time();
+    int packets = rtp_jpeg_send(&c->rtp, &jf, rtp_time(c, captured));
+    int64_t now = esp_timer_get_time();
+    if (packets < 0) {
+        ESP_LOGW(TAG, "RTP send failed: errno %d", errno);
+        return;
+    }
+
+    c->frames++;
+    metrics_inc(METRIC_RTP_FRAMES_SENT);
+    metrics_add(METRIC_RTP_PACKETS_SENT, packets);
+    metrics_observe(METRIC_RTP_FRAME_SEND_US, now - start);
+    metrics_observe(METRIC_RTP_FRAME_AGE_US, now - captured);
+}
+
+// Sender report mapping wall clock to RTP time, so players can sync and
+// measure latency
+static void send_report(rtsp_client_t *c, int64_t now)
+{
+    struct timeval tv;
+    uint8_t buf[64];
+
+    gettimeofday(&tv, NULL);
+    uint64_t ntp = rtcp_ntp_time((int64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+    size_t len = rtcp_sender_report(&c->rtp, ntp, rtp_time(c, now), RTSP_CNAME, buf, sizeof(buf));
+    if (len) {
+        sendto(s_rtcp_fd, buf, len, 0, (struct sockaddr *)&c->rtcp_dest, sizeof(c->rtcp_dest));
+    }
+    c->sr_us = now;
+}
+
+static void rtp_task(void *arg)
+{
+    while (true) {
+        // Woken by the hub on every new frame
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RTSP_SELECT_MS));
+        int64_t now = esp_timer_get_time();
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < CONFIG_RTSP_MAX_SESSIONS; i++) {
+            rtsp_client_t *c = &s_clients[i];
+            if (!c->playing) {
+                continue;
+            }
+            hub_frame_t *frame = frame_hub_wait(c->sub, 0);
+            if (frame) {
+                send_frame(c, frame);
+                frame_hub_release(frame);
+            }
+            if (c->rtp.packets && now - c->sr_us >= RTCP_INTERVAL_US) {
+                send_report(c, now);
+            }
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+static void update_session_count(void)
+{
+    size_t sessions = 0;
+    for (int i = 0; i < CONFIG_RTSP_MAX_SESSIONS; i++) {
+        sessions += s_clients[i].sub != NULL;
+    }
+    s_sessions = sessions;
+    metrics_set(METRIC_RTSP_SESSIONS, sessions);
+}
+
+// Follow the protocol state: start or stop sending for this client
+static void update_playing(rtsp_client_t *c)
+{
+    bool play = c->rtsp.state == RTSP_STATE_PLAYING;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (play && !c->playing) {
+        struct sockaddr_in dest = c->peer;
+        dest.sin_port = htons(c->rtsp.client_rtp_port);
+        rtp_stream_init(&c->rtp, s_rtp_fd, &dest, c->rtsp.session, esp_random(), RTP_MTU);
+        c->rtcp_dest = c->peer;
+        c->rtcp_dest.sin_port = htons(c->rtsp.client_rtcp_port);
+        c->ts_origin = esp_random();
+        c->sr_us = 0;
+        // Start from the next frame, not a stale one
+        hub_frame_t *stale = frame_hub_wait(c->sub, 0);
+        if (stale) {
+            frame_hub_release(stale);
+        }
+        ESP_LOGI(TAG, "Playing to %s:%u", inet_ntoa(dest.sin_addr), c->rtsp.client_rtp_port);
+    }
+    c->playing = play;
+    if (c->rtsp.state == RTSP_STATE_INIT && c->sub) {
+        frame_hub_unsubscribe(c->sub);
+        c->sub = NULL;
+    }
+    xSemaphoreGive(s_lock);
+    update_session_count();
+}
+
+static void client_close(rtsp_client_t *c)
+{
+    if (c->frames || c->rejected) {
+        ESP_LOGI(TAG, "Session ended, %lu frames sent, %lu rejected, %lu dropped",
+                 (unsigned long)c->frames, (unsigned long)c->rejected,
+                 (unsigned long)(c->sub ? frame_hub_dropped(c->sub) : 0));
+    }
+    c->rtsp.state = RTSP_STATE_INIT;
+    update_playing(c);
+    close(c->fd);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+static void client_accept(void)
+{
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    int fd = accept(s_listen_fd, (struct sockaddr *)&peer, &len);
+    if (fd < 0) {
+        return;
+    }
+    for (int i = 0; i < CONFIG_RTSP_MAX_SESSIONS; i++) {
+        rtsp_client_t *c = &s_clients[i];
+        if (c->fd < 0) {
+            c->fd = fd;
+            c->peer = peer;
+            c->seen_us = esp_timer_get_time();
+            ESP_LOGI(TAG, "Connection from %s", inet_ntoa(peer.sin_addr));
+            return;
+        }
+    }
+    ESP_LOGW(TAG, "Too many RTSP connections");
+    close(fd);
+}
+
+static bool client_request(rtsp_client_t *c, const rtsp_request_t *req)
+{
+    char out[640];
+    struct sockaddr_in local;
+    socklen_t len = sizeof(local);
+    getsockname(c->fd, (struct sockaddr *)&local, &len);
+
+    rtsp_env_t env = {
+        .local_ip = inet_ntoa(local.sin_addr),
+        .server_rtp_port = CONFIG_RTSP_RTP_PORT,
+        .new_session = esp_random() | 1,
+    };
+
+    size_t n;
+    if (req->method == RTSP_SETUP && !c->sub &&
+        (c->sub = frame_hub_subscribe(s_hub)) == NULL) {
+        n = snprintf(out, sizeof(out), "RTSP/1.0 453 Not Enough Bandwidth\r\nCSeq: %d\r\n\r\n",
+                     req->cseq);
+    } else {
+        if (c->sub) {
+            frame_hub_set_notify(c->sub, s_rtp_task);
+        }
+        n = rtsp_respond(&c->rtsp, req, &env, out, sizeof(out));
+        update_playing(c);
+    }
+    return n && send(c->fd, out, n, 0) == (ssize_t)n;
+}
+
+// Read what arrived and answer every complete request in it
+static bool client_read(rtsp_client_t *c)
+{
+    ssize_t n = recv(c->fd, c->in + c->in_len, RTSP_BUF_SIZE - c->in_len, 0);
+    if (n <= 0) {
+        return false;
+    }
+    c->in_len += n;
+    c->in[c->in_len] = '\0';
+    c->seen_us = esp_timer_get_time();
+
+    while (c->in_len) {
+        rtsp_request_t req;
+        int used = rtsp_parse_request(c->in, c->in_len, &req);
+        if (used < 0 || (used == 0 && c->in_len == RTSP_BUF_SIZE)) {
+            ESP_LOGW(TAG, "Bad request");
+            return false;
+        }
+        if (used == 0) {
+            break;
+        }
+        if (!client_request(c, &req)) {
+            return false;
+        }
+        c->in_len -= used;
+        memmove(c->in, c->in + used, c->in_len + 1);
+    }
+    return true;
+}
+
+// Receiver reports keep a session alive; other UDP input is discarded
+static void drain_udp(int fd)
+{
+    uint8_t buf[256];
+    struct sockaddr_in from;
+    socklen_t len = sizeof(from);
+
+    if (recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&from, &len) < 0) {
+        return;
+    }
+    for (int i = 0; i < CONFIG_RTSP_MAX_SESSIONS; i++) {
+        rtsp_client_t *c = &s_clients[i];
+        if (c->fd >= 0 && c->peer.sin_addr.s_addr == from.sin_addr.s_addr) {
+            c->seen_us = esp_timer_get_time();
+        }
+    }
+}
+
+static void rtsp_task(void *arg)
+{
+    while (true) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(s_listen_fd, &rfds);
+        FD_SET(s_rtp_fd, &rfds);
+        FD_SET(s_rtcp_fd, &rfds);
+        int maxfd = s_listen_fd > s_rtp_fd ? s_listen_fd : s_rtp_fd;
+        if (s_rtcp_fd > maxfd) {
+            maxfd = s_rtcp_fd;
+        }
+        for (int i = 0; i < CONFIG_RTSP_MAX_SESSIONS; i++) {
+            if (s_clients[i].fd >= 0) {
+                FD_SET(s_clients[i].fd, &rfds);
+                if (s_clients[i].fd > maxfd) {
+                    maxfd = s_clients[i].fd;
+                }
+            }
+        }
+
+        struct timeval tv = { .tv_sec = RTSP_SELECT_MS / 1000 };
+        if (select(maxfd + 1, &rfds, NULL, NULL, &tv) < 0) {
+            continue;
+        }
+        if (FD_ISSET(s_rtp_fd, &rfds)) {
+            drain_udp(s_rtp_fd);
+        }
+        if (FD_ISSET(s_rtcp_fd, &rfds)) {
+            drain_udp(s_rtcp_fd);
+        }
+
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < CONFIG_RTSP_MAX_SESSIONS; i++) {
+            rtsp_client_t *c = &s_clients[i];
+            if (c->fd < 0) {
+                continue;
+            }
+            if (FD_ISSET(c->fd, &rfds) && !client_read(c)) {
+                client_close(c);
+            } else if (now - c->seen_us > RTSP_SESSION_TIMEOUT_S * 1000000LL) {
+                ESP_LOGW(TAG, "Session timed out");
+                client_close(c);
+            }
+        }
+        if (FD_ISSET(s_listen_fd, &rfds)) {
+            client_accept();
+        }
+    }
+}
+
+static int udp_socket(uint16_t port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+esp_err_t rtsp_server_start(frame_hub_t *hub)
+{
+    s_hub = hub;
+    for (int i = 0; i < CONFIG_RTSP_MAX_SESSIONS; i++) {
+        s_clients[i].fd = -1;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_RTSP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int one = 1;
+    s_listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s_listen_fd < 0) {
+        return ESP_FAIL;
+    }
+    setsockopt(s_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(s_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(s_listen_fd, 2) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on port %d: errno %d", CONFIG_RTSP_PORT, errno);
+        close(s_listen_fd);
+        return ESP_FAIL;
+    }
+
+    s_rtp_fd = udp_socket(CONFIG_RTSP_RTP_PORT);
+    s_rtcp_fd = udp_socket(CONFIG_RTSP_RTP_PORT + 1);
+    s_lock = xSemaphoreCreateMutex();
+    if (s_rtp_fd < 0 || s_rtcp_fd < 0 || !s_lock) {
+        ESP_LOGE(TAG, "Cannot open RTP ports %d-%d", CONFIG_RTSP_RTP_PORT, CONFIG_RTSP_RTP_PORT + 1);
+        return ESP_FAIL;
+    }
+
+    if (xTaskCreate(rtp_task, "rtp_tx", RTP_TASK_STACK, NULL, RTP_TASK_PRIO, &s_rtp_task) != pdPASS ||
+        xTaskCreate(rtsp_task, "rtsp", RTSP_TASK_STACK, NULL, RTSP_TASK_PRIO, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Listening on port %d, RTP from %d", CONFIG_RTSP_PORT, CONFIG_RTSP_RTP_PORT);
+    return ESP_OK;
+}
+
+size_t rtsp_server_session_count(void)
+{
+    return s_sessions;
+}
@@ -0,0 +1,24 @@
+/*
+ * RTSP server
+ *
+ * Serves the camera as rtsp://<ip>:CONFIG_RTSP_PORT/ next to the HTTP
+ * server: one RTP/JPEG track over unicast UDP, from
+ * CONFIG_RTSP_RTP_PORT (RTP) and the port after it (RTCP sender reports).
+ * A control task handles the RTSP connections; an RTP task sends every new
+ * frame to each playing session straight from the hub buffer. Each set-up
+ * session holds a hub subscription; the hub is sized for
+ * CONFIG_RTSP_MAX_SESSIONS of them on top of the /stream viewers.
+ */
+
+#ifndef RTSP_SERVER_H
+#define RTSP_SERVER_H
+
+#include "esp_err.h"
+#include "frame_hub.h"
+
+esp_err_t rtsp_server_start(frame_hub_t *hub);
+
+// Sessions currently holding a hub subscription
+size_t rtsp_server_session_count(void);
+
+#endif // RTSP_SERVER_H
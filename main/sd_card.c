@@ -0,0 +1,67 @@
+/*
+ * microSD card - FAT over SPI
+ */
+
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_vfs_fat.h"
+#include "driver/sdspi_host.h"
+#include "sdmmc_cmd.h"
+
+#include "pins.h"
+#include "sd_card.h"
+
+static const char *TAG = "SD_CARD";
+
+static sdmmc_card_t *s_card;
+
+esp_err_t sd_card_mount(void)
+{
+    if (s_card) {
+        return ESP_OK;
+    }
+
+    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
+    host.max_freq_khz = CONFIG_SD_CARD_FREQ_KHZ;
+
+    spi_bus_config_t bus = {
+        .mosi_io_num = XIAO_SD_PIN_MOSI,
+        .miso_io_num = XIAO_SD_PIN_MISO,
+        .sclk_io_num = XIAO_SD_PIN_SCK,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = 4000,
+    };
+    esp_err_t err = spi_bus_initialize(host.slot, &bus, SDSPI_DEFAULT_DMA);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "SPI bus init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    sdspi_device_config_t slot = SDSPI_DEVICE_CONFIG_DEFAULT();
+    slot.gpio_cs = XIAO_SD_PIN_CS;
+    slot.host_id = host.slot;
+
+    // Large clusters keep the FAT small and long sequential writes cheap
+    esp_vfs_fat_sdmmc_mount_config_t mount = {
+        .format_if_mount_failed = false,
+        .max_files = 4,
+        .allocation_unit_size = 32 * 1024,
+    };
+    err = esp_vfs_fat_sdspi_mount(SD_CARD_MOUNT_POINT, &host, &slot, &mount, &s_card);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Mount failed: %s", esp_err_to_name(err));
+        s_card = NULL;
+        spi_bus_free(host.slot);
+        return err;
+    }
+
+    sdmmc_card_print_info(stdout, s_card);
+    ESP_LOGI(TAG, "Mounted at %s, SPI %d kHz", SD_CARD_MOUNT_POINT, CONFIG_SD_CARD_FREQ_KHZ);
+    return ESP_OK;
+}
+
+bool sd_card_mounted(void)
+{
+    return s_card != NULL;
+}
@@ -0,0 +1,22 @@
+/*
+ * microSD card on the Sense expansion board
+ *
+ * The slot is wired to SPI; its chip select shares GPIO21 with the user
+ * LED, so the LED must be left alone once the card is mounted.
+ */
+
+#ifndef SD_CARD_H
+#define SD_CARD_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define SD_CARD_MOUNT_POINT "/sdcard"
+
+// Mount the card's FAT filesystem at SD_CARD_MOUNT_POINT. Does nothing if
+// it is already mounted.
+esp_err_t sd_card_mount(void);
+
+bool sd_card_mounted(void);
+
+#endif // SD_CARD_H
@@ -0,0 +1,208 @@
+/*
+ * Sensor profiles - declarative tuning, applied as a diff
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sensor_profile.h"
+#include "metrics.h"
+
+static const char *TAG = "PROFILE";
+
+static const sensor_profile_t s_profiles[] = {
+    {
+        // Dim rooms: longer exposure, night mode and a high gain ceiling
+        .name = "lowlight",
+        .brightness = 3,
+        .sharpness = 3,
+        .awb = 1,
+        .awb_gain = 1,
+        .aec = 1,
+        .aec2 = 1,
+        .ae_level = 2,
+        .aec_value = 600,
+        .agc = 1,
+        .agc_gain = 15,
+        .gainceiling = GAINCEILING_128X,
+        .wpc = 1,
+        .raw_gma = 1,
+        .lenc = 1,
+        .dcw = 1,
+    },
+    {
+        // Bright scenes: neutral exposure, little gain, less noise
+        .name = "daylight",
+        .sharpness = 1,
+        .awb = 1,
+        .awb_gain = 1,
+        .aec = 1,
+        .aec_value = 300,
+        .agc = 1,
+        .gainceiling = GAINCEILING_4X,
+        .wpc = 1,
+        .raw_gma = 1,
+        .lenc = 1,
+        .dcw = 1,
+    },
+    {
+        // Never stretch the frame time: no night mode, make up with gain
+        .name = "maxfps",
+        .brightness = 1,
+        .awb = 1,
+        .awb_gain = 1,
+        .aec = 1,
+        .aec_value = 300,
+        .agc = 1,
+        .gainceiling = GAINCEILING_32X,
+        .wpc = 1,
+        .raw_gma = 1,
+        .lenc = 1,
+        .dcw = 1,
+    },
+};
+
+#define PROFILE_COUNT   (sizeof(s_profiles) / sizeof(s_profiles[0]))
+
+static const sensor_profile_t *s_current;
+static _Atomic(const sensor_profile_t *) s_pending;
+static SemaphoreHandle_t s_switch_lock;     // One switch in flight
+static SemaphoreHandle_t s_applied;         // Given by the capture task
+static sensor_profile_result_t s_result;
+
+const sensor_profile_t *sensor_profile_find(const char *name)
+{
+    for (size_t i = 0; i < PROFILE_COUNT; i++) {
+        if (!strcmp(s_profiles[i].name, name)) {
+            return &s_profiles[i];
+        }
+    }
+    return NULL;
+}
+
+size_t sensor_profile_count(void)
+{
+    return PROFILE_COUNT;
+}
+
+const sensor_profile_t *sensor_profile_get(size_t index)
+{
+    return index < PROFILE_COUNT ? &s_profiles[index] : NULL;
+}
+
+const sensor_profile_t *sensor_profile_current(void)
+{
+    return s_current;
+}
+
+// Call the setter only if the driver reports a different value, or always
+// when forced. The drivers keep status in step with every successful set.
+#define APPLY(field, setter)                                                    \
+    if (force || s->status.field != p->field) {                                 \
+        res->writes++;                                                          \
+        if (!s->setter || s->setter(s, p->field) != 0) {                        \
+            ESP_LOGW(TAG, "%s: " #field " = %d rejected", p->name, (int)p->field); \
+            res->failed++;                                                      \
+        }                                                                       \
+    }
+
+static esp_err_t profile_write(sensor_t *s, const sensor_profile_t *p, bool force,
+                               sensor_profile_result_t *res)
+{
+    sensor_profile_result_t local;
+    if (!res) {
+        res = &local;
+    }
+    memset(res, 0, sizeof(*res));
+
+    if (!s_applied) {
+        s_switch_lock = xSemaphoreCreateMutex();
+        s_applied = xSemaphoreCreateBinary();
+    }
+
+    int64_t start = esp_timer_get_time();
+
+    // Automatic modes before the manual values they gate
+    APPLY(awb, set_whitebal);
+    APPLY(awb_gain, set_awb_gain);
+    APPLY(wb_mode, set_wb_mode);
+    APPLY(aec, set_exposure_ctrl);
+    APPLY(aec2, set_aec2);
+    APPLY(ae_level, set_ae_level);
+    APPLY(aec_value, set_aec_value);
+    APPLY(agc, set_gain_ctrl);
+    APPLY(agc_gain, set_agc_gain);
+    APPLY(gainceiling, set_gainceiling);
+
+    APPLY(brightness, set_brightness);
+    APPLY(contrast, set_contrast);
+    APPLY(saturation, set_saturation);
+    APPLY(sharpness, set_sharpness);
+    APPLY(bpc, set_bpc);
+    APPLY(wpc, set_wpc);
+    APPLY(raw_gma, set_raw_gma);
+    APPLY(lenc, set_lenc);
+    APPLY(dcw, set_dcw);
+    APPLY(hmirror, set_hmirror);
+    APPLY(vflip, set_vflip);
+    APPLY(colorbar, set_colorbar);
+
+    res->apply_us = esp_timer_get_time() - start;
+    s_current = p;
+
+    metrics_observe(METRIC_SENSOR_PROFILE_US, res->apply_us);
+    metrics_add(METRIC_SENSOR_WRITES, res->writes);
+    ESP_LOGI(TAG, "%s: %d settings %s in %lld us", p->name, res->writes,
+             force ? "restored" : "changed", (long long)res->apply_us);
+    return res->failed ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t sensor_profile_apply(sensor_t *s, const sensor_profile_t *p,
+                               sensor_profile_result_t *res)
+{
+    return profile_write(s, p, false, res);
+}
+
+esp_err_t sensor_profile_restore(sensor_t *s, sensor_profile_result_t *res)
+{
+    if (!s_current) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return profile_write(s, s_current, true, res);
+}
+
+esp_err_t sensor_profile_switch(const sensor_profile_t *p, TickType_t wait,
+                                sensor_profile_result_t *res)
+{
+    if (!s_applied) {
+        return ESP_ERR_INVALID_STATE;   // Never initialized: no sensor
+    }
+
+    xSemaphoreTake(s_switch_lock, portMAX_DELAY);
+    xSemaphoreTake(s_applied, 0);       // From a switch that timed out
+    atomic_store(&s_pending, p);
+
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    if (xSemaphoreTake(s_applied, wait) == pdTRUE) {
+        if (res) {
+            *res = s_result;
+        }
+        err = s_result.failed ? ESP_FAIL : ESP_OK;
+    }
+    xSemaphoreGive(s_switch_lock);
+    return err;
+}
+
+void sensor_profile_service(sensor_t *s)
+{
+    const sensor_profile_t *p = atomic_exchange(&s_pending, NULL);
+    if (!p) {
+        return;
+    }
+    sensor_profile_apply(s, p, &s_result);
+    xSemaphoreGive(s_applied);
+}
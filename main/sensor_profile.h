@@ -0,0 +1,87 @@
+/*
+ * Sensor profiles
+ *
+ * Image tuning (exposure, gain, white balance, ISP switches) is described
+ * by named, declarative profiles instead of a run of setter calls. Applying
+ * one diffs it against the driver's view of the sensor (sensor_t.status)
+ * and only calls the setters whose value differs, back to back, so a boot
+ * or a profile switch costs one SCCB write per setting that actually
+ * changes. Frame size and JPEG quality are not part of a profile; the
+ * adaptive quality controller owns those.
+ *
+ * At runtime only the capture task touches the sensor. A switch requested
+ * from another task is handed to it and applied between two frames, so it
+ * never races the controller's framesize/quality writes.
+ */
+
+#ifndef SENSOR_PROFILE_H
+#define SENSOR_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_camera.h"
+
+// Field names and ranges follow camera_status_t
+typedef struct {
+    const char *name;
+    int8_t brightness;              // -2..2 (OV3660: -3..3)
+    int8_t contrast;
+    int8_t saturation;
+    int8_t sharpness;
+    uint8_t awb;                    // Auto white balance
+    uint8_t awb_gain;
+    uint8_t wb_mode;                // 0 = auto
+    uint8_t aec;                    // Auto exposure
+    uint8_t aec2;                   // OV3660: night mode, lowers the frame rate in the dark
+    int8_t ae_level;                // -2..2
+    uint16_t aec_value;             // Manual exposure, used with aec off
+    uint8_t agc;                    // Auto gain
+    uint8_t agc_gain;               // Manual gain 0..30, used with agc off
+    uint8_t gainceiling;            // gainceiling_t
+    uint8_t bpc;                    // Black pixel correction
+    uint8_t wpc;                    // White pixel correction
+    uint8_t raw_gma;
+    uint8_t lenc;                   // Lens shading correction
+    uint8_t dcw;                    // Downsize
+    uint8_t hmirror;
+    uint8_t vflip;
+    uint8_t colorbar;
+} sensor_profile_t;
+
+typedef struct {
+    int writes;                     // Setters called
+    int failed;                     // Of those, rejected by the driver
+    int64_t apply_us;
+} sensor_profile_result_t;
+
+// Profiles by name, NULL if there is none
+const sensor_profile_t *sensor_profile_find(const char *name);
+size_t sensor_profile_count(void);
+const sensor_profile_t *sensor_profile_get(size_t index);
+
+// Last profile applied, NULL before the first
+const sensor_profile_t *sensor_profile_current(void);
+
+// Apply p to s now. Only for the task that owns the sensor: at init
+// before capture starts, then the capture task. ESP_FAIL if a setter
+// failed; the others are still applied.
+esp_err_t sensor_profile_apply(sensor_t *s, const sensor_profile_t *p,
+                               sensor_profile_result_t *res);
+
+// Write every setting of the current profile again, whatever status says.
+// For a sensor that may have lost them, e.g. coming out of standby. Same
+// rules as sensor_profile_apply(); ESP_ERR_INVALID_STATE before the first.
+esp_err_t sensor_profile_restore(sensor_t *s, sensor_profile_result_t *res);
+
+// Ask the capture task to apply p and wait up to wait ticks for it.
+// ESP_ERR_INVALID_STATE when there is no sensor, ESP_ERR_TIMEOUT if the
+// switch is still pending (it will be applied later).
+esp_err_t sensor_profile_switch(const sensor_profile_t *p, TickType_t wait,
+                                sensor_profile_result_t *res);
+
+// Apply a pending switch. Called by the capture task between frames.
+void sensor_profile_service(sensor_t *s);
+
+#endif // SENSOR_PROFILE_H
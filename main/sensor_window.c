@@ -0,0 +1,314 @@
+/*
+ * Sensor window - region of interest through set_res_raw()
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sensor_window.h"
+
+static const char *TAG = "WINDOW";
+
+// OV3660/OV5640 timing control
+#define REG_X_ADDR_ST       0x3800
+#define REG_Y_ADDR_ST       0x3802
+#define REG_X_ADDR_END      0x3804
+#define REG_Y_ADDR_END      0x3806
+#define REG_X_OUTPUT_SIZE   0x3808
+#define REG_Y_OUTPUT_SIZE   0x380A
+#define REG_X_TOTAL_SIZE    0x380C
+#define REG_Y_TOTAL_SIZE    0x380E
+#define REG_X_OFFSET        0x3810
+#define REG_Y_OFFSET        0x3812
+#define REG_X_INC           0x3814  // Odd/even skip, 0x11 full, 0x31 binned
+#define REG_Y_INC           0x3815
+#define REG_ISP_CTRL01      0x5001  // Bit 5: scaler on
+// AEC exposure limits, in lines, for 60 and 50 Hz banding
+#define REG_AEC_MAX_EXPO_60 0x3A02
+#define REG_AEC_MAX_EXPO_50 0x3A14
+
+static bool s_supported;
+static SemaphoreHandle_t s_switch_lock;     // One switch in flight
+static SemaphoreHandle_t s_applied;         // Given by the capture task
+static portMUX_TYPE s_pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static sensor_roi_t s_pending;
+static bool s_has_pending;                  // Under s_pending_lock
+static sensor_window_result_t s_result;
+static esp_err_t s_err;
+
+// Capture task only
+static bool s_active;
+static sensor_window_regs_t s_full;         // Read when leaving the full frame
+static int s_full_expo_60, s_full_expo_50;
+static sensor_window_regs_t s_now;
+
+static int skip_factor(int inc)
+{
+    return ((inc >> 4) + (inc & 15)) / 2;
+}
+
+esp_err_t sensor_window_plan(const sensor_window_regs_t *full, const sensor_roi_t *roi,
+                             sensor_window_regs_t *out)
+{
+    *out = *full;
+    if (!roi->width) {
+        return ESP_OK;
+    }
+    if (roi->x < 0 || roi->y < 0 || roi->width < SENSOR_WINDOW_MIN ||
+        roi->height < SENSOR_WINDOW_MIN || roi->x + roi->width > full->out_width ||
+        roi->y + roi->height > full->out_height) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The visible part of the array, without the ISP crop
+    int crop_x = full->offset_x * full->sub_x;
+    int crop_y = full->offset_y * full->sub_y;
+    int vis_x = full->start_x + crop_x;
+    int vis_y = full->start_y + crop_y;
+    int vis_w = full->end_x - full->start_x + 1 - 2 * crop_x;
+    int vis_h = full->end_y - full->start_y + 1 - 2 * crop_y;
+
+    // Array rectangle under the ROI, on whole 2x2 Bayer cells (per
+    // subsampled pixel) so the colour order stays the same
+    int align_x = 2 * full->sub_x;
+    int align_y = 2 * full->sub_y;
+    int x0 = roi->x * vis_w / full->out_width;
+    int y0 = roi->y * vis_h / full->out_height;
+    int x1 = ((roi->x + roi->width) * vis_w + full->out_width - 1) / full->out_width;
+    int y1 = ((roi->y + roi->height) * vis_h + full->out_height - 1) / full->out_height;
+    x0 -= x0 % align_x;
+    y0 -= y0 % align_y;
+    x1 += (align_x - x1 % align_x) % align_x;
+    y1 += (align_y - y1 % align_y) % align_y;
+    // Rounding up may run past the array: move back rather than shrink
+    if (x1 > vis_w) {
+        x0 -= x1 - vis_w;
+        x1 = vis_w;
+    }
+    if (y1 > vis_h) {
+        y0 -= y1 - vis_h;
+        y1 = vis_h;
+    }
+
+    out->start_x = vis_x + x0 - crop_x;
+    out->end_x = vis_x + x1 + crop_x - 1;
+    out->start_y = vis_y + y0 - crop_y;
+    out->end_y = vis_y + y1 + crop_y - 1;
+
+    // Native size, or as large as the full frame allows. The ISP scaler
+    // only scales down.
+    int in_w = (x1 - x0) / full->sub_x;
+    int in_h = (y1 - y0) / full->sub_y;
+    int w = in_w, h = in_h;
+    if (w > full->out_width || h > full->out_height) {
+        if ((int64_t)w * full->out_height > (int64_t)h * full->out_width) {
+            h = h * full->out_width / w;
+            w = full->out_width;
+        } else {
+            w = w * full->out_height / h;
+            h = full->out_height;
+        }
+    }
+    // Whole JPEG MCUs (16x8 for YUV422)
+    out->out_width = w & ~15;
+    out->out_height = h & ~7;
+    if (!out->out_width || !out->out_height) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    out->scale = out->out_width != in_w || out->out_height != in_h;
+
+    // Fewer lines read out, same blanking: the frame period shrinks with
+    // the window height
+    int full_rows = (full->end_y - full->start_y + 1) / full->sub_y;
+    int rows = (out->end_y - out->start_y + 1) / full->sub_y;
+    out->total_y = full->total_y - (full_rows - rows);
+    return ESP_OK;
+}
+
+static int read16(sensor_t *s, int reg)
+{
+    int hi = s->get_reg(s, reg, 0xFF);
+    int lo = s->get_reg(s, reg + 1, 0xFF);
+    return hi < 0 || lo < 0 ? -1 : hi << 8 | lo;
+}
+
+static int write16(sensor_t *s, int reg, int value)
+{
+    return s->set_reg(s, reg, 0xFF, value >> 8) || s->set_reg(s, reg + 1, 0xFF, value & 0xFF);
+}
+
+// The registers as the driver set them up for the current frame size
+static esp_err_t read_full(sensor_t *s)
+{
+    sensor_window_regs_t *r = &s_full;
+    int x_inc = s->get_reg(s, REG_X_INC, 0xFF);
+    int y_inc = s->get_reg(s, REG_Y_INC, 0xFF);
+    int isp = s->get_reg(s, REG_ISP_CTRL01, 0xFF);
+
+    r->start_x = read16(s, REG_X_ADDR_ST);
+    r->start_y = read16(s, REG_Y_ADDR_ST);
+    r->end_x = read16(s, REG_X_ADDR_END);
+    r->end_y = read16(s, REG_Y_ADDR_END);
+    r->out_width = read16(s, REG_X_OUTPUT_SIZE);
+    r->out_height = read16(s, REG_Y_OUTPUT_SIZE);
+    r->total_x = read16(s, REG_X_TOTAL_SIZE);
+    r->total_y = read16(s, REG_Y_TOTAL_SIZE);
+    r->offset_x = read16(s, REG_X_OFFSET);
+    r->offset_y = read16(s, REG_Y_OFFSET);
+    s_full_expo_60 = read16(s, REG_AEC_MAX_EXPO_60);
+    s_full_expo_50 = read16(s, REG_AEC_MAX_EXPO_50);
+    if (x_inc < 0 || y_inc < 0 || isp < 0 || r->start_x < 0 || r->start_y < 0 ||
+        r->end_x < 0 || r->end_y < 0 || r->out_width <= 0 || r->out_height <= 0 ||
+        r->total_x < 0 || r->total_y < 0 || r->offset_x < 0 || r->offset_y < 0 ||
+        s_full_expo_60 < 0 || s_full_expo_50 < 0) {
+        return ESP_FAIL;
+    }
+    r->sub_x = skip_factor(x_inc);
+    r->sub_y = skip_factor(y_inc);
+    r->scale = isp & 0x20;
+    return r->sub_x && r->sub_y ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t write_window(sensor_t *s, const sensor_window_regs_t *r)
+{
+    if (s->set_res_raw(s, r->start_x, r->start_y, r->end_x, r->end_y, r->offset_x, r->offset_y,
+                       r->total_x, r->total_y, r->out_width, r->out_height, r->scale,
+                       r->sub_y > 1) != 0) {
+        return ESP_FAIL;
+    }
+    // Exposure longer than the frame would stretch it back out
+    int expo_60 = s_full_expo_60 < r->total_y ? s_full_expo_60 : r->total_y;
+    int expo_50 = s_full_expo_50 < r->total_y ? s_full_expo_50 : r->total_y;
+    if (write16(s, REG_AEC_MAX_EXPO_60, expo_60) || write16(s, REG_AEC_MAX_EXPO_50, expo_50)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Switch to roi. Sets *wrote if the sensor registers were touched.
+static esp_err_t apply(sensor_t *s, const sensor_roi_t *roi, sensor_window_result_t *res,
+                       bool *wrote)
+{
+    *wrote = false;
+    if (!s_active && !roi->width) {
+        return ESP_OK;              // Already full
+    }
+    if (!s_active && read_full(s) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot read the sensor's timing registers");
+        return ESP_FAIL;
+    }
+
+    sensor_window_regs_t next;
+    esp_err_t err = sensor_window_plan(&s_full, roi, &next);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *wrote = true;
+    err = write_window(s, &next);
+    if (err != ESP_OK) {
+        // Half a window is worse than none
+        ESP_LOGW(TAG, "Window rejected, back to the full frame");
+        write_window(s, &s_full);
+        next = s_full;
+    }
+
+    s_now = next;
+    s_active = err == ESP_OK && roi->width;
+    res->out_width = next.out_width;
+    res->out_height = next.out_height;
+    res->lines = next.total_y;
+    res->full_lines = s_full.total_y;
+    return err;
+}
+
+esp_err_t sensor_window_init(sensor_t *s)
+{
+    if (!s || !s->set_res_raw || !s->get_reg || !s->set_reg ||
+        (s->id.PID != OV3660_PID && s->id.PID != OV5640_PID) ||
+        s->pixformat != PIXFORMAT_JPEG) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_switch_lock = xSemaphoreCreateMutex();
+    s_applied = xSemaphoreCreateBinary();
+    if (!s_switch_lock || !s_applied) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_supported = true;
+    return ESP_OK;
+}
+
+esp_err_t sensor_window_set(const sensor_roi_t *roi, TickType_t wait,
+                            sensor_window_result_t *res)
+{
+    if (!s_supported) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_switch_lock, portMAX_DELAY);
+    xSemaphoreTake(s_applied, 0);       // From a switch that timed out
+    portENTER_CRITICAL(&s_pending_lock);
+    s_pending = *roi;
+    s_has_pending = true;
+    portEXIT_CRITICAL(&s_pending_lock);
+
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    if (xSemaphoreTake(s_applied, wait) == pdTRUE) {
+        if (res) {
+            *res = s_result;
+        }
+        err = s_err;
+    }
+    xSemaphoreGive(s_switch_lock);
+    return err;
+}
+
+bool sensor_window_service(sensor_t *s)
+{
+    sensor_roi_t roi;
+    bool pending;
+
+    if (!s_supported) {
+        return false;
+    }
+    portENTER_CRITICAL(&s_pending_lock);
+    pending = s_has_pending;
+    roi = s_pending;
+    s_has_pending = false;
+    portEXIT_CRITICAL(&s_pending_lock);
+    if (!pending) {
+        return false;
+    }
+
+    bool wrote;
+    memset(&s_result, 0, sizeof(s_result));
+    int64_t start = esp_timer_get_time();
+    s_err = apply(s, &roi, &s_result, &wrote);
+    s_result.apply_us = esp_timer_get_time() - start;
+    if (s_err == ESP_OK && s_active) {
+        ESP_LOGI(TAG, "Window %dx%d at %d,%d: output %dx%d, %d of %d lines, in %lld us",
+                 roi.width, roi.height, roi.x, roi.y, s_result.out_width, s_result.out_height,
+                 s_result.lines, s_result.full_lines, (long long)s_result.apply_us);
+    } else if (s_err == ESP_OK && wrote) {
+        ESP_LOGI(TAG, "Back to the full frame");
+    }
+    xSemaphoreGive(s_applied);
+    return wrote;
+}
+
+bool sensor_window_active(void)
+{
+    return s_active;
+}
+
+bool sensor_window_size(int *width, int *height)
+{
+    if (!s_active) {
+        return false;
+    }
+    *width = s_now.out_width;
+    *height = s_now.out_height;
+    return true;
+}
@@ -0,0 +1,85 @@
+/*
+ * Sensor window (region of interest)
+ *
+ * Narrows what the OV3660 reads out to a rectangle of the full frame,
+ * with set_res_raw() and no camera restart. Only the rows inside the
+ * window are read, and the frame length (VTS) shrinks with them while
+ * the blanking stays, so the frame rate rises as the window gets lower.
+ * Columns outside it are skipped too, which makes frames smaller, but
+ * the line time (HTS) is left alone.
+ *
+ * The window comes out at its native resolution, scaled down by the ISP
+ * only if that is larger than the full frame: a small window is a digital
+ * zoom, not an upscale. The output never exceeds the full frame, so the
+ * frame buffers sized at init still fit.
+ *
+ * The geometry is planned from the sensor's own registers as they are for
+ * the full frame, whatever frame size and binning the driver picked.
+ * Like profiles, a new window is handed to the capture task and applied
+ * between frames. There is one sensor, so the window is the same for
+ * every viewer. JPEG only: for raw formats the driver expects the frame
+ * size it was initialized with.
+ */
+
+#ifndef SENSOR_WINDOW_H
+#define SENSOR_WINDOW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_camera.h"
+
+// In pixels of the full frame. A zero width is the full frame.
+typedef struct {
+    int x, y;
+    int width, height;
+} sensor_roi_t;
+
+// OV3660/OV5640 timing registers, 0x3800-0x3815 and 0x5001
+typedef struct {
+    int start_x, start_y;           // Array window, inclusive
+    int end_x, end_y;
+    int offset_x, offset_y;         // ISP crop on each side, after subsampling
+    int total_x, total_y;           // HTS, VTS
+    int out_width, out_height;
+    int sub_x, sub_y;               // 1, or 2 when binned
+    bool scale;                     // ISP scaler on
+} sensor_window_regs_t;
+
+typedef struct {
+    int out_width, out_height;      // What the sensor outputs now
+    int lines, full_lines;          // Frame length now and for the full frame
+    int64_t apply_us;
+} sensor_window_result_t;
+
+// Smallest window side, in pixels of the full frame
+#define SENSOR_WINDOW_MIN   64
+
+// Plan the registers for roi from those of the full frame.
+// ESP_ERR_INVALID_ARG if roi does not lie within the full frame.
+esp_err_t sensor_window_plan(const sensor_window_regs_t *full, const sensor_roi_t *roi,
+                             sensor_window_regs_t *out);
+
+// Check the sensor can be windowed. ESP_ERR_NOT_SUPPORTED if not.
+esp_err_t sensor_window_init(sensor_t *s);
+
+// Ask the capture task to switch to roi and wait up to wait ticks for it.
+// ESP_ERR_INVALID_STATE when the sensor cannot be windowed,
+// ESP_ERR_INVALID_ARG for a window outside the frame, ESP_ERR_TIMEOUT if
+// the switch is still pending (it will be applied later).
+esp_err_t sensor_window_set(const sensor_roi_t *roi, TickType_t wait,
+                            sensor_window_result_t *res);
+
+// Apply a pending switch. Capture task only, between frames. True if the
+// window changed.
+bool sensor_window_service(sensor_t *s);
+
+// True while a window is set. Capture task only.
+bool sensor_window_active(void);
+
+// Output size while a window is set; false for the full frame.
+// Capture task only.
+bool sensor_window_size(int *width, int *height);
+
+#endif // SENSOR_WINDOW_H
@@ -0,0 +1,66 @@
+/*
+ * Bounded single-producer, single-consumer queue
+ */
+
+#include <stdlib.h>
+
+#include "spsc_queue.h"
+
+static inline size_t next_index(const spsc_queue_t *q, size_t i)
+{
+    return i + 1 == q->size ? 0 : i + 1;
+}
+
+bool spsc_queue_init(spsc_queue_t *q, size_t capacity)
+{
+    q->size = capacity + 1;
+    q->slots = calloc(q->size, sizeof(void *));
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    return q->slots != NULL;
+}
+
+void spsc_queue_free(spsc_queue_t *q)
+{
+    free(q->slots);
+    q->slots = NULL;
+}
+
+bool spsc_queue_push(spsc_queue_t *q, void *item)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t next = next_index(q, tail);
+    if (next == atomic_load_explicit(&q->head, memory_order_acquire)) {
+        return false;
+    }
+    q->slots[tail] = item;
+    // Publishes the slot to the consumer. Sequentially consistent so a
+    // producer that then checks whether the consumer sleeps cannot be
+    // reordered ahead of it.
+    atomic_store(&q->tail, next);
+    return true;
+}
+
+void *spsc_queue_pop(spsc_queue_t *q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == atomic_load(&q->tail)) {
+        return NULL;
+    }
+    void *item = q->slots[head];
+    // Hands the slot back to the producer only after it was read
+    atomic_store_explicit(&q->head, next_index(q, head), memory_order_release);
+    return item;
+}
+
+size_t spsc_queue_depth(spsc_queue_t *q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    return tail >= head ? tail - head : tail + q->size - head;
+}
+
+size_t spsc_queue_capacity(const spsc_queue_t *q)
+{
+    return q->size - 1;
+}
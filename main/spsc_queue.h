@@ -0,0 +1,46 @@
+/*
+ * Bounded single-producer, single-consumer queue
+ *
+ * A ring of pointers with one atomic index per side: the producer only
+ * writes tail, the consumer only writes head, so neither ever takes a lock
+ * or waits for the other. Push fails when the ring is full and the caller
+ * decides what to drop. Exactly one thread may push and one may pop.
+ *
+ * Pure C11 atomics; runs on ESP-IDF and on Linux alike.
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Indices live on separate cache lines so the two sides do not contend
+#define SPSC_LINE   64
+
+typedef struct {
+    atomic_size_t head;             // Next slot to pop, written by the consumer
+    char pad0[SPSC_LINE - sizeof(atomic_size_t)];
+    atomic_size_t tail;             // Next slot to push, written by the producer
+    char pad1[SPSC_LINE - sizeof(atomic_size_t)];
+    void **slots;
+    size_t size;                    // Capacity + 1: one slot always stays empty
+} spsc_queue_t;
+
+// Allocate room for capacity items. Returns false if out of memory.
+bool spsc_queue_init(spsc_queue_t *q, size_t capacity);
+void spsc_queue_free(spsc_queue_t *q);
+
+// Producer: false if the queue is full. item must not be NULL.
+bool spsc_queue_push(spsc_queue_t *q, void *item);
+
+// Consumer: oldest item, NULL if the queue is empty
+void *spsc_queue_pop(spsc_queue_t *q);
+
+// Items queued. Exact from either side; a snapshot from anywhere else.
+size_t spsc_queue_depth(spsc_queue_t *q);
+
+size_t spsc_queue_capacity(const spsc_queue_t *q);
+
+#endif // SPSC_QUEUE_H
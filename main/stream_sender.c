@@ -0,0 +1,655 @@
+/*
+ * Async MJPEG sender pool - non-blocking multiplexed stream writers
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+#if CONFIG_STREAM_BOUNCE_BLOCKS
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_async_memcpy.h"
+#include "esp_cache.h"
+#include "esp_memory_utils.h"
+#endif
+
+#include "stream_sender.h"
+#include "frame_pacer.h"
+#include "mjpeg_part.h"
+#include "ws_frame.h"
+#include "camera_capture.h"
+#include "clock_sync.h"
+#include "metrics.h"
+
+static const char *TAG = "STREAM_TX";
+
+#define SENDER_TASK_STACK   4096
+// Longest a sender sleeps in select() while a socket is full, so sessions
+// waiting for a new frame are not held up by a slow one
+#define SENDER_SELECT_MS    20
+#define SENDER_IDLE_MS      100
+// How long a viewer waits for the capture task before giving up
+#define STREAM_FRAME_TIMEOUT_US (3000 * 1000)
+// A /ws client that stops acking is dropped after this long
+#define WS_ACK_TIMEOUT_US       (10000 * 1000)
+#define WS_RX_BUF_SIZE          (6 + WS_CONTROL_MAX + 8)
+#define WS_HDR_VALUE_MAX        64
+// Bounce blocks hold two full segments and stay whole cache lines, which
+// is what GDMA needs to read PSRAM
+#define BOUNCE_ALIGN            64
+#define BOUNCE_BLOCK            ((2 * CONFIG_LWIP_TCP_MSS + BOUNCE_ALIGN - 1) & ~(BOUNCE_ALIGN - 1))
+
+static const char STREAM_HTTP_HEAD[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: " MJPEG_CONTENT_TYPE "\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char WS_HTTP_HEAD[] =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: %s\r\n"
+    "\r\n";
+
+typedef enum {
+    SESSION_IDLE,                   // Waiting for the next frame or its due time
+    SESSION_BLOCKED,                // Socket buffer full, wait for writability
+    SESSION_WAIT_ACK,               // /ws client has the full window, wait for an ack
+    SESSION_CLOSE,                  // Client gone or stream failed
+} session_state_t;
+
+typedef struct {
+    httpd_req_t *req;               // Async copy of the request
+    httpd_handle_t server;
+    int fd;
+    frame_sub_t *sub;
+    frame_pacer_t pacer;
+    hub_frame_t *frame;             // Frame being sent, NULL when idle
+    mjpeg_part_t part;
+    uint32_t frames;
+    uint64_t bytes;                 // Part bytes put on the socket
+    uint64_t writes;                // Send calls spent on those parts
+    int64_t next_due_us;
+    int64_t last_frame_us;
+    uint32_t scene;                 // Scene of the last frame sent
+    int64_t sent_us;                // When that frame was taken
+    int64_t send_us;                // Taking each frame to its last write, summed
+
+    // Payloads go out of internal RAM blocks, NULL to send from the frame
+    uint8_t *bounce_buf;
+    bounce_ring_t bounce;
+
+    // /ws only: JPEGs as binary messages, at most
+    // CONFIG_STREAM_WS_INFLIGHT of them not yet acked by the client
+    bool ws;
+    uint32_t ws_seq;                // Last frame sent
+    uint32_t ws_acked;              // Last frame acked
+    int64_t ws_captured[CONFIG_STREAM_WS_INFLIGHT];  // In flight, by seq
+    uint32_t ws_latency_us;         // Capture to ack of the last acked frame
+    uint8_t rx[WS_RX_BUF_SIZE];     // Client frames not parsed yet
+    size_t rx_len;
+    // Control reply held back while a JPEG is on the wire; a newer one
+    // replaces it. Sent from ctl_off once the message is out.
+    uint8_t ctl[2 * (WS_HEADER_MAX + WS_CONTROL_MAX)];
+    size_t ctl_len;
+    size_t ctl_off;
+    bool ws_closing;                // Close received: echo it, then hang up
+} stream_session_t;
+
+typedef struct {
+    TaskHandle_t task;
+    QueueHandle_t incoming;
+    stream_session_t *sessions[CONFIG_STREAM_MAX_CLIENTS];
+    atomic_int count;               // Sessions owned or queued
+#if CONFIG_STREAM_BOUNCE_BLOCKS
+    // Given whenever a GDMA copy for one of its sessions finishes. Lives as
+    // long as the task, so a late give never finds it gone.
+    SemaphoreHandle_t copied;
+#endif
+} stream_sender_t;
+
+static stream_sender_t s_senders[CONFIG_STREAM_SENDER_TASKS];
+// Sessions open on all senders, from every hub and /ws. Each sender's
+// sessions array and queue, and the GDMA backlog, hold
+// CONFIG_STREAM_MAX_CLIENTS, so that is the limit for all of them together.
+static atomic_int s_sessions;
+// Time all senders spent outside select()/notify waits
+static atomic_uint_fast64_t s_busy_us;
+
+#if CONFIG_STREAM_BOUNCE_BLOCKS
+static async_memcpy_handle_t s_mcp;
+
+// The ring may be freed as soon as its last copy counts as done, so the
+// semaphore is looked up before that
+static IRAM_ATTR bool bounce_copied(async_memcpy_handle_t mcp, async_memcpy_event_t *event, void *arg)
+{
+    bounce_ring_t *ring = arg;
+    SemaphoreHandle_t copied = ring->cfg.arg;
+    BaseType_t woken = pdFALSE;
+
+    bounce_ring_copied(ring);
+    xSemaphoreGiveFromISR(copied, &woken);
+    return woken == pdTRUE;
+}
+
+// Sleep instead of spinning while the sender is ahead of GDMA
+static void bounce_wait(bounce_ring_t *ring)
+{
+    xSemaphoreTake(ring->cfg.arg, portMAX_DELAY);
+}
+
+// GDMA copies whole cache lines out of PSRAM, after writing back what the
+// hub left in the cache. Anything else is quicker with the CPU, but only
+// once GDMA is done with the ring: the CPU then neither writes the ring
+// while GDMA does nor completes a copy ahead of one GDMA still has.
+static void bounce_copy(void *dst, const void *src, size_t n, bounce_ring_t *ring)
+{
+    size_t bulk = n & ~(BOUNCE_ALIGN - 1);
+    if (s_mcp && bulk && esp_ptr_external_ram(src) && !((uintptr_t)src & (BOUNCE_ALIGN - 1))) {
+        if (bulk < n) {
+            bounce_ring_settle(ring);
+            memcpy((uint8_t *)dst + bulk, (const uint8_t *)src + bulk, n - bulk);
+        }
+        if (esp_cache_msync((void *)src, bulk, ESP_CACHE_MSYNC_FLAG_DIR_C2M) == ESP_OK &&
+            esp_async_memcpy(s_mcp, dst, (void *)src, bulk, bounce_copied, ring) == ESP_OK) {
+            return;
+        }
+    }
+    bounce_ring_settle(ring);
+    memcpy(dst, src, n);
+    bounce_ring_copied(ring);
+}
+#endif
+
+// Driver timestamps come from esp_timer
+static inline int64_t frame_captured_us(const hub_frame_t *frame)
+{
+    return (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+}
+
+static void session_close(stream_session_t *ss)
+{
+    if (ss->bounce_buf) {
+        bounce_ring_drain(&ss->bounce);
+        heap_caps_free(ss->bounce_buf);
+    }
+    if (ss->frame) {
+        frame_hub_release(ss->frame);
+    }
+    ESP_LOGI(TAG, "Stream ended, %lu frames sent, %lu dropped, budget %lu mfps",
+             (unsigned long)ss->frames, (unsigned long)frame_hub_dropped(ss->sub),
+             (unsigned long)frame_pacer_budget_mfps(&ss->pacer));
+    if (ss->frames) {
+        ESP_LOGI(TAG, "Per frame: %lu bytes, %lu.%02lu send calls, %lu KB/s while sending%s",
+                 (unsigned long)(ss->bytes / ss->frames),
+                 (unsigned long)(ss->writes / ss->frames),
+                 (unsigned long)(ss->writes * 100 / ss->frames % 100),
+                 (unsigned long)(ss->send_us ? ss->bytes * 1000000 / 1024 / ss->send_us : 0),
+                 ss->bounce_buf ? " (bounced)" : "");
+    }
+    frame_hub_unsubscribe(ss->sub);
+    httpd_req_async_handler_complete(ss->req);
+    httpd_sess_trigger_close(ss->server, ss->fd);
+    free(ss);
+    atomic_fetch_sub(&s_sessions, 1);
+}
+
+// Push as much of the current frame as the socket accepts
+static session_state_t session_write(stream_session_t *ss)
+{
+    int64_t start = esp_timer_get_time();
+    mjpeg_part_status_t st = mjpeg_part_write(&ss->part, ss->fd);
+    int64_t now = esp_timer_get_time();
+    metrics_observe(METRIC_SEND_CHUNK_US, now - start);
+    if (st == MJPEG_PART_WOULD_BLOCK) {
+        return SESSION_BLOCKED;
+    }
+    if (st == MJPEG_PART_ERROR) {
+        ESP_LOGW(TAG, "Stream send failed: errno %d", errno);
+        return SESSION_CLOSE;
+    }
+
+    ss->frames++;
+    ss->bytes += ss->part.total;
+    ss->writes += ss->part.writes;
+    ss->send_us += now - ss->pacer.captured_us;
+    if (ss->bounce_buf) {
+        metrics_add(METRIC_BOUNCE_BYTES, ss->frame->len);
+        metrics_add(METRIC_BOUNCE_STALLS, ss->bounce.stalls);
+        ss->bounce.stalls = 0;
+    }
+    int64_t captured = frame_captured_us(ss->frame);
+    frame_hub_release(ss->frame);
+    ss->frame = NULL;
+
+    metrics_inc(METRIC_FRAMES_SENT);
+    metrics_add(METRIC_BYTES_SENT, ss->part.total);
+    metrics_observe(METRIC_FRAME_SEND_US, now - ss->pacer.captured_us);
+    metrics_observe(METRIC_STREAM_FRAME_AGE_US, now - captured);
+    camera_capture_report_send(ss->part.total, now - ss->pacer.captured_us);
+
+    // Sleep only what is left of this frame's budget
+    ss->next_due_us = now + frame_pacer_end(&ss->pacer, now);
+    frame_pacer_begin(&ss->pacer, ss->next_due_us);
+    return SESSION_IDLE;
+}
+
+// Send what is left of the pending control frame
+static session_state_t ws_flush_control(stream_session_t *ss)
+{
+    while (ss->ctl_off < ss->ctl_len) {
+        ssize_t n = send(ss->fd, ss->ctl + ss->ctl_off, ss->ctl_len - ss->ctl_off, MSG_DONTWAIT);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? SESSION_BLOCKED : SESSION_CLOSE;
+        }
+        ss->ctl_off += n;
+    }
+    ss->ctl_len = 0;
+    ss->ctl_off = 0;
+    return SESSION_IDLE;
+}
+
+// Control replies go out only between messages, never inside a JPEG: one
+// is queued while a frame is in flight and sent as soon as it is done
+static void ws_send_control(stream_session_t *ss, uint8_t opcode, const uint8_t *payload, size_t len)
+{
+    // One already half sent must finish first; the new one goes after it
+    size_t at = ss->ctl_off ? ss->ctl_len : 0;
+    if (at + WS_HEADER_MAX + len > sizeof(ss->ctl)) {
+        return;
+    }
+    size_t hlen = ws_frame_header(ss->ctl + at, opcode, len);
+    memcpy(ss->ctl + at + hlen, payload, len);
+    ss->ctl_len = at + hlen + len;
+    if (!ss->frame) {
+        ws_flush_control(ss);
+    }
+}
+
+// An ack names the last frame the client has drawn and covers all before it
+static void ws_ack(stream_session_t *ss, const ws_msg_t *msg, int64_t now)
+{
+    char text[12];
+    size_t n = msg->len < sizeof(text) - 1 ? msg->len : sizeof(text) - 1;
+    memcpy(text, msg->payload, n);
+    text[n] = '\0';
+
+    uint32_t seq = strtoul(text, NULL, 10);
+    uint32_t acked = seq - ss->ws_acked;
+    if (acked == 0 || acked > ss->ws_seq - ss->ws_acked) {
+        return;                     // Stale or not sent yet
+    }
+    ss->ws_acked = seq;
+    ss->ws_latency_us = now - ss->ws_captured[seq % CONFIG_STREAM_WS_INFLIGHT];
+    metrics_observe(METRIC_WS_ACK_LATENCY_US, ss->ws_latency_us);
+}
+
+// Take in acks and control frames. Returns false once the client is gone.
+static bool ws_receive(stream_session_t *ss, int64_t now)
+{
+    ssize_t n = recv(ss->fd, ss->rx + ss->rx_len, sizeof(ss->rx) - ss->rx_len, MSG_DONTWAIT);
+    if (n == 0) {
+        return false;
+    }
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    ss->rx_len += n;
+
+    ws_msg_t msg;
+    int used;
+    while ((used = ws_frame_parse(ss->rx, ss->rx_len, &msg)) > 0) {
+        ss->rx_len -= used;
+        memmove(ss->rx, ss->rx + used, ss->rx_len);
+        switch (msg.opcode) {
+        case WS_OP_TEXT:
+            ws_ack(ss, &msg, now);
+            break;
+        case WS_OP_PING:
+            ws_send_control(ss, WS_OP_PONG, msg.payload, msg.len);
+            break;
+        case WS_OP_CLOSE:
+            // Nothing after a close counts; hang up once the echo is out
+            ws_send_control(ss, WS_OP_CLOSE, msg.payload, msg.len < 2 ? msg.len : 2);
+            ss->ws_closing = true;
+            ss->rx_len = 0;
+            return true;
+        default:
+            break;
+        }
+    }
+    if (used < 0) {
+        ESP_LOGW(TAG, "WebSocket protocol error");
+    }
+    return used == 0;
+}
+
+static session_state_t session_service(stream_session_t *ss, int64_t now)
+{
+    if (ss->ws && !ss->ws_closing && !ws_receive(ss, now)) {
+        return SESSION_CLOSE;
+    }
+    if (ss->frame) {
+        session_state_t st = session_write(ss);
+        if (st != SESSION_IDLE || !ss->ctl_len) {
+            return st;
+        }
+    }
+    if (ss->ctl_len) {
+        session_state_t st = ws_flush_control(ss);
+        if (st != SESSION_IDLE) {
+            return st;
+        }
+    }
+    if (ss->ws_closing) {
+        return SESSION_CLOSE;
+    }
+    if (now < ss->next_due_us) {
+        return SESSION_IDLE;
+    }
+    if (ss->ws && ss->ws_seq - ss->ws_acked >= CONFIG_STREAM_WS_INFLIGHT) {
+        if (now - ss->last_frame_us > WS_ACK_TIMEOUT_US) {
+            ESP_LOGW(TAG, "WebSocket client stopped acking");
+            return SESSION_CLOSE;
+        }
+        return SESSION_WAIT_ACK;
+    }
+
+    hub_frame_t *frame = frame_hub_wait(ss->sub, 0);
+    if (!frame) {
+        if (now - ss->last_frame_us > STREAM_FRAME_TIMEOUT_US) {
+            ESP_LOGE(TAG, "Camera capture failed");
+            return SESSION_CLOSE;
+        }
+        return SESSION_IDLE;
+    }
+    if (frame->format != PIXFORMAT_JPEG) {
+        ESP_LOGE(TAG, "Non-JPEG format");
+        frame_hub_release(frame);
+        return SESSION_CLOSE;
+    }
+
+    ss->last_frame_us = now;
+
+#if CONFIG_STREAM_MOTION_GATE
+    // Same picture the client already has: skip unless a refresh is due
+    if (ss->frames && frame->scene == ss->scene &&
+        now - ss->sent_us < CONFIG_STREAM_MOTION_REFRESH_MS * 1000LL) {
+        metrics_inc(METRIC_FRAMES_UNCHANGED);
+        metrics_add(METRIC_BYTES_SUPPRESSED, frame->len);
+        frame_hub_release(frame);
+        return SESSION_IDLE;
+    }
+    ss->scene = frame->scene;
+    ss->sent_us = now;
+#endif
+
+    frame_pacer_captured(&ss->pacer, now);
+
+    ss->frame = frame;
+    if (ss->ws) {
+        int64_t captured = frame_captured_us(frame);
+        ws_frame_info_t info = {
+            .seq = ++ss->ws_seq,
+            .age_us = now - captured,
+            .latency_us = ss->ws_latency_us,
+        };
+        ss->ws_captured[info.seq % CONFIG_STREAM_WS_INFLIGHT] = captured;
+        ws_frame_part_init(&ss->part, &info, frame->buf, frame->len);
+    } else {
+        int64_t offset = clock_sync_offset_us();
+        mjpeg_part_meta_t meta = {
+            .seq = frame->seq,
+            .timestamp_us = frame_captured_us(frame) + offset,
+            .clock_offset_us = offset,
+        };
+        mjpeg_part_init(&ss->part, frame->buf, frame->len, &meta);
+    }
+    if (ss->bounce_buf) {
+        mjpeg_part_bounce(&ss->part, &ss->bounce);
+    }
+    return session_write(ss);
+}
+
+static void sender_task(void *arg)
+{
+    stream_sender_t *snd = arg;
+    stream_session_t **sessions = snd->sessions;
+    size_t n = 0;
+
+    while (true) {
+        stream_session_t *ss;
+        while (xQueueReceive(snd->incoming, &ss, 0) == pdTRUE) {
+            sessions[n++] = ss;
+        }
+
+        int64_t now = esp_timer_get_time();
+        int64_t busy_start = now;
+        int64_t wait_us = SENDER_IDLE_MS * 1000;
+        fd_set rfds, wfds;
+        int maxfd = -1;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+
+        for (size_t i = 0; i < n; ) {
+            ss = sessions[i];
+            session_state_t st = session_service(ss, now);
+            if (st == SESSION_CLOSE) {
+                session_close(ss);
+                sessions[i] = sessions[--n];
+                atomic_fetch_sub(&snd->count, 1);
+                continue;
+            }
+            if (st == SESSION_BLOCKED || st == SESSION_WAIT_ACK) {
+                FD_SET(ss->fd, st == SESSION_BLOCKED ? &wfds : &rfds);
+                if (ss->fd > maxfd) {
+                    maxfd = ss->fd;
+                }
+            } else if (ss->next_due_us > now && ss->next_due_us - now < wait_us) {
+                wait_us = ss->next_due_us - now;
+            }
+            i++;
+        }
+        atomic_fetch_add(&s_busy_us, esp_timer_get_time() - busy_start);
+
+        if (maxfd >= 0) {
+            if (wait_us > SENDER_SELECT_MS * 1000) {
+                wait_us = SENDER_SELECT_MS * 1000;
+            }
+            struct timeval tv = { .tv_sec = 0, .tv_usec = wait_us };
+            select(maxfd + 1, &rfds, &wfds, NULL, &tv);
+        } else {
+            // Woken early by the hub whenever a new frame is published
+            TickType_t ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+            ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+        }
+    }
+}
+
+static esp_err_t session_attach(httpd_req_t *req, frame_hub_t *hub, int target_fps,
+                                const char *head, size_t head_len, bool ws)
+{
+    // The hubs alone would let main, scaled and /ws viewers add up to more
+    // than a sender can hold
+    if (atomic_fetch_add(&s_sessions, 1) >= CONFIG_STREAM_MAX_CLIENTS) {
+        atomic_fetch_sub(&s_sessions, 1);
+        return ESP_ERR_NO_MEM;
+    }
+
+    frame_sub_t *sub = frame_hub_subscribe(hub);
+    if (!sub) {
+        atomic_fetch_sub(&s_sessions, 1);
+        return ESP_ERR_NO_MEM;
+    }
+
+    stream_session_t *ss = calloc(1, sizeof(*ss));
+    if (!ss) {
+        frame_hub_unsubscribe(sub);
+        atomic_fetch_sub(&s_sessions, 1);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (httpd_req_async_handler_begin(req, &ss->req) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to detach stream request");
+        frame_hub_unsubscribe(sub);
+        free(ss);
+        atomic_fetch_sub(&s_sessions, 1);
+        return ESP_FAIL;
+    }
+    ss->server = req->handle;
+    ss->fd = httpd_req_to_sockfd(ss->req);
+    ss->sub = sub;
+    ss->ws = ws;
+
+    // Response head goes out raw; parts follow on the same connection
+    if (send(ss->fd, head, head_len, 0) < 0) {
+        session_close(ss);
+        return ESP_OK;
+    }
+    fcntl(ss->fd, F_SETFL, fcntl(ss->fd, F_GETFL, 0) | O_NONBLOCK);
+
+    int64_t now = esp_timer_get_time();
+    frame_pacer_init(&ss->pacer, target_fps);
+    frame_pacer_begin(&ss->pacer, now);
+    ss->next_due_us = now;
+    ss->last_frame_us = now;
+
+    // Least loaded sender takes the session
+    stream_sender_t *snd = &s_senders[0];
+    for (int i = 1; i < CONFIG_STREAM_SENDER_TASKS; i++) {
+        if (atomic_load(&s_senders[i].count) < atomic_load(&snd->count)) {
+            snd = &s_senders[i];
+        }
+    }
+    atomic_fetch_add(&snd->count, 1);
+
+#if CONFIG_STREAM_BOUNCE_BLOCKS
+    // Without internal RAM to spare the session sends straight from PSRAM
+    ss->bounce_buf = heap_caps_aligned_alloc(BOUNCE_ALIGN, CONFIG_STREAM_BOUNCE_BLOCKS * BOUNCE_BLOCK,
+                                             MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    if (ss->bounce_buf) {
+        bounce_ring_config_t cfg = {
+            .buf = ss->bounce_buf,
+            .block_size = BOUNCE_BLOCK,
+            .blocks = CONFIG_STREAM_BOUNCE_BLOCKS,
+            .copy = bounce_copy,
+            .wait = bounce_wait,
+            .arg = snd->copied,
+        };
+        bounce_ring_init(&ss->bounce, &cfg);
+    } else {
+        ESP_LOGW(TAG, "No internal RAM for bounce buffers, sending from PSRAM");
+    }
+#endif
+
+    frame_hub_set_notify(sub, snd->task);
+    xQueueSend(snd->incoming, &ss, portMAX_DELAY);
+    xTaskNotifyGive(snd->task);
+
+    ESP_LOGI(TAG, "%s started on fd %d, target %d fps", ws ? "WebSocket stream" : "Stream",
+             ss->fd, target_fps);
+    return ESP_OK;
+}
+
+esp_err_t stream_sender_attach(httpd_req_t *req, frame_hub_t *hub, int target_fps)
+{
+    return session_attach(req, hub, target_fps, STREAM_HTTP_HEAD, sizeof(STREAM_HTTP_HEAD) - 1, false);
+}
+
+// Sec-WebSocket-Accept: base64(SHA-1(key + GUID))
+static bool ws_accept_key(const char *key, char *out, size_t cap)
+{
+    char buf[64];
+    unsigned char digest[20];
+    size_t olen;
+
+    int n = snprintf(buf, sizeof(buf), "%s" WS_GUID, key);
+    if (n < 0 || (size_t)n >= sizeof(buf)) {
+        return false;
+    }
+    return mbedtls_sha1((const unsigned char *)buf, n, digest) == 0 &&
+           mbedtls_base64_encode((unsigned char *)out, cap, &olen, digest, sizeof(digest)) == 0;
+}
+
+// Header value, or NULL if it is absent or too long to be valid
+static const char *ws_header(httpd_req_t *req, const char *name, char *buf, size_t cap)
+{
+    return httpd_req_get_hdr_value_str(req, name, buf, cap) == ESP_OK ? buf : NULL;
+}
+
+esp_err_t stream_sender_attach_ws(httpd_req_t *req, frame_hub_t *hub, int target_fps)
+{
+    char upgrade[WS_HDR_VALUE_MAX];
+    char connection[WS_HDR_VALUE_MAX];
+    char version[8];
+    char key[32];
+    char accept[32];
+    char head[sizeof(WS_HTTP_HEAD) + sizeof(accept)];
+
+    const char *k = ws_header(req, "Sec-WebSocket-Key", key, sizeof(key));
+    int status = ws_handshake_status(ws_header(req, "Upgrade", upgrade, sizeof(upgrade)),
+                                     ws_header(req, "Connection", connection, sizeof(connection)),
+                                     ws_header(req, "Sec-WebSocket-Version", version, sizeof(version)),
+                                     k);
+    if (status == 426) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (status || !ws_accept_key(k, accept, sizeof(accept))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int n = snprintf(head, sizeof(head), WS_HTTP_HEAD, accept);
+    return session_attach(req, hub, target_fps, head, n, true);
+}
+
+esp_err_t stream_sender_start(void)
+{
+#if CONFIG_STREAM_BOUNCE_BLOCKS
+    async_memcpy_config_t mcp_cfg = ASYNC_MEMCPY_DEFAULT_CONFIG();
+    mcp_cfg.backlog = CONFIG_STREAM_MAX_CLIENTS * CONFIG_STREAM_BOUNCE_BLOCKS;
+    mcp_cfg.dma_burst_size = BOUNCE_ALIGN;  // Needed to read PSRAM
+    if (esp_async_memcpy_install(&mcp_cfg, &s_mcp) != ESP_OK) {
+        ESP_LOGW(TAG, "No GDMA channel, bounce buffers filled by the CPU");
+        s_mcp = NULL;
+    }
+#endif
+    for (int i = 0; i < CONFIG_STREAM_SENDER_TASKS; i++) {
+        stream_sender_t *snd = &s_senders[i];
+        snd->incoming = xQueueCreate(CONFIG_STREAM_MAX_CLIENTS, sizeof(stream_session_t *));
+        if (!snd->incoming) {
+            return ESP_ERR_NO_MEM;
+        }
+#if CONFIG_STREAM_BOUNCE_BLOCKS
+        snd->copied = xSemaphoreCreateBinary();
+        if (!snd->copied) {
+            return ESP_ERR_NO_MEM;
+        }
+#endif
+        int core = CONFIG_PIPELINE_SEND_CORE < 0 ? tskNO_AFFINITY : CONFIG_PIPELINE_SEND_CORE;
+        if (xTaskCreatePinnedToCore(sender_task, "stream_tx", SENDER_TASK_STACK, snd,
+                                    CONFIG_PIPELINE_SEND_PRIO, &snd->task, core) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+uint64_t stream_sender_take_busy_us(void)
+{
+    return atomic_exchange(&s_busy_us, 0);
+}
@@ -0,0 +1,40 @@
+/*
+ * Async MJPEG sender pool
+ *
+ * /stream requests are detached from the httpd worker with the async handler
+ * API and handed to a small pool of sender tasks. Each sender multiplexes its
+ * sessions on non-blocking sockets, so a viewer no longer pins an httpd
+ * worker for the lifetime of the stream.
+ *
+ * /ws sessions are served the same way after the WebSocket handshake: each
+ * JPEG is one binary message, and the client acks the frames it has drawn.
+ * A session gets a new frame only while fewer than
+ * CONFIG_STREAM_WS_INFLIGHT are unacked, so it runs at the client's pace.
+ */
+
+#ifndef STREAM_SENDER_H
+#define STREAM_SENDER_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "frame_hub.h"
+
+// Start CONFIG_STREAM_SENDER_TASKS sender tasks, the pipeline's send stage.
+esp_err_t stream_sender_start(void);
+
+// Take over a /stream request, streaming frames from hub. On ESP_OK the request has been detached and
+// the handler must return immediately. ESP_ERR_NO_MEM means every stream
+// slot is in use, CONFIG_STREAM_MAX_CLIENTS over all hubs and /ws
+// together, and the request is still owned by the caller.
+esp_err_t stream_sender_attach(httpd_req_t *req, frame_hub_t *hub, int target_fps);
+
+// Same for a /ws upgrade request. ESP_ERR_INVALID_ARG means it was not a
+// valid WebSocket handshake (answer 400), ESP_ERR_NOT_SUPPORTED that it
+// asked for a version other than 13 (answer 426); the request is then
+// still the caller's.
+esp_err_t stream_sender_attach_ws(httpd_req_t *req, frame_hub_t *hub, int target_fps);
+
+// Time all sender tasks spent working since the last call
+uint64_t stream_sender_take_busy_us(void);
+
+#endif // STREAM_SENDER_H
@@ -0,0 +1,189 @@
+/*
+ * Wi-Fi station - background connect, cached AP, reconnect with backoff
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+
+#include "wifi_sta.h"
+
+static const char *TAG = "WIFI";
+
+#define WIFI_NVS_NAMESPACE      "wifi"
+#define WIFI_NVS_AP_KEY         "ap"
+
+#define WIFI_BACKOFF_MIN_MS     250
+#define WIFI_BACKOFF_MAX_MS     30000
+// Failed attempts at the cached AP before scanning for the SSID again
+#define WIFI_CACHED_ATTEMPTS    2
+
+#define WIFI_CONNECTED_BIT      BIT0
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_ap_cache_t;
+
+static EventGroupHandle_t s_events;
+static esp_timer_handle_t s_retry_timer;
+static wifi_config_t s_config;
+static wifi_ap_cache_t s_cache;
+static bool s_cached;                   // s_config points at the cached AP
+static int s_attempts;                  // Failed since the last connect
+static int64_t s_start_us;
+static bool s_first_connect = true;
+
+static bool cache_load(wifi_ap_cache_t *ap)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(*ap);
+    esp_err_t err = nvs_get_blob(nvs, WIFI_NVS_AP_KEY, ap, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(*ap) && ap->channel;
+}
+
+// Only written when the AP changed, to spare the flash
+static void cache_store(const wifi_ap_cache_t *ap)
+{
+    if (!memcmp(ap, &s_cache, sizeof(*ap))) {
+        return;
+    }
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, WIFI_NVS_AP_KEY, ap, sizeof(*ap)) == ESP_OK) {
+        nvs_commit(nvs);
+        s_cache = *ap;
+    }
+    nvs_close(nvs);
+}
+
+static void retry_connect(void *arg)
+{
+    esp_wifi_connect();
+}
+
+static void on_disconnected(const wifi_event_sta_disconnected_t *event)
+{
+    xEventGroupClearBits(s_events, WIFI_CONNECTED_BIT);
+    s_attempts++;
+
+    // The AP may have moved channel or gone: look for the SSID anywhere
+    if (s_cached && s_attempts == WIFI_CACHED_ATTEMPTS) {
+        ESP_LOGW(TAG, "Cached AP not reachable, scanning");
+        s_config.sta.bssid_set = false;
+        s_config.sta.channel = 0;
+        esp_wifi_set_config(WIFI_IF_STA, &s_config);
+        s_cached = false;
+    }
+
+    int shift = s_attempts - 1 < 7 ? s_attempts - 1 : 7;
+    int delay_ms = WIFI_BACKOFF_MIN_MS << shift;
+    if (delay_ms > WIFI_BACKOFF_MAX_MS) {
+        delay_ms = WIFI_BACKOFF_MAX_MS;
+    }
+    ESP_LOGI(TAG, "Disconnected (reason %d), retry %d in %d ms",
+             event->reason, s_attempts, delay_ms);
+    esp_timer_start_once(s_retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+static void on_got_ip(const ip_event_got_ip_t *event)
+{
+    int64_t ms = (esp_timer_get_time() - s_start_us) / 1000;
+    if (s_first_connect) {
+        ESP_LOGI(TAG, "Got IP " IPSTR " %lld ms after start (%s)", IP2STR(&event->ip_info.ip),
+                 (long long)ms, s_cached ? "cached AP" : "scanned");
+        s_first_connect = false;
+    } else {
+        ESP_LOGI(TAG, "Got IP " IPSTR " after %d retries", IP2STR(&event->ip_info.ip), s_attempts);
+    }
+    s_attempts = 0;
+
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        wifi_ap_cache_t cache = { .channel = ap.primary };
+        memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+        cache_store(&cache);
+    }
+    xEventGroupSetBits(s_events, WIFI_CONNECTED_BIT);
+}
+
+static void wifi_event_handler(void *arg, esp_event_base_t event_base,
+                               int32_t event_id, void *event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        if (s_first_connect) {
+            ESP_LOGI(TAG, "Associated %lld ms after start",
+                     (long long)(esp_timer_get_time() - s_start_us) / 1000);
+        }
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        on_disconnected(event_data);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        on_got_ip(event_data);
+    }
+}
+
+esp_err_t wifi_sta_start(const char *ssid, const char *password)
+{
+    s_start_us = esp_timer_get_time();
+    s_events = xEventGroupCreate();
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry_connect,
+        .name = "wifi_retry",
+    };
+    if (!s_events || esp_timer_create(&timer_args, &s_retry_timer) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+                                                        &wifi_event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
+                                                        &wifi_event_handler, NULL, NULL));
+
+    strncpy((char *)s_config.sta.ssid, ssid, sizeof(s_config.sta.ssid));
+    strncpy((char *)s_config.sta.password, password, sizeof(s_config.sta.password));
+    s_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+
+    s_cached = cache_load(&s_cache);
+    if (s_cached) {
+        s_config.sta.bssid_set = true;
+        memcpy(s_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+        s_config.sta.channel = s_cache.channel;
+        ESP_LOGI(TAG, "Connecting to %s via cached AP %02x:%02x:%02x:%02x:%02x:%02x, channel %d",
+                 ssid, s_cache.bssid[0], s_cache.bssid[1], s_cache.bssid[2],
+                 s_cache.bssid[3], s_cache.bssid[4], s_cache.bssid[5], s_cache.channel);
+    } else {
+        ESP_LOGI(TAG, "Connecting to %s...", ssid);
+    }
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &s_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    return ESP_OK;
+}
+
+bool wifi_sta_wait_connected(TickType_t wait)
+{
+    return xEventGroupWaitBits(s_events, WIFI_CONNECTED_BIT, pdFALSE, pdFALSE, wait) &
+           WIFI_CONNECTED_BIT;
+}
@@ -0,0 +1,29 @@
+/*
+ * Wi-Fi station
+ *
+ * Connects in the background so the rest of startup (camera, servers) runs
+ * while the radio scans, associates and gets a lease. The AP's BSSID and
+ * channel are cached in NVS after every successful connect; the next boot
+ * goes straight to that AP on that channel instead of scanning all of
+ * them, and falls back to a normal scan if it is gone. With
+ * CONFIG_LWIP_DHCP_RESTORE_LAST_IP the DHCP client likewise asks for the
+ * last lease back instead of starting from DISCOVER.
+ *
+ * A dropped link is retried forever, with exponential backoff.
+ */
+
+#ifndef WIFI_STA_H
+#define WIFI_STA_H
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+// Start connecting to ssid. Returns once the driver is running; NVS must
+// be initialized.
+esp_err_t wifi_sta_start(const char *ssid, const char *password);
+
+// Block until the station has an IP address, up to wait ticks
+bool wifi_sta_wait_connected(TickType_t wait);
+
+#endif // WIFI_STA_H
@@ -0,0 +1,115 @@
+/*
+ * WebSocket framing for the /ws stream
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "ws_frame.h"
+
+static inline uint8_t *put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+size_t ws_frame_header(uint8_t *out, uint8_t opcode, uint64_t len)
+{
+    out[0] = 0x80 | opcode;         // FIN
+    if (len < 126) {
+        out[1] = len;
+        return 2;
+    }
+    if (len <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = len >> 8;
+        out[3] = len;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) {
+        out[2 + i] = len >> (56 - 8 * i);
+    }
+    return 10;
+}
+
+void ws_frame_part_init(mjpeg_part_t *part, const ws_frame_info_t *info,
+                        const uint8_t *jpeg, size_t len)
+{
+    uint8_t *head = (uint8_t *)part->head;
+    size_t hlen = ws_frame_header(head, WS_OP_BINARY, WS_FRAME_INFO_LEN + (uint64_t)len);
+    uint8_t *p = head + hlen;
+    p = put_be32(p, info->seq);
+    p = put_be32(p, info->age_us);
+    p = put_be32(p, info->latency_us);
+    hlen = p - head;
+
+    part->iov[0] = (struct iovec){ .iov_base = head, .iov_len = hlen };
+    part->iov[1] = (struct iovec){ .iov_base = (void *)jpeg, .iov_len = len };
+    part->iov_cnt = 2;
+    part->iov_idx = 0;
+    part->total = hlen + len;
+    part->sent = 0;
+    part->writes = 0;
+    part->bounce = NULL;
+}
+
+int ws_frame_parse(const uint8_t *buf, size_t len, ws_msg_t *msg)
+{
+    if (len < 2) {
+        return 0;
+    }
+    bool fin = buf[0] & 0x80;
+    bool masked = buf[1] & 0x80;
+    size_t plen = buf[1] & 0x7F;
+
+    // Clients must mask; acks and control frames fit in one short frame
+    if (!fin || !masked || plen > WS_CONTROL_MAX || (buf[0] & 0x70)) {
+        return -1;
+    }
+    if (len < 6 + plen) {
+        return 0;
+    }
+    const uint8_t *mask = buf + 2;
+    for (size_t i = 0; i < plen; i++) {
+        msg->payload[i] = buf[6 + i] ^ mask[i & 3];
+    }
+    msg->opcode = buf[0] & 0x0F;
+    msg->len = plen;
+    return 6 + plen;
+}
+
+// True if the comma-separated list has token, ignoring case and spaces
+static bool has_token(const char *list, const char *token)
+{
+    size_t n = strlen(token);
+    for (const char *p = list; *p; ) {
+        p += strspn(p, " \t,");
+        size_t len = strcspn(p, ",");
+        while (len && (p[len - 1] == ' ' || p[len - 1] == '\t')) {
+            len--;
+        }
+        if (len == n && !strncasecmp(p, token, n)) {
+            return true;
+        }
+        p += strcspn(p, ",");
+    }
+    return false;
+}
+
+int ws_handshake_status(const char *upgrade, const char *connection,
+                        const char *version, const char *key)
+{
+    // The key is 16 random bytes in base64
+    if (!upgrade || strcasecmp(upgrade, "websocket") || !connection ||
+        !has_token(connection, "Upgrade") || !key || strlen(key) != 24 || !version) {
+        return 400;
+    }
+    if (strcmp(version, "13")) {
+        return 426;
+    }
+    return 0;
+}
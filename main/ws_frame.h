@@ -0,0 +1,68 @@
+/*
+ * WebSocket framing (RFC 6455) for the /ws stream
+ *
+ * Server to client: each JPEG goes out as one unmasked binary message,
+ * written with the multipart part writer's gather write so the payload is
+ * sent straight from the frame buffer. A short header at the start of the
+ * message carries the frame's sequence number and latency figures.
+ *
+ * Client to server: only short messages are expected (frame acks, ping,
+ * close); anything fragmented or over 125 bytes is a protocol error.
+ * Plain C, no I/O of its own.
+ */
+
+#ifndef WS_FRAME_H
+#define WS_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mjpeg_part.h"
+
+#define WS_GUID                 "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define WS_OP_TEXT              0x1
+#define WS_OP_BINARY            0x2
+#define WS_OP_CLOSE             0x8
+#define WS_OP_PING              0x9
+#define WS_OP_PONG              0xA
+
+#define WS_HEADER_MAX           10
+#define WS_CONTROL_MAX          125
+
+// Big-endian header in front of each JPEG in a binary message
+#define WS_FRAME_INFO_LEN       12
+typedef struct {
+    uint32_t seq;                   // Echoed back by the client's ack
+    uint32_t age_us;                // Capture to start of send
+    uint32_t latency_us;            // Capture to ack of the last acked frame
+} ws_frame_info_t;
+
+typedef struct {
+    uint8_t opcode;
+    size_t len;
+    uint8_t payload[WS_CONTROL_MAX];    // Unmasked
+} ws_msg_t;
+
+// Write the header of an unmasked, final frame of len bytes; returns its
+// length (at most WS_HEADER_MAX).
+size_t ws_frame_header(uint8_t *out, uint8_t opcode, uint64_t len);
+
+// Prepare part to send info + jpeg as one binary message. The JPEG must stay
+// valid until the part is done.
+void ws_frame_part_init(mjpeg_part_t *part, const ws_frame_info_t *info,
+                        const uint8_t *jpeg, size_t len);
+
+// Check the headers of an opening handshake (NULL where absent). Returns 0
+// for an RFC 6455 upgrade to version 13, 426 for another version, 400
+// when Upgrade is not "websocket", Connection lacks the "Upgrade" token,
+// or the key or version is missing or malformed.
+int ws_handshake_status(const char *upgrade, const char *connection,
+                        const char *version, const char *key);
+
+// Parse one client frame at the start of buf. Returns the bytes it spans,
+// 0 if more are needed, -1 on a protocol error.
+int ws_frame_parse(const uint8_t *buf, size_t len, ws_msg_t *msg);
+
+#endif // WS_FRAME_H
@@ -0,0 +1,224 @@
+/*
+ * Host shim - FreeRTOS semaphores, tasks and notifications over pthreads
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct host_sem {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    struct host_sem notify;         // Notification value as a counting semaphore
+};
+
+static __thread struct host_task *s_self;
+
+static void deadline(struct timespec *ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static void sem_init(struct host_sem *s, UBaseType_t max, UBaseType_t initial)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    s->max = max;
+    s->count = initial;
+}
+
+// Take one count, or all of them with drain. Returns the count taken.
+static UBaseType_t sem_take(struct host_sem *s, TickType_t timeout, bool drain)
+{
+    struct timespec ts;
+    int err = 0;
+
+    deadline(&ts, timeout);
+    pthread_mutex_lock(&s->mutex);
+    while (s->count == 0 && timeout != 0 && err != ETIMEDOUT) {
+        if (timeout == portMAX_DELAY) {
+            pthread_cond_wait(&s->cond, &s->mutex);
+        } else {
+            err = pthread_cond_timedwait(&s->cond, &s->mutex, &ts);
+        }
+    }
+    UBaseType_t taken = s->count ? (drain ? s->count : 1) : 0;
+    s->count -= taken;
+    pthread_mutex_unlock(&s->mutex);
+    return taken;
+}
+
+static BaseType_t sem_give(struct host_sem *s)
+{
+    BaseType_t ok = pdFALSE;
+
+    pthread_mutex_lock(&s->mutex);
+    if (s->count < s->max) {
+        s->count++;
+        ok = pdTRUE;
+        pthread_cond_signal(&s->cond);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return ok;
+}
+
+static SemaphoreHandle_t sem_create(UBaseType_t max, UBaseType_t initial)
+{
+    struct host_sem *s = malloc(sizeof(*s));
+    if (s) {
+        sem_init(s, max, initial);
+    }
+    return s;
+}
+
+// A mutex is a binary semaphore that starts given; nothing here relies on
+// recursion or priority inheritance
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sem_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sem_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    return sem_create(max, initial);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout)
+{
+    return sem_take(sem, timeout, false) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return sem_give(sem);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    return sem_give(sem);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->mutex);
+    free(sem);
+}
+
+static struct host_task *task_new(void)
+{
+    struct host_task *t = calloc(1, sizeof(*t));
+    if (t) {
+        sem_init(&t->notify, 0xffffffffu, 0);
+    }
+    return t;
+}
+
+static void *task_main(void *arg)
+{
+    s_self = arg;
+    s_self->fn(s_self->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *out, BaseType_t core)
+{
+    struct host_task *t = task_new();
+    if (!t) {
+        return pdFAIL;
+    }
+    t->fn = fn;
+    t->arg = arg;
+    if (pthread_create(&t->thread, NULL, task_main, t) != 0) {
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(t->thread);
+    if (out) {
+        *out = t;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t prio, TaskHandle_t *out)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, out, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL) {
+        pthread_exit(NULL);
+    }
+    abort();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { .tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// Threads not started through xTaskCreate get a handle on first use
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (!s_self) {
+        s_self = task_new();
+        s_self->thread = pthread_self();
+    }
+    return s_self;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    sem_give(&task->notify);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout)
+{
+    return sem_take(&xTaskGetCurrentTaskHandle()->notify, timeout, clear);
+}
@@ -0,0 +1,35 @@
+/*
+ * Host test helpers
+ *
+ * CHECK() records a failure and carries on, so one run reports every broken
+ * expectation. main() ends with TEST_END(), which turns the tally into the
+ * exit status ctest looks at.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_END() \
+    (test_failures ? (fprintf(stderr, "%d checks failed\n", test_failures), 1) : 0)
+
+static inline int64_t test_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif // TEST_H
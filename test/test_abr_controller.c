@@ -0,0 +1,187 @@
+/*
+ * Adaptive bitrate controller - driven by link throughput traces
+ *
+ * Each trace in test/traces is a list of "seconds,kbps" segments. One
+ * control window per second, the simulated camera produces target_fps
+ * frames whose size follows the frame size rung and the JPEG quality, and
+ * the simulated client delivers as many of them as the link allows. The
+ * controller's steps are checked against what the trace calls for.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "abr_controller.h"
+#include "test.h"
+
+#define MAX_WINDOWS 600
+
+// QVGA, VGA, SVGA, HD, as s_abr_ladder in camera_capture.c
+static const uint32_t s_pixels[] = { 320 * 240, 640 * 480, 800 * 600, 1280 * 720 };
+
+// The same settings camera_capture.c derives from the defaults
+static const abr_config_t s_cfg = {
+    .target_fps = 25,
+    .target_latency_us = 200000,
+    .quality_best = 5,
+    .quality_worst = 30,
+    .quality_step = 2,
+    .rungs = 4,
+    .up_windows = 3,
+    .cooldown_windows = 2,
+};
+
+typedef struct {
+    uint32_t kbps;
+    int quality;                    // After this window's update
+    int rung;
+    bool changed;
+    double fps;                     // Delivered during the window
+} window_t;
+
+// OV3660 JPEG size, roughly: about 2 bits per pixel at quality 5, falling
+// off as the quality number grows
+static uint32_t frame_bytes(int rung, int quality)
+{
+    return (uint32_t)(s_pixels[rung] * 2.0 / (1 + quality / 4.0) / 8);
+}
+
+static int load_trace(const char *name, uint32_t *kbps)
+{
+    char path[512], line[128];
+    int n = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", TRACE_DIR, name);
+    FILE *f = fopen(path, "r");
+    CHECK(f != NULL);
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        unsigned seconds, rate;
+        if (line[0] == '#' || sscanf(line, "%u,%u", &seconds, &rate) != 2) {
+            continue;
+        }
+        while (seconds-- && n < MAX_WINDOWS) {
+            kbps[n++] = rate;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+static int simulate(const char *name, window_t *w)
+{
+    uint32_t kbps[MAX_WINDOWS];
+    int n = load_trace(name, kbps);
+    abr_t abr;
+    int since_change = 1000, changes = 0;
+
+    abr_init(&abr, &s_cfg, s_cfg.quality_best, s_cfg.rungs - 1);
+    for (int i = 0; i < n; i++) {
+        uint32_t bytes = frame_bytes(abr.rung, abr.quality);
+        double link_bps = kbps[i] * 1000.0 / 8;
+        double fps = link_bps / bytes < s_cfg.target_fps ? link_bps / bytes : s_cfg.target_fps;
+        uint32_t sent = (uint32_t)fps;
+
+        for (uint32_t f = 0; f < s_cfg.target_fps; f++) {
+            abr_on_frame(&abr, bytes);
+        }
+        abr_on_send(&abr, (uint64_t)sent * bytes, (uint64_t)(sent * bytes / link_bps * 1e6), sent);
+
+        int quality = abr.quality, rung = abr.rung;
+        w[i] = (window_t){ .kbps = kbps[i], .fps = fps };
+        w[i].changed = abr_update(&abr);
+        w[i].quality = abr.quality;
+        w[i].rung = abr.rung;
+
+        // Always inside the configured range, one rung at a time, and the
+        // frame size only drops once quality has nothing left to give
+        CHECK(abr.quality >= s_cfg.quality_best && abr.quality <= s_cfg.quality_worst);
+        CHECK(abr.rung >= 0 && abr.rung < s_cfg.rungs);
+        CHECK(abs(abr.rung - rung) <= 1);
+        if (abr.rung < rung) {
+            CHECK(quality == s_cfg.quality_worst);
+        }
+        if (abr.rung > rung) {
+            CHECK(quality == s_cfg.quality_best);
+        }
+        // No change inside the cooldown of the previous one
+        if (w[i].changed) {
+            CHECK(since_change > s_cfg.cooldown_windows);
+            since_change = 0;
+            changes++;
+            printf("| %s | %d | %u | q%d -> q%d | %d -> %d |\n",
+                   name, i, (unsigned)kbps[i], quality, abr.quality, rung, abr.rung);
+        }
+        since_change++;
+    }
+    return n;
+}
+
+static int count_changes(const window_t *w, int from, int to)
+{
+    int changes = 0;
+    for (int i = from; i < to; i++) {
+        changes += w[i].changed;
+    }
+    return changes;
+}
+
+// By the end of a segment the controller has settled on settings that
+// deliver at least 90% of the target fps, its own step-down threshold
+static void check_settled(const window_t *w, int end)
+{
+    for (int i = end - 5; i < end; i++) {
+        CHECK(w[i].fps * 100 >= s_cfg.target_fps * 90);
+    }
+    CHECK(count_changes(w, end - 5, end) == 0);
+}
+
+int main(void)
+{
+    static window_t w[MAX_WINDOWS];
+    int n;
+
+    printf("| trace | second | kbps | quality | rung |\n");
+    printf("|---|---|---|---|---|\n");
+
+    // Plenty of headroom: full size, best quality, nothing to do
+    n = simulate("wifi_steady.csv", w);
+    CHECK(n == 120);
+    CHECK(count_changes(w, 0, n) == 0);
+    CHECK(w[n - 1].rung == 3 && w[n - 1].quality == s_cfg.quality_best);
+
+    // Falling link: quality gives way first, then the frame size, and each
+    // segment ends at settings the link can carry
+    n = simulate("wifi_walkaway.csv", w);
+    CHECK(n == 270);
+    CHECK(count_changes(w, 0, 30) == 0);
+    for (int end = 90; end <= n; end += 60) {
+        check_settled(w, end);
+        CHECK(w[end - 1].rung <= w[end - 61].rung);
+    }
+    CHECK(w[n - 1].rung == 0);
+
+    // Short dips: the controller steps down in them, but the steps it takes
+    // are bounded and it is back at full size and quality afterwards
+    n = simulate("wifi_interference.csv", w);
+    CHECK(n == 107);
+    CHECK(count_changes(w, 0, 20) == 0);
+    CHECK(count_changes(w, 0, n) <= 40);
+    CHECK(w[n - 1].rung == 3 && w[n - 1].quality == s_cfg.quality_best);
+    check_settled(w, n);
+
+    // Poor start, then a good link: it walks all the way back up. Every
+    // rung up restarts at the worst quality, so this takes minutes
+    n = simulate("wifi_recovery.csv", w);
+    CHECK(n == 340);
+    for (int i = 95; i < 100; i++) {
+        CHECK(w[i].rung == 0 && w[i].fps * 100 >= s_cfg.target_fps * 90);
+    }
+    CHECK(w[n - 1].rung == 3 && w[n - 1].quality == s_cfg.quality_best);
+    check_settled(w, n);
+
+    return TEST_END();
+}
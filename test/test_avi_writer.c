@@ -0,0 +1,301 @@
+/*
+ * AVI writer - file layout, power-cut recovery, sustained MB/s, capture stall
+ *
+ * Writes recordings of variable-size frames and parses them back: RIFF and
+ * movi sizes, frame counts in both headers, every idx1 entry pointing at
+ * its chunk and every payload as written. A writer killed without closing
+ * (a child process that _exit()s, its last batch cut short) must come back
+ * from avi_writer_recover() with every complete frame in order.
+ *
+ * The benchmark then records as fast as avi_writer_add() accepts, for a few
+ * batch sizes, and at a paced frame rate. "Stall" is the longest single
+ * avi_writer_add() call, i.e. the most the capture task can be held up;
+ * "refused" counts frames turned away because both batches were busy.
+ * The files go to $TMPDIR (or /tmp), or to the directory given:
+ *
+ *   test_avi_writer [DIR]
+ *
+ * so the same run can be pointed at an SD card in a USB reader.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "avi_writer.h"
+#include "test.h"
+
+#define W               1280
+#define H               720
+#define FRAME_MIN       30000
+#define FRAME_SPREAD    30001       // Odd, so chunk padding is exercised
+#define ROUNDTRIP       300
+#define BENCH_FRAMES    1500
+#define PACED_FPS       100
+#define PACED_FRAMES    200
+
+static char s_dir[256];
+static char s_path[512];
+static uint8_t s_frame[FRAME_MIN + FRAME_SPREAD];
+static uint8_t s_expect[FRAME_MIN + FRAME_SPREAD];
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Frame i: JPEG markers around bytes that depend on i, length varying
+static size_t make_frame(uint8_t *buf, uint32_t i)
+{
+    size_t len = FRAME_MIN + (i * 7919u) % FRAME_SPREAD;
+    uint32_t r = i + 1;
+
+    for (size_t k = 0; k < len; k += 4) {
+        r = r * 1103515245 + 12345;
+        memcpy(buf + k, &r, len - k < 4 ? len - k : 4);
+    }
+    buf[0] = 0xff;
+    buf[1] = 0xd8;
+    buf[len - 2] = 0xff;
+    buf[len - 1] = 0xd9;
+    return len;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *data = NULL;
+
+    *len = 0;
+    if (f && fseek(f, 0, SEEK_END) == 0) {
+        long n = ftell(f);
+        data = malloc(n > 0 ? n : 1);
+        rewind(f);
+        *len = fread(data, 1, n, f);
+    }
+    if (f) {
+        fclose(f);
+    }
+    return data;
+}
+
+// Parse a finished AVI and return its frame count, or -1 if anything is
+// off. Payload k must be frame first_id + k.
+static int check_avi(const char *path, uint32_t first_id)
+{
+    size_t len;
+    uint8_t *d = read_file(path, &len);
+    int bad = 0, n = -1;
+
+    if (!d || len < 512 + 8) {
+        free(d);
+        return -1;
+    }
+    bad += memcmp(d, "RIFF", 4) || memcmp(d + 8, "AVI ", 4);
+    bad += get_u32(d + 4) + 8 != len;
+    bad += get_u32(d + 64) != W || get_u32(d + 68) != H;
+    bad += get_u32(d + 44) != 0x10;                 // AVIF_HASINDEX
+    bad += memcmp(d + 500, "LIST", 4) || memcmp(d + 508, "movi", 4);
+
+    size_t movi_end = 508 + get_u32(d + 504);
+    if (bad || movi_end + 8 > len || memcmp(d + movi_end, "idx1", 4)) {
+        free(d);
+        return -1;
+    }
+    uint32_t entries = get_u32(d + movi_end + 4) / 16;
+    bad += entries != get_u32(d + 48) || entries != get_u32(d + 140);
+    bad += movi_end + 8 + entries * 16 != len;
+
+    size_t pos = 512;
+    for (uint32_t j = 0; j < entries && !bad; j++) {
+        const uint8_t *e = d + movi_end + 8 + 16 * j;
+        uint32_t n_len = get_u32(e + 12);
+        bad += memcmp(e, "00dc", 4) || get_u32(e + 8) + 508 != pos;
+        bad += pos + 8 + n_len > movi_end;
+        if (bad) {
+            break;
+        }
+        bad += memcmp(d + pos, "00dc", 4) || get_u32(d + pos + 4) != n_len;
+        bad += make_frame(s_expect, first_id + j) != n_len || memcmp(d + pos + 8, s_expect, n_len);
+        pos += 8 + n_len + (n_len & 1);
+    }
+    bad += pos != movi_end;
+    if (!bad) {
+        n = entries;
+    }
+    free(d);
+    return n;
+}
+
+static void remove_avi(const char *path)
+{
+    char idx[512];
+    unlink(path);
+    if (avi_writer_index_path(path, idx, sizeof(idx))) {
+        unlink(idx);
+    }
+}
+
+static avi_writer_t *open_writer(size_t batch, int64_t checkpoint_us)
+{
+    avi_writer_config_t cfg = {
+        .width = W,
+        .height = H,
+        .fps = 25,
+        .batch_size = batch,
+        .checkpoint_us = checkpoint_us,
+        .clock_us = test_now_us,
+    };
+    remove_avi(s_path);
+    return avi_writer_open(s_path, &cfg);
+}
+
+// Add frame i, retrying while both batches are busy. Returns the refusals.
+static uint32_t add_frame(avi_writer_t *w, uint32_t i, int64_t ts)
+{
+    size_t len = make_frame(s_frame, i);
+    uint32_t refused = 0;
+
+    while (!avi_writer_add(w, s_frame, len, ts)) {
+        if (avi_writer_failed(w)) {
+            return refused + 1;
+        }
+        refused++;
+        usleep(200);
+    }
+    return refused;
+}
+
+static void test_roundtrip(void)
+{
+    avi_writer_t *w = open_writer(256 * 1024, 0);
+    CHECK(w != NULL);
+    if (!w) {
+        return;
+    }
+    for (uint32_t i = 0; i < ROUNDTRIP; i++) {
+        add_frame(w, i, i * 40000LL);
+    }
+    CHECK(avi_writer_close(w));
+    CHECK(check_avi(s_path, 0) == ROUNDTRIP);
+
+    // The sidecar is gone, and recovering a clean file changes nothing
+    char idx[512];
+    CHECK(avi_writer_index_path(s_path, idx, sizeof(idx)) && access(idx, F_OK) != 0);
+    CHECK(avi_writer_recover(s_path));
+    CHECK(check_avi(s_path, 0) == ROUNDTRIP);
+
+    // Frames larger than a batch are refused, not split
+    w = open_writer(64 * 1024, 0);
+    static uint8_t big[128 * 1024];
+    CHECK(!avi_writer_add(w, big, sizeof(big), 0));
+    CHECK(avi_writer_close(w));
+    CHECK(check_avi(s_path, 0) == 0);
+}
+
+static void test_recover(void)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Power cut: batches written so far stay, nothing is closed
+        avi_writer_t *w = open_writer(64 * 1024, 0);
+        for (uint32_t i = 0; w && i < ROUNDTRIP; i++) {
+            add_frame(w, i, i * 40000LL);
+        }
+        usleep(300000);
+        _exit(0);
+    }
+    int status;
+    CHECK(pid > 0 && waitpid(pid, &status, 0) == pid);
+
+    // Cut the last batch short in the middle of a frame
+    struct stat st;
+    CHECK(stat(s_path, &st) == 0 && st.st_size > 64 * 1024);
+    CHECK(truncate(s_path, st.st_size - 20000) == 0);
+
+    // Playable as is up to the last checkpoint, complete after recovery
+    CHECK(avi_writer_recover(s_path));
+    int frames = check_avi(s_path, 0);
+    CHECK(frames > 0 && frames < ROUNDTRIP);
+    printf("Recovered %d of %d frames after a cut %lld bytes into the file\n\n", frames,
+           ROUNDTRIP, (long long)st.st_size - 20000);
+}
+
+typedef struct {
+    double mbps;                    // File bytes over wall time, close included
+    double write_mbps;              // File bytes over time spent in write()
+    uint32_t max_write_us;
+    uint32_t max_add_us;
+    uint32_t refused;
+    uint32_t batches;
+} bench_t;
+
+static bench_t record(size_t batch, int frames, int fps)
+{
+    avi_writer_t *w = open_writer(batch, 1000000);
+    avi_writer_stats_t st;
+    bench_t b = { 0 };
+
+    CHECK(w != NULL);
+    if (!w) {
+        return b;
+    }
+    int64_t start = test_now_us();
+    for (int i = 0; i < frames; i++) {
+        int64_t due = start + (fps ? (int64_t)i * 1000000 / fps : 0);
+        int64_t wait = due - test_now_us();
+        if (wait > 0) {
+            usleep(wait);
+        }
+        b.refused += add_frame(w, i, test_now_us());
+    }
+    uint64_t bytes = avi_writer_bytes(w);
+    avi_writer_take_stats(w, &st);
+    CHECK(avi_writer_close(w));
+    int64_t us = test_now_us() - start;
+    CHECK(check_avi(s_path, 0) == frames);
+
+    b.mbps = bytes / (double)us;
+    b.write_mbps = st.write_us ? st.bytes / (double)st.write_us : 0;
+    b.max_write_us = st.max_write_us;
+    b.max_add_us = st.max_add_us;
+    b.batches = st.batches;
+    return b;
+}
+
+static void bench_row(const char *mode, size_t batch, const bench_t *b)
+{
+    printf("| %s | %zu | %u | %.1f | %.1f | %.2f | %u | %u |\n", mode, batch / 1024, b->batches,
+           b->mbps, b->write_mbps, b->max_write_us / 1000.0, b->max_add_us, b->refused);
+}
+
+int main(int argc, char **argv)
+{
+    const char *tmp = getenv("TMPDIR");
+    snprintf(s_dir, sizeof(s_dir), "%s", argc > 1 ? argv[1] : tmp ? tmp : "/tmp");
+    snprintf(s_path, sizeof(s_path), "%s/avitest%d.avi", s_dir, (int)getpid());
+
+    test_roundtrip();
+    test_recover();
+
+    printf("| mode | batch KB | batches | MB/s | write() MB/s | max write ms | max stall us | refused |\n");
+    printf("|---|---|---|---|---|---|---|---|\n");
+    for (size_t batch = 64 * 1024; batch <= 1024 * 1024; batch *= 4) {
+        bench_t b = record(batch, BENCH_FRAMES, 0);
+        bench_row("flat out", batch, &b);
+    }
+
+    // A capture rate the writer keeps up with: nothing may be refused and
+    // no add may wait on the card
+    bench_t b = record(256 * 1024, PACED_FRAMES, PACED_FPS);
+    bench_row("100 fps", 256 * 1024, &b);
+    CHECK(b.refused == 0);
+    CHECK(b.max_add_us < 20000);
+
+    remove_avi(s_path);
+    return TEST_END();
+}
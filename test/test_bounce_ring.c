@@ -0,0 +1,294 @@
+/*
+ * Bounce ring - payload integrity and the copy scheduler against a slow link
+ *
+ * A copier thread stands in for GDMA: it takes copies in the order they
+ * were started, spends the time a copy out of PSRAM would take asleep, and
+ * completes each one the way stream_sender's interrupt callback does,
+ * bounce_ring_copied() and then a give of the sender's semaphore, which the
+ * ring's wait hook takes. Payloads of awkward lengths go through rings of
+ * one to four blocks, consumed in uneven pieces, and must arrive byte for
+ * byte, with nothing in flight after bounce_ring_drain().
+ *
+ * Like GDMA, the stand-in only lands the data once a copy is done. A
+ * copier that splits copies as stream_sender's does runs against a slow
+ * channel: whole cache lines go to the channel and the rest is done at once
+ * by the CPU, and every third channel copy is refused and done by the CPU
+ * instead. A short copy right after a slow one must not complete first and
+ * make the slow block look ready.
+ *
+ * The benchmark sends frames to a link that takes a fixed time per byte,
+ * with copies faster and slower than the link, for each ring size, and
+ * with the consumer spinning (no wait hook) or blocking. It reports time
+ * per frame, waits for a copy ("stalls") and the CPU the consumer burns
+ * per frame, which on the ESP32-S3 is CPU taken from the other tasks on
+ * the sender's core. The copy and link rates are made up; the shape of the
+ * table is what carries over.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "bounce_ring.h"
+#include "test.h"
+
+#define BLOCK           2944        // Two 1436-byte segments, in cache lines
+#define MAX_BLOCKS      4
+#define FRAME_LEN       60000
+#define BENCH_FRAMES    8
+#define LINK_MBPS       4.0         // Bytes per us the link takes
+#define SEGMENT         1436
+
+typedef struct {
+    void *dst;
+    const void *src;
+    size_t n;
+    bounce_ring_t *ring;
+} copy_job_t;
+
+// The stand-in for GDMA: one channel, copies in start order
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    copy_job_t jobs[64];
+    unsigned head, tail;
+    double mbps;                    // Copy rate, bytes per us
+    bool stop;
+} s_dma = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static SemaphoreHandle_t s_copied;
+static int64_t s_link_free_us;      // When the link has sent what it was given
+static uint8_t s_buf[MAX_BLOCKS * BLOCK];
+static uint8_t s_payload[FRAME_LEN];
+
+// Busy until us bytes later than when it was last free, as a DMA channel
+// or a link is; sleeping to an absolute time keeps oversleeps from adding up
+static void occupy(int64_t *free_us, size_t n, double mbps)
+{
+    int64_t now = test_now_us();
+    *free_us = (*free_us > now ? *free_us : now) + (int64_t)(n / mbps);
+    struct timespec ts = { *free_us / 1000000, *free_us % 1000000 * 1000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+    }
+}
+
+static void *dma_thread(void *arg)
+{
+    int64_t free_us = 0;
+
+    pthread_mutex_lock(&s_dma.lock);
+    while (!s_dma.stop) {
+        if (s_dma.head == s_dma.tail) {
+            pthread_cond_wait(&s_dma.cond, &s_dma.lock);
+            continue;
+        }
+        copy_job_t job = s_dma.jobs[s_dma.head % 64];
+        double mbps = s_dma.mbps;
+        pthread_mutex_unlock(&s_dma.lock);
+
+        if (mbps > 0) {
+            occupy(&free_us, job.n, mbps);
+        }
+        memcpy(job.dst, job.src, job.n);
+        // As stream_sender's callback: the ring may go once its last copy
+        // counts, so the semaphore is looked up first
+        SemaphoreHandle_t copied = job.ring->cfg.arg;
+        BaseType_t woken;
+        bounce_ring_copied(job.ring);
+        if (copied) {
+            xSemaphoreGiveFromISR(copied, &woken);
+        }
+
+        pthread_mutex_lock(&s_dma.lock);
+        s_dma.head++;
+    }
+    pthread_mutex_unlock(&s_dma.lock);
+    return NULL;
+}
+
+static void dma_copy(void *dst, const void *src, size_t n, bounce_ring_t *ring)
+{
+    pthread_mutex_lock(&s_dma.lock);
+    s_dma.jobs[s_dma.tail++ % 64] = (copy_job_t){ dst, src, n, ring };
+    pthread_cond_signal(&s_dma.cond);
+    pthread_mutex_unlock(&s_dma.lock);
+}
+
+// As stream_sender's bounce_copy(): the channel takes whole cache lines,
+// the CPU the rest, and the CPU only once the channel is done with the ring
+static void split_copy(void *dst, const void *src, size_t n, bounce_ring_t *ring)
+{
+    static unsigned calls;
+    size_t bulk = n & ~(size_t)63;
+
+    if (bulk) {
+        if (bulk < n) {
+            bounce_ring_settle(ring);
+            memcpy((uint8_t *)dst + bulk, (const uint8_t *)src + bulk, n - bulk);
+        }
+        if (++calls % 3) {
+            dma_copy(dst, src, bulk, ring);
+            return;
+        }
+    }
+    bounce_ring_settle(ring);
+    memcpy(dst, src, n);
+    bounce_ring_copied(ring);
+}
+
+static void sem_wait(bounce_ring_t *ring)
+{
+    xSemaphoreTake(ring->cfg.arg, portMAX_DELAY);
+}
+
+static void init_ring(bounce_ring_t *r, size_t blocks, bool async, bool block)
+{
+    bounce_ring_config_t cfg = {
+        .buf = s_buf,
+        .block_size = BLOCK,
+        .blocks = blocks,
+        .copy = async ? dma_copy : NULL,
+        .wait = block ? sem_wait : NULL,
+        .arg = block ? s_copied : NULL,
+    };
+    bounce_ring_init(r, &cfg);
+}
+
+static int64_t thread_cpu_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Send one payload, piece by piece. Returns false if any byte differs.
+static bool send_payload(bounce_ring_t *r, const uint8_t *src, size_t len, size_t piece,
+                         double link_mbps)
+{
+    bool ok = true;
+    size_t pos = 0;
+
+    bounce_ring_start(r, src, len);
+    while (pos < len) {
+        const uint8_t *data;
+        size_t n = bounce_ring_peek(r, &data);
+        if (!n) {
+            bounce_ring_wait(r);
+            continue;
+        }
+        n = n < piece ? n : piece;
+        ok &= !memcmp(data, src + pos, n);
+        if (link_mbps > 0) {
+            occupy(&s_link_free_us, n, link_mbps);
+        }
+        bounce_ring_consume(r, n);
+        pos += n;
+    }
+    bounce_ring_drain(r);
+    return ok && atomic_load(&r->completed) == r->started;
+}
+
+static void test_integrity(void)
+{
+    static const size_t lens[] = { 0, 1, BLOCK - 1, BLOCK, BLOCK + 1, 3 * BLOCK, 10007, FRAME_LEN };
+    static const size_t pieces[] = { 1, 100, SEGMENT, 4 * BLOCK };
+    int bad = 0;
+
+    s_dma.mbps = 0;
+    for (int mode = 0; mode < 3; mode++) {
+        for (size_t blocks = 1; blocks <= MAX_BLOCKS; blocks++) {
+            bounce_ring_t r;
+            init_ring(&r, blocks, mode > 0, mode == 2);
+            for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+                for (size_t j = 0; j < sizeof(pieces) / sizeof(pieces[0]); j++) {
+                    // A different stretch of the payload every time
+                    const uint8_t *src = s_payload + (i * 7 + j) % 64;
+                    size_t len = lens[i] > FRAME_LEN - 64 ? FRAME_LEN - 64 : lens[i];
+                    bad += !send_payload(&r, src, len, pieces[j], 0);
+                }
+            }
+        }
+    }
+    CHECK(bad == 0);
+}
+
+static void test_short_after_slow(void)
+{
+    // The last block 1 to 63 bytes, or whole lines and a tail
+    static const size_t lens[] = { BLOCK + 1, BLOCK + 63, 2 * BLOCK + 10, BLOCK + 100,
+                                   3 * BLOCK + 64, 5 * BLOCK + 7 };
+    int bad = 0;
+
+    s_dma.mbps = 0.5;               // About 6 ms a block
+    for (size_t blocks = 2; blocks <= MAX_BLOCKS; blocks++) {
+        for (int block = 0; block < 2; block++) {
+            bounce_ring_t r;
+            bounce_ring_config_t cfg = {
+                .buf = s_buf, .block_size = BLOCK, .blocks = blocks, .copy = split_copy,
+                .wait = block ? sem_wait : NULL, .arg = block ? s_copied : NULL,
+            };
+            bounce_ring_init(&r, &cfg);
+            for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+                bad += !send_payload(&r, s_payload + i, lens[i], SEGMENT, 0);
+            }
+        }
+    }
+    CHECK(bad == 0);
+}
+
+static void bench_row(const char *copy, double copy_mbps, size_t blocks, bool block)
+{
+    bounce_ring_t r;
+
+    s_dma.mbps = copy_mbps;
+    init_ring(&r, blocks, true, block);
+    int64_t start = test_now_us();
+    int64_t cpu = thread_cpu_us();
+    bool ok = true;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        ok &= send_payload(&r, s_payload, FRAME_LEN, 2 * SEGMENT, LINK_MBPS);
+    }
+    cpu = thread_cpu_us() - cpu;
+    int64_t us = test_now_us() - start;
+    CHECK(ok);
+
+    printf("| %s | %zu | %s | %.1f | %.1f | %.1f | %.0f |\n", copy, blocks, block ? "block" : "spin",
+           us / 1000.0 / BENCH_FRAMES, FRAME_LEN / (double)us * BENCH_FRAMES,
+           (double)r.stalls / BENCH_FRAMES, (double)cpu / BENCH_FRAMES);
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(s_payload); i++) {
+        s_payload[i] = i * 131 + (i >> 8);
+    }
+    s_copied = xSemaphoreCreateBinary();
+    pthread_t dma;
+    CHECK(s_copied && pthread_create(&dma, NULL, dma_thread, NULL) == 0);
+
+    test_integrity();
+    test_short_after_slow();
+
+    printf("| copy | blocks | waiting | ms/frame | MB/s | stalls/frame | consumer CPU us/frame |\n");
+    printf("|---|---|---|---|---|---|---|\n");
+    for (size_t blocks = 1; blocks <= MAX_BLOCKS; blocks++) {
+        bench_row("10x link", 10 * LINK_MBPS, blocks, false);
+        bench_row("10x link", 10 * LINK_MBPS, blocks, true);
+    }
+    for (size_t blocks = 1; blocks <= MAX_BLOCKS; blocks += 3) {
+        bench_row("half link", LINK_MBPS / 2, blocks, false);
+        bench_row("half link", LINK_MBPS / 2, blocks, true);
+    }
+
+    pthread_mutex_lock(&s_dma.lock);
+    s_dma.stop = true;
+    pthread_cond_signal(&s_dma.cond);
+    pthread_mutex_unlock(&s_dma.lock);
+    pthread_join(dma, NULL);
+    vSemaphoreDelete(s_copied);
+    return TEST_END();
+}
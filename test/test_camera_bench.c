@@ -0,0 +1,368 @@
+/*
+ * Capture benchmark - the settings sweep against a simulated camera
+ *
+ * Runs camera_bench over the Kconfig default matrix, with a third frame
+ * buffer count added, against a camera made of canned frames: a few
+ * frames of a synthetic scene per frame size, encoded with the software
+ * encoder at the quality each setting asks for. Time is virtual and
+ * follows a simple sensor model, so the whole sweep takes a second:
+ *
+ *   - a frame takes one pixel per two XCLK cycles plus a quarter for
+ *     blanking, and never less than 1/30 s
+ *   - with one frame buffer the driver misses every other frame
+ *   - buffers are width x height / 5 bytes, as the driver sizes them for
+ *     JPEG; a larger frame is an FB-OVF and lost
+ *   - above 16 MHz from HD up, every tenth frame is a NO-EOI and lost
+ *   - the driver waits up to 4 s for a frame that is not lost
+ *   - frame buffers get 512 KB of PSRAM; asking for more fails init
+ *
+ * Every point must come out as that model predicts: the failed inits as
+ * errors, the rates exact where no frame was lost, the frame sizes those
+ * of the canned frames, the events and the heap as simulated. The CSV and
+ * JSON reports must hold every point. The rates are the model's, not the
+ * OV3660's; what this shows is the sweep and the report working. Given a
+ * directory, the reports are also written there:
+ *
+ *   test_camera_bench [DIR]
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camera_bench.h"
+#include "esp_camera.h"
+#include "esp_err.h"
+#include "jpeg_encoder.h"
+#include "test.h"
+
+#define CANNED              4       // Frames per frame size and quality
+#define WARMUP_US           3000000 // Kconfig defaults
+#define MEASURE_US          10000000
+#define MIN_FRAME_US        33334
+#define FB_TIMEOUT_US       4000000
+#define FB_PSRAM            (512 * 1024)
+#define INTERNAL_USED       12288   // DMA descriptors and line buffers
+#define INTERNAL_FREE       (300 * 1024)
+#define PSRAM_FREE          (8 * 1024 * 1024)
+
+static const char *const s_sizes[FRAMESIZE_INVALID] = {
+    [FRAMESIZE_QQVGA] = "QQVGA", [FRAMESIZE_QVGA] = "QVGA", [FRAMESIZE_CIF] = "CIF",
+    [FRAMESIZE_HVGA] = "HVGA", [FRAMESIZE_VGA] = "VGA", [FRAMESIZE_SVGA] = "SVGA",
+    [FRAMESIZE_XGA] = "XGA", [FRAMESIZE_HD] = "HD", [FRAMESIZE_SXGA] = "SXGA",
+    [FRAMESIZE_UXGA] = "UXGA", [FRAMESIZE_FHD] = "FHD", [FRAMESIZE_QXGA] = "QXGA",
+};
+static const char *const s_grab[] = {
+    [CAMERA_GRAB_WHEN_EMPTY] = "empty",
+    [CAMERA_GRAB_LATEST] = "latest",
+};
+static const struct {
+    int width, height;
+} s_res[FRAMESIZE_INVALID] = {
+    [FRAMESIZE_VGA] = { 640, 480 },
+    [FRAMESIZE_SVGA] = { 800, 600 },
+    [FRAMESIZE_HD] = { 1280, 720 },
+};
+
+// Canned frame lengths by frame size and sensor quality (0..63)
+static size_t s_canned[FRAMESIZE_INVALID][64][CANNED];
+
+static struct {
+    camera_bench_point_t point;
+    bool inited;
+    bool finished;
+    int64_t now_us;
+    uint32_t next;                  // Canned frame the sensor sends next
+    uint32_t no_eoi;
+    uint32_t fb_ovf;
+    size_t psram_free;
+    size_t internal_free;
+} s_cam;
+
+static int64_t sim_clock(void)
+{
+    return s_cam.now_us;
+}
+
+static size_t fb_size(const camera_bench_point_t *p)
+{
+    return s_res[p->frame_size].width * s_res[p->frame_size].height / 5;
+}
+
+static int64_t frame_interval_us(const camera_bench_point_t *p)
+{
+    int64_t pixels = s_res[p->frame_size].width * s_res[p->frame_size].height;
+    int64_t us = pixels * 2 * 5 / 4 * 1000000 / p->xclk_hz;
+    us = us > MIN_FRAME_US ? us : MIN_FRAME_US;
+    return p->fb_count == 1 ? 2 * us : us;
+}
+
+static bool drops_no_eoi(const camera_bench_point_t *p)
+{
+    return p->xclk_hz > 16000000 && p->frame_size >= FRAMESIZE_HD;
+}
+
+// A scene with a window and furniture, moved per frame, with more noise
+// in each of the canned frames so their sizes spread
+static size_t encode_canned(int width, int height, int quality, int i)
+{
+    static uint8_t rgb[1280 * 720 * 2];
+    static uint8_t out[1280 * 720];
+    jpeg_encoder_config_t cfg = { .max_width = width, .quality = quality };
+    jpeg_encoder_t *enc = jpeg_encoder_create(&cfg);
+    uint32_t r = 7 + i;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            r = r * 1103515245 + 12345;
+            int n = (r >> 16) % (6 + 3 * i);
+            int xs = (x + i * 5) * 1280 / width;
+            int ys = y * 720 / height;
+            int v = 70 + ys / 5 + n;
+            int red = v, green = v, blue = v + 10;
+            if (xs > 800 && xs < 1100 && ys > 100 && ys < 380) {
+                red = green = 200 + n;
+                blue = 240;
+            }
+            if (ys > 480 && xs % 320 < 200) {
+                red = 120 + n;
+                green = 80 + n;
+                blue = 40 + (xs & 31);
+            }
+            red = red > 255 ? 255 : red;
+            green = green > 255 ? 255 : green;
+            blue = blue > 255 ? 255 : blue;
+            unsigned p = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+            rgb[2 * (y * width + x)] = p >> 8;
+            rgb[2 * (y * width + x) + 1] = p & 0xff;
+        }
+    }
+    size_t len = jpeg_encode(enc, rgb, width, height, JPEG_ENC_RGB565, out, sizeof(out));
+    jpeg_encoder_destroy(enc);
+    return len;
+}
+
+// The sensor's 0..63 (lower is better) onto the encoder's 1..100
+static void can_frames(const camera_bench_axis_t *sizes, const camera_bench_axis_t *qualities)
+{
+    for (size_t s = 0; s < sizes->count; s++) {
+        for (size_t q = 0; q < qualities->count; q++) {
+            int fs = sizes->values[s], jq = qualities->values[q];
+            for (int i = 0; i < CANNED; i++) {
+                s_canned[fs][jq][i] = encode_canned(s_res[fs].width, s_res[fs].height,
+                                                    100 - jq * 3 / 2, i);
+                CHECK(s_canned[fs][jq][i] > 0);
+            }
+        }
+    }
+}
+
+static int sim_setup(const camera_bench_point_t *p, void *arg)
+{
+    s_cam.inited = false;
+    s_cam.psram_free = PSRAM_FREE;
+    s_cam.internal_free = INTERNAL_FREE;
+    if (p->fb_count * fb_size(p) > FB_PSRAM) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_cam.point = *p;
+    s_cam.inited = true;
+    s_cam.next = 0;
+    s_cam.psram_free -= p->fb_count * fb_size(p);
+    s_cam.internal_free -= INTERNAL_USED;
+    return ESP_OK;
+}
+
+static bool sim_frame(void *arg, size_t *len)
+{
+    const camera_bench_point_t *p = &s_cam.point;
+    int64_t give_up = s_cam.now_us + FB_TIMEOUT_US;
+
+    while (s_cam.inited) {
+        uint32_t n = s_cam.next++;
+        s_cam.now_us += frame_interval_us(p);
+        size_t l = s_canned[p->frame_size][p->jpeg_quality][n % CANNED];
+        if (drops_no_eoi(p) && n % 10 == 9) {
+            s_cam.no_eoi++;
+        } else if (l > fb_size(p)) {
+            s_cam.fb_ovf++;
+        } else {
+            *len = l;
+            return true;
+        }
+        if (s_cam.now_us >= give_up) {
+            break;
+        }
+    }
+    return false;
+}
+
+static void sim_sample(void *arg, camera_bench_sample_t *s)
+{
+    s->no_eoi = s_cam.no_eoi;
+    s->fb_ovf = s_cam.fb_ovf;
+    s->internal_free = s_cam.internal_free;
+    s->psram_free = s_cam.psram_free;
+}
+
+static void sim_finish(void *arg)
+{
+    s_cam.inited = false;
+    s_cam.finished = true;
+}
+
+static void test_parse(void)
+{
+    camera_bench_axis_t a;
+
+    CHECK(camera_bench_parse_axis("VGA,hd,SVGA", s_sizes, FRAMESIZE_INVALID, &a));
+    CHECK(a.count == 3 && a.values[0] == FRAMESIZE_VGA && a.values[1] == FRAMESIZE_HD);
+    CHECK(camera_bench_parse_axis("1,2,3", NULL, 0, &a) && a.count == 3 && a.values[2] == 3);
+    CHECK(!camera_bench_parse_axis("VGA,FOO", s_sizes, FRAMESIZE_INVALID, &a));
+    CHECK(!camera_bench_parse_axis("1,,2", NULL, 0, &a));
+    CHECK(!camera_bench_parse_axis("1,2x", NULL, 0, &a));
+    CHECK(!camera_bench_parse_axis("1,2,3,4,5,6,7,8,9", NULL, 0, &a));
+    CHECK(!camera_bench_parse_axis("", NULL, 0, &a));
+}
+
+// What the model says a point must report
+static void check_point(const camera_bench_result_t *r)
+{
+    const camera_bench_point_t *p = &r->point;
+    const size_t *canned = s_canned[p->frame_size][p->jpeg_quality];
+    size_t fb = fb_size(p), smallest = SIZE_MAX, largest = 0;
+    bool ovf = false;
+
+    if (p->fb_count * fb > FB_PSRAM) {
+        CHECK(r->err == ESP_ERR_NO_MEM && r->frames == 0);
+        return;
+    }
+    for (int i = 0; i < CANNED; i++) {
+        ovf |= canned[i] > fb;
+        if (canned[i] <= fb) {
+            smallest = canned[i] < smallest ? canned[i] : smallest;
+            largest = canned[i] > largest ? canned[i] : largest;
+        }
+    }
+    CHECK(r->err == 0);
+    CHECK(ovf == (r->fb_ovf > 0));
+    CHECK(drops_no_eoi(p) == (r->no_eoi > 0));
+    CHECK(r->psram_used == (int64_t)(p->fb_count * fb) && r->internal_used == INTERNAL_USED);
+    if (!largest) {
+        // Every frame overflows: the driver times out and the point is given up
+        CHECK(r->frames == 0 && r->failed == 3);
+        return;
+    }
+    CHECK(r->failed == 0 && r->frames > 0);
+    CHECK(r->mean_bytes >= smallest && r->mean_bytes <= r->p99_bytes && r->p99_bytes <= r->max_bytes);
+    CHECK(r->max_bytes == largest);
+    if (!ovf && !drops_no_eoi(p)) {
+        uint32_t expect = 100000000 / frame_interval_us(p);
+        CHECK(r->fps_x100 + 1 >= expect && r->fps_x100 <= expect + 1);
+    }
+}
+
+static size_t count(const char *s, const char *what)
+{
+    size_t n = 0;
+    for (const char *p = s; (p = strstr(p, what)) != NULL; p += strlen(what)) {
+        n++;
+    }
+    return n;
+}
+
+static char *render(camera_bench_t *b, camera_bench_format_t fmt)
+{
+    size_t n = camera_bench_format(b, fmt, NULL, 0);
+    char *buf = malloc(n + 1);
+    CHECK(buf && camera_bench_format(b, fmt, buf, n + 1) == n && strlen(buf) == n);
+    return buf;
+}
+
+static void save(const char *dir, const char *name, const char *text)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    CHECK(f != NULL);
+    if (f) {
+        fputs(text, f);
+        fclose(f);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    camera_bench_config_t cfg = {
+        .frame_size_names = s_sizes,
+        .frame_size_name_count = FRAMESIZE_INVALID,
+        .grab_mode_names = s_grab,
+        .grab_mode_name_count = sizeof(s_grab) / sizeof(s_grab[0]),
+        .warmup_us = WARMUP_US,
+        .measure_us = MEASURE_US,
+        .max_failures = 3,
+        .setup = sim_setup,
+        .frame = sim_frame,
+        .sample = sim_sample,
+        .finish = sim_finish,
+        .clock_us = sim_clock,
+    };
+
+    test_parse();
+    s_cam.psram_free = PSRAM_FREE;
+    s_cam.internal_free = INTERNAL_FREE;
+
+    camera_bench_parse_axis("VGA,SVGA,HD", s_sizes, FRAMESIZE_INVALID, &cfg.frame_size);
+    camera_bench_parse_axis("5,12", NULL, 0, &cfg.jpeg_quality);
+    camera_bench_parse_axis("10,20", NULL, 0, &cfg.xclk_hz);
+    camera_bench_parse_axis("1,2,3", NULL, 0, &cfg.fb_count);
+    camera_bench_parse_axis("empty,latest", s_grab, cfg.grab_mode_name_count, &cfg.grab_mode);
+    for (size_t i = 0; i < cfg.xclk_hz.count; i++) {
+        cfg.xclk_hz.values[i] *= 1000000;
+    }
+    can_frames(&cfg.frame_size, &cfg.jpeg_quality);
+
+    camera_bench_t *b = camera_bench_create(&cfg);
+    CHECK(b && b->points == 72);
+    if (!b) {
+        return TEST_END();
+    }
+
+    // Before the run: the header alone, and snprintf-like truncation
+    char small[16];
+    char *csv = render(b, CAMERA_BENCH_CSV);
+    CHECK(count(csv, "\n") == 1);
+    free(csv);
+    size_t n = camera_bench_format(b, CAMERA_BENCH_JSON, small, sizeof(small));
+    CHECK(n > sizeof(small) && strlen(small) == sizeof(small) - 1);
+
+    camera_bench_run(b);
+    CHECK(s_cam.finished && camera_bench_done(b) == b->points);
+
+    printf("| size | q | MHz | fb | grab | err | fps | mean KB | p99 KB | no_eoi | fb_ovf | PSRAM KB |\n");
+    printf("|---|---|---|---|---|---|---|---|---|---|---|---|\n");
+    for (size_t i = 0; i < b->points; i++) {
+        const camera_bench_result_t *r = &b->results[i];
+        check_point(r);
+        printf("| %s | %d | %d | %d | %s | %d | %u.%02u | %.1f | %.1f | %u | %u | %lld |\n",
+               s_sizes[r->point.frame_size], r->point.jpeg_quality, r->point.xclk_hz / 1000000,
+               r->point.fb_count, s_grab[r->point.grab_mode], r->err, r->fps_x100 / 100,
+               r->fps_x100 % 100, r->mean_bytes / 1024.0, r->p99_bytes / 1024.0, r->no_eoi,
+               r->fb_ovf, (long long)r->psram_used / 1024);
+    }
+
+    // Every point in both reports
+    csv = render(b, CAMERA_BENCH_CSV);
+    char *json = render(b, CAMERA_BENCH_JSON);
+    CHECK(count(csv, "\n") == b->points + 1);
+    CHECK(count(csv, ",") == (b->points + 1) * 15);
+    CHECK(count(json, "\"err\":") == b->points && strstr(json, "\"done\":72") != NULL);
+    if (argc > 1) {
+        save(argv[1], "bench.csv", csv);
+        save(argv[1], "bench.json", json);
+    }
+    free(csv);
+    free(json);
+    camera_bench_free(b);
+    return TEST_END();
+}
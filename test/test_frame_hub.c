@@ -0,0 +1,297 @@
+/*
+ * Frame hub - reference counting, latest-frame-wins and fan-out throughput
+ *
+ * A synthetic producer publishes frames at a fixed rate while 1, 2, 4 and 8
+ * consumers take them, check the payload and spend a fixed time "sending"
+ * each one. Every consumer should see close to every frame, so the
+ * aggregate rate scales with the number of consumers, and the producer
+ * should never be held up by them. A slow consumer only loses frames itself.
+ *
+ * A producer publishing back to back against a consumer that waits with a
+ * long timeout hits the window between the consumer's wake-up and its look
+ * at the pending frame over and over: a wait must never come back empty
+ * before its timeout while frames are still being published.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "frame_hub.h"
+#include "test.h"
+
+#define FRAME_BYTES     (32 * 1024)
+#define FRAME_PERIOD_US 5000        // 200 fps
+#define RUN_US          1000000
+#define SEND_US         2000        // Simulated per-frame send time
+#define SLOW_SEND_US    30000
+#define RACE_FRAMES     200000
+#define RACE_WAIT_MS    200
+
+typedef struct {
+    frame_hub_t *hub;
+    volatile bool stop;
+    uint32_t published;
+    uint32_t refused;               // acquire() found no free slot
+} producer_t;
+
+typedef struct {
+    frame_sub_t *sub;
+    volatile bool *stop;
+    int send_us;
+    uint32_t frames;
+    uint32_t corrupt;
+    uint32_t out_of_order;
+} consumer_t;
+
+static void *producer_main(void *arg)
+{
+    producer_t *p = arg;
+    int64_t next = test_now_us();
+    int64_t end = next + RUN_US;
+
+    while (next < end) {
+        hub_frame_t *frame = frame_hub_acquire(p->hub, FRAME_BYTES);
+        if (frame) {
+            // Every byte carries the low bits of the sequence number the
+            // frame is about to get
+            memset(frame->buf, (p->published + 1) & 0xff, FRAME_BYTES);
+            frame->len = FRAME_BYTES;
+            frame_hub_publish(p->hub, frame);
+            p->published++;
+        } else {
+            p->refused++;
+        }
+        next += FRAME_PERIOD_US;
+        int64_t now = test_now_us();
+        if (next > now) {
+            usleep(next - now);
+        }
+    }
+    p->stop = true;
+    return NULL;
+}
+
+static void *consumer_main(void *arg)
+{
+    consumer_t *c = arg;
+    uint32_t last = 0;
+
+    while (!*c->stop) {
+        hub_frame_t *frame = frame_hub_wait(c->sub, pdMS_TO_TICKS(50));
+        if (!frame) {
+            continue;
+        }
+        uint8_t want = frame->seq & 0xff;
+        if (frame->len != FRAME_BYTES || frame->buf[0] != want ||
+            frame->buf[FRAME_BYTES / 2] != want || frame->buf[FRAME_BYTES - 1] != want) {
+            c->corrupt++;
+        }
+        if (frame->seq <= last) {
+            c->out_of_order++;
+        }
+        last = frame->seq;
+        c->frames++;
+        usleep(c->send_us);
+        frame_hub_release(frame);
+    }
+    return NULL;
+}
+
+// Run n consumers, the first of them slow if asked. Returns the aggregate
+// frames per second delivered.
+static double run(int n, bool one_slow)
+{
+    frame_hub_t *hub = frame_hub_create(n, 1);
+    producer_t p = { .hub = hub };
+    consumer_t c[8] = { 0 };
+    pthread_t pt, ct[8];
+
+    CHECK(hub != NULL);
+    for (int i = 0; i < n; i++) {
+        c[i].sub = frame_hub_subscribe(hub);
+        c[i].stop = &p.stop;
+        c[i].send_us = one_slow && i == 0 ? SLOW_SEND_US : SEND_US;
+        CHECK(c[i].sub != NULL);
+        pthread_create(&ct[i], NULL, consumer_main, &c[i]);
+    }
+    pthread_create(&pt, NULL, producer_main, &p);
+    pthread_join(pt, NULL);
+
+    uint32_t total = 0, fastest = 0, slowest = UINT32_MAX, dropped = 0;
+    for (int i = 0; i < n; i++) {
+        pthread_join(ct[i], NULL);
+        CHECK(c[i].corrupt == 0);
+        CHECK(c[i].out_of_order == 0);
+        total += c[i].frames;
+        dropped += frame_hub_dropped(c[i].sub);
+        if (one_slow && i == 0) {
+            continue;
+        }
+        fastest = c[i].frames > fastest ? c[i].frames : fastest;
+        slowest = c[i].frames < slowest ? c[i].frames : slowest;
+    }
+
+    // The producer keeps its rate whatever the consumers do, and every
+    // consumer at full speed sees nearly every frame. The margin leaves
+    // room for the host scheduler, which may run all threads on one core.
+    CHECK(p.refused == 0);
+    CHECK(p.published >= RUN_US / FRAME_PERIOD_US * 9 / 10);
+    CHECK(slowest >= p.published * 8 / 10);
+    if (one_slow) {
+        CHECK(c[0].frames < p.published / 2);
+        CHECK(frame_hub_dropped(c[0].sub) > 0);
+    }
+
+    double fps = total * 1e6 / RUN_US;
+    printf("| %d%s | %u | %u | %u | %u | %.0f |\n", n, one_slow ? " (1 slow)" : "",
+           (unsigned)p.published, (unsigned)slowest, (unsigned)fastest, (unsigned)dropped, fps);
+
+    for (int i = 0; i < n; i++) {
+        frame_hub_unsubscribe(c[i].sub);
+    }
+    return fps;
+}
+
+static void test_latest_wins(void)
+{
+    frame_hub_t *hub = frame_hub_create(2, 1);
+    frame_sub_t *sub = frame_hub_subscribe(hub);
+
+    CHECK(frame_hub_latest(hub) == NULL);
+    for (int i = 0; i < 5; i++) {
+        hub_frame_t *frame = frame_hub_acquire(hub, 16);
+        CHECK(frame != NULL);
+        frame->len = 16;
+        frame_hub_publish(hub, frame);
+    }
+
+    // Only the newest of the five is still pending
+    hub_frame_t *frame = frame_hub_wait(sub, 0);
+    CHECK(frame != NULL && frame->seq == 5);
+    CHECK(frame_hub_dropped(sub) == 4);
+    CHECK(frame_hub_wait(sub, 0) == NULL);
+
+    hub_frame_t *latest = frame_hub_latest(hub);
+    CHECK(latest == frame);
+    frame_hub_release(latest);
+    frame_hub_release(frame);
+    frame_hub_unsubscribe(sub);
+}
+
+static void test_slots_return(void)
+{
+    // 2 subscribers + 1 producer frame + 2 extra slots
+    frame_hub_t *hub = frame_hub_create(2, 1);
+    frame_sub_t *a = frame_hub_subscribe(hub);
+    frame_sub_t *b = frame_hub_subscribe(hub);
+
+    CHECK(frame_hub_subscribe(hub) == NULL);
+    CHECK(frame_hub_subscriber_count(hub) == 2);
+
+    hub_frame_t *frame = frame_hub_acquire(hub, 64);
+    frame->len = 64;
+    frame_hub_publish(hub, frame);
+
+    // Latest plus both subscribers hold the one frame: four slots are free
+    hub_frame_t *held[8];
+    int n = 0;
+    while (n < 8 && (held[n] = frame_hub_acquire(hub, 64)) != NULL) {
+        n++;
+    }
+    CHECK(n == 4);
+    for (int i = 0; i < n; i++) {
+        frame_hub_discard(hub, held[i]);
+    }
+
+    // Unsubscribing drops the pending references; only latest is left
+    frame_hub_unsubscribe(a);
+    frame_hub_unsubscribe(b);
+    n = 0;
+    while (n < 8 && (held[n] = frame_hub_acquire(hub, 64)) != NULL) {
+        n++;
+    }
+    CHECK(n == 4);
+    for (int i = 0; i < n; i++) {
+        frame_hub_discard(hub, held[i]);
+    }
+    CHECK(frame_hub_subscriber_count(hub) == 0);
+}
+
+typedef struct {
+    frame_hub_t *hub;
+    volatile bool stop;
+} race_producer_t;
+
+static void *race_producer_main(void *arg)
+{
+    race_producer_t *p = arg;
+
+    for (int i = 0; i < RACE_FRAMES; i++) {
+        hub_frame_t *frame = frame_hub_acquire(p->hub, 16);
+        if (frame) {
+            frame->len = 16;
+            frame_hub_publish(p->hub, frame);
+        }
+        if (i % 8 == 0) {
+            sched_yield();
+        }
+    }
+    p->stop = true;
+    return NULL;
+}
+
+static void test_wait_race(void)
+{
+    frame_hub_t *hub = frame_hub_create(1, 1);
+    frame_sub_t *sub = frame_hub_subscribe(hub);
+    race_producer_t p = { .hub = hub };
+    uint32_t frames = 0, early = 0;
+    pthread_t pt;
+
+    CHECK(hub && sub);
+    pthread_create(&pt, NULL, race_producer_main, &p);
+    while (!p.stop) {
+        int64_t start = test_now_us();
+        hub_frame_t *frame = frame_hub_wait(sub, pdMS_TO_TICKS(RACE_WAIT_MS));
+        if (frame) {
+            frames++;
+            frame_hub_release(frame);
+        } else if (!p.stop && test_now_us() - start < RACE_WAIT_MS * 1000 / 2) {
+            early++;
+        }
+    }
+    pthread_join(pt, NULL);
+
+    // Nothing pending once the last frame has been taken
+    hub_frame_t *frame = frame_hub_wait(sub, 0);
+    if (frame) {
+        frame_hub_release(frame);
+    }
+    CHECK(frame_hub_wait(sub, 0) == NULL);
+    CHECK(early == 0);
+    CHECK(frames > 0);
+    printf("Wait race: %u frames taken, %u early empty returns\n\n", (unsigned)frames,
+           (unsigned)early);
+    frame_hub_unsubscribe(sub);
+}
+
+int main(void)
+{
+    test_latest_wins();
+    test_slots_return();
+    test_wait_race();
+
+    printf("| consumers | published | min frames | max frames | dropped | aggregate fps |\n");
+    printf("|---|---|---|---|---|---|\n");
+    double one = run(1, false);
+    for (int n = 2; n <= 8; n *= 2) {
+        double fps = run(n, false);
+        CHECK(fps >= one * n * 0.8);
+    }
+    run(4, true);
+
+    return TEST_END();
+}
@@ -0,0 +1,174 @@
+/*
+ * Frame pacer - simulated stream client on a synthetic clock
+ *
+ * The sensor delivers a frame every sensor period; the client waits for the
+ * next one, "sends" it for a scripted time and sleeps for what the pacer
+ * returns. No real time passes, so the run is deterministic. Each scenario
+ * checks the achieved frame rate, the interval between frames and how many
+ * sensor frames the client skipped, and prints the old fixed 30 ms delay
+ * next to it for comparison.
+ */
+
+#include <stdbool.h>
+
+#include "frame_pacer.h"
+#include "test.h"
+
+#define SIM_FRAMES  600
+
+typedef struct {
+    const char *name;
+    int sensor_fps;
+    int target_fps;
+    int send_min_us;                // Send time is uniform in [min, max]
+    int send_max_us;
+    int slow_from, slow_to;         // Frames sent with slow_us instead
+    int slow_us;
+} scenario_t;
+
+typedef struct {
+    double fps;                     // Over the last half of the run
+    int64_t max_interval_us;        // Between sends, last half
+    int64_t min_interval_us;
+    uint32_t skipped;               // Sensor frames never sent
+    int64_t negative_sleeps;
+} result_t;
+
+static uint32_t s_rand = 1;
+
+static uint32_t next_rand(void)
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return s_rand >> 8;
+}
+
+static int send_time(const scenario_t *s, int frame)
+{
+    if (frame >= s->slow_from && frame < s->slow_to) {
+        return s->slow_us;
+    }
+    return s->send_min_us + next_rand() % (s->send_max_us - s->send_min_us + 1);
+}
+
+// Sensor frames are ready at multiples of the sensor period; the client
+// takes the latest one, waiting for the next if it already took it
+static int64_t next_frame(int64_t now, int64_t period, int64_t *last_taken)
+{
+    int64_t ready = now / period * period;
+    if (ready <= *last_taken) {
+        ready = *last_taken + period;
+    }
+    *last_taken = ready;
+    return ready > now ? ready : now;
+}
+
+static result_t simulate(const scenario_t *s, bool fixed_delay)
+{
+    frame_pacer_t p;
+    result_t r = { .min_interval_us = INT64_MAX };
+    int64_t period = 1000000 / s->sensor_fps;
+    int64_t now = 0, last_taken = -period, prev_sent = -1, half_start = 0;
+    uint32_t sent_half = 0;
+
+    s_rand = 1;
+    frame_pacer_init(&p, s->target_fps);
+    for (int i = 0; i < SIM_FRAMES; i++) {
+        frame_pacer_begin(&p, now);
+        int64_t before = last_taken;
+        now = next_frame(now, period, &last_taken);
+        r.skipped += (last_taken - before) / period - 1;
+        frame_pacer_captured(&p, now);
+        now += send_time(s, i);
+
+        int64_t sleep = frame_pacer_end(&p, now);
+        if (sleep < 0) {
+            r.negative_sleeps++;
+        }
+        if (fixed_delay) {
+            sleep = 30000;
+        }
+
+        if (i == SIM_FRAMES / 2) {
+            half_start = now;
+        } else if (i > SIM_FRAMES / 2) {
+            int64_t interval = now - prev_sent;
+            r.max_interval_us = interval > r.max_interval_us ? interval : r.max_interval_us;
+            r.min_interval_us = interval < r.min_interval_us ? interval : r.min_interval_us;
+            sent_half++;
+        }
+        prev_sent = now;
+        now += sleep;
+    }
+    r.fps = sent_half * 1e6 / (prev_sent - half_start);
+    return r;
+}
+
+static result_t run(const scenario_t *s)
+{
+    result_t r = simulate(s, false);
+    result_t fixed = simulate(s, true);
+
+    printf("| %s | %d | %d | %.1f | %.1f | %.1f | %.1f | %u | %.1f |\n",
+           s->name, s->sensor_fps, s->target_fps, s->send_min_us / 1000.0, s->send_max_us / 1000.0,
+           r.fps, r.max_interval_us / 1000.0, (unsigned)r.skipped, fixed.fps);
+    CHECK(r.negative_sleeps == 0);
+    return r;
+}
+
+static bool near(double v, double want, double tolerance)
+{
+    return v >= want * (1 - tolerance) && v <= want * (1 + tolerance);
+}
+
+int main(void)
+{
+    printf("| scenario | sensor fps | target fps | send min ms | send max ms | fps | max interval ms | skipped | fixed 30 ms fps |\n");
+    printf("|---|---|---|---|---|---|---|---|---|\n");
+
+    // Fast link: the pacer holds the target and skips the surplus sensor frames
+    scenario_t fast = { "fast link", 100, 25, 2000, 6000, -1, -1, 0 };
+    result_t r = run(&fast);
+    CHECK(near(r.fps, 25, 0.05));
+    CHECK(r.max_interval_us <= 40000 + 10000);
+    CHECK(r.skipped >= SIM_FRAMES * 2);
+
+    // Jittery sends below the budget still average out to the target
+    scenario_t jitter = { "jittery link", 100, 20, 5000, 35000, -1, -1, 0 };
+    r = run(&jitter);
+    CHECK(near(r.fps, 20, 0.05));
+
+    // A 30 fps sensor quantizes to its own frame times: 15 fps is every
+    // other frame, with nothing skipped beyond that
+    scenario_t sensor = { "30 fps sensor", 30, 15, 3000, 8000, -1, -1, 0 };
+    r = run(&sensor);
+    CHECK(near(r.fps, 15, 0.05));
+    CHECK(r.skipped <= SIM_FRAMES + 2);
+
+    // Sends slower than the budget: the pacer backs off until sends fit in
+    // 7/8 of it, so the client runs a little under the 10 fps the link
+    // allows instead of queueing behind it
+    scenario_t slow = { "slow link", 100, 25, 90000, 110000, -1, -1, 0 };
+    r = run(&slow);
+    CHECK(r.fps >= 10 * 0.75 && r.fps <= 10);
+    CHECK(r.min_interval_us >= 90000);
+
+    // A slow spell in the first half recovers to the target before the
+    // second half is measured
+    scenario_t recover = { "slow then fast", 100, 25, 2000, 6000, 50, 200, 120000 };
+    r = run(&recover);
+    CHECK(near(r.fps, 25, 0.05));
+
+    // Pacing off: frames go out as fast as the sensor and link allow
+    scenario_t off = { "pacing off", 100, 0, 2000, 2000, -1, -1, 0 };
+    r = run(&off);
+    CHECK(r.fps > 90);
+
+    frame_pacer_t p;
+    frame_pacer_init(&p, 0);
+    frame_pacer_begin(&p, 0);
+    frame_pacer_captured(&p, 10);
+    CHECK(frame_pacer_end(&p, 20) == 0);
+    CHECK(frame_pacer_budget_mfps(&p) == 0);
+
+    return TEST_END();
+}
@@ -0,0 +1,179 @@
+/*
+ * Frame ring - arena invariants under random load, pinning, age bound, speed
+ *
+ * Pushes tens of thousands of frames of random size (mostly JPEG-sized,
+ * some larger than a fifth of the arena) and after every push walks the
+ * whole ring: sequence numbers ascending and complete, every record inside
+ * the arena and its payload intact, count and used bytes as the ring
+ * claims. Pinning must hold the oldest record in place while pushes fail,
+ * and the age bound must evict by timestamp. Finally push throughput is
+ * compared with a plain memcpy of the same frames.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_ring.h"
+#include "test.h"
+
+#define ARENA       (1 << 20)
+#define RANDOM_PUSHES 20000
+#define BENCH_PUSHES 20000
+
+static uint8_t s_arena[ARENA];
+static uint8_t s_frame[ARENA];
+static uint8_t s_copy[ARENA];
+
+// Payload bytes are a function of the sequence number they were stored as
+static void fill(uint8_t *buf, size_t len, uint32_t seq)
+{
+    for (size_t i = 0; i < len; i += 97) {
+        buf[i] = (uint8_t)(seq * 7 + i);
+    }
+}
+
+static bool walk(const frame_ring_t *r)
+{
+    uint32_t first, last, prev = 0;
+    size_t count = 0, used = 0;
+    const frame_ring_rec_t *rec;
+    bool ok = true;
+
+    if (!frame_ring_span(r, &first, &last)) {
+        return r->count == 0 && r->used == 0;
+    }
+    for (uint32_t seq = first; (rec = frame_ring_find(r, seq)) != NULL; seq = rec->seq + 1) {
+        const uint8_t *p = frame_ring_payload(rec);
+        ok &= rec->seq == (prev ? prev + 1 : first);
+        ok &= (const uint8_t *)rec >= r->arena && p + rec->len <= r->arena + r->size;
+        ok &= ((uintptr_t)rec & 7) == 0;
+        for (uint32_t i = 0; i < rec->len; i += 97) {
+            ok &= p[i] == (uint8_t)(rec->seq * 7 + i);
+        }
+        prev = rec->seq;
+        count++;
+        used += rec->size;
+    }
+    return ok && prev == last && count == r->count && used == r->used && used <= r->size;
+}
+
+static uint32_t s_rand = 5;
+
+static uint32_t next_rand(void)
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return s_rand >> 8;
+}
+
+static void test_random(void)
+{
+    frame_ring_t r;
+    int bad = 0;
+
+    frame_ring_init(&r, s_arena, ARENA, 0);
+    for (int i = 0; i < RANDOM_PUSHES; i++) {
+        size_t len = next_rand() % 5 == 0 ? next_rand() % 200000 : next_rand() % 40000;
+        uint32_t seq = r.next_seq;
+        fill(s_frame, len, seq);
+        CHECK(frame_ring_push(&r, s_frame, len, 640, 480, i) == seq);
+        bad += !walk(&r);
+
+        // Every thousand pushes, pin the oldest record and keep pushing:
+        // it stays put and the pushes that would need its space fail
+        if (i % 1000 == 999) {
+            uint32_t first, last, refused = 0;
+            frame_ring_span(&r, &first, &last);
+            frame_ring_pin(&r, first);
+            for (int j = 0; j < 50; j++) {
+                seq = r.next_seq;
+                fill(s_frame, 30000, seq);
+                refused += frame_ring_push(&r, s_frame, 30000, 640, 480, i) == 0;
+                bad += !walk(&r);
+            }
+            uint32_t still;
+            CHECK(frame_ring_span(&r, &still, &last) && still == first);
+            CHECK(refused > 0);
+            frame_ring_unpin(&r);
+        }
+    }
+    CHECK(bad == 0);
+
+    // Larger than the whole arena: refused, nothing evicted for it
+    size_t count = r.count;
+    uint32_t dropped = r.dropped;
+    CHECK(frame_ring_push(&r, s_frame, ARENA, 640, 480, 0) == 0);
+    CHECK(r.count == count && r.dropped == dropped + 1);
+}
+
+static void test_age(void)
+{
+    frame_ring_t r;
+
+    // 100 us apart, at most 1000 us old: the newest 11 remain
+    frame_ring_init(&r, s_arena, ARENA, 1000);
+    for (int i = 0; i < 100; i++) {
+        fill(s_frame, 100, r.next_seq);
+        frame_ring_push(&r, s_frame, 100, 1, 1, i * 100);
+    }
+    uint32_t first, last;
+    CHECK(walk(&r));
+    CHECK(r.count == 11);
+    CHECK(frame_ring_span(&r, &first, &last) && first == 90 && last == 100);
+    CHECK(frame_ring_find(&r, 1)->seq == 90);
+    CHECK(frame_ring_find(&r, 101) == NULL);
+}
+
+static void bench(void)
+{
+    frame_ring_t r;
+    size_t bytes = 0;
+
+    frame_ring_init(&r, s_arena, ARENA, 0);
+    int64_t start = test_now_us();
+    for (int i = 0; i < BENCH_PUSHES; i++) {
+        size_t len = 40000 + (i % 17) * 1000;
+        frame_ring_push(&r, s_frame, len, 1280, 720, i);
+        bytes += len;
+    }
+    int64_t ring_us = test_now_us() - start;
+
+    // The same bytes through memcpy alone, wrapping the same way
+    size_t pos = 0;
+    start = test_now_us();
+    for (int i = 0; i < BENCH_PUSHES; i++) {
+        size_t len = 40000 + (i % 17) * 1000;
+        if (pos + len > ARENA) {
+            pos = 0;
+        }
+        memcpy(s_copy + pos, s_frame, len);
+        pos += len;
+    }
+    int64_t copy_us = test_now_us() - start;
+
+    // Lookup of a sequence number in a full ring
+    uint32_t first, last;
+    frame_ring_span(&r, &first, &last);
+    start = test_now_us();
+    uint32_t found = 0;
+    for (int i = 0; i < 100000; i++) {
+        found += frame_ring_find(&r, first + i % (last - first + 1)) != NULL;
+    }
+    int64_t find_us = test_now_us() - start;
+    CHECK(found == 100000);
+
+    printf("| operation | frames/s | MB/s | ns/op |\n|---|---|---|---|\n");
+    printf("| push 40-56 KB | %.0f | %.0f | %.0f |\n", BENCH_PUSHES / (ring_us / 1e6),
+           bytes / (double)ring_us, ring_us * 1000.0 / BENCH_PUSHES);
+    printf("| memcpy alone | %.0f | %.0f | %.0f |\n", BENCH_PUSHES / (copy_us / 1e6),
+           bytes / (double)copy_us, copy_us * 1000.0 / BENCH_PUSHES);
+    printf("| find (%u records) | - | - | %.0f |\n", (unsigned)r.count, find_us * 1000.0 / 100000);
+}
+
+int main(void)
+{
+    test_random();
+    test_age();
+    bench();
+    return TEST_END();
+}
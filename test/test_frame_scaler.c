@@ -0,0 +1,220 @@
+/*
+ * Scaled streams - CPU cost per scale and bandwidth against the full stream
+ *
+ * Runs each frame through what the scaler task does for one scale:
+ * jpeg_dc_scale() to YUYV at 1/N, then the software encoder at the default
+ * CONFIG_STREAM_SCALE_QUALITY. Reports decode and encode time per frame,
+ * the share of one core that costs at 25 fps, and the bytes a viewer of
+ * each scale receives against the full stream. Every output must decode
+ * again at the expected size.
+ *
+ * Without arguments the frames are 1280x720 synthetic scenes from the
+ * software encoder; given a directory of JPEG files (e.g. frames saved
+ * from /capture) it scales those instead:
+ *
+ *   test_frame_scaler DIR
+ *
+ * Times are for this machine, not the ESP32-S3; the ratios between scales
+ * and the byte counts carry over.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "jpeg_dc.h"
+#include "jpeg_encoder.h"
+#include "test.h"
+
+#define W               1280
+#define H               720
+#define FRAMES          20
+#define QUALITY         70          // Kconfig default
+#define SOURCE_QUALITY  80
+#define FPS             25
+#define MAX_BYTES       (1 << 20)
+
+typedef struct {
+    uint8_t *jpg;
+    size_t len;
+} frame_t;
+
+typedef struct {
+    int frames;
+    int width;
+    int height;
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+    int64_t decode_us;
+    int64_t encode_us;
+} scale_stats_t;
+
+static uint8_t s_yuyv[W * H * 2 * 4];
+static uint8_t s_out[MAX_BYTES];
+
+// A room with a window and furniture, shifted and re-lit per frame, with
+// sensor noise, so every frame has to be encoded afresh
+static size_t make_frame(jpeg_encoder_t *enc, int i, uint8_t *out, size_t cap)
+{
+    uint32_t r = 17 + i;
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            r = r * 1103515245 + 12345;
+            int n = (r >> 16) % 20;
+            int xs = x + i * 3;
+            int v = 80 + y / 6 + n + i;
+            int red = v, green = v, blue = v + 12;
+            if (xs % W > 800 && xs % W < 1100 && y > 100 && y < 380) {
+                red = green = 210 + n / 2;
+                blue = 240;
+            }
+            if (y > 480 && xs % 320 < 200) {
+                red = 130 + n;
+                green = 80 + n;
+                blue = 40 + (xs & 31);
+            }
+            red = red > 255 ? 255 : red;
+            green = green > 255 ? 255 : green;
+            blue = blue > 255 ? 255 : blue;
+            unsigned p = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+            s_yuyv[2 * (y * W + x)] = p >> 8;
+            s_yuyv[2 * (y * W + x) + 1] = p & 0xff;
+        }
+    }
+    return jpeg_encode(enc, s_yuyv, W, H, JPEG_ENC_RGB565, out, cap);
+}
+
+static int load_dir(const char *dir, frame_t **frames)
+{
+    struct dirent **names;
+    int n = scandir(dir, &names, NULL, alphasort);
+    int count = 0;
+
+    *frames = calloc(n > 0 ? n : 1, sizeof(frame_t));
+    for (int i = 0; i < n; i++) {
+        const char *ext = strrchr(names[i]->d_name, '.');
+        if (ext && (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg"))) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", dir, names[i]->d_name);
+            FILE *f = fopen(path, "rb");
+            frame_t *fr = &(*frames)[count];
+            fr->jpg = malloc(MAX_BYTES);
+            fr->len = f ? fread(fr->jpg, 1, MAX_BYTES, f) : 0;
+            if (f) {
+                fclose(f);
+            }
+            count += fr->len > 0;
+        }
+        free(names[i]);
+    }
+    free(n > 0 ? names : NULL);
+    return count;
+}
+
+static scale_stats_t run_scale(const frame_t *frames, int count, int scale)
+{
+    scale_stats_t st = { 0 };
+    jpeg_encoder_t *enc = NULL;
+    int enc_width = 0;
+
+    for (int i = 0; i < count; i++) {
+        const frame_t *f = &frames[i];
+        int w, h;
+        if (!jpeg_dc_scaled_size(f->jpg, f->len, scale, &w, &h)) {
+            continue;
+        }
+        // As the scaler does: one encoder, recreated only for a wider frame
+        if (w > enc_width) {
+            jpeg_encoder_destroy(enc);
+            jpeg_encoder_config_t cfg = { .max_width = w, .quality = QUALITY };
+            enc = jpeg_encoder_create(&cfg);
+            enc_width = w;
+        }
+
+        int64_t start = test_now_us();
+        bool ok = jpeg_dc_scale(f->jpg, f->len, scale, s_yuyv, sizeof(s_yuyv), &w, &h);
+        int64_t decoded = test_now_us();
+        size_t len = ok ? jpeg_encode(enc, s_yuyv, w, h, JPEG_ENC_YUYV, s_out, sizeof(s_out)) : 0;
+        int64_t done = test_now_us();
+        CHECK(ok && len > 0);
+
+        // What viewers get must decode again: halve it once more
+        static uint8_t check[W * H];
+        int ow, oh;
+        CHECK(jpeg_dc_scale(s_out, len, 2, check, sizeof(check), &ow, &oh));
+        CHECK(ow == ((w / 2) & ~1) && oh == h / 2);
+
+        st.frames++;
+        st.width = w;
+        st.height = h;
+        st.in_bytes += f->len;
+        st.out_bytes += len;
+        st.decode_us += decoded - start;
+        st.encode_us += done - decoded;
+    }
+    jpeg_encoder_destroy(enc);
+    return st;
+}
+
+int main(int argc, char **argv)
+{
+    frame_t *frames;
+    int count;
+
+    if (argc > 1) {
+        count = load_dir(argv[1], &frames);
+        if (!count) {
+            fprintf(stderr, "No JPEG files in %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        jpeg_encoder_config_t cfg = { .max_width = W, .quality = SOURCE_QUALITY };
+        jpeg_encoder_t *enc = jpeg_encoder_create(&cfg);
+        frames = calloc(FRAMES, sizeof(frame_t));
+        for (count = 0; count < FRAMES; count++) {
+            frames[count].jpg = malloc(MAX_BYTES);
+            frames[count].len = make_frame(enc, count, frames[count].jpg, MAX_BYTES);
+            CHECK(frames[count].len > 0);
+        }
+        jpeg_encoder_destroy(enc);
+    }
+
+    uint64_t full_bytes = 0;
+    for (int i = 0; i < count; i++) {
+        full_bytes += frames[i].len;
+    }
+    printf("| scale | size | decode ms | encode ms | total ms | core at %d fps | KB/frame | KB/s at %d fps | saved |\n",
+           FPS, FPS);
+    printf("|---|---|---|---|---|---|---|---|---|\n");
+    printf("| 1 (full) | - | - | - | - | - | %.1f | %.0f | - |\n", full_bytes / 1024.0 / count,
+           full_bytes / 1024.0 / count * FPS);
+
+    uint64_t prev_bytes = full_bytes;
+    double all_ms = 0;
+    for (int scale = 2; scale <= 8; scale *= 2) {
+        scale_stats_t st = run_scale(frames, count, scale);
+        CHECK(st.frames == count);
+        if (!st.frames) {
+            continue;
+        }
+        double dec = st.decode_us / 1000.0 / st.frames;
+        double encd = st.encode_us / 1000.0 / st.frames;
+        double kb = st.out_bytes / 1024.0 / st.frames;
+        all_ms += dec + encd;
+        printf("| 1/%d | %dx%d | %.2f | %.2f | %.2f | %.1f%% | %.1f | %.0f | %.1f%% |\n", scale,
+               st.width, st.height, dec, encd, dec + encd, (dec + encd) * FPS / 10.0, kb, kb * FPS,
+               100.0 - 100.0 * st.out_bytes / st.in_bytes);
+        // Each halving of the size cuts the bytes
+        CHECK(st.out_bytes < prev_bytes);
+        prev_bytes = st.out_bytes;
+    }
+    printf("| all three | | | | %.2f | %.1f%% | | | |\n", all_ms, all_ms * FPS / 10.0);
+
+    for (int i = 0; i < count; i++) {
+        free(frames[i].jpg);
+    }
+    free(frames);
+    return TEST_END();
+}
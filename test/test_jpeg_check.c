@@ -0,0 +1,285 @@
+/*
+ * JPEG integrity check - damaged frames and scanner speed
+ *
+ * Frames from the software encoder, and sequential frames with a restart
+ * interval built here (the encoder writes no DRI), are damaged the ways the
+ * camera DMA damages them: cut short at every tenth of their length, the
+ * EOI lost, padding left behind, a foreign marker in the scan, restart
+ * intervals lost or stale ones appended. Each must come back intact,
+ * repaired with an EOI at a sane point, or rejected. Stuffed 0xFF00 bytes,
+ * fill bytes and an 0xFF00 followed by what would be an EOI or RST byte
+ * must all pass as scan data.
+ *
+ * The benchmark compares jpeg_check() with a memcpy of the same frames and
+ * the word-at-a-time 0xFF search with a byte loop.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jpeg_check.h"
+#include "jpeg_dc.h"
+#include "jpeg_encoder.h"
+#include "test.h"
+
+#define W           640
+#define H           480
+#define MAX_BYTES   (256 * 1024)
+#define BENCH_ROUNDS 500
+
+static uint8_t s_rgb[W * H * 2];
+static uint8_t s_frame[MAX_BYTES];
+static uint8_t s_buf[MAX_BYTES + 8192];
+static uint8_t s_copy[MAX_BYTES];
+static size_t s_len;
+
+// A noisy scene, so the scan is dense and has its share of stuffed bytes
+static size_t encode_frame(void)
+{
+    jpeg_encoder_config_t cfg = { .max_width = W, .quality = 80 };
+    jpeg_encoder_t *enc = jpeg_encoder_create(&cfg);
+    uint32_t r = 3;
+
+    for (int i = 0; i < W * H; i++) {
+        r = r * 1103515245 + 12345;
+        unsigned v = (i % W) / 3 + (r >> 16) % 48;
+        unsigned p = ((v >> 3) << 11) | ((v >> 2) << 5) | (((i / W) / 2) >> 3);
+        s_rgb[2 * i] = p >> 8;
+        s_rgb[2 * i + 1] = p & 0xff;
+    }
+    size_t len = jpeg_encode(enc, s_rgb, W, H, JPEG_ENC_RGB565, s_frame, sizeof(s_frame));
+    jpeg_encoder_destroy(enc);
+    return len;
+}
+
+// Sequential 4:2:0 frame with restart interval dri MCUs and made-up scan
+// data. Intervals [skip_from, skip_from + skip) are left out, extra stale
+// intervals are appended. Every interval carries stuffed bytes, a fill
+// byte and 0xFF00 followed by 0xD9 and 0xD0.
+static size_t make_dri_frame(uint8_t *out, int dri, int skip_from, int skip, int extra)
+{
+    const uint8_t hdr[] = {
+        0xFF, 0xD8,
+        0xFF, 0xC0, 0, 17, 8, H >> 8, H & 255, W >> 8, W & 255, 3,
+        1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1,
+        0xFF, 0xDD, 0, 4, dri >> 8, dri & 255,
+        0xFF, 0xDA, 0, 12, 3, 1, 0, 2, 0x11, 3, 0x11, 0, 63, 0,
+    };
+    const uint8_t tricky[] = { 0xFF, 0x00, 0xD9, 0x12, 0xFF, 0xFF, 0x00, 0xFF, 0x00, 0xD0 };
+    int intervals = ((W + 15) / 16) * ((H + 15) / 16) / dri + extra;
+    uint32_t r = 1;
+    size_t n = sizeof(hdr);
+
+    memcpy(out, hdr, n);
+    for (int i = 0; i < intervals; i++) {
+        if (i >= skip_from && i < skip_from + skip) {
+            continue;
+        }
+        if (i) {
+            out[n++] = 0xFF;
+            out[n++] = 0xD0 + ((i - 1) & 7);
+        }
+        int bytes = 50 + i % 100;
+        for (int k = 0; k < bytes; k++) {
+            r = r * 1103515245 + 12345;
+            out[n++] = r >> 16;
+            if (out[n - 1] == 0xFF) {
+                out[n++] = 0;
+            }
+        }
+        memcpy(out + n, tricky, sizeof(tricky));
+        n += sizeof(tricky);
+    }
+    out[n++] = 0xFF;
+    out[n++] = 0xD9;
+    return n;
+}
+
+static jpeg_check_result_t check(size_t len, size_t cap, jpeg_check_info_t *info)
+{
+    return jpeg_check(s_buf, len, cap, info);
+}
+
+static bool ends_with_eoi(const jpeg_check_info_t *info)
+{
+    return info->len >= 4 && s_buf[info->len - 2] == 0xFF && s_buf[info->len - 1] == 0xD9 &&
+           s_buf[info->len - 3] != 0xFF;
+}
+
+static void test_find_ff(void)
+{
+    uint8_t buf[80];
+    int bad = 0;
+
+    // Every start alignment, every position, and none at all
+    memset(buf, 0x5a, sizeof(buf));
+    for (size_t start = 0; start < 8; start++) {
+        size_t len = sizeof(buf) - start;
+        bad += jpeg_find_ff(buf + start, len) != len;
+        for (size_t at = start; at < sizeof(buf); at++) {
+            buf[at] = 0xFF;
+            bad += jpeg_find_ff(buf + start, len) != at - start;
+            buf[at] = 0xFE;         // Close, but not a marker byte
+            bad += jpeg_find_ff(buf + start, len) != len;
+            buf[at] = 0x5a;
+        }
+    }
+    CHECK(bad == 0);
+}
+
+static void test_encoded(void)
+{
+    jpeg_check_info_t info;
+
+    // Intact, and intact with the driver's zero padding behind it
+    memcpy(s_buf, s_frame, s_len);
+    CHECK(check(s_len, sizeof(s_buf), &info) == JPEG_CHECK_OK && info.len == s_len && !info.padding);
+    memset(s_buf + s_len, 0, 4000);
+    CHECK(check(s_len + 4000, sizeof(s_buf), &info) == JPEG_CHECK_OK);
+    CHECK(info.len == s_len && info.padding == 4000);
+    int w, h;
+    static uint8_t thumb[(W / 8) * (H / 8)];
+    CHECK(jpeg_dc_thumbnail(s_buf, info.len, thumb, sizeof(thumb), &w, &h) && w == W / 8);
+
+    // The EOI lost: the whole scan is kept and closed again
+    memcpy(s_buf, s_frame, s_len);
+    CHECK(check(s_len - 2, s_len, &info) == JPEG_CHECK_REPAIRED);
+    CHECK(info.len == s_len && ends_with_eoi(&info) && !strcmp(info.reason, "no EOI"));
+
+    // Cut short anywhere: closed at the cut, less a dangling 0xFF
+    int bad = 0;
+    for (int tenth = 1; tenth < 10; tenth++) {
+        size_t cut = s_len * tenth / 10;
+        memcpy(s_buf, s_frame, s_len);
+        bad += check(cut, cut + 2, &info) != JPEG_CHECK_REPAIRED;
+        bad += !ends_with_eoi(&info) || info.len > cut + 2 || info.len < cut + 1;
+    }
+    CHECK(bad == 0);
+
+    // Cut right after the 0xFF of a stuffed byte
+    size_t ff = 0;
+    for (size_t i = s_len / 2; i < s_len && !ff; i++) {
+        ff = s_frame[i] == 0xFF && s_frame[i + 1] == 0x00 ? i : 0;
+    }
+    CHECK(ff != 0);
+    memcpy(s_buf, s_frame, s_len);
+    CHECK(check(ff + 1, ff + 3, &info) == JPEG_CHECK_REPAIRED && info.len == ff + 2);
+    CHECK(ends_with_eoi(&info));
+
+    // No room for the EOI, and no restart marker to fall back to
+    memcpy(s_buf, s_frame, s_len);
+    CHECK(check(s_len / 2, s_len / 2, &info) == JPEG_CHECK_BAD);
+
+    // A foreign marker in the scan
+    memcpy(s_buf, s_frame, s_len);
+    s_buf[s_len / 3] = 0xFF;
+    s_buf[s_len / 3 + 1] = 0xC4;
+    CHECK(check(s_len, sizeof(s_buf), &info) == JPEG_CHECK_REPAIRED && info.len == s_len / 3 + 2);
+
+    // Nothing worth showing
+    memcpy(s_buf, s_frame, s_len);
+    s_buf[0] = 0;
+    CHECK(check(s_len, sizeof(s_buf), &info) == JPEG_CHECK_BAD && !strcmp(info.reason, "no SOI"));
+    memcpy(s_buf, s_frame, s_len);
+    CHECK(check(200, 202, &info) == JPEG_CHECK_BAD);
+}
+
+static void test_restarts(void)
+{
+    jpeg_check_info_t info;
+    int expected = ((W + 15) / 16) * ((H + 15) / 16) / 10 - 1;
+
+    // Intact: stuffed and fill bytes, 0xFF00 0xD9 and 0xFF00 0xD0 are data
+    size_t len = make_dri_frame(s_buf, 10, 0, 0, 0);
+    CHECK(check(len, sizeof(s_buf), &info) == JPEG_CHECK_OK);
+    CHECK(info.len == len && info.restarts == (uint32_t)expected);
+
+    // Cut short: closed at the cut, restarts counted up to it
+    len = make_dri_frame(s_buf, 10, 0, 0, 0);
+    CHECK(check(len * 2 / 3, len, &info) == JPEG_CHECK_REPAIRED && ends_with_eoi(&info));
+    CHECK(info.restarts > 0 && info.restarts < (uint32_t)expected);
+
+    // Three intervals lost: the marker sequence breaks, cut before it
+    len = make_dri_frame(s_buf, 10, 50, 3, 0);
+    CHECK(check(len, sizeof(s_buf), &info) == JPEG_CHECK_REPAIRED);
+    CHECK(info.restarts == 49 && !strcmp(info.reason, "restart marker out of order"));
+
+    // Eight lost keep the sequence in phase; only the count gives it away
+    len = make_dri_frame(s_buf, 10, 50, 8, 0);
+    CHECK(check(len, sizeof(s_buf), &info) == JPEG_CHECK_BAD);
+
+    // Stale intervals from a larger frame behind the last real one
+    len = make_dri_frame(s_buf, 10, 0, 0, 5);
+    CHECK(check(len, sizeof(s_buf), &info) == JPEG_CHECK_REPAIRED);
+    CHECK(info.restarts == (uint32_t)expected && ends_with_eoi(&info));
+}
+
+static void bench(void)
+{
+    jpeg_check_info_t info;
+    size_t ff = 0, stuffed = 0, sink = 0;
+
+    for (size_t i = 0; i + 1 < s_len; i++) {
+        ff += s_frame[i] == 0xFF;
+        stuffed += s_frame[i] == 0xFF && s_frame[i + 1] == 0;
+    }
+
+    int64_t start = test_now_us();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        sink += jpeg_check(s_frame, s_len, s_len, &info) == JPEG_CHECK_OK;
+    }
+    int64_t check_us = test_now_us() - start;
+    CHECK(sink == BENCH_ROUNDS);
+
+    start = test_now_us();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        memcpy(s_copy, s_frame, s_len);
+        sink += s_copy[i % s_len];
+    }
+    int64_t copy_us = test_now_us() - start;
+
+    // Marker-free data: the word loop runs start to end
+    memset(s_copy, 0x5a, sizeof(s_copy));
+    start = test_now_us();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        sink += jpeg_find_ff(s_copy + (i & 7), sizeof(s_copy) - 8);
+    }
+    int64_t find_us = test_now_us() - start;
+
+    start = test_now_us();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        const uint8_t *p = s_copy + (i & 7);
+        size_t k = 0, n = sizeof(s_copy) - 8;
+        while (k < n && p[k] != 0xFF) {
+            k++;
+        }
+        sink += k;
+    }
+    int64_t byte_us = test_now_us() - start;
+
+    double bytes = (double)s_len * BENCH_ROUNDS;
+    double scan = (double)(sizeof(s_copy) - 8) * BENCH_ROUNDS;
+    printf("Encoded %dx%d frame: %zu bytes, %zu of them 0xFF (%zu stuffed)\n\n", W, H, s_len, ff,
+           stuffed);
+    printf("| operation | MB/s | us/frame |\n|---|---|---|\n");
+    printf("| jpeg_check | %.0f | %.1f |\n", bytes / check_us, (double)check_us / BENCH_ROUNDS);
+    printf("| memcpy | %.0f | %.1f |\n", bytes / copy_us, (double)copy_us / BENCH_ROUNDS);
+    printf("| jpeg_find_ff, no 0xFF | %.0f | - |\n", scan / find_us);
+    printf("| byte loop, no 0xFF | %.0f | - |\n", scan / byte_us);
+    if (sink == 0) {
+        printf("\n");
+    }
+}
+
+int main(void)
+{
+    s_len = encode_frame();
+    CHECK(s_len > 0);
+
+    test_find_ff();
+    test_encoded();
+    test_restarts();
+    bench();
+    return TEST_END();
+}
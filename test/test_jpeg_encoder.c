@@ -0,0 +1,275 @@
+/*
+ * Software JPEG encoder - kernel exactness, round-trip PSNR, MP/s per stage
+ *
+ * The fast color conversion and quantization kernels must match their
+ * scalar references bit for bit; the integer DCT only has to agree with the
+ * double-precision one to within rounding, so it is compared by PSNR. A
+ * synthetic 1280x720 frame is then encoded with both kernel sets and
+ * decoded again at half size by jpeg_dc_scale(), and the luma compared
+ * with the 2x2 mean of the source. Finally each stage's throughput is
+ * printed in megapixels per second, together with the jpeg_dc decoders.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jpeg_dc.h"
+#include "jpeg_encoder.h"
+#include "jpeg_kernels.h"
+#include "test.h"
+
+#define W       1280
+#define H       720
+#define REPS    5
+
+static uint8_t s_rgb[W * H * 2];
+static uint8_t s_yuyv[W * H * 2];
+static uint8_t s_luma[W * H];       // Reference conversion of s_rgb
+static uint8_t s_jpg[W * H];
+
+// Gradients, a checkerboard of inverted tiles and some noise: smooth areas
+// and hard edges, like a real scene
+static void make_frame(void)
+{
+    uint32_t r = 1;
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            r = r * 1103515245 + 12345;
+            int red = x * 255 / W, green = y * 255 / H, blue = ((x + y) / 3 + (r >> 16) % 16) & 255;
+            if (((x / 64) + (y / 64)) & 1) {
+                red = 255 - red;
+            }
+            unsigned v = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+            uint8_t *p = &s_rgb[2 * (y * W + x)];
+            p[0] = v >> 8;
+            p[1] = v & 0xff;
+            uint8_t *q = &s_yuyv[2 * (y * W + x)];
+            q[0] = (red + green) / 2;
+            q[1] = x & 1 ? blue : green;
+        }
+    }
+}
+
+static void test_convert(void)
+{
+    static uint8_t a[W * 3], b[W * 3];
+    int bad = 0;
+
+    for (int y = 0; y < H; y += 2) {
+        const uint8_t *r0 = s_rgb + y * W * 2, *r1 = r0 + W * 2;
+        jpeg_rgb565_rows_ref(r0, r1, W, a, a + W, a + 2 * W, a + 2 * W + W / 2);
+        jpeg_rgb565_rows_fast(r0, r1, W, b, b + W, b + 2 * W, b + 2 * W + W / 2);
+        bad += memcmp(a, b, W * 3) != 0;
+        memcpy(s_luma + y * W, a, W * 2);
+
+        const uint8_t *y0 = s_yuyv + y * W * 2, *y1 = y0 + W * 2;
+        jpeg_yuyv_rows_ref(y0, y1, W, a, a + W, a + 2 * W, a + 2 * W + W / 2);
+        jpeg_yuyv_rows_fast(y0, y1, W, b, b + W, b + 2 * W, b + 2 * W + W / 2);
+        bad += memcmp(a, b, W * 3) != 0;
+    }
+    CHECK(bad == 0);
+
+    // Widths that leave a partial 16-pixel group
+    for (int w = 2; w < 40; w += 2) {
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        jpeg_rgb565_rows_ref(s_rgb, s_rgb + W * 2, w, a, a + W, a + 2 * W, a + 2 * W + W / 2);
+        jpeg_rgb565_rows_fast(s_rgb, s_rgb + W * 2, w, b, b + W, b + 2 * W, b + 2 * W + W / 2);
+        CHECK(memcmp(a, b, sizeof(a)) == 0);
+        jpeg_yuyv_rows_ref(s_yuyv, s_yuyv + W * 2, w, a, a + W, a + 2 * W, a + 2 * W + W / 2);
+        jpeg_yuyv_rows_fast(s_yuyv, s_yuyv + W * 2, w, b, b + W, b + 2 * W, b + 2 * W + W / 2);
+        CHECK(memcmp(a, b, sizeof(a)) == 0);
+    }
+}
+
+// Returns the PSNR of the fast DCT against the reference, peak being the
+// largest coefficient an 8-bit block can produce
+static double test_fdct(void)
+{
+    uint8_t blk[64];
+    uint32_t r = 7;
+    double se = 0;
+    int max_diff = 0;
+    long n = 0;
+
+    for (int i = 0; i < 20000; i++) {
+        for (int k = 0; k < 64; k++) {
+            r = r * 1103515245 + 12345;
+            // Flat blocks first: their AC terms must come out exactly zero
+            blk[k] = i < 256 ? (uint8_t)i : (uint8_t)(r >> 16);
+        }
+        int32_t ref[64], fast[64];
+        jpeg_fdct_ref(blk, 8, ref);
+        jpeg_fdct_fast(blk, 8, fast);
+        for (int k = 0; k < 64; k++) {
+            int d = abs(ref[k] - fast[k]);
+            max_diff = d > max_diff ? d : max_diff;
+            se += (double)d * d;
+            n++;
+            if (i < 256 && k) {
+                CHECK(fast[k] == 0);
+            }
+        }
+    }
+    double psnr = 20 * log10(1024.0 * JPEG_DCT_SCALE / sqrt(se / n));
+    // Out by at most one unit of the unscaled coefficient
+    CHECK(max_diff <= JPEG_DCT_SCALE);
+    CHECK(psnr >= 60);
+    return psnr;
+}
+
+static void test_quantize(void)
+{
+    long bad = 0;
+
+    // Every quant table entry (1..255) against dequantized values of both
+    // signs, including exact multiples and halfway points
+    for (int q = 1; q <= 255; q++) {
+        uint16_t div[64];
+        jpeg_qrecip_t rq;
+        for (int k = 0; k < 64; k++) {
+            div[k] = q * JPEG_DCT_SCALE;
+        }
+        jpeg_qrecip_init(&rq, div);
+        for (int v = -16384; v <= 16384; v += 64) {
+            int32_t in[64];
+            int16_t ref[64], fast[64];
+            for (int k = 0; k < 64; k++) {
+                in[k] = v + k;
+            }
+            jpeg_quantize_ref(in, div, ref);
+            jpeg_quantize_fast(in, &rq, fast);
+            bad += memcmp(ref, fast, sizeof(ref)) != 0;
+        }
+    }
+    CHECK(bad == 0);
+}
+
+// Decode at half size and compare the luma with the 2x2 mean of the source
+static double roundtrip_psnr(const uint8_t *jpg, size_t len)
+{
+    static uint8_t half[W * H / 2];
+    int w = 0, h = 0;
+    double se = 0;
+
+    CHECK(jpeg_dc_scale(jpg, len, 2, half, sizeof(half), &w, &h));
+    CHECK(w == W / 2 && h == H / 2);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            const uint8_t *p = &s_luma[2 * y * W + 2 * x];
+            double mean = (p[0] + p[1] + p[W] + p[W + 1]) / 4.0;
+            double d = half[2 * (y * w + x)] - mean;
+            se += d * d;
+        }
+    }
+    return 10 * log10(255.0 * 255.0 / (se / (w * h)));
+}
+
+typedef struct {
+    size_t len;
+    double psnr;
+    double total_mps;
+    jpeg_enc_stats_t stats;
+} encode_result_t;
+
+static encode_result_t encode(bool reference, jpeg_enc_input_t input, int quality)
+{
+    jpeg_encoder_config_t cfg = {
+        .max_width = W,
+        .quality = quality,
+        .reference = reference,
+        .clock_us = test_now_us,
+    };
+    jpeg_encoder_t *enc = jpeg_encoder_create(&cfg);
+    encode_result_t r = { 0 };
+
+    CHECK(enc != NULL);
+    // Too small an output buffer is refused, not overrun, as are frames
+    // wider than configured or of odd width
+    CHECK(jpeg_encode(enc, s_rgb, W, H, JPEG_ENC_RGB565, s_jpg, 4096) == 0);
+    CHECK(jpeg_encode(enc, s_rgb, W + 2, 16, JPEG_ENC_RGB565, s_jpg, sizeof(s_jpg)) == 0);
+    CHECK(jpeg_encode(enc, s_rgb, 641, 16, JPEG_ENC_RGB565, s_jpg, sizeof(s_jpg)) == 0);
+    jpeg_encoder_take_stats(enc, &r.stats);
+
+    int64_t start = test_now_us();
+    for (int i = 0; i < REPS; i++) {
+        r.len = jpeg_encode(enc, input == JPEG_ENC_YUYV ? s_yuyv : s_rgb, W, H, input,
+                            s_jpg, sizeof(s_jpg));
+    }
+    int64_t us = test_now_us() - start;
+    jpeg_encoder_take_stats(enc, &r.stats);
+    CHECK(r.len > 0);
+    CHECK(r.stats.frames == REPS && r.stats.pixels == (uint64_t)W * H * REPS);
+    r.total_mps = (double)r.stats.pixels / us;
+    if (input == JPEG_ENC_RGB565) {
+        r.psnr = roundtrip_psnr(s_jpg, r.len);
+    }
+    jpeg_encoder_destroy(enc);
+    return r;
+}
+
+static double mps(uint64_t pixels, uint64_t us)
+{
+    return us ? (double)pixels / us : 0;
+}
+
+int main(void)
+{
+    make_frame();
+    test_convert();
+    double dct_psnr = test_fdct();
+    test_quantize();
+
+    printf("| kernels | input | quality | bytes | luma PSNR dB | convert MP/s | DCT+quant MP/s | entropy MP/s | total MP/s |\n");
+    printf("|---|---|---|---|---|---|---|---|---|\n");
+    for (int ref = 1; ref >= 0; ref--) {
+        for (int in = 0; in < 2; in++) {
+            for (int q = 50; q <= 90; q += 40) {
+                encode_result_t r = encode(ref, in ? JPEG_ENC_YUYV : JPEG_ENC_RGB565, q);
+                const jpeg_enc_stats_t *s = &r.stats;
+                printf("| %s | %s | %d | %zu | ", ref ? "reference" : "fast", in ? "YUYV" : "RGB565", q, r.len);
+                in ? printf("- | ") : printf("%.1f | ", r.psnr);
+                printf("%.1f | %.1f | %.1f | %.1f |\n", mps(s->pixels, s->convert_us),
+                       mps(s->pixels, s->transform_us), mps(s->pixels, s->entropy_us), r.total_mps);
+                if (!in) {
+                    // The half-size decode tracks the source closely
+                    CHECK(r.psnr >= (q >= 90 ? 45 : 40));
+                }
+            }
+        }
+    }
+
+    // Fast and reference kernels produce practically the same picture
+    encode_result_t ref = encode(true, JPEG_ENC_RGB565, 80);
+    encode_result_t fast = encode(false, JPEG_ENC_RGB565, 80);
+    CHECK(fabs(fast.psnr - ref.psnr) < 0.1);
+    printf("\nFast DCT against the double-precision reference: %.1f dB\n\n", dct_psnr);
+
+    // The DCT-domain decoders on the frame just encoded
+    static uint8_t out[W * H];
+    size_t len = fast.len;
+
+    printf("| decoder | output | MP/s of source |\n|---|---|---|\n");
+    int w, h;
+    int64_t start = test_now_us();
+    for (int i = 0; i < REPS; i++) {
+        CHECK(jpeg_dc_thumbnail(s_jpg, len, out, sizeof(out), &w, &h));
+    }
+    printf("| jpeg_dc_thumbnail | %dx%d | %.1f |\n", w, h, (double)W * H * REPS / (test_now_us() - start));
+    CHECK(w == W / 8 && h == H / 8);
+    for (int scale = 2; scale <= 8; scale *= 2) {
+        start = test_now_us();
+        for (int i = 0; i < REPS; i++) {
+            CHECK(jpeg_dc_scale(s_jpg, len, scale, out, sizeof(out), &w, &h));
+        }
+        printf("| jpeg_dc_scale 1/%d | %dx%d | %.1f |\n", scale, w, h,
+               (double)W * H * REPS / (test_now_us() - start));
+        CHECK(w == W / scale && h == H / scale);
+    }
+
+    // A stream cut in half is refused
+    CHECK(!jpeg_dc_thumbnail(s_jpg, len / 2, out, sizeof(out), &w, &h));
+    return TEST_END();
+}
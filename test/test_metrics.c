@@ -0,0 +1,142 @@
+/*
+ * Runtime metrics - exposition format, bucket edges, wraparound, atomicity
+ *
+ * Renders the metrics into a buffer and looks for the exact lines a
+ * Prometheus scraper would parse. Counters and histogram sums are 32 bits
+ * and wrap, so the test drives one past 2^32. Four threads incrementing the
+ * same counter check that no update is lost.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "test.h"
+
+#define THREADS     4
+#define THREAD_INCS 1000000
+
+static char s_buf[64 * 1024];
+
+// True if the rendered metrics contain line, as a whole line
+static bool has_line(const char *line)
+{
+    size_t len = metrics_format(s_buf, sizeof(s_buf));
+    CHECK(len < sizeof(s_buf));
+
+    size_t n = strlen(line);
+    for (const char *p = s_buf; (p = strstr(p, line)) != NULL; p += n) {
+        if ((p == s_buf || p[-1] == '\n') && p[n] == '\n') {
+            return true;
+        }
+    }
+    fprintf(stderr, "missing: %s\n", line);
+    return false;
+}
+
+static void test_format(void)
+{
+    metrics_reset();
+    CHECK(has_line("# TYPE camera_frames_total counter"));
+    CHECK(has_line("camera_frames_total 0"));
+    CHECK(has_line("# TYPE camera_frame_size_bytes histogram"));
+    CHECK(has_line("camera_frame_size_bytes_bucket{le=\"+Inf\"} 0"));
+
+    // snprintf semantics: the full length comes back whatever fits
+    char small[32];
+    size_t full = metrics_format(NULL, 0);
+    CHECK(full > sizeof(small));
+    CHECK(metrics_format(small, sizeof(small)) == full);
+    CHECK(strlen(small) == sizeof(small) - 1);
+    CHECK(metrics_format(s_buf, sizeof(s_buf)) == full && strlen(s_buf) == full);
+}
+
+static void test_buckets(void)
+{
+    metrics_reset();
+    // Bounds are inclusive upper edges; past the last one is +Inf
+    metrics_observe(METRIC_FRAME_BYTES, 8192);
+    metrics_observe(METRIC_FRAME_BYTES, 8193);
+    metrics_observe(METRIC_FRAME_BYTES, 600000);
+    CHECK(has_line("camera_frame_size_bytes_bucket{le=\"8192\"} 1"));
+    CHECK(has_line("camera_frame_size_bytes_bucket{le=\"16384\"} 2"));
+    CHECK(has_line("camera_frame_size_bytes_bucket{le=\"524288\"} 2"));
+    CHECK(has_line("camera_frame_size_bytes_bucket{le=\"+Inf\"} 3"));
+    CHECK(has_line("camera_frame_size_bytes_sum 616385"));
+    CHECK(has_line("camera_frame_size_bytes_count 3"));
+
+    // Microseconds print as seconds without floating point
+    metrics_observe(METRIC_FB_GET_WAIT_US, 1500);
+    CHECK(has_line("camera_fb_get_wait_seconds_bucket{le=\"0.001000\"} 0"));
+    CHECK(has_line("camera_fb_get_wait_seconds_bucket{le=\"0.002000\"} 1"));
+    CHECK(has_line("camera_fb_get_wait_seconds_sum 0.001500"));
+}
+
+static void test_wrap(void)
+{
+    metrics_reset();
+    metrics_add(METRIC_BYTES_SENT, UINT32_MAX);
+    CHECK(metrics_counter(METRIC_BYTES_SENT) == UINT32_MAX);
+    CHECK(has_line("stream_bytes_sent_total 4294967295"));
+    metrics_add(METRIC_BYTES_SENT, 2);
+    CHECK(metrics_counter(METRIC_BYTES_SENT) == 1);
+    CHECK(has_line("stream_bytes_sent_total 1"));
+
+    // Differences across the wrap still come out right
+    uint32_t before = UINT32_MAX - 10;
+    CHECK((uint32_t)(metrics_counter(METRIC_BYTES_SENT) - before) == 12);
+
+    metrics_observe(METRIC_FRAME_BYTES, UINT32_MAX);
+    metrics_observe(METRIC_FRAME_BYTES, 5);
+    CHECK(has_line("camera_frame_size_bytes_sum 4"));
+    CHECK(has_line("camera_frame_size_bytes_count 2"));
+
+    // Gauges are signed and survive a reset
+    metrics_set(METRIC_STREAM_CLIENTS, -3);
+    metrics_set(METRIC_HEAP_PSRAM_FREE, 8 * 1024 * 1024);
+    metrics_reset();
+    CHECK(has_line("stream_clients -3"));
+    CHECK(has_line("heap_psram_free_bytes 8388608"));
+    CHECK(has_line("stream_bytes_sent_total 0"));
+}
+
+static void *inc_main(void *arg)
+{
+    for (int i = 0; i < THREAD_INCS; i++) {
+        metrics_inc(METRIC_FRAMES_SENT);
+        metrics_observe(METRIC_SEND_CHUNK_US, 200);
+    }
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    pthread_t th[THREADS];
+
+    metrics_reset();
+    int64_t start = test_now_us();
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&th[i], NULL, inc_main, NULL);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(th[i], NULL);
+    }
+    int64_t us = test_now_us() - start;
+
+    CHECK(metrics_counter(METRIC_FRAMES_SENT) == THREADS * THREAD_INCS);
+    CHECK(has_line("stream_send_chunk_seconds_bucket{le=\"0.000500\"} 4000000"));
+    CHECK(has_line("stream_send_chunk_seconds_sum 800.000000"));
+    printf("| threads | updates | ns/update |\n|---|---|---|\n");
+    printf("| %d | %d | %.1f |\n", THREADS, THREADS * THREAD_INCS * 2,
+           us * 1000.0 / (THREADS * THREAD_INCS * 2));
+}
+
+int main(void)
+{
+    test_format();
+    test_buckets();
+    test_wrap();
+    test_concurrent();
+    return TEST_END();
+}
@@ -0,0 +1,233 @@
+/*
+ * MJPEG part writer - bytes and syscalls per frame over a loopback socket
+ *
+ * Streams the same frames over TCP on 127.0.0.1 twice: once the way
+ * httpd_resp_send_chunk() did it (header, payload and boundary as three
+ * chunks, each a length line, the data and a CRLF in separate sends), and
+ * once with mjpeg_part_write(). A reader thread takes the stream apart
+ * again and checks every payload byte. Reports socket bytes and send calls
+ * per frame for each path; TCP/IP headers are not counted.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mjpeg_part.h"
+#include "test.h"
+
+#define FRAMES      40
+
+typedef struct {
+    int fd;
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+} reader_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t calls;
+} tally_t;
+
+static void *reader_main(void *arg)
+{
+    reader_t *r = arg;
+    for (;;) {
+        if (r->len == r->cap) {
+            r->cap = r->cap ? r->cap * 2 : 1 << 20;
+            r->buf = realloc(r->buf, r->cap);
+        }
+        ssize_t n = read(r->fd, r->buf + r->len, r->cap - r->len);
+        if (n <= 0) {
+            return NULL;
+        }
+        r->len += n;
+    }
+}
+
+// Connected pair over loopback TCP; *tx is non-blocking
+static void tcp_pair(int *tx, int *rx, int sndbuf)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t alen = sizeof(addr);
+    int one = 1;
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+
+    bind(lfd, (struct sockaddr *)&addr, sizeof(addr));
+    listen(lfd, 1);
+    getsockname(lfd, (struct sockaddr *)&addr, &alen);
+    *tx = socket(AF_INET, SOCK_STREAM, 0);
+    if (sndbuf) {
+        setsockopt(*tx, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    }
+    setsockopt(*tx, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    connect(*tx, (struct sockaddr *)&addr, sizeof(addr));
+    *rx = accept(lfd, NULL, NULL);
+    close(lfd);
+    fcntl(*tx, F_SETFL, fcntl(*tx, F_GETFL) | O_NONBLOCK);
+}
+
+static void wait_writable(int fd)
+{
+    struct pollfd p = { .fd = fd, .events = POLLOUT };
+    poll(&p, 1, 1000);
+}
+
+// One send() the way httpd_send() loops over a buffer
+static void send_all(int fd, const void *data, size_t len, tally_t *t)
+{
+    const uint8_t *p = data;
+    while (len) {
+        ssize_t n = send(fd, p, len, 0);
+        t->calls++;
+        if (n < 0) {
+            CHECK(errno == EAGAIN);
+            wait_writable(fd);
+            continue;
+        }
+        p += n;
+        len -= n;
+        t->bytes += n;
+    }
+}
+
+static void send_chunk(int fd, const void *data, size_t len, tally_t *t)
+{
+    char line[16];
+    int n = snprintf(line, sizeof(line), "%x\r\n", (unsigned)len);
+    send_all(fd, line, n, t);
+    send_all(fd, data, len, t);
+    send_all(fd, "\r\n", 2, t);
+}
+
+static void frame_fill(uint8_t *buf, size_t len, int frame)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)(i * 7 + frame);
+    }
+}
+
+// Undo chunked encoding in place; returns the decoded length
+static size_t dechunk(uint8_t *buf, size_t len)
+{
+    size_t in = 0, out = 0;
+    while (in < len) {
+        size_t n = strtoul((char *)buf + in, NULL, 16);
+        in = (uint8_t *)strstr((char *)buf + in, "\r\n") - buf + 2;
+        memmove(buf + out, buf + in, n);
+        in += n + 2;
+        out += n;
+    }
+    return out;
+}
+
+// Walk the parts and compare every payload with what was sent
+static int verify(const uint8_t *buf, size_t len, size_t frame_len, uint8_t *expect)
+{
+    size_t pos = 0;
+    int frames = 0;
+    while (pos < len) {
+        const char *cl = strstr((const char *)buf + pos, "Content-Length: ");
+        const char *body = strstr((const char *)buf + pos, "\r\n\r\n");
+        if (!cl || !body || (size_t)atoi(cl + 16) != frame_len) {
+            return -1;
+        }
+        pos = (const uint8_t *)body + 4 - buf;
+        frame_fill(expect, frame_len, frames);
+        if (pos + frame_len + MJPEG_PART_DELIM_LEN > len || memcmp(buf + pos, expect, frame_len) != 0 ||
+            memcmp(buf + pos + frame_len, MJPEG_PART_DELIM, MJPEG_PART_DELIM_LEN) != 0) {
+            return -1;
+        }
+        pos += frame_len + MJPEG_PART_DELIM_LEN;
+        frames++;
+    }
+    return frames;
+}
+
+static void run(size_t frame_len, bool gather, int sndbuf, tally_t *t)
+{
+    uint8_t *frame = malloc(frame_len);
+    int tx, rx;
+    pthread_t th;
+    reader_t r = { 0 };
+
+    tcp_pair(&tx, &rx, sndbuf);
+    r.fd = rx;
+    pthread_create(&th, NULL, reader_main, &r);
+
+    *t = (tally_t){ 0 };
+    for (int f = 0; f < FRAMES; f++) {
+        frame_fill(frame, frame_len, f);
+        mjpeg_part_meta_t meta = { .seq = f + 1, .timestamp_us = 1760000000123456LL + f * 40000 };
+        if (gather) {
+            mjpeg_part_t part;
+            mjpeg_part_init(&part, frame, frame_len, &meta);
+            mjpeg_part_status_t st;
+            while ((st = mjpeg_part_write(&part, tx)) == MJPEG_PART_WOULD_BLOCK) {
+                wait_writable(tx);
+            }
+            CHECK(st == MJPEG_PART_DONE);
+            t->calls += part.writes;
+            t->bytes += part.total;
+        } else {
+            char head[160];
+            size_t hlen = mjpeg_part_head(head, sizeof(head), frame_len, &meta);
+            send_chunk(tx, head, hlen, t);
+            send_chunk(tx, frame, frame_len, t);
+            send_chunk(tx, MJPEG_PART_DELIM, MJPEG_PART_DELIM_LEN, t);
+        }
+    }
+    close(tx);
+    pthread_join(th, NULL);
+    close(rx);
+
+    CHECK(r.len == t->bytes);
+    size_t len = gather ? r.len : dechunk(r.buf, r.len);
+    CHECK(verify(r.buf, len, frame_len, frame) == FRAMES);
+    free(r.buf);
+    free(frame);
+}
+
+int main(void)
+{
+    static const size_t sizes[] = { 20 * 1024, 80 * 1024, 200 * 1024 };
+    // A small send buffer forces partial writes that have to resume
+    static const int sndbufs[] = { 0, 64 * 1024 };
+
+    CHECK(MJPEG_PART_DELIM_LEN == strlen(MJPEG_PART_DELIM));
+
+    printf("| frame KB | SO_SNDBUF | path | bytes/frame | overhead/frame | send calls/frame |\n");
+    printf("|---|---|---|---|---|---|\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t b = 0; b < sizeof(sndbufs) / sizeof(sndbufs[0]); b++) {
+            tally_t chunked, gather;
+            run(sizes[s], false, sndbufs[b], &chunked);
+            run(sizes[s], true, sndbufs[b], &gather);
+            for (int g = 0; g < 2; g++) {
+                tally_t *t = g ? &gather : &chunked;
+                printf("| %zu | %s | %s | %.0f | %.0f | %.1f |\n", sizes[s] / 1024,
+                       sndbufs[b] ? "64 KB" : "default", g ? "gather" : "3 chunks",
+                       (double)t->bytes / FRAMES, (double)t->bytes / FRAMES - sizes[s],
+                       (double)t->calls / FRAMES);
+            }
+            // Chunk framing costs bytes on every part; the gather write sends
+            // exactly header, payload and boundary, in fewer calls
+            CHECK(gather.bytes < chunked.bytes);
+            CHECK(gather.calls < chunked.calls);
+            if (!sndbufs[b]) {
+                CHECK(gather.calls <= FRAMES * 2);
+            }
+        }
+    }
+    return TEST_END();
+}
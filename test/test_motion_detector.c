@@ -0,0 +1,267 @@
+/*
+ * Motion gate - detector cost per frame and stream bytes saved
+ *
+ * Plays clips through the same steps as the firmware: DC thumbnail of each
+ * JPEG, motion_update(), and the /stream rule of sending a frame when its
+ * scene moved on or the client has gone CONFIG_STREAM_MOTION_REFRESH_MS
+ * without one. Reports the detector's cost per frame and how many frames
+ * and bytes the gate kept off the air.
+ *
+ * Without arguments the clips are synthetic, encoded with the software
+ * encoder: a static scene with sensor noise, a person-sized object walking
+ * through it, a slow lighting change and a camera pan. Each has an
+ * expected outcome that is checked. Given a directory of JPEG files (e.g. a
+ * recording split into frames), it runs that clip instead and only reports:
+ *
+ *   test_motion_detector DIR [FPS]
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "jpeg_dc.h"
+#include "jpeg_encoder.h"
+#include "motion_detector.h"
+#include "test.h"
+
+#define W           640
+#define H           480
+#define FPS         25
+#define REFRESH_MS  5000            // Kconfig defaults
+#define THRESHOLD   10
+#define AREA        5
+
+typedef struct {
+    uint32_t frames;
+    uint32_t sent;
+    uint32_t changes;
+    uint64_t bytes;
+    uint64_t bytes_sent;
+    int64_t detect_us;
+    int64_t detect_max_us;
+} gate_t;
+
+typedef struct {
+    motion_t motion;
+    uint8_t *thumb;
+    size_t thumb_cap;
+    uint32_t sent_scene;
+    int64_t sent_at_us;
+    bool sent_any;
+    gate_t g;
+} clip_t;
+
+static uint8_t s_frame[W * H * 2];
+static uint8_t s_jpg[W * H];
+
+static void clip_init(clip_t *c)
+{
+    motion_config_t cfg = { .threshold = THRESHOLD, .area_permille = AREA };
+    memset(c, 0, sizeof(*c));
+    motion_init(&c->motion, &cfg);
+}
+
+// One frame through motion_scene() and the stream handler's gate
+static void clip_frame(clip_t *c, const uint8_t *jpg, size_t len, int64_t now_us)
+{
+    int64_t start = test_now_us();
+    size_t cells = jpeg_dc_cells(jpg, len);
+    int w, h;
+
+    if (cells > c->thumb_cap) {
+        free(c->thumb);
+        c->thumb = malloc(cells);
+        c->thumb_cap = cells;
+    }
+    if (cells && jpeg_dc_thumbnail(jpg, len, c->thumb, c->thumb_cap, &w, &h)) {
+        c->g.changes += motion_update(&c->motion, c->thumb, w, h);
+    } else {
+        motion_force(&c->motion);
+        c->g.changes++;
+    }
+    int64_t us = test_now_us() - start;
+    c->g.detect_us += us;
+    c->g.detect_max_us = us > c->g.detect_max_us ? us : c->g.detect_max_us;
+
+    c->g.frames++;
+    c->g.bytes += len;
+    if (c->sent_any && c->motion.scene == c->sent_scene &&
+        now_us - c->sent_at_us < REFRESH_MS * 1000LL) {
+        return;
+    }
+    c->sent_scene = c->motion.scene;
+    c->sent_at_us = now_us;
+    c->sent_any = true;
+    c->g.sent++;
+    c->g.bytes_sent += len;
+}
+
+static void report(const char *name, const clip_t *c)
+{
+    const gate_t *g = &c->g;
+    printf("| %s | %u | %u | %u | %.1f | %.0f | %.0f | %.0f%% |\n", name, (unsigned)g->frames,
+           (unsigned)g->changes, (unsigned)g->sent, g->bytes / 1024.0 / g->frames,
+           (double)g->detect_us / g->frames, (double)g->detect_max_us,
+           100.0 - 100.0 * g->bytes_sent / g->bytes);
+}
+
+static void put_pixel(uint8_t *img, int x, int y, int r, int g, int b)
+{
+    r = r < 0 ? 0 : r > 255 ? 255 : r;
+    g = g < 0 ? 0 : g > 255 ? 255 : g;
+    b = b < 0 ? 0 : b > 255 ? 255 : b;
+    unsigned v = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    img[2 * (y * W + x)] = v >> 8;
+    img[2 * (y * W + x) + 1] = v & 0xff;
+}
+
+// A room: a gradient wall, a window, some furniture edges and texture,
+// stored as RGB888 values re-packed per frame
+static uint8_t s_scene[H][W * 2][3];
+
+static void make_scene(void)
+{
+    uint32_t r = 5;
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W * 2; x++) {
+            r = r * 1103515245 + 12345;
+            int t = (r >> 16) % 24;
+            int v = 90 + y / 8 + t;
+            int red = v, green = v, blue = v + 10;
+            if (x % W > 400 && x % W < 560 && y > 60 && y < 220) {
+                red = green = 200 + t;  // Window
+                blue = 230;
+            }
+            if (y > 330 && x % 200 < 120) {
+                red = 120 + t;          // Furniture
+                green = 70 + t;
+                blue = 40;
+            }
+            s_scene[y][x][0] = red;
+            s_scene[y][x][1] = green;
+            s_scene[y][x][2] = blue;
+        }
+    }
+}
+
+typedef enum {
+    CLIP_STATIC,
+    CLIP_WALKER,
+    CLIP_LIGHTING,
+    CLIP_PAN,
+} clip_kind_t;
+
+// Frame i of a synthetic clip: the scene shifted by pan pixels, lit by
+// gain/256, with a walker when asked and per-pixel sensor noise
+static void render(clip_kind_t kind, int i, uint32_t *noise)
+{
+    int pan = kind == CLIP_PAN ? i * 4 : 0;
+    int gain = kind == CLIP_LIGHTING ? 256 + i / 2 : 256;
+    bool walker = kind == CLIP_WALKER && i >= 40 && i < 100;
+    int wx = (i - 40) * 10;
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            *noise = *noise * 1103515245 + 12345;
+            int n = (int)((*noise >> 16) % 7) - 3;
+            const uint8_t *p = s_scene[y][(x + pan) % (W * 2)];
+            if (walker && x >= wx && x < wx + 60 && y >= 150 && y < 420) {
+                put_pixel(s_frame, x, y, 40 + n, 50 + n, 80 + n);
+                continue;
+            }
+            put_pixel(s_frame, x, y, p[0] * gain / 256 + n, p[1] * gain / 256 + n,
+                      p[2] * gain / 256 + n);
+        }
+    }
+}
+
+static clip_t run_synthetic(jpeg_encoder_t *enc, const char *name, clip_kind_t kind, int frames)
+{
+    clip_t c;
+    uint32_t noise = 11;
+
+    clip_init(&c);
+    for (int i = 0; i < frames; i++) {
+        render(kind, i, &noise);
+        size_t len = jpeg_encode(enc, s_frame, W, H, JPEG_ENC_RGB565, s_jpg, sizeof(s_jpg));
+        CHECK(len > 0);
+        clip_frame(&c, s_jpg, len, (int64_t)i * 1000000 / FPS);
+    }
+    report(name, &c);
+    free(c.thumb);
+    return c;
+}
+
+static int jpeg_filter(const struct dirent *e)
+{
+    const char *ext = strrchr(e->d_name, '.');
+    return ext && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0);
+}
+
+static int run_dir(const char *dir, int fps)
+{
+    struct dirent **names;
+    int n = scandir(dir, &names, jpeg_filter, alphasort);
+    clip_t c;
+
+    if (n <= 0) {
+        fprintf(stderr, "No JPEG files in %s\n", dir);
+        return 1;
+    }
+    clip_init(&c);
+    for (int i = 0; i < n; i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]->d_name);
+        FILE *f = fopen(path, "rb");
+        size_t len = f ? fread(s_jpg, 1, sizeof(s_jpg), f) : 0;
+        if (f) {
+            fclose(f);
+        }
+        if (len) {
+            clip_frame(&c, s_jpg, len, (int64_t)i * 1000000 / fps);
+        }
+        free(names[i]);
+    }
+    free(names);
+    report(dir, &c);
+    free(c.thumb);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    printf("| clip | frames | scene changes | sent | KB/frame | detect us/frame | detect max us | bytes saved |\n");
+    printf("|---|---|---|---|---|---|---|---|\n");
+    if (argc > 1) {
+        return run_dir(argv[1], argc > 2 ? atoi(argv[2]) : FPS);
+    }
+
+    jpeg_encoder_config_t cfg = { .max_width = W, .quality = 80 };
+    jpeg_encoder_t *enc = jpeg_encoder_create(&cfg);
+    make_scene();
+
+    // Nothing moves: one frame, then one refresh every REFRESH_MS
+    clip_t c = run_synthetic(enc, "static, noise", CLIP_STATIC, 6 * FPS);
+    CHECK(c.g.changes == 1);
+    CHECK(c.g.sent == 2);
+    CHECK(c.g.bytes_sent * 10 < c.g.bytes);
+
+    // Only the frames with the walker in them, and one as it leaves
+    c = run_synthetic(enc, "walker", CLIP_WALKER, 110);
+    CHECK(c.g.changes >= 55 && c.g.changes <= 64);
+    CHECK(c.g.sent <= c.g.changes + 2);
+
+    // A slow fade still moves the reference every few frames
+    c = run_synthetic(enc, "lighting fade", CLIP_LIGHTING, 4 * FPS);
+    CHECK(c.g.changes >= 3 && c.g.changes * 3 < c.g.frames);
+
+    // A pan changes everything: every frame goes out
+    c = run_synthetic(enc, "pan", CLIP_PAN, 2 * FPS);
+    CHECK(c.g.sent >= c.g.frames - 1);
+
+    jpeg_encoder_destroy(enc);
+    return TEST_END();
+}
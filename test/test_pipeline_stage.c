@@ -0,0 +1,262 @@
+/*
+ * Pipeline stages - SPSC queue and stage hand-off under load, with costs
+ *
+ * The queue is run flat out between two threads through a three-slot ring,
+ * so head and tail wrap constantly: every item must come out once and in
+ * order, and the depth must never exceed the capacity. Two stages are then
+ * chained the way the capture pipeline chains them, fed faster than they
+ * drain, with a quick and with a jittery second stage: each stage sees
+ * items in increasing order, and what was refused at either queue plus
+ * what came out the end adds up to what went in. A trickle of single items
+ * makes the worker go to sleep and be woken for almost every one, which
+ * is where a lost wake-up would leave items stuck in the queue. Stopping
+ * a stage must still process what it had queued.
+ *
+ * Build with -fsanitize=thread to have the same runs checked for races:
+ *
+ *   cmake -S test -B build-tsan -DCMAKE_C_FLAGS=-fsanitize=thread
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pipeline_stage.h"
+#include "spsc_queue.h"
+#include "test.h"
+
+#define QUEUE_ITEMS     1000000
+#define CHAIN_ITEMS     200000
+#define TRICKLE_ITEMS   20000
+#define WAIT_US         2000000     // For a stage to finish what it was given
+
+static spsc_queue_t s_queue;
+
+static void *queue_producer(void *arg)
+{
+    for (uintptr_t i = 1; i <= QUEUE_ITEMS; i++) {
+        while (!spsc_queue_push(&s_queue, (void *)i)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void test_queue(void)
+{
+    void *item = (void *)1;
+
+    // Full at capacity, empty after as many pops, in the order pushed
+    CHECK(spsc_queue_init(&s_queue, 3) && spsc_queue_capacity(&s_queue) == 3);
+    CHECK(spsc_queue_pop(&s_queue) == NULL);
+    for (uintptr_t i = 1; i <= 3; i++) {
+        CHECK(spsc_queue_push(&s_queue, (void *)i));
+    }
+    CHECK(!spsc_queue_push(&s_queue, item) && spsc_queue_depth(&s_queue) == 3);
+    for (uintptr_t i = 1; i <= 3; i++) {
+        CHECK(spsc_queue_pop(&s_queue) == (void *)i);
+    }
+    CHECK(spsc_queue_pop(&s_queue) == NULL && spsc_queue_depth(&s_queue) == 0);
+
+    pthread_t thread;
+    uintptr_t want = 1;
+    uint32_t bad = 0, empty = 0;
+    int64_t start = test_now_us();
+    CHECK(pthread_create(&thread, NULL, queue_producer, NULL) == 0);
+    while (want <= QUEUE_ITEMS) {
+        item = spsc_queue_pop(&s_queue);
+        if (!item) {
+            empty++;
+            sched_yield();
+            continue;
+        }
+        bad += (uintptr_t)item != want++;
+        bad += spsc_queue_depth(&s_queue) > 3;
+    }
+    pthread_join(thread, NULL);
+    int64_t us = test_now_us() - start;
+    CHECK(bad == 0);
+    CHECK(spsc_queue_pop(&s_queue) == NULL);
+    spsc_queue_free(&s_queue);
+
+    printf("| queue | items | ns/item | pops on empty |\n|---|---|---|---|\n");
+    printf("| 3 slots, 2 threads | %d | %.1f | %u |\n\n", QUEUE_ITEMS, us * 1000.0 / QUEUE_ITEMS,
+           empty);
+}
+
+// Two chained stages: a forwards to b, b is the end of the line
+typedef struct {
+    pipeline_stage_t *next;
+    uintptr_t last;                 // Highest item seen, for the order check
+    uint32_t out_of_order;
+    uint32_t forwarded;
+    uint32_t dropped;               // Refused by next
+    uint32_t done;
+    bool jitter;
+} chain_t;
+
+static void spin(unsigned n)
+{
+    volatile unsigned x = 0;
+    for (unsigned i = 0; i < n; i++) {
+        x += i;
+    }
+}
+
+static void chain_process(void *item, void *arg)
+{
+    chain_t *c = arg;
+    uintptr_t v = (uintptr_t)item;
+
+    c->out_of_order += v <= c->last;
+    c->last = v;
+    if (c->jitter) {
+        spin((v * 2654435761u) % 2000);
+    }
+    if (c->next) {
+        if (pipeline_stage_submit(c->next, item)) {
+            c->forwarded++;
+        } else {
+            c->dropped++;
+        }
+    }
+    c->done++;
+}
+
+// Collect a stage's stats until it has processed want items, or give up.
+// The stage's own fields are only read after pipeline_stage_stop().
+static bool wait_items(pipeline_stage_t *st, pipeline_stage_stats_t *total, uint32_t want)
+{
+    int64_t until = test_now_us() + WAIT_US;
+    pipeline_stage_stats_t s;
+
+    *total = (pipeline_stage_stats_t){ 0 };
+    for (;;) {
+        pipeline_stage_take_stats(st, &s);
+        total->items += s.items;
+        total->refused += s.refused;
+        total->max_depth = s.max_depth > total->max_depth ? s.max_depth : total->max_depth;
+        total->busy_us += s.busy_us;
+        if (total->items >= want || test_now_us() > until) {
+            return total->items == want;
+        }
+        usleep(100);
+    }
+}
+
+static void run_chain(const char *name, bool jitter)
+{
+    chain_t b = { .jitter = jitter };
+    chain_t a = { 0 };
+    pipeline_stage_config_t bcfg = {
+        .name = "b", .process = chain_process, .arg = &b, .queue_len = 2, .clock_us = test_now_us,
+    };
+    a.next = pipeline_stage_start(&bcfg);
+    pipeline_stage_config_t acfg = {
+        .name = "a", .process = chain_process, .arg = &a, .queue_len = 4, .clock_us = test_now_us,
+    };
+    pipeline_stage_t *sa = pipeline_stage_start(&acfg);
+    CHECK(sa && a.next);
+    if (!sa || !a.next) {
+        return;
+    }
+
+    uint32_t refused = 0;
+    int64_t start = test_now_us();
+    for (uintptr_t i = 1; i <= CHAIN_ITEMS; i++) {
+        refused += !pipeline_stage_submit(sa, (void *)i);
+        // Hand the CPU over now and then, so that on a single core the
+        // stages get to run between submits and not only once it is over
+        if (i % 4 == 0) {
+            sched_yield();
+        }
+    }
+    pipeline_stage_stats_t sta, stb;
+    CHECK(wait_items(sa, &sta, CHAIN_ITEMS - refused));
+    pipeline_stage_stop(sa);
+    CHECK(wait_items(a.next, &stb, a.forwarded));
+    pipeline_stage_stop(a.next);
+    int64_t us = test_now_us() - start;
+
+    // Nothing lost, nothing twice, nothing reordered
+    uint32_t delivered = b.done;
+    CHECK(a.out_of_order == 0 && b.out_of_order == 0);
+    CHECK(refused + a.dropped + delivered == CHAIN_ITEMS);
+    CHECK(sta.refused == refused);
+    CHECK(stb.items == delivered && stb.refused == a.dropped);
+    CHECK(sta.max_depth <= 4 && stb.max_depth <= 2);
+
+    printf("| %s | %d | %u | %u | %u | %u/%u | %.0f%% | %.0f |\n", name, CHAIN_ITEMS, refused,
+           a.dropped, delivered, sta.max_depth, stb.max_depth, 100.0 * stb.busy_us / us,
+           delivered / (us / 1e6));
+}
+
+static void test_trickle(void)
+{
+    chain_t c = { 0 };
+    pipeline_stage_config_t cfg = {
+        .name = "t", .process = chain_process, .arg = &c, .queue_len = 1, .clock_us = test_now_us,
+    };
+    pipeline_stage_t *st = pipeline_stage_start(&cfg);
+    CHECK(st != NULL);
+    if (!st) {
+        return;
+    }
+
+    // One item at a time, mostly into an empty queue and a sleeping worker
+    uint32_t retries = 0;
+    int64_t start = test_now_us();
+    for (uintptr_t i = 1; i <= TRICKLE_ITEMS; i++) {
+        while (!pipeline_stage_submit(st, (void *)i)) {
+            retries++;
+            sched_yield();
+        }
+        if (i % 3 == 0) {
+            usleep(1);
+        }
+    }
+    pipeline_stage_stats_t stats;
+    CHECK(wait_items(st, &stats, TRICKLE_ITEMS));
+    int64_t us = test_now_us() - start;
+    pipeline_stage_stop(st);
+    CHECK(stats.refused == retries && stats.max_depth <= 1);
+    CHECK(c.done == TRICKLE_ITEMS && c.out_of_order == 0);
+    printf("\nTrickle: %d items through a one-slot stage in %.0f ms, %u submits refused\n",
+           TRICKLE_ITEMS, us / 1000.0, retries);
+}
+
+static void test_stop(void)
+{
+    chain_t c = { .jitter = true };
+    pipeline_stage_config_t cfg = { .name = "s", .process = chain_process, .arg = &c, .queue_len = 8 };
+    pipeline_stage_t *st = pipeline_stage_start(&cfg);
+    CHECK(st != NULL);
+    if (!st) {
+        return;
+    }
+
+    // Whatever was accepted is processed before stop returns
+    uint32_t accepted = 0;
+    for (uintptr_t i = 1; i <= 100; i++) {
+        accepted += pipeline_stage_submit(st, (void *)i);
+    }
+    pipeline_stage_stop(st);
+    CHECK(accepted >= 8 && c.done == accepted && c.out_of_order == 0);
+}
+
+int main(void)
+{
+    test_queue();
+
+    printf("| chain | submitted | refused at a | refused at b | delivered | max depth a/b | b busy | items/s |\n");
+    printf("|---|---|---|---|---|---|---|---|\n");
+    run_chain("quick b", false);
+    run_chain("jittery b", true);
+
+    test_trickle();
+    test_stop();
+    return TEST_END();
+}
@@ -0,0 +1,460 @@
+/*
+ * Replay pipeline - frame source, hub and MJPEG senders on a Linux host
+ *
+ * The firmware's capture -> hub -> /stream path, built from the same
+ * modules: frame_source_replay plays a directory of JPEG files, a capture
+ * thread copies each frame into a hub slot the way camera_capture does, and
+ * every /stream connection gets a sender thread that writes parts with
+ * mjpeg_part_write() and waits for writability when the socket is full.
+ *
+ * Without arguments it writes synthetic JPEGs to a temporary directory,
+ * streams them to 1, 2 and 4 loopback clients and checks every part byte
+ * for byte. Given a directory it serves /stream and a stand-in / until
+ * killed, for the load generator:
+ *
+ *   test_replay_stream DIR [PORT [FPS]]
+ *   python3 tools/stream_loadgen.py 127.0.0.1 --port 8080 -n 4 --probe /
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frame_hub.h"
+#include "frame_source.h"
+#include "metrics.h"
+#include "mjpeg_part.h"
+#include "test.h"
+
+#define MAX_CLIENTS     8
+#define TEST_FILES      8
+#define TEST_FPS        30
+#define TEST_RUN_US     2000000
+#define MAX_SAMPLES     1024
+
+// As STREAM_HTTP_HEAD in stream_sender.c
+static const char STREAM_HTTP_HEAD[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: " MJPEG_CONTENT_TYPE "\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+typedef struct {
+    frame_hub_t *hub;
+    frame_source_t *src;
+    int lfd;
+    int port;
+    volatile bool stop;
+    pthread_t capture;
+    pthread_t accept;
+} server_t;
+
+typedef struct {
+    server_t *srv;
+    int fd;
+} session_t;
+
+// Wall clock minus the monotonic clock, clock_sync_offset_us() on the host
+static int64_t clock_offset_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - test_now_us();
+}
+
+static void *capture_main(void *arg)
+{
+    server_t *srv = arg;
+
+    while (!srv->stop) {
+        camera_fb_t *fb = srv->src->get(srv->src);
+        if (!fb) {
+            metrics_inc(METRIC_CAPTURE_FAILED);
+            usleep(10000);
+            continue;
+        }
+        metrics_inc(METRIC_FRAMES_CAPTURED);
+        hub_frame_t *frame = frame_hub_acquire(srv->hub, fb->len);
+        if (frame) {
+            memcpy(frame->buf, fb->buf, fb->len);
+            frame->len = fb->len;
+            frame->width = fb->width;
+            frame->height = fb->height;
+            frame->format = fb->format;
+            frame->timestamp = fb->timestamp;
+            frame->wall_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec +
+                             clock_offset_us();
+        } else {
+            metrics_inc(METRIC_FRAMES_OVERRUN);
+        }
+        srv->src->put(srv->src, fb);
+        if (frame) {
+            frame_hub_publish(srv->hub, frame);
+        }
+    }
+    return NULL;
+}
+
+static bool wait_writable(server_t *srv, int fd)
+{
+    struct pollfd p = { .fd = fd, .events = POLLOUT };
+    while (!srv->stop) {
+        int n = poll(&p, 1, 100);
+        if (n > 0) {
+            return !(p.revents & (POLLERR | POLLHUP));
+        }
+    }
+    return false;
+}
+
+static void *session_main(void *arg)
+{
+    session_t *s = arg;
+    server_t *srv = s->srv;
+    char req[1024];
+    size_t len = 0;
+
+    // Request head, then nothing more is read from the client
+    while (len < sizeof(req) - 1) {
+        ssize_t n = recv(s->fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+    req[len] = '\0';
+
+    frame_sub_t *sub = NULL;
+    if (strncmp(req, "GET / ", 6) == 0) {
+        // Stands in for the index page, for --probe / and index_latency.py
+        static const char index[] =
+            "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 32\r\n"
+            "Connection: close\r\n\r\n<html><img src=\"/stream\"></html>";
+        send(s->fd, index, sizeof(index) - 1, MSG_NOSIGNAL);
+    } else if (strncmp(req, "GET /stream ", 12) != 0) {
+        static const char not_found[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        send(s->fd, not_found, sizeof(not_found) - 1, MSG_NOSIGNAL);
+    } else if ((sub = frame_hub_subscribe(srv->hub)) == NULL) {
+        static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+        send(s->fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+    } else if (send(s->fd, STREAM_HTTP_HEAD, sizeof(STREAM_HTTP_HEAD) - 1, MSG_NOSIGNAL) < 0) {
+        frame_hub_unsubscribe(sub);
+        sub = NULL;
+    }
+
+    bool open = sub != NULL;
+    while (open && !srv->stop) {
+        hub_frame_t *frame = frame_hub_wait(sub, pdMS_TO_TICKS(100));
+        if (!frame) {
+            continue;
+        }
+        mjpeg_part_meta_t meta = {
+            .seq = frame->seq,
+            .timestamp_us = frame->wall_us,
+            .clock_offset_us = clock_offset_us(),
+        };
+        mjpeg_part_t part;
+        mjpeg_part_init(&part, frame->buf, frame->len, &meta);
+        mjpeg_part_status_t st;
+        while ((st = mjpeg_part_write(&part, s->fd)) == MJPEG_PART_WOULD_BLOCK) {
+            if (!wait_writable(srv, s->fd)) {
+                st = MJPEG_PART_ERROR;
+                break;
+            }
+        }
+        if (st == MJPEG_PART_DONE) {
+            metrics_inc(METRIC_FRAMES_SENT);
+            metrics_add(METRIC_BYTES_SENT, part.total);
+        } else {
+            open = false;
+        }
+        frame_hub_release(frame);
+    }
+
+    if (sub) {
+        frame_hub_unsubscribe(sub);
+    }
+    close(s->fd);
+    free(s);
+    return NULL;
+}
+
+static void *accept_main(void *arg)
+{
+    server_t *srv = arg;
+
+    while (!srv->stop) {
+        int fd = accept(srv->lfd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        session_t *s = malloc(sizeof(*s));
+        pthread_t th;
+        s->srv = srv;
+        s->fd = fd;
+        pthread_create(&th, NULL, session_main, s);
+        pthread_detach(th);
+    }
+    return NULL;
+}
+
+static bool server_start(server_t *srv, const char *dir, int port, int fps)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t alen = sizeof(addr);
+    int one = 1;
+
+    *srv = (server_t){ 0 };
+    srv->src = frame_source_replay_create(dir, fps);
+    srv->hub = frame_hub_create(MAX_CLIENTS, 1);
+    srv->lfd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(srv->lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (!srv->src || !srv->hub || bind(srv->lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(srv->lfd, MAX_CLIENTS) < 0) {
+        fprintf(stderr, "Cannot start the replay server on port %d: %s\n", port, strerror(errno));
+        return false;
+    }
+    getsockname(srv->lfd, (struct sockaddr *)&addr, &alen);
+    srv->port = ntohs(addr.sin_port);
+    pthread_create(&srv->capture, NULL, capture_main, srv);
+    pthread_create(&srv->accept, NULL, accept_main, srv);
+    return true;
+}
+
+static void server_stop(server_t *srv)
+{
+    srv->stop = true;
+    shutdown(srv->lfd, SHUT_RDWR);
+    pthread_join(srv->accept, NULL);
+    pthread_join(srv->capture, NULL);
+    close(srv->lfd);
+    usleep(200000);                 // Sessions notice stop within 100 ms
+}
+
+// Test client side
+
+typedef struct {
+    uint8_t *data[TEST_FILES];
+    size_t len[TEST_FILES];
+} corpus_t;
+
+typedef struct {
+    int port;
+    const corpus_t *corpus;
+    uint32_t frames;
+    uint64_t bytes;
+    uint32_t corrupt;
+    uint32_t out_of_order;
+    uint32_t skipped;               // Sequence gaps
+    int64_t latency_us[MAX_SAMPLES];
+    uint32_t samples;
+} client_t;
+
+// A baseline JPEG skeleton: SOI, a COM segment carrying the file index,
+// SOF0, SOS, entropy-coded filler without 0xFF, EOI
+static size_t make_jpeg(uint8_t *p, size_t len, int index)
+{
+    static const uint8_t sof_sos[] = {
+        0xFF, 0xC0, 0x00, 0x0B, 0x08, 0x01, 0xE0, 0x02, 0x80, 0x01, 0x01, 0x11, 0x00,
+        0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3F, 0x00,
+    };
+    size_t pos = 0;
+    uint32_t r = index * 2654435761u + 1;
+
+    p[pos++] = 0xFF;
+    p[pos++] = 0xD8;
+    p[pos++] = 0xFF;
+    p[pos++] = 0xFE;
+    p[pos++] = 0x00;
+    p[pos++] = 0x03;
+    p[pos++] = (uint8_t)index;
+    memcpy(p + pos, sof_sos, sizeof(sof_sos));
+    pos += sizeof(sof_sos);
+    while (pos < len - 2) {
+        r = r * 1103515245 + 12345;
+        p[pos++] = (uint8_t)((r >> 16) % 0xFF);
+    }
+    p[pos++] = 0xFF;
+    p[pos++] = 0xD9;
+    return pos;
+}
+
+static bool part_valid(const client_t *c, const uint8_t *body, size_t len)
+{
+    if (len < 8 || body[0] != 0xFF || body[1] != 0xD8 || body[2] != 0xFF || body[3] != 0xFE) {
+        return false;
+    }
+    int index = body[6];
+    return index < TEST_FILES && c->corpus->len[index] == len &&
+           memcmp(body, c->corpus->data[index], len) == 0;
+}
+
+static void *client_main(void *arg)
+{
+    client_t *c = arg;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(c->port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    char line[256];
+    uint8_t *body = malloc(1 << 20);
+    uint32_t last_seq = 0;
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        CHECK(false);
+        close(fd);
+        free(body);
+        return NULL;
+    }
+    static const char req[] = "GET /stream HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    send(fd, req, sizeof(req) - 1, 0);
+    FILE *f = fdopen(fd, "rb");
+
+    CHECK(fgets(line, sizeof(line), f) && strcmp(line, "HTTP/1.1 200 OK\r\n") == 0);
+    while (fgets(line, sizeof(line), f) && strcmp(line, "\r\n") != 0) {
+    }
+
+    int64_t end = test_now_us() + TEST_RUN_US;
+    while (test_now_us() < end) {
+        size_t len = 0;
+        uint32_t seq = 0;
+        long long sec = 0, usec = 0;
+        while (fgets(line, sizeof(line), f) && strcmp(line, "\r\n") != 0) {
+            sscanf(line, "Content-Length: %zu", &len);
+            sscanf(line, "X-Sequence: %u", &seq);
+            sscanf(line, "X-Timestamp: %lld.%lld", &sec, &usec);
+        }
+        if (!len || len > (1 << 20) || fread(body, 1, len, f) != len ||
+            fread(line, 1, MJPEG_PART_DELIM_LEN, f) != MJPEG_PART_DELIM_LEN) {
+            c->corrupt++;
+            break;
+        }
+        int64_t latency = test_now_us() + clock_offset_us() - (sec * 1000000 + usec);
+
+        c->frames++;
+        c->bytes += len;
+        c->corrupt += !part_valid(c, body, len) ||
+                      memcmp(line, MJPEG_PART_DELIM, MJPEG_PART_DELIM_LEN) != 0;
+        c->out_of_order += seq <= last_seq;
+        c->skipped += last_seq && seq > last_seq + 1 ? seq - last_seq - 1 : 0;
+        last_seq = seq;
+        if (c->samples < MAX_SAMPLES) {
+            c->latency_us[c->samples++] = latency;
+        }
+    }
+    fclose(f);
+    free(body);
+    return NULL;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(int port, const corpus_t *corpus, int n)
+{
+    static client_t c[MAX_CLIENTS];
+    static int64_t all[MAX_CLIENTS * MAX_SAMPLES];
+    pthread_t th[MAX_CLIENTS];
+    size_t samples = 0;
+    uint64_t bytes = 0;
+    double fps_min = 1e9, fps_max = 0;
+
+    for (int i = 0; i < n; i++) {
+        c[i] = (client_t){ .port = port, .corpus = corpus };
+        pthread_create(&th[i], NULL, client_main, &c[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_join(th[i], NULL);
+        double fps = c[i].frames * 1e6 / TEST_RUN_US;
+        fps_min = fps < fps_min ? fps : fps_min;
+        fps_max = fps > fps_max ? fps : fps_max;
+        bytes += c[i].bytes;
+        memcpy(all + samples, c[i].latency_us, c[i].samples * sizeof(int64_t));
+        samples += c[i].samples;
+
+        // Every part is one of the files, whole, in publish order, and a
+        // client keeping up sees nearly every frame the source played
+        CHECK(c[i].corrupt == 0);
+        CHECK(c[i].out_of_order == 0);
+        CHECK(fps >= TEST_FPS * 0.85);
+    }
+    qsort(all, samples, sizeof(all[0]), cmp_i64);
+    printf("| %d | %.1f | %.1f | %.2f | %.2f | %.2f |\n", n, fps_min, fps_max,
+           samples ? all[samples / 2] / 1000.0 : 0, samples ? all[samples * 99 / 100] / 1000.0 : 0,
+           bytes / (TEST_RUN_US / 1e6) / 1e6);
+}
+
+static int self_test(void)
+{
+    char dir[] = "/tmp/replay_stream_XXXXXX";
+    corpus_t corpus;
+    server_t srv;
+
+    CHECK(mkdtemp(dir) != NULL);
+    for (int i = 0; i < TEST_FILES; i++) {
+        char path[64];
+        size_t len = (12 + i * 4) * 1024;
+        corpus.data[i] = malloc(len);
+        corpus.len[i] = make_jpeg(corpus.data[i], len, i);
+        snprintf(path, sizeof(path), "%s/%02d.jpg", dir, i);
+        FILE *f = fopen(path, "wb");
+        fwrite(corpus.data[i], 1, corpus.len[i], f);
+        fclose(f);
+    }
+
+    if (!server_start(&srv, dir, 0, TEST_FPS)) {
+        return 1;
+    }
+    printf("| clients | min fps | max fps | p50 latency ms | p99 latency ms | total MB/s |\n");
+    printf("|---|---|---|---|---|---|\n");
+    for (int n = 1; n <= 4; n *= 2) {
+        run(srv.port, &corpus, n);
+    }
+    server_stop(&srv);
+
+    for (int i = 0; i < TEST_FILES; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s/%02d.jpg", dir, i);
+        unlink(path);
+        free(corpus.data[i]);
+    }
+    rmdir(dir);
+    return TEST_END();
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    if (argc < 2) {
+        return self_test();
+    }
+
+    server_t srv;
+    int port = argc > 2 ? atoi(argv[2]) : 8080;
+    int fps = argc > 3 ? atoi(argv[3]) : TEST_FPS;
+    if (!server_start(&srv, argv[1], port, fps)) {
+        return 1;
+    }
+    printf("Serving %s at %d fps on http://127.0.0.1:%d/stream\n", argv[1], fps, srv.port);
+    for (;;) {
+        pause();
+    }
+}
@@ -0,0 +1,296 @@
+/*
+ * RTSP and RTP/JPEG - a client session end to end, packets over loopback
+ *
+ * Drives rtsp_parse_request() and rtsp_respond() through the conversation
+ * an NVR has with the camera: OPTIONS, DESCRIBE, SETUP (TCP interleaved
+ * refused, UDP accepted), PLAY, keepalive, TEARDOWN, with the state and
+ * the lines of every response checked, and requests that are partial,
+ * malformed, or for the wrong session.
+ *
+ * A JPEG from the software encoder is then sent with rtp_jpeg_send() to a
+ * loopback UDP socket at several MTUs, down to the smallest one the
+ * stream accepts, and the packets reassembled: sequence numbers and
+ * fragment offsets contiguous, tables in the first packet only, the
+ * marker on the last, no packet over the MTU and the scan intact.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "jpeg_encoder.h"
+#include "rtp_jpeg.h"
+#include "rtsp_proto.h"
+#include "test.h"
+
+#define W           640
+#define H           480
+#define SESSION     0xDEADBEEF
+
+static const rtsp_env_t s_env = {
+    .local_ip = "192.168.1.5",
+    .server_rtp_port = 5004,
+    .new_session = SESSION,
+};
+
+static char s_out[1024];
+
+// Parse req and respond to it on c; the response lands in s_out
+static size_t exchange(rtsp_conn_t *c, const char *req, rtsp_method_t method)
+{
+    rtsp_request_t r;
+    int used = rtsp_parse_request(req, strlen(req), &r);
+
+    CHECK(used == (int)strlen(req));
+    CHECK(r.method == method);
+    if (used <= 0) {
+        s_out[0] = '\0';
+        return 0;
+    }
+    size_t n = rtsp_respond(c, &r, &s_env, s_out, sizeof(s_out));
+    CHECK(n > 0 && n == strlen(s_out));
+    return n;
+}
+
+// True if the last response has line, as a whole CRLF-terminated line
+static bool has_line(const char *line)
+{
+    size_t n = strlen(line);
+    for (const char *p = s_out; (p = strstr(p, line)) != NULL; p += n) {
+        if ((p == s_out || p[-1] == '\n') && !strncmp(p + n, "\r\n", 2)) {
+            return true;
+        }
+    }
+    fprintf(stderr, "missing: %s\n", line);
+    return false;
+}
+
+static void test_session(void)
+{
+    rtsp_conn_t c = { 0 };
+
+    exchange(&c, "OPTIONS rtsp://cam/ RTSP/1.0\r\nCSeq: 1\r\n\r\n", RTSP_OPTIONS);
+    CHECK(has_line("RTSP/1.0 200 OK") && has_line("CSeq: 1"));
+    CHECK(has_line("Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER"));
+    CHECK(c.state == RTSP_STATE_INIT && c.session == 0);
+
+    exchange(&c, "DESCRIBE rtsp://cam RTSP/1.0\r\nCSeq: 2\r\nAccept: application/sdp\r\n\r\n",
+             RTSP_DESCRIBE);
+    CHECK(has_line("RTSP/1.0 200 OK") && has_line("CSeq: 2"));
+    CHECK(has_line("Content-Base: rtsp://cam/") && has_line("Content-Type: application/sdp"));
+    CHECK(has_line("m=video 0 RTP/AVP 26") && has_line("a=rtpmap:26 JPEG/90000"));
+    CHECK(has_line("o=- 3735928559 1 IN IP4 192.168.1.5") && has_line("a=control:track1"));
+    const char *body = strstr(s_out, "\r\n\r\n");
+    int content_length = 0;
+    sscanf(strstr(s_out, "Content-Length:"), "Content-Length: %d", &content_length);
+    CHECK(body && strlen(body + 4) == (size_t)content_length);
+
+    // RTP over TCP only: refused, so the client retries with UDP
+    exchange(&c, "SETUP rtsp://cam/track1 RTSP/1.0\r\nCSeq: 3\r\n"
+             "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n\r\n", RTSP_SETUP);
+    CHECK(has_line("RTSP/1.0 461 Unsupported Transport"));
+    CHECK(c.state == RTSP_STATE_INIT && c.session == 0);
+
+    // Both offered: the UDP option is taken
+    exchange(&c, "SETUP rtsp://cam/track1 RTSP/1.0\r\nCSeq: 4\r\n"
+             "Transport: RTP/AVP/TCP;interleaved=0-1,RTP/AVP;unicast;client_port=6000-6001\r\n\r\n",
+             RTSP_SETUP);
+    CHECK(has_line("RTSP/1.0 200 OK") && has_line("Session: DEADBEEF;timeout=60"));
+    CHECK(has_line("Transport: RTP/AVP;unicast;client_port=6000-6001;server_port=5004-5005;ssrc=DEADBEEF"));
+    CHECK(c.state == RTSP_STATE_READY && c.session == SESSION);
+    CHECK(c.client_rtp_port == 6000 && c.client_rtcp_port == 6001);
+
+    // Another session's PLAY changes nothing
+    exchange(&c, "PLAY rtsp://cam/ RTSP/1.0\r\nCSeq: 5\r\nSession: 1234\r\n\r\n", RTSP_PLAY);
+    CHECK(has_line("RTSP/1.0 454 Session Not Found") && has_line("CSeq: 5"));
+    CHECK(c.state == RTSP_STATE_READY);
+
+    exchange(&c, "PLAY rtsp://cam/ RTSP/1.0\r\nCSeq: 6\r\nSession: DEADBEEF\r\n\r\n", RTSP_PLAY);
+    CHECK(has_line("RTSP/1.0 200 OK") && has_line("Range: npt=0.000-"));
+    CHECK(c.state == RTSP_STATE_PLAYING);
+
+    // Keepalive, header names in any case, with a body to skip
+    exchange(&c, "GET_PARAMETER rtsp://cam/ RTSP/1.0\r\nCSeq: 7\r\nsession: deadbeef\r\n"
+             "Content-Length: 5\r\n\r\nhello", RTSP_GET_PARAMETER);
+    CHECK(has_line("RTSP/1.0 200 OK") && has_line("Session: DEADBEEF;timeout=60"));
+    CHECK(c.state == RTSP_STATE_PLAYING);
+
+    exchange(&c, "ANNOUNCE rtsp://cam/ RTSP/1.0\r\nCSeq: 8\r\n\r\n", RTSP_UNKNOWN);
+    CHECK(has_line("RTSP/1.0 501 Not Implemented"));
+
+    exchange(&c, "PAUSE rtsp://cam/ RTSP/1.0\r\nCSeq: 9\r\nSession: DEADBEEF\r\n\r\n", RTSP_PAUSE);
+    CHECK(has_line("RTSP/1.0 200 OK") && c.state == RTSP_STATE_READY);
+
+    exchange(&c, "TEARDOWN rtsp://cam/ RTSP/1.0\r\nCSeq: 10\r\nSession: DEADBEEF\r\n\r\n",
+             RTSP_TEARDOWN);
+    CHECK(has_line("RTSP/1.0 200 OK") && has_line("CSeq: 10"));
+    CHECK(c.state == RTSP_STATE_INIT && c.session == 0);
+
+    // The session is gone
+    exchange(&c, "PLAY rtsp://cam/ RTSP/1.0\r\nCSeq: 11\r\nSession: DEADBEEF\r\n\r\n", RTSP_PLAY);
+    CHECK(has_line("RTSP/1.0 454 Session Not Found"));
+    CHECK(c.state == RTSP_STATE_INIT);
+}
+
+static void test_parse(void)
+{
+    rtsp_request_t r;
+
+    // Not complete yet: headers unterminated, or the body still short
+    const char *partial = "PLAY rtsp://cam/ RTSP/1.0\r\nCSeq: 1\r\n";
+    CHECK(rtsp_parse_request(partial, strlen(partial), &r) == 0);
+    const char *short_body = "GET_PARAMETER rtsp://cam/ RTSP/1.0\r\nCSeq: 2\r\n"
+                             "Content-Length: 10\r\n\r\nhello";
+    CHECK(rtsp_parse_request(short_body, strlen(short_body), &r) == 0);
+
+    const char *garbage = "garbage\r\n\r\n";
+    CHECK(rtsp_parse_request(garbage, strlen(garbage), &r) == -1);
+
+    // Two pipelined requests: the first is consumed on its own
+    const char *two = "OPTIONS rtsp://cam/ RTSP/1.0\r\nCSeq: 3\r\n\r\n"
+                      "OPTIONS rtsp://cam/ RTSP/1.0\r\nCSeq: 4\r\n\r\n";
+    int used = rtsp_parse_request(two, strlen(two), &r);
+    CHECK(used == (int)strlen(two) / 2 && r.cseq == 3);
+    CHECK(rtsp_parse_request(two + used, strlen(two + used), &r) == used && r.cseq == 4);
+
+    // A URI longer than the request can hold is malformed, not truncated
+    char long_uri[300];
+    snprintf(long_uri, sizeof(long_uri), "DESCRIBE rtsp://cam/%0200d RTSP/1.0\r\nCSeq: 5\r\n\r\n", 0);
+    CHECK(rtsp_parse_request(long_uri, strlen(long_uri), &r) == -1);
+}
+
+static uint8_t s_jpg[W * H];
+static uint8_t s_scan[W * H];
+static uint8_t s_pkt[2048];
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// Send f at this mtu to a loopback socket and put it back together.
+// Returns the packet count, or -1 if anything about the packets was off.
+static int send_and_reassemble(const rtp_jpeg_frame_t *f, size_t mtu, int tx, int rx,
+                               const struct sockaddr_in *dest)
+{
+    rtp_stream_t s;
+    uint16_t seq = 65530;           // Wraps during the frame
+    int bad = 0, packets = 0;
+    size_t scan = 0;
+    bool marker = false;
+
+    CHECK(rtp_stream_init(&s, tx, dest, SESSION, seq, mtu));
+    int sent = rtp_jpeg_send(&s, f, 90000);
+    CHECK(sent > 0);
+
+    while (!marker && packets < sent) {
+        ssize_t n = recv(rx, s_pkt, sizeof(s_pkt), 0);
+        if (n < 0) {
+            return -1;
+        }
+        const uint8_t *p = s_pkt;
+        size_t hdr = 12 + 8 + (f->type >= 64 ? 4 : 0);
+        bool first = packets == 0;
+        bad += (size_t)n > mtu;
+        bad += p[0] != 0x80 || (p[1] & 0x7f) != RTP_PT_JPEG;
+        bad += (uint16_t)(p[2] << 8 | p[3]) != (uint16_t)(seq + packets);
+        bad += be32(p + 4) != 90000 || be32(p + 8) != SESSION;
+        bad += (be32(p + 12) & 0xffffff) != scan;
+        bad += p[16] != f->type || p[17] != 255 || p[18] != f->width8 || p[19] != f->height8;
+        if (first) {
+            bad += p[hdr + 2] != 0 || p[hdr + 3] != 128;
+            bad += memcmp(p + hdr + 4, f->qt[0], 64) || memcmp(p + hdr + 68, f->qt[1], 64);
+            hdr += 4 + 128;
+        }
+        memcpy(s_scan + scan, p + hdr, n - hdr);
+        scan += n - hdr;
+        marker = p[1] & 0x80;
+        packets++;
+    }
+    bad += !marker || packets != sent || scan != f->scan_len || memcmp(s_scan, f->scan, scan);
+    bad += s.packets != (uint32_t)sent || s.seq != (uint16_t)(seq + sent);
+    return bad ? -1 : packets;
+}
+
+static void test_rtp(void)
+{
+    jpeg_encoder_config_t cfg = { .max_width = W, .quality = 80 };
+    jpeg_encoder_t *enc = jpeg_encoder_create(&cfg);
+    static uint8_t rgb[W * H * 2];
+    uint32_t r = 3;
+
+    for (size_t i = 0; i < sizeof(rgb); i++) {
+        r = r * 1103515245 + 12345;
+        rgb[i] = (i / 2 % W) / 3 + (r >> 20) % 32;
+    }
+    size_t len = jpeg_encode(enc, rgb, W, H, JPEG_ENC_RGB565, s_jpg, sizeof(s_jpg));
+    jpeg_encoder_destroy(enc);
+    rtp_jpeg_frame_t f;
+    CHECK(len > 0 && rtp_jpeg_parse(s_jpg, len, &f));
+    CHECK(f.width8 == W / 8 && f.height8 == H / 8 && f.scan_len > 0);
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in dest = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t dest_len = sizeof(dest);
+    int rcvbuf = 1 << 20;
+    setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    CHECK(bind(rx, (struct sockaddr *)&dest, sizeof(dest)) == 0);
+    CHECK(getsockname(rx, (struct sockaddr *)&dest, &dest_len) == 0);
+    struct timeval tv = { .tv_sec = 1 };
+    setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // The smaller MTUs send a cut-down scan, so a default-sized socket
+    // buffer still holds every packet of the frame
+    struct {
+        size_t mtu;
+        size_t scan;
+    } runs[] = {
+        { 1400, f.scan_len },
+        { 576, 32768 },
+        { RTP_JPEG_MIN_MTU + 63, 16384 },
+        { RTP_JPEG_MIN_MTU, 2048 },
+    };
+    printf("| mtu | scan bytes | packets |\n|---|---|---|\n");
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        rtp_jpeg_frame_t part = f;
+        part.scan_len = runs[i].scan < f.scan_len ? runs[i].scan : f.scan_len;
+        int packets = send_and_reassemble(&part, runs[i].mtu, tx, rx, &dest);
+        CHECK(packets > 0);
+        printf("| %zu | %zu | %d |\n", runs[i].mtu, part.scan_len, packets);
+    }
+
+    // Too small to carry the first packet's headers and tables: refused
+    // at init, and a stream left that way sends nothing
+    rtp_stream_t s;
+    CHECK(!rtp_stream_init(&s, tx, &dest, SESSION, 0, RTP_JPEG_MIN_MTU - 1));
+    CHECK(!rtp_stream_init(&s, tx, &dest, SESSION, 0, 0));
+    errno = 0;
+    CHECK(rtp_jpeg_send(&s, &f, 0) == -1 && errno == EMSGSIZE);
+    CHECK(s.packets == 0);
+
+    // Sender report: SR and SDES, 32-bit aligned, the totals in place
+    CHECK(rtp_stream_init(&s, tx, &dest, SESSION, 0, 1400));
+    CHECK(rtp_jpeg_send(&s, &f, 1234) > 0);
+    uint8_t sr[64];
+    size_t n = rtcp_sender_report(&s, rtcp_ntp_time(0), 1234, "cam", sr, sizeof(sr));
+    CHECK(n > 28 && n % 4 == 0 && sr[1] == 200 && be32(sr + 4) == SESSION);
+    CHECK(be32(sr + 8) == 2208988800u && be32(sr + 16) == 1234);
+    CHECK(be32(sr + 20) == s.packets && be32(sr + 24) == s.octets);
+    CHECK(rtcp_sender_report(&s, 0, 0, "cam", sr, 16) == 0);
+
+    close(tx);
+    close(rx);
+}
+
+int main(void)
+{
+    test_session();
+    test_parse();
+    test_rtp();
+    return TEST_END();
+}
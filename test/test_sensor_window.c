@@ -0,0 +1,354 @@
+/*
+ * Sensor window - planning ROIs against the full frame, and the switch
+ *
+ * sensor_window_plan() is checked against two sets of full-frame timing
+ * registers shaped like the OV3660's: the whole array read out unbinned,
+ * and the same array binned 2x2 and scaled to VGA. For every ROI planned,
+ * the array window must lie inside the full one and cover the ROI. It must
+ * start and end on whole Bayer cells, and the output must be in whole MCUs
+ * and never larger than the ROI or the full frame. The frame must also
+ * lose exactly the lines the window drops. A sweep covers every alignment
+ * and size up to the frame edges. Odd and edge ROIs are checked one by
+ * one, and so are ROIs outside the frame or below the minimum, which must
+ * be refused.
+ *
+ * A fake sensor then takes sensor_window_set() through the capture task
+ * path: registers read, window written with the AEC limits cut to the
+ * frame, a refused window rolled back, and the full frame restored.
+ *
+ * The table gives the planned output and frame length for the windows
+ * tools/roi_sweep.py steps through, on these register sets. Full lines
+ * over window lines bound the speedup. It is not a measured frame rate.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sensor_window.h"
+#include "test.h"
+
+#define REG_X_INC           0x3814
+#define REG_Y_INC           0x3815
+#define REG_ISP_CTRL01      0x5001
+#define REG_AEC_MAX_EXPO_60 0x3A02
+#define REG_AEC_MAX_EXPO_50 0x3A14
+#define FULL_EXPO           1560    // AEC limit for the full frame, in lines
+
+typedef struct {
+    const char *name;
+    sensor_window_regs_t regs;
+} full_frame_t;
+
+static const full_frame_t s_frames[] = {
+    { "2048x1536", { .start_x = 0, .start_y = 0, .end_x = 2079, .end_y = 1547,
+                     .offset_x = 16, .offset_y = 6, .total_x = 2300, .total_y = 1564,
+                     .out_width = 2048, .out_height = 1536, .sub_x = 1, .sub_y = 1 } },
+    { "640x480 binned", { .start_x = 0, .start_y = 0, .end_x = 2079, .end_y = 1547,
+                          .offset_x = 8, .offset_y = 3, .total_x = 2300, .total_y = 800,
+                          .out_width = 640, .out_height = 480, .sub_x = 2, .sub_y = 2,
+                          .scale = true } },
+};
+
+// Every property a plan for roi must have. Returns false at the first miss.
+static bool plan_ok(const sensor_window_regs_t *f, const sensor_roi_t *roi,
+                    const sensor_window_regs_t *w)
+{
+    int crop_x = f->offset_x * f->sub_x;
+    int crop_y = f->offset_y * f->sub_y;
+    int vis_w = f->end_x - f->start_x + 1 - 2 * crop_x;
+    int vis_h = f->end_y - f->start_y + 1 - 2 * crop_y;
+    // Visible part of the window, in array pixels from the visible origin
+    int x0 = w->start_x - f->start_x;
+    int y0 = w->start_y - f->start_y;
+    int x1 = w->end_x + 1 - f->start_x - 2 * crop_x;
+    int y1 = w->end_y + 1 - f->start_y - 2 * crop_y;
+    int in_w = (x1 - x0) / f->sub_x;
+    int in_h = (y1 - y0) / f->sub_y;
+
+    // Inside the array, on whole Bayer cells
+    if (w->start_x < f->start_x || w->end_x > f->end_x || w->start_y < f->start_y ||
+        w->end_y > f->end_y || x0 % (2 * f->sub_x) || y0 % (2 * f->sub_y) ||
+        x1 % (2 * f->sub_x) || y1 % (2 * f->sub_y)) {
+        return false;
+    }
+    // Covers the ROI
+    if ((int64_t)x0 * f->out_width > (int64_t)roi->x * vis_w ||
+        (int64_t)y0 * f->out_height > (int64_t)roi->y * vis_h ||
+        (int64_t)x1 * f->out_width < (int64_t)(roi->x + roi->width) * vis_w ||
+        (int64_t)y1 * f->out_height < (int64_t)(roi->y + roi->height) * vis_h) {
+        return false;
+    }
+    // Whole MCUs, no upscaling, no larger than the frame buffers
+    if (w->out_width <= 0 || w->out_height <= 0 || w->out_width % 16 || w->out_height % 8 ||
+        w->out_width > in_w || w->out_height > in_h || w->out_width > f->out_width ||
+        w->out_height > f->out_height) {
+        return false;
+    }
+    if (w->scale != (w->out_width != in_w || w->out_height != in_h)) {
+        return false;
+    }
+    // Scaled down only to fit, keeping the aspect ratio within a MCU
+    if (in_w <= f->out_width && in_h <= f->out_height &&
+        (in_w - w->out_width >= 16 || in_h - w->out_height >= 8)) {
+        return false;
+    }
+    // The same blanking, fewer lines; the rest as for the full frame
+    int dropped = (f->end_y - f->start_y - (w->end_y - w->start_y)) / f->sub_y;
+    return w->total_y == f->total_y - dropped && w->total_x == f->total_x &&
+           w->offset_x == f->offset_x && w->offset_y == f->offset_y &&
+           w->sub_x == f->sub_x && w->sub_y == f->sub_y;
+}
+
+static void test_plan_sweep(const sensor_window_regs_t *f)
+{
+    int planned = 0, bad = 0;
+
+    for (int w = SENSOR_WINDOW_MIN; w <= f->out_width; w += 37) {
+        for (int h = SENSOR_WINDOW_MIN; h <= f->out_height; h += 29) {
+            for (int x = 0; x + w <= f->out_width; x += 53) {
+                // Last position flush with the right and bottom edges
+                int xs[2] = { x, f->out_width - w };
+                int ys[2] = { (x * 7) % (f->out_height - h + 1), f->out_height - h };
+                for (int i = 0; i < 4; i++) {
+                    sensor_roi_t roi = { xs[i & 1], ys[i >> 1], w, h };
+                    sensor_window_regs_t out;
+                    planned++;
+                    bad += sensor_window_plan(f, &roi, &out) != ESP_OK || !plan_ok(f, &roi, &out);
+                }
+            }
+        }
+    }
+    CHECK(planned > 1000 && bad == 0);
+}
+
+static void test_plan_cases(const sensor_window_regs_t *f)
+{
+    int fw = f->out_width, fh = f->out_height;
+    sensor_window_regs_t out;
+
+    // The full frame, as zero width or as a window covering all of it
+    CHECK(sensor_window_plan(f, &(sensor_roi_t){ 0 }, &out) == ESP_OK);
+    CHECK(!memcmp(&out, f, sizeof(out)));
+    CHECK(sensor_window_plan(f, &(sensor_roi_t){ 0, 0, fw, fh }, &out) == ESP_OK);
+    CHECK(out.start_x == f->start_x && out.end_x == f->end_x && out.start_y == f->start_y &&
+          out.end_y == f->end_y && out.total_y == f->total_y);
+    CHECK(out.out_width == fw && out.out_height == fh);
+
+    // Odd positions and sizes, the minimum, and flush with each corner
+    static const sensor_roi_t odd[] = {
+        { 1, 1, 65, 65 }, { 3, 5, 101, 77 }, { 0, 0, 64, 64 }, { 1, 0, 64, 64 },
+    };
+    for (size_t i = 0; i < sizeof(odd) / sizeof(odd[0]); i++) {
+        CHECK(sensor_window_plan(f, &odd[i], &out) == ESP_OK && plan_ok(f, &odd[i], &out));
+    }
+    sensor_roi_t corners[] = {
+        { fw - 64, 0, 64, 64 }, { 0, fh - 64, 64, 64 }, { fw - 64, fh - 64, 64, 64 },
+        { fw - 65, fh - 65, 65, 65 }, { 1, fh - 71, fw - 1, 71 },
+    };
+    for (size_t i = 0; i < sizeof(corners) / sizeof(corners[0]); i++) {
+        CHECK(sensor_window_plan(f, &corners[i], &out) == ESP_OK &&
+              plan_ok(f, &corners[i], &out));
+    }
+
+    // A thin strip is faster, a narrow column is not
+    CHECK(sensor_window_plan(f, &(sensor_roi_t){ 0, fh / 2, fw, 64 }, &out) == ESP_OK);
+    CHECK(out.total_y < f->total_y);
+    CHECK(sensor_window_plan(f, &(sensor_roi_t){ fw / 2, 0, 64, fh }, &out) == ESP_OK);
+    CHECK(out.total_y == f->total_y);
+
+    // Outside the frame, below the minimum, or negative: refused
+    static const sensor_roi_t bad[] = {
+        { -1, 0, 64, 64 }, { 0, -1, 64, 64 }, { 0, 0, 63, 64 }, { 0, 0, 64, 63 },
+        { 0, 0, -64, 64 }, { 0, 0, 64, -64 },
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CHECK(sensor_window_plan(f, &bad[i], &out) == ESP_ERR_INVALID_ARG);
+    }
+    sensor_roi_t past[] = {
+        { fw - 63, 0, 64, 64 }, { 0, fh - 63, 64, 64 }, { 0, 0, fw + 1, fh }, { 0, 0, fw, fh + 1 },
+    };
+    for (size_t i = 0; i < sizeof(past) / sizeof(past[0]); i++) {
+        CHECK(sensor_window_plan(f, &past[i], &out) == ESP_ERR_INVALID_ARG);
+    }
+}
+
+// The windows tools/roi_sweep.py steps through, centered
+static void print_plan(const full_frame_t *ff)
+{
+    static const int sizes[][2] = { { 1, 1 }, { 2, 2 }, { 1, 4 }, { 4, 4 }, { 2, 8 }, { 8, 8 } };
+    const sensor_window_regs_t *f = &ff->regs;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int w = f->out_width / sizes[i][0], h = f->out_height / sizes[i][1];
+        sensor_roi_t roi = { (f->out_width - w) / 2, (f->out_height - h) / 2, w, h };
+        sensor_window_regs_t out;
+        if (sensor_window_plan(f, &roi, &out) != ESP_OK) {
+            printf("| %s | 1/%d x 1/%d | refused | | |\n", ff->name, sizes[i][0], sizes[i][1]);
+            continue;
+        }
+        printf("| %s | 1/%d x 1/%d | %dx%d | %d of %d | %.2fx |\n", ff->name, sizes[i][0],
+               sizes[i][1], out.out_width, out.out_height, out.total_y, f->total_y,
+               (double)f->total_y / out.total_y);
+    }
+}
+
+// A sensor that is only registers; set_res_raw writes them as the driver does
+static struct {
+    sensor_t sensor;
+    uint8_t regs[0x10000];
+    int windows;                    // set_res_raw calls
+    bool refuse;                    // Fail the next set_res_raw
+    pthread_mutex_t lock;
+    bool stop;
+} s_fake = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int fake_get_reg(sensor_t *s, int reg, int mask)
+{
+    return s_fake.regs[reg] & mask;
+}
+
+static int fake_set_reg(sensor_t *s, int reg, int mask, int value)
+{
+    s_fake.regs[reg] = (s_fake.regs[reg] & ~mask) | (value & mask);
+    return 0;
+}
+
+static int get16(int reg)
+{
+    return s_fake.regs[reg] << 8 | s_fake.regs[reg + 1];
+}
+
+static void put16(int reg, int value)
+{
+    s_fake.regs[reg] = value >> 8;
+    s_fake.regs[reg + 1] = value & 0xff;
+}
+
+static int fake_set_res_raw(sensor_t *s, int start_x, int start_y, int end_x, int end_y,
+                            int offset_x, int offset_y, int total_x, int total_y, int out_x,
+                            int out_y, bool scale, bool binning)
+{
+    if (s_fake.refuse) {
+        s_fake.refuse = false;
+        return -1;
+    }
+    // 0x3800 to 0x3812, in register order
+    int v[] = { start_x, start_y, end_x, end_y, out_x, out_y, total_x, total_y, offset_x, offset_y };
+    for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++) {
+        put16(0x3800 + 2 * i, v[i]);
+    }
+    s_fake.regs[REG_ISP_CTRL01] = scale ? 0x20 : 0;
+    s_fake.regs[REG_X_INC] = s_fake.regs[REG_Y_INC] = binning ? 0x31 : 0x11;
+    s_fake.windows++;
+    return 0;
+}
+
+static void fake_load(const sensor_window_regs_t *r)
+{
+    fake_set_res_raw(NULL, r->start_x, r->start_y, r->end_x, r->end_y, r->offset_x, r->offset_y,
+                     r->total_x, r->total_y, r->out_width, r->out_height, r->scale, r->sub_y > 1);
+    put16(REG_AEC_MAX_EXPO_60, FULL_EXPO);
+    put16(REG_AEC_MAX_EXPO_50, FULL_EXPO);
+    s_fake.windows = 0;
+}
+
+// The capture task's part: apply switches between "frames"
+static void *capture_main(void *arg)
+{
+    for (;;) {
+        pthread_mutex_lock(&s_fake.lock);
+        bool stop = s_fake.stop;
+        pthread_mutex_unlock(&s_fake.lock);
+        if (stop) {
+            return NULL;
+        }
+        sensor_window_service(&s_fake.sensor);
+        usleep(100);
+    }
+}
+
+static void test_switch(void)
+{
+    const sensor_window_regs_t *f = &s_frames[0].regs;
+    sensor_window_result_t res;
+    sensor_roi_t strip = { 100, 700, 1001, 130 };
+    sensor_window_regs_t plan;
+    int w, h;
+
+    s_fake.sensor = (sensor_t){
+        .id.PID = 0x2640, .pixformat = PIXFORMAT_JPEG, .get_reg = fake_get_reg,
+        .set_reg = fake_set_reg, .set_res_raw = fake_set_res_raw,
+    };
+    fake_load(f);
+
+    // Not before init, not for other sensors or raw output
+    CHECK(sensor_window_set(&strip, 0, &res) == ESP_ERR_INVALID_STATE);
+    CHECK(sensor_window_init(&s_fake.sensor) == ESP_ERR_NOT_SUPPORTED);
+    s_fake.sensor.id.PID = OV3660_PID;
+    s_fake.sensor.pixformat = PIXFORMAT_YUV422;
+    CHECK(sensor_window_init(&s_fake.sensor) == ESP_ERR_NOT_SUPPORTED);
+    s_fake.sensor.pixformat = PIXFORMAT_JPEG;
+    CHECK(sensor_window_init(&s_fake.sensor) == ESP_OK);
+
+    pthread_t capture;
+    CHECK(pthread_create(&capture, NULL, capture_main, NULL) == 0);
+
+    // Into a window: the planned registers, AEC cut to the shorter frame
+    CHECK(sensor_window_plan(f, &strip, &plan) == ESP_OK);
+    CHECK(sensor_window_set(&strip, pdMS_TO_TICKS(1000), &res) == ESP_OK);
+    CHECK(res.out_width == plan.out_width && res.out_height == plan.out_height);
+    CHECK(res.lines == plan.total_y && res.full_lines == f->total_y && res.lines < FULL_EXPO);
+    CHECK(get16(0x3800) == plan.start_x && get16(0x3806) == plan.end_y &&
+          get16(0x380E) == plan.total_y);
+    CHECK(get16(REG_AEC_MAX_EXPO_60) == plan.total_y && get16(REG_AEC_MAX_EXPO_50) == plan.total_y);
+
+    // A window outside the frame changes nothing
+    int windows = s_fake.windows;
+    CHECK(sensor_window_set(&(sensor_roi_t){ 2000, 0, 64, 64 }, pdMS_TO_TICKS(1000), NULL) ==
+          ESP_ERR_INVALID_ARG);
+    CHECK(s_fake.windows == windows && get16(0x380E) == plan.total_y);
+
+    // From one window to another, planned from the full frame, not the
+    // window; a refused one falls back to the full frame
+    sensor_roi_t corner = { 2048 - 65, 1536 - 65, 65, 65 };
+    CHECK(sensor_window_plan(f, &corner, &plan) == ESP_OK);
+    CHECK(sensor_window_set(&corner, pdMS_TO_TICKS(1000), &res) == ESP_OK);
+    CHECK(get16(0x3804) == plan.end_x && get16(0x3806) == plan.end_y);
+    s_fake.refuse = true;
+    CHECK(sensor_window_set(&strip, pdMS_TO_TICKS(1000), &res) == ESP_FAIL);
+    CHECK(res.out_width == f->out_width && get16(0x380E) == f->total_y &&
+          get16(REG_AEC_MAX_EXPO_60) == FULL_EXPO);
+
+    // And back to the full frame from a window
+    CHECK(sensor_window_set(&strip, pdMS_TO_TICKS(1000), &res) == ESP_OK);
+    CHECK(sensor_window_set(&(sensor_roi_t){ 0 }, pdMS_TO_TICKS(1000), &res) == ESP_OK);
+    CHECK(res.out_width == f->out_width && res.lines == f->total_y);
+    CHECK(get16(0x3800) == f->start_x && get16(0x3804) == f->end_x &&
+          get16(0x380E) == f->total_y && get16(REG_AEC_MAX_EXPO_50) == FULL_EXPO);
+
+    pthread_mutex_lock(&s_fake.lock);
+    s_fake.stop = true;
+    pthread_mutex_unlock(&s_fake.lock);
+    pthread_join(capture, NULL);
+
+    // Read on the capture task only, now that it has stopped
+    CHECK(!sensor_window_active() && !sensor_window_size(&w, &h));
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(s_frames) / sizeof(s_frames[0]); i++) {
+        test_plan_sweep(&s_frames[i].regs);
+        test_plan_cases(&s_frames[i].regs);
+    }
+    test_switch();
+
+    printf("| full frame | window | output | lines | speedup bound |\n");
+    printf("|---|---|---|---|---|\n");
+    for (size_t i = 0; i < sizeof(s_frames) / sizeof(s_frames[0]); i++) {
+        print_plan(&s_frames[i]);
+    }
+    return TEST_END();
+}
@@ -0,0 +1,107 @@
+/*
+ * WebSocket framing - headers, client frame parsing, opening handshake
+ *
+ * Server headers must pick the shortest of the three length encodings.
+ * Client frames are only accepted masked, final and short, and are
+ * reported incomplete until every byte is in. The handshake check must let
+ * a browser's upgrade through and send anything else back with 400, or
+ * with 426 when only the protocol version is wrong.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "ws_frame.h"
+#include "test.h"
+
+#define KEY "dGhlIHNhbXBsZSBub25jZQ=="
+
+static void test_header(void)
+{
+    uint8_t h[WS_HEADER_MAX];
+
+    CHECK(ws_frame_header(h, WS_OP_PONG, 0) == 2 && h[0] == 0x8A && h[1] == 0);
+    CHECK(ws_frame_header(h, WS_OP_BINARY, 125) == 2 && h[0] == 0x82 && h[1] == 125);
+    CHECK(ws_frame_header(h, WS_OP_BINARY, 126) == 4 && h[1] == 126 && h[2] == 0 && h[3] == 126);
+    CHECK(ws_frame_header(h, WS_OP_BINARY, 65535) == 4 && h[2] == 0xff && h[3] == 0xff);
+    CHECK(ws_frame_header(h, WS_OP_BINARY, 65536) == 10 && h[1] == 127 && h[7] == 1 && h[9] == 0);
+}
+
+// A masked client frame of opcode carrying text
+static size_t client_frame(uint8_t *buf, uint8_t first, const char *text)
+{
+    static const uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+    size_t len = strlen(text);
+
+    buf[0] = first;
+    buf[1] = 0x80 | len;
+    memcpy(buf + 2, mask, 4);
+    for (size_t i = 0; i < len; i++) {
+        buf[6 + i] = text[i] ^ mask[i & 3];
+    }
+    return 6 + len;
+}
+
+static void test_parse(void)
+{
+    uint8_t buf[256];
+    ws_msg_t msg;
+
+    size_t n = client_frame(buf, 0x80 | WS_OP_TEXT, "42");
+    CHECK(ws_frame_parse(buf, n, &msg) == (int)n);
+    CHECK(msg.opcode == WS_OP_TEXT && msg.len == 2 && !memcmp(msg.payload, "42", 2));
+
+    // Every byte short of the whole frame is "not yet"
+    for (size_t i = 0; i < n; i++) {
+        CHECK(ws_frame_parse(buf, i, &msg) == 0);
+    }
+
+    // Two frames back to back come out one at a time
+    size_t m = client_frame(buf + n, 0x80 | WS_OP_PING, "hi");
+    CHECK(ws_frame_parse(buf, n + m, &msg) == (int)n);
+    CHECK(ws_frame_parse(buf + n, m, &msg) == (int)m && msg.opcode == WS_OP_PING);
+
+    // Unmasked, fragmented, reserved bits set or too long: protocol errors
+    n = client_frame(buf, 0x80 | WS_OP_TEXT, "1");
+    buf[1] &= 0x7f;
+    CHECK(ws_frame_parse(buf, n, &msg) == -1);
+    n = client_frame(buf, WS_OP_TEXT, "1");
+    CHECK(ws_frame_parse(buf, n, &msg) == -1);
+    n = client_frame(buf, 0xC0 | WS_OP_TEXT, "1");
+    CHECK(ws_frame_parse(buf, n, &msg) == -1);
+    buf[0] = 0x80 | WS_OP_BINARY;
+    buf[1] = 0x80 | 126;
+    CHECK(ws_frame_parse(buf, 8, &msg) == -1);
+}
+
+static void test_handshake(void)
+{
+    // What browsers send, and the usual variations on it
+    CHECK(ws_handshake_status("websocket", "Upgrade", "13", KEY) == 0);
+    CHECK(ws_handshake_status("WebSocket", "keep-alive, Upgrade", "13", KEY) == 0);
+    CHECK(ws_handshake_status("websocket", "upgrade ,keep-alive", "13", KEY) == 0);
+
+    // Not a WebSocket upgrade at all
+    CHECK(ws_handshake_status(NULL, "Upgrade", "13", KEY) == 400);
+    CHECK(ws_handshake_status("h2c", "Upgrade", "13", KEY) == 400);
+    CHECK(ws_handshake_status("websocket", NULL, "13", KEY) == 400);
+    CHECK(ws_handshake_status("websocket", "keep-alive", "13", KEY) == 400);
+    CHECK(ws_handshake_status("websocket", "Upgraded", "13", KEY) == 400);
+
+    // Key missing or not 16 bytes of base64, version missing
+    CHECK(ws_handshake_status("websocket", "Upgrade", "13", NULL) == 400);
+    CHECK(ws_handshake_status("websocket", "Upgrade", "13", "c2hvcnQ=") == 400);
+    CHECK(ws_handshake_status("websocket", "Upgrade", NULL, KEY) == 400);
+
+    // A version this server does not speak
+    CHECK(ws_handshake_status("websocket", "Upgrade", "8", KEY) == 426);
+    CHECK(ws_handshake_status("websocket", "Upgrade", "130", KEY) == 426);
+}
+
+int main(void)
+{
+    test_header();
+    test_parse();
+    test_handshake();
+    return TEST_END();
+}
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""
+Burst against stream frame interval comparison
+
+Takes N frames from /stream?fps=0 and then N frames from /burst?n=N, and
+compares the interval between consecutive frames in each, from the capture
+times in their X-Timestamp headers: mean, p50 and largest interval, the
+frame rate that works out to, and how many sequence numbers were skipped.
+Over a slow link the stream falls behind the sensor and skips frames; a
+burst should not. Prints a Markdown table.
+
+Standard library only.
+
+    python3 tools/burst_compare.py 192.168.1.252 -n 30
+"""
+
+import argparse
+
+from stream_latency import read_part
+from stream_loadgen import ChunkedReader, open_http, percentile
+
+
+def frames(args, path, count):
+    """Capture time and sequence number of the first count parts of path."""
+    sock, raw, status, headers = open_http(args.host, args.port, path, args.timeout)
+    try:
+        if " 200 " not in status + " ":
+            body = raw.read(int(headers.get("content-length", "0")))
+            raise SystemExit(f"{path}: {status} {body.decode(errors='replace').strip()}")
+        reader = ChunkedReader(raw) if "chunked" in headers.get("transfer-encoding", "") else raw
+        out = []
+        while len(out) < count:
+            part = read_part(reader)
+            if part is None:
+                break
+            reader.read(int(part["content-length"]))
+            if "x-timestamp" not in part:
+                raise SystemExit(f"{path}: no X-Timestamp header: firmware too old?")
+            out.append((float(part["x-timestamp"]), int(part.get("x-sequence", "0"))))
+        return out
+    finally:
+        sock.close()
+
+
+def row(name, got):
+    if len(got) < 2:
+        return f"| {name} | {len(got)} | - | - | - | - | - |"
+    intervals = [(b[0] - a[0]) * 1000 for a, b in zip(got, got[1:])]
+    skipped = sum(b[1] - a[1] - 1 for a, b in zip(got, got[1:]))
+    mean = sum(intervals) / len(intervals)
+    return (f"| {name} | {len(got)} | {mean:.1f} | {percentile(intervals, 50):.1f} | "
+            f"{max(intervals):.1f} | {1000 / mean:.1f} | {skipped} |")
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("host")
+    p.add_argument("--port", type=int, default=80)
+    p.add_argument("-n", "--frames", type=int, default=30)
+    p.add_argument("--skip", type=int, default=5, help="stream frames dropped first, queued before the request")
+    p.add_argument("--timeout", type=float, default=10.0)
+    args = p.parse_args()
+
+    stream = frames(args, "/stream?fps=0", args.frames + args.skip)[args.skip:]
+    burst = frames(args, f"/burst?n={args.frames}", args.frames)
+
+    print("| mode | frames | mean ms | p50 ms | max ms | fps | skipped |")
+    print("|---|---|---|---|---|---|---|")
+    print(row("stream", stream))
+    print(row("burst", burst))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""
+Index page latency under stream load
+
+For each stream count in turn, opens that many /stream clients, lets them
+settle, then fetches / repeatedly and records how long each fetch takes.
+Prints one Markdown table row per count: p50, p99 and worst latency of /,
+failed fetches and the frame rate the streams kept up meanwhile.
+
+Run it once against firmware built with CONFIG_STREAM_ASYNC_SENDER=n and
+once with it set, giving each run a --label, to compare the in-handler
+stream loop with the sender pool; the rows of both runs share one table.
+
+Standard library only.
+
+    python3 tools/index_latency.py 192.168.1.252 --label async -n 0 1 2 4
+"""
+
+import argparse
+import threading
+import time
+
+from stream_loadgen import Prober, StreamClient, percentile
+
+
+def measure(args, count):
+    stop = threading.Event()
+    clients = [StreamClient(i, args, stop) for i in range(count)]
+    for c in clients:
+        c.start()
+    time.sleep(args.settle)
+    frames = sum(c.frames for c in clients)
+
+    prober = Prober(args, stop)
+    prober.start()
+    time.sleep(args.duration)
+    frames = sum(c.frames for c in clients) - frames
+    stop.set()
+    prober.join(args.timeout)
+    for c in clients:
+        c.join(args.timeout)
+
+    lat = [v * 1000 for v in prober.latencies]
+    errors = [c.error for c in clients if c.error]
+    worst = max(lat) if lat else 0.0
+    print(f"| {args.label} | {count} | {len(lat)} | {percentile(lat, 50):.1f} | "
+          f"{percentile(lat, 99):.1f} | {worst:.1f} | {prober.failures} | "
+          f"{frames / args.duration:.1f} |" + (f" {errors[0]}" if errors else ""))
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("host")
+    p.add_argument("--port", type=int, default=80)
+    p.add_argument("-n", "--streams", type=int, nargs="+", default=[0, 1, 2, 4],
+                   help="stream counts to measure")
+    p.add_argument("-d", "--duration", type=float, default=15.0, help="seconds of probing per count")
+    p.add_argument("--settle", type=float, default=3.0, help="seconds between opening streams and probing")
+    p.add_argument("--label", default="-", help="first column, e.g. the firmware variant")
+    p.add_argument("--timeout", type=float, default=10.0)
+    p.add_argument("--probe-interval", type=float, default=0.25)
+    args = p.parse_args()
+    args.path = "/stream"
+    args.probe = "/"
+
+    print("| firmware | streams | fetches | / p50 ms | / p99 ms | / max ms | failed | stream fps |")
+    print("|---|---|---|---|---|---|---|---|")
+    for count in args.streams:
+        measure(args, count)
+
+
+if __name__ == "__main__":
+    main()
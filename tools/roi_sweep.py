@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""
+Sensor window frame rate sweep
+
+Streams the camera with a series of centered ?roi= windows, from the full
+frame down to a thin strip, and measures for each: the frame rate the
+sensor delivers, the output size (from the JPEG SOF) and the frame size.
+Prints a Markdown table to paste into notes or the README. The window is
+shared by all viewers, so run it while nobody else is watching, and with
+CONFIG_STREAM_TARGET_FPS at 0 so the pacer does not cap the rate.
+
+Standard library only.
+
+    python3 tools/roi_sweep.py 192.168.1.252 -d 10
+"""
+
+import argparse
+import time
+
+from stream_latency import read_part
+from stream_loadgen import ChunkedReader, open_http
+
+# Window width and height as fractions of the full frame
+SIZES = [(1, 1), (1 / 2, 1 / 2), (1, 1 / 4), (1 / 4, 1 / 4), (1 / 2, 1 / 8), (1 / 8, 1 / 8)]
+
+
+def jpeg_size(jpg):
+    """Width and height from the SOF marker, None if there is none."""
+    pos = 2
+    while pos + 9 <= len(jpg) and jpg[pos] == 0xFF:
+        marker = jpg[pos + 1]
+        seg = jpg[pos + 2] << 8 | jpg[pos + 3]
+        if marker in (0xC0, 0xC1, 0xC2):
+            return (jpg[pos + 7] << 8 | jpg[pos + 8], jpg[pos + 5] << 8 | jpg[pos + 6])
+        pos += 2 + seg
+    return None
+
+
+def measure(args, roi):
+    """Frames per second, output size and mean frame bytes with this roi."""
+    sock, raw, status, headers = open_http(args.host, args.port, f"/stream?roi={roi}", args.timeout)
+    try:
+        if " 200 " not in status + " ":
+            raise SystemExit(f"roi={roi}: {status}")
+        reader = ChunkedReader(raw) if "chunked" in headers.get("transfer-encoding", "") else raw
+        settle = time.monotonic() + args.settle
+        frames = size = 0
+        start = dims = None
+        while True:
+            part = read_part(reader)
+            if part is None:
+                raise SystemExit(f"roi={roi}: stream closed")
+            body = reader.read(int(part["content-length"]))
+            now = time.monotonic()
+            if now < settle:
+                continue            # AEC and the driver's queue catching up
+            if start is None:
+                start, dims = now, jpeg_size(body)
+                continue
+            frames += 1
+            size += len(body)
+            if now - start >= args.duration:
+                return frames / (now - start), dims, size / frames
+    finally:
+        sock.close()
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("host")
+    p.add_argument("--port", type=int, default=80)
+    p.add_argument("-d", "--duration", type=float, default=10.0, help="seconds per window")
+    p.add_argument("--settle", type=float, default=2.0, help="seconds skipped after each switch")
+    p.add_argument("--timeout", type=float, default=10.0)
+    args = p.parse_args()
+
+    full_fps, full, full_bytes = measure(args, "full")
+    if not full:
+        raise SystemExit("no SOF in the full frame")
+    print(f"full frame {full[0]}x{full[1]}\n")
+    print("| window | output | fps | speedup | KB/frame |")
+    print("|---|---|---|---|---|")
+    for fw, fh in SIZES:
+        w, h = int(full[0] * fw) & ~15, int(full[1] * fh) & ~7
+        if w < 64 or h < 64:
+            continue                # Below the smallest window
+        if (w, h) == full:
+            fps, dims, size = full_fps, full, full_bytes
+        else:
+            fps, dims, size = measure(args, f"{(full[0] - w) // 2},{(full[1] - h) // 2},{w},{h}")
+        out = f"{dims[0]}x{dims[1]}" if dims else "?"
+        print(f"| {w}x{h} | {out} | {fps:.1f} | {fps / full_fps:.2f}x | {size / 1024:.1f} |")
+
+    # Leave the full frame behind: the window outlives the stream
+    sock, _, _, _ = open_http(args.host, args.port, "/stream?roi=full", args.timeout)
+    sock.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""
+MJPEG stream latency analyzer
+
+Follows one /stream and, from the X-Timestamp / X-Sequence / X-Clock-Offset
+headers the camera puts on every part, reports over time: end-to-end latency
+(capture on the device to the last byte here), jitter, frame rate, frames
+the device skipped and stalls in delivery. Prints one line per interval and
+a summary at the end; --csv keeps every frame for comparing builds later.
+
+Latency is absolute only when both clocks are synced (the camera over SNTP,
+this host over NTP); the error is the sum of both sync errors, typically a
+few ms on a LAN. If the camera has not synced yet, its timestamps count from
+boot and latency is reported relative to the lowest seen, which
+still shows jitter and drift.
+
+Standard library only.
+
+    python3 tools/stream_latency.py 192.168.1.252 -d 60 --csv run.csv
+"""
+
+import argparse
+import csv
+import time
+
+from stream_loadgen import ChunkedReader, open_http, percentile
+
+# Device timestamps before this are boot-relative: no SNTP sync yet
+SYNCED_AFTER = 1_500_000_000
+# Device clock offset changes larger than this count as a clock step
+CLOCK_STEP_US = 1000
+# An inter-arrival gap this many times the median counts as a stall
+STALL_FACTOR = 3.0
+
+
+class Window:
+    """Per-frame samples over one reporting period."""
+
+    def __init__(self):
+        self.latencies = []
+        self.intervals = []
+        self.frames = 0
+        self.bytes = 0
+        self.skipped = 0
+        self.stalls = 0
+        self.steps = 0
+        self.jitter = 0.0
+
+    def line(self, label, seconds, base):
+        lat = [(v - base) * 1000 for v in self.latencies]
+        fps = self.frames / seconds if seconds > 0 else 0.0
+        return (f"{label:>8} {self.frames:>6} {fps:>6.1f} "
+                f"{percentile(lat, 50):>8.1f} {percentile(lat, 95):>8.1f} "
+                f"{max(lat, default=0.0):>8.1f} {self.jitter * 1000:>7.2f} "
+                f"{self.skipped:>7} {self.stalls:>6} {self.steps:>5} "
+                f"{self.bytes / seconds / 1024 if seconds > 0 else 0.0:>8.1f}")
+
+
+HEADER = (f"{'time':>8} {'frames':>6} {'fps':>6} {'lat p50':>8} {'lat p95':>8} "
+          f"{'lat max':>8} {'jitter':>7} {'skipped':>7} {'stalls':>6} {'steps':>5} {'KB/s':>8}")
+
+
+def read_part(reader):
+    """Headers and payload length of the next part, None at end of stream."""
+    headers = {}
+    while True:
+        line = reader.readline()
+        if not line:
+            return None
+        if line in (b"\r\n", b"\n"):
+            if "content-length" in headers:
+                return headers
+            continue        # Blank line around a boundary
+        if line.startswith(b"--"):
+            continue
+        key, _, value = line.decode(errors="replace").partition(":")
+        headers[key.strip().lower()] = value.strip()
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("host")
+    p.add_argument("--port", type=int, default=80)
+    p.add_argument("--path", default="/stream")
+    p.add_argument("-d", "--duration", type=float, default=30.0, help="seconds, 0 runs until Ctrl-C")
+    p.add_argument("-i", "--interval", type=float, default=5.0, help="seconds between report lines")
+    p.add_argument("--timeout", type=float, default=10.0)
+    p.add_argument("--csv", help="write one row per frame to this file")
+    args = p.parse_args()
+
+    sock, raw, status, headers = open_http(args.host, args.port, args.path, args.timeout)
+    if " 200 " not in status + " ":
+        raise SystemExit(f"{args.path}: {status}")
+    reader = ChunkedReader(raw) if "chunked" in headers.get("transfer-encoding", "") else raw
+
+    out = None
+    if args.csv:
+        out_file = open(args.csv, "w", newline="")
+        out = csv.writer(out_file)
+        out.writerow(["recv_s", "seq", "captured_s", "latency_ms", "bytes", "clock_offset_us"])
+
+    start = time.monotonic()
+    total, window = Window(), Window()
+    window_start = start
+    synced = None
+    base = 0.0              # Subtracted from latencies in relative mode
+    last_seq = last_offset = last_recv = last_transit = None
+
+    print(HEADER)
+    try:
+        while not args.duration or time.monotonic() - start < args.duration:
+            part = read_part(reader)
+            if part is None:
+                print("stream closed by the camera")
+                break
+            length = int(part["content-length"])
+            body = reader.read(length)
+            if len(body) < length:
+                print("stream closed mid-frame")
+                break
+            recv = time.time()
+            now = time.monotonic()
+
+            if "x-timestamp" not in part:
+                raise SystemExit("no X-Timestamp header: firmware too old?")
+            captured = float(part["x-timestamp"])
+            seq = int(part.get("x-sequence", "0"))
+            offset = int(part.get("x-clock-offset", "0"))
+            if synced is None or (not synced and captured > SYNCED_AFTER):
+                synced = captured > SYNCED_AFTER
+                print(f"device clock {'synced' if synced else 'not synced, latency is relative'}")
+                total.latencies.clear()
+                window.latencies.clear()
+                last_transit = None
+                base = 0.0
+            transit = recv - captured
+
+            for w in (total, window):
+                w.frames += 1
+                w.bytes += length
+                w.latencies.append(transit)
+                if last_seq is not None and seq > last_seq + 1:
+                    w.skipped += seq - last_seq - 1
+                if last_offset is not None and abs(offset - last_offset) > CLOCK_STEP_US:
+                    w.steps += 1
+                if last_recv is not None:
+                    gap = recv - last_recv
+                    if len(w.intervals) >= 10 and gap > STALL_FACTOR * percentile(w.intervals, 50):
+                        w.stalls += 1
+                    w.intervals.append(gap)
+                # Interarrival jitter as in RFC 3550, section 6.4.1
+                if last_transit is not None:
+                    w.jitter += (abs(transit - last_transit) - w.jitter) / 16
+            if out:
+                out.writerow([f"{recv:.6f}", seq, f"{captured:.6f}",
+                              f"{transit * 1000:.3f}", length, offset])
+            last_seq, last_offset, last_recv, last_transit = seq, offset, recv, transit
+
+            if not synced:
+                base = min(total.latencies)
+            if now - window_start >= args.interval:
+                print(window.line(f"{now - start:.0f}s", now - window_start, base))
+                jitter = window.jitter
+                window = Window()
+                window.jitter = jitter
+                window_start = now
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sock.close()
+        if out:
+            out_file.close()
+
+    elapsed = time.monotonic() - start
+    print(total.line("total", elapsed, base))
+    if not synced:
+        print("latency relative to the lowest seen: the device clock was not synced")
+
+
+if __name__ == "__main__":
+    main()
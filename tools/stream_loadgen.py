@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+"""
+MJPEG stream load generator
+
+Opens N concurrent /stream clients against the camera (or any server speaking
+the same multipart/x-mixed-replace format) and reports, per client and in
+total: frames per second, p50/p99 inter-frame interval, p50/p99 frame
+transfer time and bytes per second. Optionally probes another URI (e.g. /)
+while the streams run, to measure how responsive the server stays.
+
+Standard library only.
+
+    python3 tools/stream_loadgen.py 192.168.1.252 -n 4 -d 30 --probe /
+"""
+
+import argparse
+import socket
+import threading
+import time
+
+
+def percentile(values, pct):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    idx = min(len(ordered) - 1, int(round(pct / 100.0 * (len(ordered) - 1))))
+    return ordered[idx]
+
+
+class ChunkedReader:
+    """Undo HTTP chunked transfer encoding on top of a buffered socket file."""
+
+    def __init__(self, raw):
+        self.raw = raw
+        self.left = 0
+        self.buf = b""
+
+    def _fill(self):
+        if self.left == 0:
+            line = self.raw.readline()
+            if not line:
+                return False
+            size = int(line.split(b";")[0].strip() or b"0", 16)
+            if size == 0:
+                return False
+            self.left = size
+        data = self.raw.read(self.left)
+        if not data:
+            return False
+        self.left -= len(data)
+        if self.left == 0:
+            self.raw.readline()  # CRLF after chunk
+        self.buf += data
+        return True
+
+    def readline(self):
+        while b"\n" not in self.buf:
+            if not self._fill():
+                break
+        idx = self.buf.find(b"\n")
+        if idx < 0:
+            line, self.buf = self.buf, b""
+        else:
+            line, self.buf = self.buf[:idx + 1], self.buf[idx + 1:]
+        return line
+
+    def read(self, n):
+        while len(self.buf) < n:
+            if not self._fill():
+                break
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+
+def open_http(host, port, path, timeout):
+    sock = socket.create_connection((host, port), timeout=timeout)
+    sock.sendall(f"GET {path} HTTP/1.1\r\nHost: {host}\r\n\r\n".encode())
+    raw = sock.makefile("rb")
+    status = raw.readline().decode(errors="replace").strip()
+    headers = {}
+    while True:
+        line = raw.readline()
+        if not line or line in (b"\r\n", b"\n"):
+            break
+        key, _, value = line.decode(errors="replace").partition(":")
+        headers[key.strip().lower()] = value.strip()
+    return sock, raw, status, headers
+
+
+class StreamClient(threading.Thread):
+    def __init__(self, idx, args, stop):
+        super().__init__(daemon=True)
+        self.idx = idx
+        self.args = args
+        self.stop = stop
+        self.frames = 0
+        self.bytes = 0
+        self.intervals = []
+        self.transfers = []
+        self.error = None
+        self.started = None
+        self.ended = None
+
+    def run(self):
+        try:
+            self._run()
+        except Exception as exc:  # report, don't kill the run
+            self.error = str(exc)
+        self.ended = time.monotonic()
+
+    def _run(self):
+        a = self.args
+        sock, raw, status, headers = open_http(a.host, a.port, a.path, a.timeout)
+        if " 200 " not in status + " ":
+            raise RuntimeError(status)
+        reader = ChunkedReader(raw) if "chunked" in headers.get("transfer-encoding", "") else raw
+        self.started = time.monotonic()
+        last = None
+        try:
+            while not self.stop.is_set():
+                length = None
+                part_start = None
+                while True:
+                    line = reader.readline()
+                    if not line:
+                        return
+                    # The boundary ends the previous part; the header starts this one
+                    if part_start is None and line.strip() and not line.startswith(b"--"):
+                        part_start = time.monotonic()
+                    if line.lower().startswith(b"content-length:"):
+                        length = int(line.split(b":", 1)[1])
+                    elif line in (b"\r\n", b"\n") and length is not None:
+                        break
+                body = reader.read(length)
+                if len(body) < length:
+                    return
+                now = time.monotonic()
+                self.frames += 1
+                self.bytes += length
+                self.transfers.append(now - part_start)
+                if last is not None:
+                    self.intervals.append(now - last)
+                last = now
+        finally:
+            sock.close()
+
+    def elapsed(self):
+        if self.started is None:
+            return 0.0
+        return (self.ended or time.monotonic()) - self.started
+
+
+class Prober(threading.Thread):
+    def __init__(self, args, stop):
+        super().__init__(daemon=True)
+        self.args = args
+        self.stop = stop
+        self.latencies = []
+        self.failures = 0
+
+    def run(self):
+        a = self.args
+        while not self.stop.wait(a.probe_interval):
+            t0 = time.monotonic()
+            try:
+                sock, raw, status, headers = open_http(a.host, a.port, a.probe, a.timeout)
+                length = int(headers.get("content-length", "0"))
+                raw.read(length) if length else raw.read()
+                sock.close()
+                self.latencies.append(time.monotonic() - t0)
+            except Exception:
+                self.failures += 1
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("host")
+    p.add_argument("--port", type=int, default=80)
+    p.add_argument("--path", default="/stream")
+    p.add_argument("-n", "--clients", type=int, default=1)
+    p.add_argument("-d", "--duration", type=float, default=20.0, help="seconds")
+    p.add_argument("--timeout", type=float, default=10.0)
+    p.add_argument("--probe", help="URI to fetch periodically while streaming, e.g. /")
+    p.add_argument("--probe-interval", type=float, default=0.5)
+    args = p.parse_args()
+
+    stop = threading.Event()
+    clients = [StreamClient(i, args, stop) for i in range(args.clients)]
+    for c in clients:
+        c.start()
+    prober = None
+    if args.probe:
+        prober = Prober(args, stop)
+        prober.start()
+
+    time.sleep(args.duration)
+    stop.set()
+    for c in clients:
+        c.join(args.timeout)
+
+    ms = 1000.0
+    print(f"{'client':>6} {'frames':>7} {'fps':>6} {'int p50':>8} {'int p99':>8} "
+          f"{'xfer p50':>9} {'xfer p99':>9} {'KB/s':>8}")
+    total_frames = total_bytes = 0
+    for c in clients:
+        t = c.elapsed() or 1e-9
+        total_frames += c.frames
+        total_bytes += c.bytes
+        print(f"{c.idx:>6} {c.frames:>7} {c.frames / t:>6.1f} "
+              f"{percentile(c.intervals, 50) * ms:>7.1f}ms {percentile(c.intervals, 99) * ms:>7.1f}ms "
+              f"{percentile(c.transfers, 50) * ms:>8.1f}ms {percentile(c.transfers, 99) * ms:>8.1f}ms "
+              f"{c.bytes / t / 1024:>8.1f}" + (f"  error: {c.error}" if c.error else ""))
+    print(f"total: {total_frames} frames, {total_frames / args.duration:.1f} fps, "
+          f"{total_bytes / args.duration / 1024:.1f} KB/s")
+    if prober:
+        print(f"probe {args.probe}: {len(prober.latencies)} ok, {prober.failures} failed, "
+              f"p50 {percentile(prober.latencies, 50) * ms:.1f}ms, "
+              f"p99 {percentile(prober.latencies, 99) * ms:.1f}ms")
+
+
+if __name__ == "__main__":
+    main()